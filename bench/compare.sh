@@ -0,0 +1,21 @@
+#!/bin/sh
+#
+# Compare two results of bench/run.sh (e.g. for two extension versions),
+# printing the ratios of latency, peak memory and temporary files (new/old)
+# for the scenarios present in both.
+#
+#     bench/compare.sh old.csv new.csv
+
+if [ $# -ne 2 ]; then
+	echo "usage: $0 old.csv new.csv" >&2
+	exit 1
+fi
+
+awk -F, '
+	function ratio(a, b) { return (a > 0) ? sprintf("%.3f", b / a) : "" }
+	FNR == 1 { next }
+	{ key = $2 "," $3 "," $4 "," $5 }
+	NR == FNR { latency[key] = $6; memory[key] = $8; temp[key] = $9; next }
+	!header { print "scenario,aggregate,type,rows,latency_ratio,memory_ratio,temp_ratio"; header = 1 }
+	key in latency { print key "," ratio(latency[key], $6) "," ratio(memory[key], $8) "," ratio(temp[key], $9) }
+' "$1" "$2"
@@ -0,0 +1,14 @@
+-- Microbenchmark of the core kernels (sorting, merging the runs collected
+-- by combine, final summation), for all types, data distributions and a
+-- range of sizes. Prints CSV with the best time of five loops, in ns per
+-- value and millions of values per second. Run by "make bench".
+--
+-- The benchmark function is not part of the extension API, so it's only
+-- defined in a temporary schema (the library needs to be installed).
+
+CREATE FUNCTION pg_temp.trimmed_benchmark(kernel text, type text, distribution text, nvalues int, loops int)
+    RETURNS double precision
+    AS '$libdir/trimmed_aggregates', 'trimmed_benchmark'
+    LANGUAGE C STRICT;
+
+\copy (SELECT k AS kernel, t AS type, d AS distribution, n AS nvalues, round(ns::numeric, 3) AS ns_per_value, round((1000 / ns)::numeric, 3) AS mvalues_per_sec FROM unnest(ARRAY['sort', 'merge', 'final']) k, unnest(ARRAY['double', 'int32', 'int64', 'numeric']) t, unnest(ARRAY['uniform', 'skewed', 'presorted', 'duplicates']) d, unnest(ARRAY[1000, 100000, 1000000]) n, LATERAL pg_temp.trimmed_benchmark(k, t, d, n, 5) ns) TO STDOUT WITH (FORMAT csv, HEADER)
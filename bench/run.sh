@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# Benchmark suite for the trimmed aggregates, running pgbench scenarios for
+# each aggregate, type and data size against a local cluster (selected by
+# the usual libpq environment variables). Prints CSV with the average
+# latency, and the peak memory and temporary files of a single execution.
+#
+#     bench/run.sh [label] > results.csv
+#
+# The label (the installed extension version by default) identifies the
+# results, so that runs with different versions may be compared by
+# bench/compare.sh. The runs are configured by environment variables:
+#
+#     ROWS        data sizes (default "10000 100000 1000000")
+#     SCENARIOS   scenarios in bench/scenarios (default all)
+#     AGGS        aggregates (default "avg var stddev trimmed")
+#     TYPES       value types (default "double int32 int64 numeric")
+#     DURATION    seconds per pgbench run (default 10)
+#
+# The peak memory is the high-water mark of the backend RSS (which includes
+# the touched shared buffers, but not the parallel workers), so it requires
+# Linux and a cluster on the same machine.
+
+set -e
+
+DIR=$(dirname "$0")
+
+ROWS=${ROWS:-"10000 100000 1000000"}
+SCENARIOS=${SCENARIOS:-$(cd "$DIR/scenarios" && ls *.sql | sed 's/\.sql$//')}
+AGGS=${AGGS:-"avg var stddev trimmed"}
+TYPES=${TYPES:-"double int32 int64 numeric"}
+DURATION=${DURATION:-10}
+
+for rows in $ROWS; do
+	psql -X -q -v ON_ERROR_STOP=1 -v rows=$rows -f "$DIR/setup.sql"
+done
+
+LABEL=${1:-$(psql -X -At -c "SELECT extversion FROM pg_extension WHERE extname = 'trimmed_aggregates'")}
+
+# peak memory (kB) and temporary files (kB) of a single execution
+measure() {
+	psql -X -At -v ON_ERROR_STOP=1 <<SQL | awk '/^VmHWM/ { hwm[n++] = $2 } /^temp/ { temp = $2 } END { print hwm[1] - hwm[0] "," temp }'
+SELECT pg_backend_pid() AS pid \gset
+\setenv BENCH_PID :pid
+$2
+\! grep VmHWM /proc/\$BENCH_PID/status
+SELECT 'temp ' || coalesce((plan->0->'Plan'->>'Temp Written Blocks')::bigint, 0) * current_setting('block_size')::bigint / 1024 FROM (SELECT pg_temp.bench_explain(\$q\$$1\$q\$) AS plan) foo;
+\! grep VmHWM /proc/\$BENCH_PID/status
+SQL
+}
+
+echo "label,scenario,aggregate,type,rows,latency_ms,transactions,peak_memory_kb,temp_kb"
+
+for rows in $ROWS; do
+	for scenario in $SCENARIOS; do
+		script="$DIR/scenarios/$scenario.sql"
+
+		for agg in $AGGS; do
+			for type in $TYPES; do
+				subst="s/:agg/$agg/g; s/:col/v_$type/g; s/:table/bench_$rows/g"
+
+				if ! out=$(pgbench -n -c 1 -T "$DURATION" -f "$script" \
+					-D table=bench_$rows -D agg=$agg -D col=v_$type 2>&1); then
+					echo "$out" >&2
+					echo "scenario $scenario failed for $agg($type) on $rows rows" >&2
+					exit 1
+				fi
+
+				latency=$(echo "$out" | awk '/^latency average/ { print $4 }')
+				count=$(echo "$out" | awk '/^number of transactions actually processed/ { print $6 }' | cut -d/ -f1)
+
+				settings=$(grep -v '^--' "$script" | grep '^SET' | sed "$subst")
+				query=$(grep -v '^--' "$script" | grep -v '^SET' | sed "$subst; s/;\$//")
+
+				setup="CREATE FUNCTION pg_temp.bench_explain(q text) RETURNS json AS \$f\$ DECLARE r json; BEGIN EXECUTE 'EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) ' || q INTO r; RETURN r; END \$f\$ LANGUAGE plpgsql;"
+
+				memory=$(measure "$query" "$setup
+$settings")
+
+				echo "$LABEL,$scenario,$agg,$type,$rows,$latency,$count,$memory"
+			done
+		done
+	done
+done
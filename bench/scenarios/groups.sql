@@ -0,0 +1,4 @@
+-- many groups (100 rows each), hashed aggregation
+SET enable_sort = off;
+SET trimmed_aggregates.planner_support = off;
+SELECT count(x) FROM (SELECT g, :agg(:col, 0.1, 0.1) AS x FROM :table GROUP BY g) foo;
@@ -0,0 +1,6 @@
+-- single group, forced parallel plan (partial aggregates combined)
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 4;
+SELECT :agg(:col, 0.1, 0.1) FROM :table;
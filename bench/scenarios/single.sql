@@ -0,0 +1,2 @@
+-- single group (plain aggregate over the whole table)
+SELECT :agg(:col, 0.1, 0.1) FROM :table;
@@ -0,0 +1,2 @@
+-- sliding window frames (100 rows), on the first 10000 rows
+SELECT count(x) FROM (SELECT :agg(:col, 0.1, 0.1) OVER (ORDER BY id ROWS BETWEEN 99 PRECEDING AND CURRENT ROW) AS x FROM :table WHERE id <= 10000) foo;
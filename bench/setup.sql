@@ -0,0 +1,27 @@
+-- Data for the benchmark suite (see bench/run.sh), with :rows rows. The
+-- groups have 100 rows each, and the values are uniformly distributed.
+
+SET client_min_messages = warning;
+
+CREATE EXTENSION IF NOT EXISTS trimmed_aggregates;
+
+SELECT format('bench_%s', :rows) AS table \gset
+
+SELECT to_regclass(:'table') IS NULL AS missing \gset
+
+\if :missing
+CREATE UNLOGGED TABLE :table (
+    id          bigint,
+    g           int,
+    v_double    double precision,
+    v_int32     int,
+    v_int64     bigint,
+    v_numeric   numeric
+);
+
+INSERT INTO :table
+SELECT i, (i - 1) / 100, r * 1000000, (r * 1000000)::int, (r * 1000000000000)::bigint, round((r * 1000000)::numeric, 2)
+  FROM (SELECT i, random() AS r FROM generate_series(1, :rows) s(i)) foo;
+
+VACUUM ANALYZE :table;
+\endif
@@ -23,43 +23,43 @@ CREATE OR REPLACE FUNCTION trimmed_combine_numeric(p_state_1 internal, p_state_2
 CREATE OR REPLACE FUNCTION trimmed_serial_double(p_pointer internal)
     RETURNS bytea
     AS 'trimmed_aggregates', 'trimmed_serial_double'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 CREATE OR REPLACE FUNCTION trimmed_serial_int32(p_pointer internal)
     RETURNS bytea
     AS 'trimmed_aggregates', 'trimmed_serial_int32'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 CREATE OR REPLACE FUNCTION trimmed_serial_int64(p_pointer internal)
     RETURNS bytea
     AS 'trimmed_aggregates', 'trimmed_serial_int64'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 CREATE OR REPLACE FUNCTION trimmed_serial_numeric(p_pointer internal)
     RETURNS bytea
     AS 'trimmed_aggregates', 'trimmed_serial_numeric'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 /* deserialize data */
 CREATE OR REPLACE FUNCTION trimmed_deserial_double(p_value bytea, p_dummy internal)
     RETURNS internal
     AS 'trimmed_aggregates', 'trimmed_deserial_double'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 CREATE OR REPLACE FUNCTION trimmed_deserial_int32(p_value bytea, p_dummy internal)
     RETURNS internal
     AS 'trimmed_aggregates', 'trimmed_deserial_int32'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 CREATE OR REPLACE FUNCTION trimmed_deserial_int64(p_value bytea, p_dummy internal)
     RETURNS internal
     AS 'trimmed_aggregates', 'trimmed_deserial_int64'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 CREATE OR REPLACE FUNCTION trimmed_deserial_numeric(p_value bytea, p_dummy internal)
     RETURNS internal
     AS 'trimmed_aggregates', 'trimmed_deserial_numeric'
-    LANGUAGE C IMMUTABLE;
+    LANGUAGE C IMMUTABLE STRICT;
 
 /* average */
 
@@ -436,3 +436,3886 @@ CREATE AGGREGATE trimmed(numeric, double precision, double precision) (
     DESERIALFUNC = trimmed_deserial_numeric,
     PARALLEL = SAFE
 );
+
+/* multiple cut configurations (evaluated from a single sorted state) */
+CREATE OR REPLACE FUNCTION trimmed_append_double(p_pointer internal, p_element double precision, p_cut_low double precision[], p_cut_up double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int32(p_pointer internal, p_element int, p_cut_low double precision[], p_cut_up double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int64(p_pointer internal, p_element bigint, p_cut_low double precision[], p_cut_up double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_numeric(p_pointer internal, p_element numeric, p_cut_low double precision[], p_cut_up double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_double_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_avg_double_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_int32_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_avg_int32_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_int64_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_avg_int64_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_numeric_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_avg_numeric_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE avg(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_double_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_int32_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_int64_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_numeric_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_var_double_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_double_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_int32_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_int32_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_int64_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_int64_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_numeric_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_var_numeric_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE var(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_double_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_int32_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_int64_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_numeric_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop_double_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_pop_double_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop_int32_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_pop_int32_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop_int64_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_pop_int64_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop_numeric_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_var_pop_numeric_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE var_pop(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_double_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_int32_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_int64_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_numeric_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp_double_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_samp_double_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp_int32_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_samp_int32_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp_int64_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_var_samp_int64_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp_numeric_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_var_samp_numeric_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE var_samp(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_double_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_int32_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_int64_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_numeric_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_double_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_double_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_int32_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_int32_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_int64_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_int64_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_numeric_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_numeric_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE stddev(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_double_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_int32_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_int64_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_numeric_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop_double_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_pop_double_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop_int32_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_pop_int32_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop_int64_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_pop_int64_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop_numeric_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_pop_numeric_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE stddev_pop(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_double_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_int32_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_int64_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_numeric_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp_double_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_samp_double_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp_int32_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_samp_int32_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp_int64_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_samp_int64_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp_numeric_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_stddev_samp_numeric_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE stddev_samp(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_double_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_int32_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_int64_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_numeric_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_double_array_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_double_array_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_int32_array_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_int32_array_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_int64_array_multi(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_int64_array_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_numeric_array_multi(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_numeric_array_multi'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE trimmed(double precision, double precision[], double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_double_array_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(int, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_int32_array_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(bigint, double precision[], double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_int64_array_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(numeric, double precision[], double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_numeric_array_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+/* combined aggregate computing only the requested statistics */
+CREATE OR REPLACE FUNCTION trimmed_append_double(p_pointer internal, p_element double precision, p_cut_low double precision, p_cut_up double precision, p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int32(p_pointer internal, p_element int, p_cut_low double precision, p_cut_up double precision, p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int64(p_pointer internal, p_element bigint, p_cut_low double precision, p_cut_up double precision, p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_numeric(p_pointer internal, p_element numeric, p_cut_low double precision, p_cut_up double precision, p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_double(p_pointer internal, p_element double precision, p_cut_low double precision[], p_cut_up double precision[], p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int32(p_pointer internal, p_element int, p_cut_low double precision[], p_cut_up double precision[], p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int64(p_pointer internal, p_element bigint, p_cut_low double precision[], p_cut_up double precision[], p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_numeric(p_pointer internal, p_element numeric, p_cut_low double precision[], p_cut_up double precision[], p_stats text[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE trimmed(double precision, double precision, double precision, text[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_double_array_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(int, double precision, double precision, text[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_int32_array_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(bigint, double precision, double precision, text[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_int64_array_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(numeric, double precision, double precision, text[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_numeric_array_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(double precision, double precision[], double precision[], text[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_double_array_multi,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(int, double precision[], double precision[], text[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_int32_array_multi,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(bigint, double precision[], double precision[], text[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_int64_array_multi,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(numeric, double precision[], double precision[], text[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_numeric_array_multi,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+/* quantiles of the kept part (sharing the sorted state) */
+CREATE OR REPLACE FUNCTION trimmed_append_double(p_pointer internal, p_element double precision, p_cut_low double precision, p_cut_up double precision, p_quantiles double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int32(p_pointer internal, p_element int, p_cut_low double precision, p_cut_up double precision, p_quantiles double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int64(p_pointer internal, p_element bigint, p_cut_low double precision, p_cut_up double precision, p_quantiles double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_numeric(p_pointer internal, p_element numeric, p_cut_low double precision, p_cut_up double precision, p_quantiles double precision[])
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_quantiles_double(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_quantiles_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_quantiles_int32(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_quantiles_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_quantiles_int64(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_quantiles_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_quantiles_numeric(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_quantiles_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantiles(double precision, double precision, double precision, double precision[]) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_quantiles_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantiles(int, double precision, double precision, double precision[]) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_quantiles_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantiles(bigint, double precision, double precision, double precision[]) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_quantiles_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantiles(numeric, double precision, double precision, double precision[]) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_quantiles_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+/* weighted aggregates (for pre-aggregated data with counts) */
+CREATE OR REPLACE FUNCTION trimmed_append_weighted_double(p_pointer internal, p_element double precision, p_weight bigint, p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_weighted_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_weighted_int32(p_pointer internal, p_element int, p_weight bigint, p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_weighted_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_weighted_int64(p_pointer internal, p_element bigint, p_weight bigint, p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_weighted_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_serial_weighted_double(p_pointer internal)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_serial_weighted_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_serial_weighted_int32(p_pointer internal)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_serial_weighted_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_serial_weighted_int64(p_pointer internal)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_serial_weighted_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_deserial_weighted_double(p_value bytea, p_dummy internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_deserial_weighted_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_deserial_weighted_int32(p_value bytea, p_dummy internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_deserial_weighted_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_deserial_weighted_int64(p_value bytea, p_dummy internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_deserial_weighted_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_combine_weighted_double(p_state_1 internal, p_state_2 internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_combine_weighted_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_combine_weighted_int32(p_state_1 internal, p_state_2 internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_combine_weighted_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_combine_weighted_int64(p_state_1 internal, p_state_2 internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_combine_weighted_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_avg_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_avg_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_avg_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_avg_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_avg_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_avg_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_pop_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_pop_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_pop_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_pop_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_pop_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_pop_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_samp_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_samp_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_samp_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_samp_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_var_samp_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_var_samp_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_pop_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_pop_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_pop_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_pop_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_pop_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_pop_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_samp_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_samp_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_samp_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_samp_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_stddev_samp_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_weighted_stddev_samp_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_double_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_weighted_double_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_int32_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_weighted_int32_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_weighted_int64_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_weighted_int64_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE avg(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_avg_double,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_avg_int32,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_avg_int64,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_double,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_int32,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_int64,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_pop_double,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_pop_int32,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_pop_int64,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_samp_double,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_samp_int32,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_var_samp_int64,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_double,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_int32,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_int64,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_pop_double,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_pop_int32,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_pop_int64,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_samp_double,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_samp_int32,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_stddev_samp_int64,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(double precision, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_double_array,
+    COMBINEFUNC = trimmed_combine_weighted_double,
+    SERIALFUNC = trimmed_serial_weighted_double,
+    DESERIALFUNC = trimmed_deserial_weighted_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(int, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_int32_array,
+    COMBINEFUNC = trimmed_combine_weighted_int32,
+    SERIALFUNC = trimmed_serial_weighted_int32,
+    DESERIALFUNC = trimmed_deserial_weighted_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(bigint, bigint, double precision, double precision) (
+    SFUNC = trimmed_append_weighted_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_weighted_int64_array,
+    COMBINEFUNC = trimmed_combine_weighted_int64,
+    SERIALFUNC = trimmed_serial_weighted_int64,
+    DESERIALFUNC = trimmed_deserial_weighted_int64,
+    PARALLEL = SAFE
+);
+
+/* array input (appending all elements of the array at once) */
+CREATE OR REPLACE FUNCTION trimmed_append_array_double(p_pointer internal, p_elements double precision[], p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_array_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_array_int32(p_pointer internal, p_elements int[], p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_array_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_array_int64(p_pointer internal, p_elements bigint[], p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_array_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_array_numeric(p_pointer internal, p_elements numeric[], p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_array_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE avg(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(double precision[], double precision, double precision) (
+    SFUNC = trimmed_append_array_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_double_array,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(int[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_int32_array,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(bigint[], double precision, double precision) (
+    SFUNC = trimmed_append_array_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_int64_array,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(numeric[], double precision, double precision) (
+    SFUNC = trimmed_append_array_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_numeric_array,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+/* persistent state (stored sorted data, merged for incremental rollups) */
+CREATE TYPE trimmed_state_double;
+
+CREATE OR REPLACE FUNCTION trimmed_state_double_in(p_value cstring)
+    RETURNS trimmed_state_double
+    AS 'trimmed_aggregates', 'trimmed_state_double_in'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_double_out(p_state trimmed_state_double)
+    RETURNS cstring
+    AS 'trimmed_aggregates', 'trimmed_state_double_out'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_double_recv(p_buffer internal)
+    RETURNS trimmed_state_double
+    AS 'trimmed_aggregates', 'trimmed_state_double_recv'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_double_send(p_state trimmed_state_double)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_state_double_send'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE trimmed_state_double (
+    INPUT = trimmed_state_double_in,
+    OUTPUT = trimmed_state_double_out,
+    RECEIVE = trimmed_state_double_recv,
+    SEND = trimmed_state_double_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE TYPE trimmed_state_int32;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int32_in(p_value cstring)
+    RETURNS trimmed_state_int32
+    AS 'trimmed_aggregates', 'trimmed_state_int32_in'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int32_out(p_state trimmed_state_int32)
+    RETURNS cstring
+    AS 'trimmed_aggregates', 'trimmed_state_int32_out'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int32_recv(p_buffer internal)
+    RETURNS trimmed_state_int32
+    AS 'trimmed_aggregates', 'trimmed_state_int32_recv'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int32_send(p_state trimmed_state_int32)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_state_int32_send'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE trimmed_state_int32 (
+    INPUT = trimmed_state_int32_in,
+    OUTPUT = trimmed_state_int32_out,
+    RECEIVE = trimmed_state_int32_recv,
+    SEND = trimmed_state_int32_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE TYPE trimmed_state_int64;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int64_in(p_value cstring)
+    RETURNS trimmed_state_int64
+    AS 'trimmed_aggregates', 'trimmed_state_int64_in'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int64_out(p_state trimmed_state_int64)
+    RETURNS cstring
+    AS 'trimmed_aggregates', 'trimmed_state_int64_out'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int64_recv(p_buffer internal)
+    RETURNS trimmed_state_int64
+    AS 'trimmed_aggregates', 'trimmed_state_int64_recv'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_int64_send(p_state trimmed_state_int64)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_state_int64_send'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE trimmed_state_int64 (
+    INPUT = trimmed_state_int64_in,
+    OUTPUT = trimmed_state_int64_out,
+    RECEIVE = trimmed_state_int64_recv,
+    SEND = trimmed_state_int64_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE TYPE trimmed_state_numeric;
+
+CREATE OR REPLACE FUNCTION trimmed_state_numeric_in(p_value cstring)
+    RETURNS trimmed_state_numeric
+    AS 'trimmed_aggregates', 'trimmed_state_numeric_in'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_numeric_out(p_state trimmed_state_numeric)
+    RETURNS cstring
+    AS 'trimmed_aggregates', 'trimmed_state_numeric_out'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_numeric_recv(p_buffer internal)
+    RETURNS trimmed_state_numeric
+    AS 'trimmed_aggregates', 'trimmed_state_numeric_recv'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_state_numeric_send(p_state trimmed_state_numeric)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_state_numeric_send'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE trimmed_state_numeric (
+    INPUT = trimmed_state_numeric_in,
+    OUTPUT = trimmed_state_numeric_out,
+    RECEIVE = trimmed_state_numeric_recv,
+    SEND = trimmed_state_numeric_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION trimmed_state_final_double(p_pointer internal)
+    RETURNS trimmed_state_double
+    AS 'trimmed_aggregates', 'trimmed_state_final_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_merge_double(p_pointer internal, p_state trimmed_state_double)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_merge_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_state_final_int32(p_pointer internal)
+    RETURNS trimmed_state_int32
+    AS 'trimmed_aggregates', 'trimmed_state_final_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_merge_int32(p_pointer internal, p_state trimmed_state_int32)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_merge_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_state_final_int64(p_pointer internal)
+    RETURNS trimmed_state_int64
+    AS 'trimmed_aggregates', 'trimmed_state_final_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_merge_int64(p_pointer internal, p_state trimmed_state_int64)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_merge_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_state_final_numeric(p_pointer internal)
+    RETURNS trimmed_state_numeric
+    AS 'trimmed_aggregates', 'trimmed_state_final_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_merge_numeric(p_pointer internal, p_state trimmed_state_numeric)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_merge_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE trimmed_state(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_state(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_state(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_state(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_merge(trimmed_state_double) (
+    SFUNC = trimmed_merge_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_merge(trimmed_state_int32) (
+    SFUNC = trimmed_merge_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_merge(trimmed_state_int64) (
+    SFUNC = trimmed_merge_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_merge(trimmed_state_numeric) (
+    SFUNC = trimmed_merge_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_state_final_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_double)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_avg_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_avg_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_int32)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_avg_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_avg_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_int64)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_avg_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_avg_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_numeric)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_avg_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_avg_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_double)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_int32)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_int64)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_numeric)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_var_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_var_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_double)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_int32)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_int64)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_numeric)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_var_pop_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_double)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_int32)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_int64)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_numeric)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_var_samp_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_double)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_int32)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_int64)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_numeric)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_double)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_int32)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_int64)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_numeric)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_pop_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_double)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_double'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_int32)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_int32'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_int64)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_int64'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_numeric)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'trimmed_state_stddev_samp_numeric'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_double)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_state_double_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_double, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_state_double_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_int32)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_state_int32_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_int32, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_state_int32_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_int64)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_state_int64_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_int64, p_cut_low double precision, p_cut_up double precision)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_state_int64_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_numeric)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_state_numeric_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_stats(p_state trimmed_state_numeric, p_cut_low double precision, p_cut_up double precision)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_state_numeric_array'
+    LANGUAGE C IMMUTABLE STRICT;
+
+/* shared cache of sorted states (requires shared_preload_libraries) */
+CREATE OR REPLACE FUNCTION trimmed_cached_state_double(p_relation regclass, p_column name, p_filter text, p_cut_low double precision, p_cut_up double precision)
+    RETURNS trimmed_state_double
+    AS 'trimmed_aggregates', 'trimmed_cached_state_double'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION trimmed_cached_state_int32(p_relation regclass, p_column name, p_filter text, p_cut_low double precision, p_cut_up double precision)
+    RETURNS trimmed_state_int32
+    AS 'trimmed_aggregates', 'trimmed_cached_state_int32'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION trimmed_cached_state_int64(p_relation regclass, p_column name, p_filter text, p_cut_low double precision, p_cut_up double precision)
+    RETURNS trimmed_state_int64
+    AS 'trimmed_aggregates', 'trimmed_cached_state_int64'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION trimmed_cached_state_numeric(p_relation regclass, p_column name, p_filter text, p_cut_low double precision, p_cut_up double precision)
+    RETURNS trimmed_state_numeric
+    AS 'trimmed_aggregates', 'trimmed_cached_state_numeric'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION trimmed_cache_invalidate()
+    RETURNS trigger
+    AS 'trimmed_aggregates', 'trimmed_cache_invalidate'
+    LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION trimmed_cache_reset()
+    RETURNS void
+    AS 'trimmed_aggregates', 'trimmed_cache_reset'
+    LANGUAGE C VOLATILE;
+
+REVOKE ALL ON FUNCTION trimmed_cache_reset() FROM PUBLIC;
+
+/* registered statistics, maintained by the background worker */
+CREATE TABLE trimmed_registry (
+    id              serial PRIMARY KEY,
+    relation        regclass NOT NULL,
+    value_column    name NOT NULL,
+    position_column name NOT NULL,
+    group_column    name,
+    cut_low         double precision NOT NULL,
+    cut_up          double precision NOT NULL,
+    state_type      text NOT NULL CHECK (state_type IN ('double', 'int32', 'int64', 'numeric')),
+    last_position   text,
+    last_refresh    timestamptz
+);
+
+CREATE TABLE trimmed_results (
+    registry_id     int NOT NULL REFERENCES trimmed_registry (id) ON DELETE CASCADE,
+    group_key       text NOT NULL,
+    stats           double precision[],
+    state_double    trimmed_state_double,
+    state_int32     trimmed_state_int32,
+    state_int64     trimmed_state_int64,
+    state_numeric   trimmed_state_numeric,
+    updated_at      timestamptz NOT NULL,
+    PRIMARY KEY (registry_id, group_key)
+);
+
+-- the registrations should be dumped
+SELECT pg_catalog.pg_extension_config_dump('trimmed_registry', '');
+SELECT pg_catalog.pg_extension_config_dump('trimmed_registry_id_seq', '');
+SELECT pg_catalog.pg_extension_config_dump('trimmed_results', '');
+
+CREATE OR REPLACE FUNCTION trimmed_register(p_relation regclass, p_value_column name, p_position_column name, p_group_column name, p_cut_low double precision, p_cut_up double precision)
+    RETURNS int AS $$
+DECLARE
+    v_type  text;
+    v_id    int;
+BEGIN
+    IF (SELECT relkind FROM pg_class WHERE oid = p_relation) NOT IN ('r', 'p', 'm') THEN
+        RAISE EXCEPTION 'relation "%" is not a table or materialized view', p_relation;
+    END IF;
+
+    SELECT CASE atttypid
+               WHEN 'double precision'::regtype THEN 'double'
+               WHEN 'real'::regtype THEN 'double'
+               WHEN 'smallint'::regtype THEN 'int32'
+               WHEN 'int'::regtype THEN 'int32'
+               WHEN 'bigint'::regtype THEN 'int64'
+               WHEN 'numeric'::regtype THEN 'numeric'
+           END INTO v_type
+      FROM pg_attribute
+     WHERE attrelid = p_relation AND attname = p_value_column AND NOT attisdropped;
+
+    IF v_type IS NULL THEN
+        RAISE EXCEPTION 'column "%" of relation "%" does not exist or has unsupported type', p_value_column, p_relation;
+    END IF;
+
+    IF NOT EXISTS (SELECT 1 FROM pg_attribute WHERE attrelid = p_relation AND attname = p_position_column AND NOT attisdropped) THEN
+        RAISE EXCEPTION 'column "%" of relation "%" does not exist', p_position_column, p_relation;
+    END IF;
+
+    IF p_group_column IS NOT NULL AND NOT EXISTS (SELECT 1 FROM pg_attribute WHERE attrelid = p_relation AND attname = p_group_column AND NOT attisdropped) THEN
+        RAISE EXCEPTION 'column "%" of relation "%" does not exist', p_group_column, p_relation;
+    END IF;
+
+    -- validate the cuts
+    PERFORM trimmed_state(1, p_cut_low, p_cut_up);
+
+    INSERT INTO trimmed_registry (relation, value_column, position_column, group_column, cut_low, cut_up, state_type)
+    VALUES (p_relation, p_value_column, p_position_column, p_group_column, p_cut_low, p_cut_up, v_type)
+    RETURNING id INTO v_id;
+
+    RETURN v_id;
+END;
+$$ LANGUAGE plpgsql
+   SET search_path = pg_catalog, @extschema@, pg_temp;
+
+-- process rows added since the last refresh (in batches of at most p_batch_rows
+-- rows), merge them into the stored states and recompute the statistics
+--
+-- Only rows with a position above the last processed one are read, so the
+-- positions have to increase in commit order. A row committed after a refresh
+-- with a position <= last_position (e.g. a sequence value assigned by a
+-- transaction that committed late) is never processed.
+--
+-- Updates and deletes of rows that were already processed are not reflected
+-- in the stored states (the states can't remove values). To rebuild a
+-- registration, delete its results and set last_position to NULL.
+--
+-- The search_path is pinned, because the function runs in the background
+-- worker, and the statements are built from the names in the registry.
+--
+-- Rows with a NULL group value are skipped (and not processed later either).
+-- The group key is the text of the group value, so there's no key left for
+-- NULL that could not collide with a real group (the single group of an
+-- ungrouped registration uses an empty string).
+CREATE OR REPLACE FUNCTION trimmed_refresh(p_batch_rows bigint DEFAULT 1000000)
+    RETURNS bigint AS $$
+DECLARE
+    v_reg       trimmed_registry;
+    v_postype   text;
+    v_sqltype   text;
+    v_last      text;
+    v_groups    bigint;
+    v_total     bigint := 0;
+BEGIN
+    -- registrations refreshed by a concurrent call are skipped
+    FOR v_reg IN SELECT * FROM trimmed_registry ORDER BY id FOR UPDATE SKIP LOCKED LOOP
+        -- a broken registration (e.g. renamed column) should not block the others
+        BEGIN
+            SELECT format_type(atttypid, atttypmod) INTO v_postype
+              FROM pg_attribute
+             WHERE attrelid = v_reg.relation AND attname = v_reg.position_column AND NOT attisdropped;
+
+            v_sqltype := CASE v_reg.state_type
+                             WHEN 'double' THEN 'double precision'
+                             WHEN 'int32' THEN 'int'
+                             WHEN 'int64' THEN 'bigint'
+                             ELSE 'numeric'
+                         END;
+
+            LOOP
+                -- upper boundary of the next batch of new rows
+                EXECUTE format('SELECT max(p)::text FROM (SELECT %1$I AS p FROM %2$s WHERE $1 IS NULL OR %1$I > $1::%3$s ORDER BY %1$I LIMIT $2) s',
+                               v_reg.position_column, v_reg.relation, v_postype)
+                   INTO v_last USING v_reg.last_position, p_batch_rows;
+
+                EXIT WHEN v_last IS NULL;
+
+                EXECUTE format('INSERT INTO trimmed_results AS r (registry_id, group_key, state_%1$s, updated_at)
+                                SELECT $1, %2$s, trimmed_state(%3$I::%4$s, $2, $3), now()
+                                  FROM %5$s
+                                 WHERE ($4 IS NULL OR %6$I > $4::%7$s) AND %6$I <= $5::%7$s AND %8$s
+                                 GROUP BY 2
+                                ON CONFLICT (registry_id, group_key) DO UPDATE
+                                   SET state_%1$s = (SELECT trimmed_merge(s) FROM (VALUES (r.state_%1$s), (excluded.state_%1$s)) v(s)),
+                                       stats = NULL,
+                                       updated_at = excluded.updated_at',
+                               v_reg.state_type,
+                               CASE WHEN v_reg.group_column IS NULL THEN '''''' ELSE format('%I::text', v_reg.group_column) END,
+                               v_reg.value_column, v_sqltype, v_reg.relation,
+                               v_reg.position_column, v_postype,
+                               -- rows with a NULL group are skipped (see above)
+                               CASE WHEN v_reg.group_column IS NULL THEN 'true' ELSE format('%I IS NOT NULL', v_reg.group_column) END)
+                   USING v_reg.id, v_reg.cut_low, v_reg.cut_up, v_reg.last_position, v_last;
+
+                GET DIAGNOSTICS v_groups = ROW_COUNT;
+                v_total := v_total + v_groups;
+
+                v_reg.last_position := v_last;
+                UPDATE trimmed_registry SET last_position = v_last WHERE id = v_reg.id;
+            END LOOP;
+
+            EXECUTE format('UPDATE trimmed_results SET stats = trimmed_stats(state_%s)::double precision[] WHERE registry_id = $1 AND stats IS NULL',
+                           v_reg.state_type)
+               USING v_reg.id;
+
+            UPDATE trimmed_registry SET last_refresh = now() WHERE id = v_reg.id;
+        EXCEPTION WHEN others THEN
+            RAISE WARNING 'refresh of registration % failed: %', v_reg.id, SQLERRM;
+        END;
+    END LOOP;
+
+    RETURN v_total;
+END;
+$$ LANGUAGE plpgsql
+   SET search_path = pg_catalog, @extschema@, pg_temp;
+
+CREATE OR REPLACE FUNCTION trimmed_worker_start()
+    RETURNS int
+    AS 'trimmed_aggregates', 'trimmed_worker_start'
+    LANGUAGE C VOLATILE;
+
+REVOKE ALL ON FUNCTION trimmed_worker_start() FROM PUBLIC;
+
+/* runtime counters (of the current backend, and of all backends when preloaded) */
+CREATE OR REPLACE FUNCTION trimmed_counters(OUT scope text, OUT appended bigint,
+                                            OUT allocated bigint, OUT peak_state bigint,
+                                            OUT sorts bigint, OUT sort_time double precision,
+                                            OUT merges bigint, OUT merge_time double precision,
+                                            OUT combines bigint, OUT serialized bigint,
+                                            OUT deserialized bigint)
+    RETURNS SETOF record
+    AS 'trimmed_aggregates', 'trimmed_counters'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE VIEW trimmed_counters AS SELECT * FROM trimmed_counters();
+
+CREATE OR REPLACE FUNCTION trimmed_counters_reset()
+    RETURNS void
+    AS 'trimmed_aggregates', 'trimmed_counters_reset'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION trimmed_counters_reset_shared()
+    RETURNS void
+    AS 'trimmed_aggregates', 'trimmed_counters_reset_shared'
+    LANGUAGE C VOLATILE;
+
+REVOKE ALL ON FUNCTION trimmed_counters_reset_shared() FROM PUBLIC;
+
+/* progress of long sorts/merges in all backends (when preloaded) */
+CREATE OR REPLACE FUNCTION trimmed_progress(OUT pid int, OUT phase text,
+                                            OUT processed bigint, OUT total bigint)
+    RETURNS SETOF record
+    AS 'trimmed_aggregates', 'trimmed_progress'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE VIEW trimmed_progress AS SELECT * FROM trimmed_progress();
+
+/* real and smallint values (stored in their native width) */
+CREATE OR REPLACE FUNCTION trimmed_append_float4(p_pointer internal, p_element real, p_cut_low double precision default 0, p_cut_up double precision default 0)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_combine_float4(p_state_1 internal, p_state_2 internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_combine_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_serial_float4(p_pointer internal)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_serial_float4'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_deserial_float4(p_value bytea, p_dummy internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_deserial_float4'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_avg_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_var_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_var_pop_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_var_samp_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_stddev_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_stddev_pop_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_stddev_samp_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_float4_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_float4_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int16(p_pointer internal, p_element smallint, p_cut_low double precision default 0, p_cut_up double precision default 0)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_combine_int16(p_state_1 internal, p_state_2 internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_combine_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_serial_int16(p_pointer internal)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_serial_int16'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_deserial_int16(p_value bytea, p_dummy internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_deserial_int16'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_avg_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_var_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_pop_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_var_pop_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_var_samp_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_var_samp_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_stddev_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_pop_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_stddev_pop_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_stddev_samp_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_stddev_samp_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_int16_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_int16_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE avg(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_float4_array,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_pop_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_var_samp_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_pop_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_stddev_samp_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_int16_array,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+/* timestamp, timestamptz and interval averages (as int64 microseconds) */
+CREATE OR REPLACE FUNCTION trimmed_append_timestamp(p_pointer internal, p_element timestamp, p_cut_low double precision default 0, p_cut_up double precision default 0)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_timestamptz(p_pointer internal, p_element timestamptz, p_cut_low double precision default 0, p_cut_up double precision default 0)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_interval(p_pointer internal, p_element interval, p_cut_low double precision default 0, p_cut_up double precision default 0)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_interval'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_timestamp(p_pointer internal)
+    RETURNS timestamp
+    AS 'trimmed_aggregates', 'trimmed_avg_timestamp'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_timestamptz(p_pointer internal)
+    RETURNS timestamptz
+    AS 'trimmed_aggregates', 'trimmed_avg_timestamp'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_avg_interval(p_pointer internal)
+    RETURNS interval
+    AS 'trimmed_aggregates', 'trimmed_avg_interval'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE avg(timestamp, double precision, double precision) (
+    SFUNC = trimmed_append_timestamp,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_timestamp,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(timestamptz, double precision, double precision) (
+    SFUNC = trimmed_append_timestamptz,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_timestamptz,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg(interval, double precision, double precision) (
+    SFUNC = trimmed_append_interval,
+    STYPE = internal,
+    FINALFUNC = trimmed_avg_interval,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+/* trimming by one column (key), statistics of the other columns (payloads) */
+
+CREATE OR REPLACE FUNCTION trimmed_append_keyed(p_pointer internal, p_value double precision, p_key double precision, p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_keyed'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_keyed_array(p_pointer internal, p_values double precision[], p_key double precision, p_cut_low double precision, p_cut_up double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_keyed_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_serial_keyed(p_pointer internal)
+    RETURNS bytea
+    AS 'trimmed_aggregates', 'trimmed_serial_keyed'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_deserial_keyed(p_value bytea, p_dummy internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_deserial_keyed'
+    LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION trimmed_combine_keyed(p_state_1 internal, p_state_2 internal)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_combine_keyed'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_sum(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_sum'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_avg(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_avg'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_var(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_var'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_var_pop(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_var_pop'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_var_samp(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_var_samp'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_stddev(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_stddev'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_stddev_pop(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_stddev_pop'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_stddev_samp(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'trimmed_keyed_stddev_samp'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_sum_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_sum'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_avg_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_avg'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_var_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_var'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_var_pop_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_var_pop'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_var_samp_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_var_samp'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_stddev_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_stddev'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_stddev_pop_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_stddev_pop'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_stddev_samp_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_stddev_samp'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_keyed_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_keyed_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE sum_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_sum,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_avg,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_var,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_var_pop,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_var_samp,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_stddev,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_stddev_pop,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_stddev_samp,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_by(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE sum_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_sum_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_avg_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_var_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_var_pop_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_var_samp_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_stddev_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_stddev_pop_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_by(double precision[], double precision, double precision, double precision) (
+    SFUNC = trimmed_append_keyed_array,
+    STYPE = internal,
+    FINALFUNC = trimmed_keyed_stddev_samp_array,
+    COMBINEFUNC = trimmed_combine_keyed,
+    SERIALFUNC = trimmed_serial_keyed,
+    DESERIALFUNC = trimmed_deserial_keyed,
+    PARALLEL = SAFE
+);
+
+/* winsorized statistics (computed from the same state as the trimmed ones) */
+CREATE OR REPLACE FUNCTION winsorized_avg_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_avg_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_pop_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_pop_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_samp_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_samp_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_pop_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_pop_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_samp_double(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_samp_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_double_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'winsorized_double_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_avg_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_avg_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_pop_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_pop_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_samp_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_samp_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_pop_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_pop_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_samp_int32(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_samp_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_int32_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'winsorized_int32_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_avg_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_avg_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_pop_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_pop_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_samp_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_samp_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_pop_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_pop_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_samp_int64(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_samp_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_int64_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'winsorized_int64_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_avg_numeric(p_pointer internal)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'winsorized_avg_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_numeric(p_pointer internal)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'winsorized_var_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_pop_numeric(p_pointer internal)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'winsorized_var_pop_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_samp_numeric(p_pointer internal)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'winsorized_var_samp_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_numeric(p_pointer internal)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'winsorized_stddev_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_pop_numeric(p_pointer internal)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'winsorized_stddev_pop_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_samp_numeric(p_pointer internal)
+    RETURNS numeric
+    AS 'trimmed_aggregates', 'winsorized_stddev_samp_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_numeric_array(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'winsorized_numeric_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_avg_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_avg_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_pop_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_pop_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_samp_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_samp_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_pop_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_pop_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_samp_float4(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_samp_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_float4_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'winsorized_float4_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_avg_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_avg_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_pop_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_pop_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_var_samp_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_var_samp_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_pop_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_pop_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_stddev_samp_int16(p_pointer internal)
+    RETURNS double precision
+    AS 'trimmed_aggregates', 'winsorized_stddev_samp_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION winsorized_int16_array(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'winsorized_int16_array'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE avg_winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_avg_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_pop_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_samp_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_pop_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_samp_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE winsorized(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = winsorized_double_array,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg_winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_avg_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_pop_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_samp_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_pop_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_samp_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE winsorized(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = winsorized_int32_array,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg_winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_avg_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_pop_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_samp_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_pop_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_samp_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE winsorized(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = winsorized_int64_array,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg_winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_avg_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_pop_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_samp_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_pop_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_samp_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE winsorized(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = winsorized_numeric_array,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg_winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_avg_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_pop_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_samp_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_pop_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_samp_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE winsorized(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = winsorized_float4_array,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE avg_winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_avg_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_pop_winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_pop_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE var_samp_winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_var_samp_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_pop_winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_pop_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE stddev_samp_winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_stddev_samp_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE winsorized(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = winsorized_int16_array,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+/* the kept part of the sorted values (as an array) */
+CREATE OR REPLACE FUNCTION trimmed_values_double(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_values_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_values_int32(p_pointer internal)
+    RETURNS int[]
+    AS 'trimmed_aggregates', 'trimmed_values_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_values_int64(p_pointer internal)
+    RETURNS bigint[]
+    AS 'trimmed_aggregates', 'trimmed_values_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_values_numeric(p_pointer internal)
+    RETURNS numeric[]
+    AS 'trimmed_aggregates', 'trimmed_values_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_values_float4(p_pointer internal)
+    RETURNS real[]
+    AS 'trimmed_aggregates', 'trimmed_values_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_values_int16(p_pointer internal)
+    RETURNS smallint[]
+    AS 'trimmed_aggregates', 'trimmed_values_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE trimmed_values(double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_values_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_values(int, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_values_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_values(bigint, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_values_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_values(numeric, double precision, double precision) (
+    SFUNC = trimmed_append_numeric,
+    STYPE = internal,
+    FINALFUNC = trimmed_values_numeric,
+    COMBINEFUNC = trimmed_combine_numeric,
+    SERIALFUNC = trimmed_serial_numeric,
+    DESERIALFUNC = trimmed_deserial_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_values(real, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_values_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_values(smallint, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_values_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+/* confidence intervals of the trimmed mean (Yuen's or bootstrap) */
+CREATE OR REPLACE FUNCTION trimmed_append_double(p_pointer internal, p_element double precision, p_cut_low double precision, p_cut_up double precision, p_confidence double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_double(p_pointer internal, p_element double precision, p_cut_low double precision, p_cut_up double precision, p_confidence double precision, p_resamples int)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_ci_double(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_ci_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int32(p_pointer internal, p_element int, p_cut_low double precision, p_cut_up double precision, p_confidence double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int32(p_pointer internal, p_element int, p_cut_low double precision, p_cut_up double precision, p_confidence double precision, p_resamples int)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_ci_int32(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_ci_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int64(p_pointer internal, p_element bigint, p_cut_low double precision, p_cut_up double precision, p_confidence double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int64(p_pointer internal, p_element bigint, p_cut_low double precision, p_cut_up double precision, p_confidence double precision, p_resamples int)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_ci_int64(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_ci_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_float4(p_pointer internal, p_element real, p_cut_low double precision, p_cut_up double precision, p_confidence double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_float4(p_pointer internal, p_element real, p_cut_low double precision, p_cut_up double precision, p_confidence double precision, p_resamples int)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_ci_float4(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_ci_float4'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int16(p_pointer internal, p_element smallint, p_cut_low double precision, p_cut_up double precision, p_confidence double precision)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_append_int16(p_pointer internal, p_element smallint, p_cut_low double precision, p_cut_up double precision, p_confidence double precision, p_resamples int)
+    RETURNS internal
+    AS 'trimmed_aggregates', 'trimmed_append_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION trimmed_ci_int16(p_pointer internal)
+    RETURNS double precision[]
+    AS 'trimmed_aggregates', 'trimmed_ci_int16'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE trimmed_ci(double precision, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(double precision, double precision, double precision, double precision, int) (
+    SFUNC = trimmed_append_double,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_double,
+    COMBINEFUNC = trimmed_combine_double,
+    SERIALFUNC = trimmed_serial_double,
+    DESERIALFUNC = trimmed_deserial_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(int, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(int, double precision, double precision, double precision, int) (
+    SFUNC = trimmed_append_int32,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_int32,
+    COMBINEFUNC = trimmed_combine_int32,
+    SERIALFUNC = trimmed_serial_int32,
+    DESERIALFUNC = trimmed_deserial_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(bigint, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(bigint, double precision, double precision, double precision, int) (
+    SFUNC = trimmed_append_int64,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_int64,
+    COMBINEFUNC = trimmed_combine_int64,
+    SERIALFUNC = trimmed_serial_int64,
+    DESERIALFUNC = trimmed_deserial_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(real, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(real, double precision, double precision, double precision, int) (
+    SFUNC = trimmed_append_float4,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_float4,
+    COMBINEFUNC = trimmed_combine_float4,
+    SERIALFUNC = trimmed_serial_float4,
+    DESERIALFUNC = trimmed_deserial_float4,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(smallint, double precision, double precision, double precision) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE trimmed_ci(smallint, double precision, double precision, double precision, int) (
+    SFUNC = trimmed_append_int16,
+    STYPE = internal,
+    FINALFUNC = trimmed_ci_int16,
+    COMBINEFUNC = trimmed_combine_int16,
+    SERIALFUNC = trimmed_serial_int16,
+    DESERIALFUNC = trimmed_deserial_int16,
+    PARALLEL = SAFE
+);
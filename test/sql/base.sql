@@ -3,7 +3,7 @@ BEGIN;
 
 -- disable the notices for the create script (shell types etc.)
 SET client_min_messages = 'WARNING';
-\i sql/trimmed_aggregates--2.0.0-dev.sql
+CREATE EXTENSION trimmed_aggregates;
 SET client_min_messages = 'NOTICE';
 
 \set ECHO all
@@ -50,4 +50,440 @@ SELECT round(stddev(x::numeric, 0.1, 0.1),3) FROM generate_series(1,1000) s(x);
 SELECT round(stddev_pop(x::numeric, 0.1, 0.1),3) FROM generate_series(1,1000) s(x);
 SELECT round(stddev_samp(x::numeric, 0.1, 0.1),3) FROM generate_series(1,1000) s(x);
 
+-- multiple cut configurations
+SELECT round(unnest(avg(x, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(var(x, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(var_pop(x, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(var_samp(x, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(stddev(x, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(stddev_pop(x, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(stddev_samp(x, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+
+SELECT round(unnest(avg(x::bigint, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(avg(x::double precision, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(avg(x::numeric, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(stddev(x::numeric, ARRAY[0, 0.1, 0.2], ARRAY[0, 0.1, 0.3])),3) FROM generate_series(1,1000) s(x);
+
+SELECT array_dims(trimmed(x, ARRAY[0, 0.1], ARRAY[0, 0.1])) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(trimmed(x::double precision, ARRAY[0, 0.1], ARRAY[0, 0.1])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(trimmed(x::numeric, ARRAY[0, 0.1], ARRAY[0, 0.1])),3) FROM generate_series(1,1000) s(x);
+
+-- a single kept value (var_samp and stddev_samp are zero)
+SELECT trimmed(x::numeric, 0, 0) FROM generate_series(1,1) s(x);
+
+-- parallel aggregation (serialization of the cut configurations)
+CREATE TABLE trimmed_data AS SELECT i AS x, i::numeric AS n FROM generate_series(1,100000) s(i);
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT round(unnest(avg(x, ARRAY[0.1, 0.2], ARRAY[0.1, 0])),3) FROM trimmed_data;
+SELECT round(unnest(stddev(n, ARRAY[0.1, 0.2], ARRAY[0.1, 0])),3) FROM trimmed_data;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+-- combined aggregate with a list of requested statistics
+SELECT round(unnest(trimmed(x, 0.1, 0.1, ARRAY['stddev', 'avg'])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(trimmed(x::bigint, 0.1, 0.1, ARRAY['var_samp'])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(trimmed(x::double precision, 0.1, 0.1, ARRAY['avg', 'var_pop', 'stddev_pop'])),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(trimmed(x::numeric, 0.1, 0.1, ARRAY['avg', 'var_samp', 'stddev_samp'])),3) FROM generate_series(1,1000) s(x);
+SELECT array_dims(trimmed(x, ARRAY[0, 0.1], ARRAY[0, 0.1], ARRAY['avg', 'var'])) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(trimmed(x::numeric, ARRAY[0, 0.1], ARRAY[0, 0.1], ARRAY['avg', 'var'])),3) FROM generate_series(1,1000) s(x);
+
+-- numeric statistics have the same scale, however they are requested (the values cut off have more digits)
+SELECT avg(v, 0.1, 0.2)::text = (avg(v, ARRAY[0.1], ARRAY[0.2]))[1]::text AS avg, var(v, 0.1, 0.2)::text = (var(v, ARRAY[0.1], ARRAY[0.2]))[1]::text AS var, var_pop(v, 0.1, 0.2)::text = (var_pop(v, ARRAY[0.1], ARRAY[0.2]))[1]::text AS var_pop, stddev_samp(v, 0.1, 0.2)::text = (stddev_samp(v, ARRAY[0.1], ARRAY[0.2]))[1]::text AS stddev_samp FROM (SELECT (CASE WHEN x <= 100 THEN x / 7.0 ELSE x END)::numeric AS v FROM generate_series(1,1000) s(x)) foo;
+SELECT trimmed(v, 0.1, 0.2)::text = ARRAY[avg(v, 0.1, 0.2), var_pop(v, 0.1, 0.2), var_samp(v, 0.1, 0.2), var(v, 0.1, 0.2), stddev_pop(v, 0.1, 0.2), stddev_samp(v, 0.1, 0.2), stddev(v, 0.1, 0.2)]::text AS all, trimmed(v, 0.1, 0.2, ARRAY['stddev', 'avg'])::text = ARRAY[stddev(v, 0.1, 0.2), avg(v, 0.1, 0.2)]::text AS list, avg(v, 0.1, 0.2) FROM (SELECT (CASE WHEN x <= 100 THEN x / 7.0 ELSE x END)::numeric AS v FROM generate_series(1,1000) s(x)) foo;
+
+-- quantiles of the kept part
+SELECT quantiles(x, 0.1, 0.1, ARRAY[0, 0.25, 0.5, 0.75, 1]) FROM generate_series(1,1000) s(x);
+SELECT quantiles(x::bigint, 0.1, 0.1, ARRAY[0, 0.5, 1]) FROM generate_series(1,1000) s(x);
+SELECT quantiles(x::double precision, 0.1, 0.1, ARRAY[0.1, 0.5]) FROM generate_series(1,1000) s(x);
+SELECT quantiles(x::numeric, 0.1, 0.1, ARRAY[1, 0.5, 0, 0.25]) FROM generate_series(1,1000) s(x);
+SELECT quantiles(x::numeric / 7, 0.1, 0.1, ARRAY[0.5]) FROM generate_series(1,1000) s(x);
+-- numeric quantiles keep the scale of the values (exact hits and interpolated)
+SELECT quantiles(v, 0, 0, ARRAY[0, 0.1, 0.25, 0.5, 1]) FROM (VALUES (1.50), (2.25), (3.00), (3.00), (4.125)) t(v);
+SELECT quantiles(v, 0, 0, ARRAY[0, 0.5, 0.75, 1]) FROM (VALUES (1::numeric), (2), (2), ('NaN')) t(v);
+SELECT quantiles(x, 0.5, 0.49, ARRAY[0, 0.5, 1]) FROM generate_series(1,10) s(x);
+SELECT trimmed(x, 0.1, 0.1, ARRAY['min', 'median', 'max', 'avg']) FROM generate_series(1,1000) s(x);
+SELECT trimmed(x::numeric, ARRAY[0, 0.1], ARRAY[0, 0.2], ARRAY['min', 'max', 'median']) FROM generate_series(1,1000) s(x);
+SELECT trimmed(x::double precision, ARRAY[0, 0.1], ARRAY[0, 0.2], ARRAY['min', 'max', 'median']) FROM generate_series(1,1000) s(x);
+
+-- weighted (pre-aggregated) data, compared to the expanded data
+CREATE TABLE trimmed_weighted AS SELECT i AS v, (i % 7) + 1 AS w FROM generate_series(1,1000) s(i);
+INSERT INTO trimmed_weighted VALUES (NULL, 10), (5, NULL), (17, 0);
+SELECT round(avg(v, w, 0.1, 0.2)::numeric, 6) AS avg_w, (SELECT round(avg(v, 0.1, 0.2)::numeric, 6) FROM trimmed_weighted, generate_series(1, w)) AS avg_x FROM trimmed_weighted;
+SELECT round(var(v::bigint, w, 0.1, 0.2)::numeric, 3), round(var_pop(v::bigint, w, 0.1, 0.2)::numeric, 3), round(var_samp(v::bigint, w, 0.1, 0.2)::numeric, 3) FROM trimmed_weighted;
+SELECT round(var(v::bigint, 0.1, 0.2)::numeric, 3), round(var_pop(v::bigint, 0.1, 0.2)::numeric, 3), round(var_samp(v::bigint, 0.1, 0.2)::numeric, 3) FROM trimmed_weighted, generate_series(1, w);
+SELECT round(stddev(v::float8, w, 0.1, 0.2)::numeric, 3), round(stddev_pop(v::float8, w, 0.1, 0.2)::numeric, 3), round(stddev_samp(v::float8, w, 0.1, 0.2)::numeric, 3) FROM trimmed_weighted;
+SELECT round(stddev(v::float8, 0.1, 0.2)::numeric, 3), round(stddev_pop(v::float8, 0.1, 0.2)::numeric, 3), round(stddev_samp(v::float8, 0.1, 0.2)::numeric, 3) FROM trimmed_weighted, generate_series(1, w);
+SELECT round(unnest(trimmed(v, w, 0.05, 0.05))::numeric, 3) FROM trimmed_weighted;
+SELECT round(unnest(trimmed(v, 0.05, 0.05))::numeric, 3) FROM trimmed_weighted, generate_series(1, w);
+SELECT avg(v, w, 0.5, 0.49) FROM trimmed_weighted;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT round(unnest(trimmed(v, w, 0.05, 0.05))::numeric, 3) FROM trimmed_weighted;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+-- array input (compared to the unnested values)
+CREATE TABLE trimmed_arrays AS SELECT i % 10 AS g, array_agg(CASE WHEN j % 13 = 0 THEN NULL ELSE i * j END) AS a
+  FROM generate_series(1,100) s(i), generate_series(1,25) t(j) GROUP BY 1;
+INSERT INTO trimmed_arrays VALUES (10, NULL), (11, '{}'), (12, '{NULL,NULL}');
+SELECT round(avg(a::float8[], 0.1, 0.1)::numeric, 6), round(var(a, 0.1, 0.1)::numeric, 3), round(stddev_samp(a::bigint[], 0.1, 0.1)::numeric, 3), round(var_pop(a::numeric[], 0.1, 0.1), 3) FROM trimmed_arrays;
+SELECT round(avg(v::float8, 0.1, 0.1)::numeric, 6), round(var(v, 0.1, 0.1)::numeric, 3), round(stddev_samp(v::bigint, 0.1, 0.1)::numeric, 3), round(var_pop(v::numeric, 0.1, 0.1), 3) FROM trimmed_arrays, unnest(a) u(v);
+SELECT round(unnest(trimmed(a::numeric[], 0.2, 0.1)), 3) FROM trimmed_arrays;
+SELECT round(unnest(trimmed(v::numeric, 0.2, 0.1)), 3) FROM trimmed_arrays, unnest(a) u(v);
+SELECT avg(a, 0.1, 0.1) FROM trimmed_arrays WHERE g > 10;
+SELECT avg(ARRAY[[1,2],[3,NULL]], 0, 0);
+
+-- combining partial states with disjoint / overlapping ranges (partitionwise aggregation)
+CREATE TABLE trimmed_parts (k int, v int) PARTITION BY RANGE (k);
+CREATE TABLE trimmed_parts_1 PARTITION OF trimmed_parts FOR VALUES FROM (0) TO (300);
+CREATE TABLE trimmed_parts_2 PARTITION OF trimmed_parts FOR VALUES FROM (300) TO (700);
+CREATE TABLE trimmed_parts_3 PARTITION OF trimmed_parts FOR VALUES FROM (700) TO (1000);
+INSERT INTO trimmed_parts SELECT i, i FROM generate_series(0,999) s(i);
+INSERT INTO trimmed_parts SELECT i, (i * 37) % 500 + 250 FROM generate_series(0,999) s(i);
+INSERT INTO trimmed_parts SELECT i, 1000 - i FROM generate_series(0,999) s(i);
+SET enable_partitionwise_aggregate = on;
+EXPLAIN (COSTS OFF) SELECT avg(v, 0.1, 0.1) FROM trimmed_parts;
+SELECT avg(v, 0.1, 0.1), avg(v::bigint, 0.05, 0.2), avg(v::float8, 0.2, 0.05), avg(v::numeric, 0.1, 0.3), avg(v, v % 3, 0.1, 0.1) FROM trimmed_parts;
+SELECT avg(v, 0.1, 0.1), avg(v::bigint, 0.05, 0.2), avg(v::float8, 0.2, 0.05), avg(v::numeric, 0.1, 0.3), avg(v, v % 3, 0.1, 0.1) FROM trimmed_parts WHERE k < 300 OR v < 100;
+SELECT quantiles(v::numeric, 0, 0, ARRAY[0, 0.1, 0.5, 0.9, 1]), quantiles(v, 0, 0, ARRAY[0, 0.1, 0.5, 0.9, 1]) FROM trimmed_parts WHERE v < 300 OR v > 700;
+SELECT avg(v, 0.1, 0.1), avg(v::bigint, 0.05, 0.2), avg(v::float8, 0.2, 0.05), avg(v::numeric, 0.1, 0.3), avg(v, v % 3, 0.1, 0.1) FROM trimmed_parts WHERE v = k;
+RESET enable_partitionwise_aggregate;
+SELECT avg(v, 0.1, 0.1), avg(v::bigint, 0.05, 0.2), avg(v::float8, 0.2, 0.05), avg(v::numeric, 0.1, 0.3), avg(v, v % 3, 0.1, 0.1) FROM trimmed_parts;
+SELECT avg(v, 0.1, 0.1), avg(v::bigint, 0.05, 0.2), avg(v::float8, 0.2, 0.05), avg(v::numeric, 0.1, 0.3), avg(v, v % 3, 0.1, 0.1) FROM trimmed_parts WHERE k < 300 OR v < 100;
+SELECT quantiles(v::numeric, 0, 0, ARRAY[0, 0.1, 0.5, 0.9, 1]), quantiles(v, 0, 0, ARRAY[0, 0.1, 0.5, 0.9, 1]) FROM trimmed_parts WHERE v < 300 OR v > 700;
+SELECT avg(v, 0.1, 0.1), avg(v::bigint, 0.05, 0.2), avg(v::float8, 0.2, 0.05), avg(v::numeric, 0.1, 0.3), avg(v, v % 3, 0.1, 0.1) FROM trimmed_parts WHERE v = k;
+
+-- combining many partial states (k-way merge of the sorted runs)
+CREATE TABLE trimmed_hparts (k int, v int) PARTITION BY HASH (k);
+CREATE TABLE trimmed_hparts_0 PARTITION OF trimmed_hparts FOR VALUES WITH (MODULUS 6, REMAINDER 0);
+CREATE TABLE trimmed_hparts_1 PARTITION OF trimmed_hparts FOR VALUES WITH (MODULUS 6, REMAINDER 1);
+CREATE TABLE trimmed_hparts_2 PARTITION OF trimmed_hparts FOR VALUES WITH (MODULUS 6, REMAINDER 2);
+CREATE TABLE trimmed_hparts_3 PARTITION OF trimmed_hparts FOR VALUES WITH (MODULUS 6, REMAINDER 3);
+CREATE TABLE trimmed_hparts_4 PARTITION OF trimmed_hparts FOR VALUES WITH (MODULUS 6, REMAINDER 4);
+CREATE TABLE trimmed_hparts_5 PARTITION OF trimmed_hparts FOR VALUES WITH (MODULUS 6, REMAINDER 5);
+INSERT INTO trimmed_hparts SELECT i, (i * 7919) % 1000 FROM generate_series(1,5000) s(i);
+SET enable_partitionwise_aggregate = on;
+SELECT round(unnest(trimmed(v, 0.1, 0.2))::numeric, 6) AS a, round(unnest(trimmed(v::numeric, 0.1, 0.2)), 6) AS b FROM trimmed_hparts;
+SELECT quantiles(v::numeric, 0.1, 0.1, ARRAY[0, 0.5, 1]), quantiles(v::bigint, 0.1, 0.1, ARRAY[0, 0.5, 1]) FROM trimmed_hparts WHERE k % 7 = 0;
+RESET enable_partitionwise_aggregate;
+SELECT round(unnest(trimmed(v, 0.1, 0.2))::numeric, 6) AS a, round(unnest(trimmed(v::numeric, 0.1, 0.2)), 6) AS b FROM trimmed_hparts;
+SELECT quantiles(v::numeric, 0.1, 0.1, ARRAY[0, 0.5, 1]), quantiles(v::bigint, 0.1, 0.1, ARRAY[0, 0.5, 1]) FROM trimmed_hparts WHERE k % 7 = 0;
+
+-- persistent states (text round-trip, merging stored states, overriding the cuts)
+SELECT trimmed_state(x, 0.1, 0.2) FROM (VALUES (3), (1), (2)) t(x);
+SELECT '(0.1,0.2):{3.5,1,2}'::trimmed_state_numeric, '(0,0):{}'::trimmed_state_int64;
+CREATE TABLE trimmed_hourly AS SELECT k % 24 AS h, trimmed_state(v, 0.1, 0.1) AS s, trimmed_state(v::numeric, 0.1, 0.1) AS sn FROM trimmed_hparts GROUP BY 1;
+SELECT count(*) FROM trimmed_hourly WHERE s::text::trimmed_state_int32::text = s::text AND sn::text::trimmed_state_numeric::text = sn::text;
+SELECT trimmed_stats(trimmed_merge(s)) = (SELECT trimmed(v, 0.1, 0.1) FROM trimmed_hparts), trimmed_stats(trimmed_merge(sn)) = (SELECT trimmed(v::numeric, 0.1, 0.1) FROM trimmed_hparts) FROM trimmed_hourly;
+SELECT trimmed_avg(m), trimmed_var(m, 0.2, 0.05), trimmed_stddev_samp(m, 0, 0) FROM (SELECT trimmed_merge(sn) AS m FROM trimmed_hourly) x;
+SELECT trimmed(v::numeric, 0.2, 0.05, ARRAY['var']), trimmed(v::numeric, 0, 0, ARRAY['stddev_samp']) FROM trimmed_hparts;
+SELECT trimmed_avg('(0.4,0.5):{1}'::trimmed_state_int32);
+CREATE CAST (trimmed_state_int32 AS bytea) WITHOUT FUNCTION;
+CREATE CAST (bytea AS trimmed_state_int32) WITHOUT FUNCTION;
+SELECT '(0.1,0.2)@1/2:{1,2}'::trimmed_state_int32::bytea;
+SELECT trimmed_avg('\x013fb999999999999a3fc999999999999a000000000000000105000000'::bytea::trimmed_state_int32);
+
+-- cached states (the same results with or without the shared cache)
+CREATE TABLE trimmed_cached (k int, v int);
+INSERT INTO trimmed_cached SELECT i, (i * 7919) % 1000 FROM generate_series(1,5000) s(i);
+CREATE TRIGGER trimmed_cached_invalidate AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON trimmed_cached FOR EACH STATEMENT EXECUTE PROCEDURE trimmed_cache_invalidate();
+SELECT trimmed_avg(trimmed_cached_state_int32('trimmed_cached', 'v', 'k > 1000', 0.1, 0.1)), trimmed_avg(trimmed_cached_state_numeric('trimmed_cached', 'v', NULL, 0.1, 0.2));
+SELECT trimmed_avg(trimmed_cached_state_int32('trimmed_cached', 'v', 'k > 1000', 0.1, 0.1)), trimmed_avg(trimmed_cached_state_numeric('trimmed_cached', 'v', NULL, 0.1, 0.2));
+INSERT INTO trimmed_cached SELECT i, 1000 + i FROM generate_series(5001,6000) s(i);
+SELECT trimmed_avg(trimmed_cached_state_int32('trimmed_cached', 'v', 'k > 1000', 0.1, 0.1)), trimmed_avg(trimmed_cached_state_numeric('trimmed_cached', 'v', NULL, 0.1, 0.2));
+SELECT avg(v, 0.1, 0.1) FILTER (WHERE k > 1000), avg(v::numeric, 0.1, 0.2) FROM trimmed_cached;
+SELECT trimmed_cached_state_double('trimmed_cached', 'v', 'k < 0', 0.1, 0.1);
+SELECT trimmed_avg(trimmed_cached_state_int32('trimmed_cached', 'v', 'k > 1000 AND now() IS NOT NULL', 0.1, 0.1));
+
+-- registered statistics (refreshed incrementally, in batches)
+CREATE TABLE trimmed_events (id bigserial, host text, v int);
+INSERT INTO trimmed_events (host, v) SELECT 'h' || (i % 3), (i * 7919) % 1000 FROM generate_series(1,3000) s(i);
+SELECT trimmed_register('trimmed_events', 'v', 'id', 'host', 0.1, 0.1), trimmed_register('trimmed_events', 'v', 'id', NULL, 0.1, 0.2);
+SELECT trimmed_refresh(1000);
+INSERT INTO trimmed_events (host, v) SELECT 'h' || (i % 4), i FROM generate_series(1,500) s(i);
+SELECT trimmed_refresh(1000), trimmed_refresh(1000);
+SELECT registry_id, group_key, round(stats[1]::numeric, 6) AS avg FROM trimmed_results ORDER BY 1, 2;
+SELECT host, round(avg(v, 0.1, 0.1)::numeric, 6) FROM trimmed_events GROUP BY 1 ORDER BY 1;
+SELECT round(avg(v, 0.1, 0.2)::numeric, 6) FROM trimmed_events;
+SELECT count(*) FROM trimmed_results r JOIN (SELECT host, trimmed(v, 0.1, 0.1) t FROM trimmed_events GROUP BY 1) x ON (x.host = r.group_key) WHERE r.stats = x.t;
+SELECT id, last_position FROM trimmed_registry ORDER BY id;
+-- rows with a NULL group are skipped by the grouped registration (for good)
+INSERT INTO trimmed_events (host, v) SELECT NULL, i FROM generate_series(1,10) s(i);
+SELECT trimmed_refresh(1000);
+SELECT registry_id, string_agg(group_key, ',' ORDER BY group_key) FROM trimmed_results GROUP BY 1 ORDER BY 1;
+SELECT round(stats[1]::numeric, 6) = (SELECT round(avg(v, 0.1, 0.2)::numeric, 6) FROM trimmed_events) FROM trimmed_results WHERE registry_id = 2;
+SELECT id, last_position FROM trimmed_registry ORDER BY id;
+-- the refresh does not depend on the caller's search_path
+SET search_path = pg_catalog;
+INSERT INTO public.trimmed_events (host, v) VALUES ('h0', 1);
+SELECT public.trimmed_refresh(1000);
+RESET search_path;
+-- updated and deleted rows are not reflected, until the registration is rebuilt
+SAVEPOINT s;
+UPDATE trimmed_events SET v = v + 1000 WHERE host = 'h3';
+DELETE FROM trimmed_events WHERE host = 'h2';
+SELECT trimmed_refresh(1000);
+SELECT r.group_key, r.stats = x.t FROM trimmed_results r LEFT JOIN (SELECT host, trimmed(v, 0.1, 0.1) t FROM trimmed_events GROUP BY 1) x ON (x.host = r.group_key) WHERE r.registry_id = 1 ORDER BY 1;
+DELETE FROM trimmed_results WHERE registry_id = 1;
+UPDATE trimmed_registry SET last_position = NULL WHERE id = 1;
+SELECT trimmed_refresh(1000);
+SELECT r.group_key, r.stats = x.t FROM trimmed_results r LEFT JOIN (SELECT host, trimmed(v, 0.1, 0.1) t FROM trimmed_events GROUP BY 1) x ON (x.host = r.group_key) WHERE r.registry_id = 1 ORDER BY 1;
+ROLLBACK TO s;
+
+-- memory budget (the values are sampled when the state exceeds the budget)
+SET trimmed_aggregates.state_memory = '16kB';
+SET trimmed_aggregates.memory_policy = 'sample';
+SELECT avg(x, 0.1, 0.1), avg(x::numeric, 0.1, 0.1) FROM generate_series(1,1000) s(x);
+SELECT trimmed_state(x, 0.1, 0.1)::text LIKE '(0.1,0.1)@1/%' FROM generate_series(1,100000) s(x);
+SELECT abs(avg(x, 0.1, 0.1) - 50000.5) < 5000, abs(avg(x::numeric, 0.1, 0.1) - 50000.5) < 5000, abs(avg(x, 1::bigint, 0.1, 0.1) - 50000.5) < 5000 FROM generate_series(1,100000) s(x);
+SELECT abs(avg(a, 0.1, 0.1) - 50000.5) < 5000 FROM (SELECT array_agg(x) AS a FROM generate_series(1,100000) s(x) GROUP BY x % 10) t;
+SELECT trimmed_merge(x) FROM (VALUES ('(0,0)@1/4:{1,3}'::trimmed_state_int32), ('(0,0)@1/4:{2}')) t(x);
+RESET trimmed_aggregates.state_memory;
+SET trimmed_aggregates.backend_memory = '256kB';
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT avg(x, 0.1, 0.1) BETWEEN 25000 AND 75000 FROM trimmed_data;
+SELECT avg(n, 0.1, 0.1) BETWEEN 25000 AND 75000 FROM trimmed_data;
+SELECT avg(x, 1::bigint, 0.1, 0.1) BETWEEN 25000 AND 75000 FROM trimmed_data;
+SELECT avg_by(x, x, 0.1, 0.1) BETWEEN 25000 AND 75000 FROM trimmed_data;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+RESET trimmed_aggregates.backend_memory;
+RESET trimmed_aggregates.memory_policy;
+
+-- planner support (no hashed aggregation when the values exceed hash_mem)
+CREATE TABLE trimmed_planner AS SELECT i % 100 AS g, i AS v FROM generate_series(1,100000) s(i);
+ANALYZE trimmed_planner;
+SET work_mem = '64kB';
+SET max_parallel_workers_per_gather = 0;
+EXPLAIN (costs off) SELECT g, avg(v, 0.1, 0.1) FROM trimmed_planner GROUP BY g;
+EXPLAIN (costs off) SELECT g, avg(v) FROM trimmed_planner GROUP BY g;
+SELECT g, avg(v, 0.1, 0.1) FROM trimmed_planner WHERE g < 3 GROUP BY g ORDER BY g;
+-- the arrays are counted with all their elements
+CREATE TABLE trimmed_planner_arrays AS SELECT i % 10 AS g, array(SELECT generate_series(1,100)) AS a FROM generate_series(1,1000) s(i);
+ANALYZE trimmed_planner_arrays;
+EXPLAIN (costs off) SELECT g, avg(a, 0.1, 0.1) FROM trimmed_planner_arrays GROUP BY g;
+EXPLAIN (costs off) SELECT g, count(a) FROM trimmed_planner_arrays GROUP BY g;
+RESET work_mem;
+RESET max_parallel_workers_per_gather;
+
+-- kernel microbenchmark (see bench/kernels.sql, only checks that it runs)
+CREATE FUNCTION pg_temp.trimmed_benchmark(kernel text, type text, distribution text, nvalues int, loops int) RETURNS double precision AS '$libdir/trimmed_aggregates', 'trimmed_benchmark' LANGUAGE C STRICT;
+SELECT count(*) FROM unnest(ARRAY['sort', 'merge', 'final']) k, unnest(ARRAY['double', 'int32', 'int64', 'numeric']) t, LATERAL pg_temp.trimmed_benchmark(k, t, 'skewed', 100, 2) ns WHERE ns >= 0;
+
+-- runtime counters (of the current backend)
+SELECT trimmed_counters_reset();
+SELECT avg(x, 0.1, 0.1) FROM generate_series(1,1000) s(x);
+SELECT avg(a, 0.1, 0.1) FROM (VALUES (ARRAY[1, 2, NULL, 3]), (ARRAY[4, 5])) v(a);
+SELECT trimmed_avg(trimmed_merge(s)) FROM (SELECT trimmed_state(x::numeric, 0.1, 0.1) AS s FROM generate_series(1,100) s(x) GROUP BY x % 2) foo;
+SELECT scope, appended, allocated > 0, peak_state > 0, sorts, merges, combines, serialized > 0, deserialized > 0 FROM trimmed_counters WHERE scope = 'backend';
+SELECT trimmed_counters_reset();
+SELECT appended, sorts, sort_time, merges, merge_time FROM trimmed_counters WHERE scope = 'backend';
+
+-- chunked (interruptible) sorts of more than 1M values
+SELECT quantiles((i::bigint * 7919) % 1200007, 0, 0, ARRAY[0, 0.25, 0.5, 0.75, 1]) FROM generate_series(1, 1200006) s(i);
+SELECT quantiles(((i::bigint * 7919) % 1200007)::double precision, 0.1, 0.1, ARRAY[0, 0.5, 1]) FROM generate_series(1, 1200006) s(i);
+SELECT quantiles(i % 16, 0, 0, ARRAY[0, 0.5, 1]), round(avg(i % 16, 0.1, 0.1)::numeric, 3) FROM generate_series(1, 1200006) s(i);
+SELECT round(avg(((i::bigint * 7919) % 1200007)::int, 2, 0.1, 0.1)::numeric, 3) FROM generate_series(1, 1200006) s(i);
+SELECT count(*) FROM trimmed_progress;
+
+-- parallel finalization (on threads) of states with more than 1M values
+SET trimmed_aggregates.finalize_threads = 3;
+SELECT quantiles((i::bigint * 7919) % 1200007, 0, 0, ARRAY[0, 0.25, 0.5, 0.75, 1]) FROM generate_series(1, 1200006) s(i);
+SELECT quantiles(((i::bigint * 7919) % 1200007)::double precision, 0.1, 0.1, ARRAY[0, 0.5, 1]) FROM generate_series(1, 1200006) s(i);
+SELECT quantiles(i % 16, 0, 0, ARRAY[0, 0.5, 1]), round(avg(i % 16, 0.1, 0.1)::numeric, 3) FROM generate_series(1, 1200006) s(i);
+SET trimmed_aggregates.finalize_threads = 4;
+SELECT round(avg(x, 0.1, 0.1)::numeric, 3), round(var(x, 0.1, 0.1)::numeric, -2), round(stddev(x, 0.1, 0.1)::numeric, 3) FROM (SELECT ((i::bigint * 7919) % 1200007)::int AS x FROM generate_series(1, 1200006) s(i)) foo;
+SELECT round(avg(((i::bigint * 7919) % 1200007)::int, 2, 0.1, 0.1)::numeric, 3) FROM generate_series(1, 1200006) s(i);
+RESET trimmed_aggregates.finalize_threads;
+SELECT round(avg(x, 0.1, 0.1)::numeric, 3), round(var(x, 0.1, 0.1)::numeric, -2), round(stddev(x, 0.1, 0.1)::numeric, 3) FROM (SELECT ((i::bigint * 7919) % 1200007)::int AS x FROM generate_series(1, 1200006) s(i)) foo;
+
+-- real and smallint (stored in their native width)
+SELECT round(avg(x::real, 0.1, 0.1),3), round(var(x::real, 0.1, 0.1),3), round(var_pop(x::real, 0.1, 0.1),3), round(var_samp(x::real, 0.1, 0.1),3) FROM generate_series(1,1000) s(x);
+SELECT round(stddev(x::real, 0.1, 0.1),3), round(stddev_pop(x::real, 0.1, 0.1),3), round(stddev_samp(x::real, 0.1, 0.1),3) FROM generate_series(1,1000) s(x);
+SELECT round(avg(x::smallint, 0.1, 0.1),3), round(var(x::smallint, 0.1, 0.1),3), round(var_pop(x::smallint, 0.1, 0.1),3), round(var_samp(x::smallint, 0.1, 0.1),3) FROM generate_series(1,1000) s(x);
+SELECT round(stddev(x::smallint, 0.1, 0.1),3), round(stddev_pop(x::smallint, 0.1, 0.1),3), round(stddev_samp(x::smallint, 0.1, 0.1),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(trimmed(x / 4.0::real, 0.1, 0.2))::numeric, 3) AS a, round(unnest(trimmed((x % 1000 - 500)::smallint, 0.1, 0.2))::numeric, 3) AS b FROM generate_series(1,10000) s(x);
+SELECT avg(x::real, 0, 0), avg(x::smallint, 0.45, 0.45), avg(NULL::real, 0.1, 0.1) FROM generate_series(1,10) s(x);
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT round(avg(x::real, 0.1, 0.1),3), round(var((x % 30000)::smallint, 0.1, 0.1),3), round(unnest(trimmed((x % 30000)::smallint, 0.2, 0.1))::numeric, 3) FROM trimmed_data;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+SET enable_partitionwise_aggregate = on;
+SELECT round(avg(v::real, 0.1, 0.2)::numeric, 6) AS a, round(avg(v::smallint, 0.1, 0.2)::numeric, 6) AS b, round(avg(v, 0.1, 0.2)::numeric, 6) AS c FROM trimmed_hparts;
+RESET enable_partitionwise_aggregate;
+
+-- timestamp, timestamptz and interval averages (exact, in microseconds)
+SELECT avg(t, 0.1, 0.1), avg(t::timestamptz, 0.1, 0.1), avg(t - '2020-01-01', 0.1, 0.1) FROM (SELECT '2020-01-01'::timestamp + (i * 7919 % 1000) * interval '1 hour 1.000003 sec' AS t FROM generate_series(1,1000) s(i)) foo;
+SELECT avg(t, 0.2, 0), avg(d, 0, 0.2) FROM (VALUES ('2021-03-01 10:00:00.000001'::timestamp, interval '1 month'), ('2021-03-01 10:00:00.000002', interval '1 day 1 microsecond'), ('2021-03-01 10:00:00.000004', interval '-3 days'), ('-infinity', interval '2 hours'), ('2021-03-01 10:00:00.000009', interval '1 year')) v(t, d);
+SELECT avg(d, 0, 0), justify_days(avg(d, 0, 0)), avg(d) FROM (VALUES (interval '1 month'), (interval '2 months')) v(d);
+SELECT avg(d, 0, 0), justify_days(avg(d, 0, 0)), avg(d) FROM (VALUES (interval '1 month'), (interval '31 days')) v(d);
+SELECT avg(t, 0, 0) FROM (VALUES ('2021-03-01'::timestamp), ('infinity')) v(t);
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT avg('2000-01-01'::timestamptz + x * interval '1 second', 0.1, 0.1), avg(x * interval '1.5 sec', 0.1, 0.1) FROM trimmed_data;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+-- trimming by a key column (statistics of the other columns, compared to a sorted subquery)
+SELECT avg_by(x % 97, (x * 7919) % 100003, 0.05, 0.05), sum_by(x % 97, (x * 7919) % 100003, 0.05, 0.05), round(var_by(x % 97, (x * 7919) % 100003, 0.05, 0.05)::numeric, 6) FROM trimmed_data;
+SELECT avg(v), sum(v), round(var_pop(v)::numeric, 6) FROM (SELECT x % 97 AS v FROM trimmed_data ORDER BY (x * 7919) % 100003 OFFSET 5000 LIMIT 90000) foo;
+SELECT round(var_pop_by(x % 97, -x, 0.1, 0.2)::numeric, 6), round(var_samp_by(x % 97, -x, 0.1, 0.2)::numeric, 6), round(stddev_by(x % 97, -x, 0.1, 0.2)::numeric, 6), round(stddev_pop_by(x % 97, -x, 0.1, 0.2)::numeric, 6), round(stddev_samp_by(x % 97, -x, 0.1, 0.2)::numeric, 6) FROM trimmed_data;
+SELECT round(var_pop(v)::numeric, 6), round(var_samp(v)::numeric, 6), round(stddev_pop(v)::numeric, 6), round(stddev_pop(v)::numeric, 6), round(stddev_samp(v)::numeric, 6) FROM (SELECT x % 97 AS v FROM trimmed_data ORDER BY x DESC OFFSET 10000 LIMIT 70000) foo;
+SELECT round(unnest(trimmed_by(x % 97, (x * 7919) % 100003, 0.05, 0.05))::numeric, 6) FROM trimmed_data;
+SELECT avg_by(ARRAY[x % 97, x % 13, x], (x * 7919) % 100003, 0.05, 0.05), sum_by(ARRAY[x % 97, x % 13, x], (x * 7919) % 100003, 0.05, 0.05) FROM trimmed_data;
+SELECT avg(x % 97), avg(x % 13), avg(x), sum(x % 97), sum(x % 13), sum(x) FROM (SELECT x FROM trimmed_data ORDER BY (x * 7919) % 100003 OFFSET 5000 LIMIT 90000) foo;
+SELECT avg_by(v, k, 0, 0), avg_by(ARRAY[v, k], k, 0, 0), avg_by(v, k, 0.5, 0.49) FROM (VALUES (1, 1), (NULL, 2), (3, NULL), (5, 3)) t(v, k);
+SELECT avg_by(a, k, 0, 0) FROM (VALUES (ARRAY[1, 2]::float8[], 1), (ARRAY[NULL, 4], 2), (NULL, 3), (ARRAY[5, 6], 4)) t(a, k);
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT avg_by(x % 97, (x * 7919) % 100003, 0.05, 0.05), round(stddev_samp_by(x % 97, -x, 0.1, 0.2)::numeric, 6), avg_by(ARRAY[x % 97, x % 13, x], (x * 7919) % 100003, 0.05, 0.05) FROM trimmed_data;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+SET enable_partitionwise_aggregate = on;
+EXPLAIN (COSTS OFF) SELECT avg_by(v, k, 0.1, 0.2) FROM trimmed_hparts;
+SELECT avg_by(v, k, 0.1, 0.2), sum_by(ARRAY[v, k], k, 0.1, 0.2) FROM trimmed_hparts;
+RESET enable_partitionwise_aggregate;
+SELECT avg(v), sum(v), sum(k) FROM trimmed_hparts WHERE k > 500 AND k <= 4000;
+
+-- winsorized statistics (compared to the values clamped to the kept range)
+SELECT round(avg_winsorized(x, 0.1, 0.2),3), round(var_winsorized(x, 0.1, 0.2),2), round(var_pop_winsorized(x, 0.1, 0.2),2), round(var_samp_winsorized(x, 0.1, 0.2),3) FROM generate_series(1,1000) s(x);
+SELECT round(stddev_winsorized(x::bigint, 0.1, 0.2),3), round(stddev_pop_winsorized(x::real, 0.1, 0.2),3), round(stddev_samp_winsorized(x::smallint, 0.1, 0.2),3), round(avg_winsorized(x::double precision, 0.1, 0.2),3) FROM generate_series(1,1000) s(x);
+SELECT round(avg(least(greatest(x, 101), 800)),3), round(var_pop(least(greatest(x, 101), 800)),2), round(var_samp(least(greatest(x, 101), 800)),3), round(stddev_pop(least(greatest(x, 101), 800)),3), round(stddev_samp(least(greatest(x, 101), 800)),3) FROM generate_series(1,1000) s(x);
+SELECT round(avg_winsorized(x::numeric, 0.1, 0.2),3), round(var_winsorized(x::numeric, 0.1, 0.2),2), round(stddev_samp_winsorized(x::numeric, 0.1, 0.2),3) FROM generate_series(1,1000) s(x);
+SELECT round(unnest(winsorized((x * 7919) % 1009, 0.05, 0.1))::numeric, 3) AS a, round(unnest(winsorized(((x * 7919) % 1009)::numeric, 0.05, 0.1)), 3) AS b FROM generate_series(1,1009) s(x);
+SELECT avg_winsorized(x, 0, 0), avg(x, 0, 0), avg_winsorized(x, 0.45, 0.45), var_samp_winsorized(x, 0.5, 0.45), avg_winsorized(NULL::int, 0.1, 0.1) FROM generate_series(1,10) s(x);
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT avg_winsorized(x, 0.1, 0.2), round(var_winsorized(x, 0.1, 0.2)::numeric, 2), round(stddev_samp_winsorized(n, 0.1, 0.2), 3) FROM trimmed_data;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+SELECT avg(least(greatest(x, 10001), 80000)), round(var_pop(least(greatest(x, 10001), 80000))::numeric, 2), round(stddev_samp(least(greatest(n, 10001), 80000)), 3) FROM trimmed_data;
+
+-- kept values (the sorted slice of the state, as an array)
+SELECT trimmed_values(x, 0.1, 0.2), trimmed_values(x::bigint, 0.1, 0.2), trimmed_values(x::smallint, 0.2, 0) FROM generate_series(20,1,-1) s(x);
+SELECT trimmed_values(x / 4.0::double precision, 0.1, 0.2), trimmed_values((x / 4.0)::real, 0.1, 0.2), trimmed_values(x / 4.0, 0.1, 0.2) FROM generate_series(10,1,-1) s(x);
+SELECT trimmed_values(x, 0.45, 0.45), trimmed_values(x::numeric, 0.45, 0.45), trimmed_values(NULL::int, 0.1, 0.1) FROM generate_series(1,2) s(x);
+SELECT array_length(v, 1), v[1], v[80000], v = (SELECT array_agg(x ORDER BY x) FROM trimmed_data WHERE x > 10000 AND x <= 90000) FROM (SELECT trimmed_values(x, 0.1, 0.1) AS v FROM trimmed_data) foo;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT v = (SELECT array_agg(x ORDER BY x) FROM trimmed_data WHERE x > 5000 AND x <= 80000), w = (SELECT array_agg(n ORDER BY n) FROM trimmed_data WHERE x > 5000 AND x <= 80000) FROM (SELECT trimmed_values(x, 0.05, 0.2) AS v, trimmed_values(n, 0.05, 0.2) AS w FROM trimmed_data) foo;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+-- confidence intervals of the trimmed mean (Yuen's interval compared to the winsorized variance, bootstrap)
+SELECT round(unnest(trimmed_ci(x, 0, 0, 0.95))::numeric, 6) AS a, round(unnest(trimmed_ci(x, 0, 0, 0.9))::numeric, 6) AS b FROM generate_series(1,11) s(x);
+SELECT round(unnest(trimmed_ci(x, 0.1, 0.2, 0.95))::numeric, 6) AS a, round(unnest(trimmed_ci(x::bigint, 0.1, 0.2, 0.95))::numeric, 6) AS b, round(unnest(trimmed_ci(x::real, 0.1, 0.2, 0.95))::numeric, 6) AS c, round(unnest(trimmed_ci(x::smallint, 0.1, 0.2, 0.95))::numeric, 6) AS d FROM (SELECT (i * 7919) % 1009 AS x FROM generate_series(1,1009) s(i)) foo;
+SELECT round((avg(x, 0.1, 0.2) + s * sqrt(var_samp_winsorized(x, 0.1, 0.2) * 1008 / (708 * 707)))::numeric, 5) FROM (SELECT (i * 7919) % 1009 AS x FROM generate_series(1,1009) s(i)) foo, (VALUES (-1.963325), (1.963325)) t(s) GROUP BY s ORDER BY s;
+SELECT trimmed_ci(x, 0.45, 0.45, 0.95), trimmed_ci(x, 0.45, 0.45, 0.95, 10), trimmed_ci(NULL::int, 0.1, 0.1, 0.95) FROM generate_series(1,2) s(x);
+SELECT round(unnest(trimmed_ci(x, 0.1, 0.2, 0.95, 200))::numeric, 6) AS a, round(unnest(trimmed_ci(x::bigint, 0.1, 0.2, 0.95, 200))::numeric, 6) AS b FROM (SELECT (i * 7919) % 1009 AS x FROM generate_series(1,1009) s(i)) foo;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT round(unnest(trimmed_ci(x, 0.1, 0.1, 0.99))::numeric, 3) AS a, round(unnest(trimmed_ci(x, 0.1, 0.1, 0.99, 50))::numeric, 3) AS b FROM trimmed_data;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+SET trimmed_aggregates.finalize_threads = 4;
+SELECT round(unnest(trimmed_ci(x, 0.1, 0.1, 0.99, 50))::numeric, 3) FROM trimmed_data;
+-- the counts of the resamples are charged to the budget (fewer threads are used)
+SET trimmed_aggregates.backend_memory = '1MB';
+SELECT round(unnest(trimmed_ci(x, 0.1, 0.1, 0.99, 50))::numeric, 3) FROM trimmed_data;
+RESET trimmed_aggregates.backend_memory;
+RESET trimmed_aggregates.finalize_threads;
+
+-- invalid parameters
+SAVEPOINT s;
+SELECT avg_by(a, k, 0, 0) FROM (VALUES (ARRAY[1, 2]::float8[], 1), (ARRAY[3], 2)) t(a, k);
+ROLLBACK TO s;
+SELECT avg_by(ARRAY[[1, 2], [3, 4]], 1, 0, 0);
+ROLLBACK TO s;
+SELECT avg_by(x, x, 0.5, 0.5) FROM generate_series(1,10) s(x);
+ROLLBACK TO s;
+SELECT avg(t, 0, 0) FROM (VALUES ('-infinity'::timestamp), ('infinity')) v(t);
+ROLLBACK TO s;
+SELECT avg(interval '300000 years', 0, 0);
+ROLLBACK TO s;
+SELECT avg(x, ARRAY[0, 0.1], ARRAY[0.1]) FROM generate_series(1,1000) s(x);
+ROLLBACK TO s;
+SELECT trimmed(x, 0.1, 0.1, ARRAY['mode']) FROM generate_series(1,1000) s(x);
+ROLLBACK TO s;
+SELECT quantiles(x, 0.1, 0.1, ARRAY[1.5]) FROM generate_series(1,1000) s(x);
+ROLLBACK TO s;
+SELECT trimmed_ci(x, 0.1, 0.1, 1.0) FROM generate_series(1,1000) s(x);
+ROLLBACK TO s;
+SELECT trimmed_ci(x, 0.1, 0.1, 0.95, 0) FROM generate_series(1,1000) s(x);
+ROLLBACK TO s;
+SELECT avg(x, -1, 0.1, 0.1) FROM generate_series(1,1000) s(x);
+ROLLBACK TO s;
+SELECT 'garbage'::trimmed_state_int32;
+ROLLBACK TO s;
+SELECT '(0.1,0.2):{1,NULL}'::trimmed_state_int32;
+ROLLBACK TO s;
+SELECT trimmed_merge(x) FROM (VALUES ('(0.1,0.2):{1}'::trimmed_state_int32), ('(0.1,0.1):{2}')) t(x);
+ROLLBACK TO s;
+SELECT trimmed_cached_state_int32('trimmed_cached', 'missing', NULL, 0.1, 0.1);
+ROLLBACK TO s;
+SELECT trimmed_cached_state_int32('trimmed_cached', 'v', 'random() < 0.5', 0.1, 0.1);
+ROLLBACK TO s;
+SELECT trimmed_cached_state_int32('trimmed_cached', 'v', 'true UNION ALL SELECT NULL', 0.1, 0.1);
+ROLLBACK TO s;
+SELECT trimmed_register('trimmed_events', 'host', 'id', NULL, 0.1, 0.1);
+ROLLBACK TO s;
+SELECT '(0.1,0.1)@1/3:{1}'::trimmed_state_int32;
+ROLLBACK TO s;
+SELECT trimmed_avg('\x02'::bytea::trimmed_state_int32);
+ROLLBACK TO s;
+SELECT trimmed_avg('\x023fb999999999999a3fc999999999999a0000000000000001'::bytea::trimmed_state_int32);
+ROLLBACK TO s;
+SELECT trimmed_avg('\x013fb999999999999a3fc999999999999a000000007fffffff'::bytea::trimmed_state_int32);
+ROLLBACK TO s;
+SELECT trimmed_avg('\x013fb999999999999a3fc999999999999a000000000000000101000000ff'::bytea::trimmed_state_int32);
+ROLLBACK TO s;
+SELECT pg_temp.trimmed_benchmark('sort', 'double', 'normal', 100, 1);
+ROLLBACK TO s;
+SET trimmed_aggregates.state_memory = '16kB';
+SELECT avg(x, 0.1, 0.1) FROM generate_series(1,100000) s(x);
+ROLLBACK TO s;
+SET trimmed_aggregates.state_memory = '1kB';
+SET trimmed_aggregates.memory_policy = 'sample';
+SELECT avg(x, 0.001, 0.001) FROM generate_series(1,100000) s(x);
+ROLLBACK TO s;
+
 ROLLBACK;
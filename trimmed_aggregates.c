@@ -12,6 +12,8 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -23,18 +25,93 @@
 #include "utils/lsyscache.h"
 #include "utils/numeric.h"
 #include "utils/builtins.h"
+#include "utils/fmgroids.h"
 #include "utils/memutils.h"
 #include "nodes/memnodes.h"
 #include "fmgr.h"
+#include "libpq/pqformat.h"
+#include "catalog/dependency.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_proc.h"
+#include "catalog/pg_trigger.h"
 #include "catalog/pg_type.h"
+#include "access/xact.h"
+#include "commands/extension.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/cost.h"
+#include "optimizer/planner.h"
+#include "pgstat.h"
+#include "portability/instr_time.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/lock.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/guc.h"
+#include "utils/inval.h"
+#include "utils/plancache.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/clauses.h"
+#include "optimizer/var.h"
+#endif
+
+#if PG_VERSION_NUM >= 150000
+#include "access/table.h"
+#include "catalog/namespace.h"
+#include "common/hashfn.h"
+#include "common/pg_prng.h"
+#include "lib/dshash.h"
+#include "parser/parse_func.h"
+#include "port/atomics.h"
+#include "rewrite/rewriteManip.h"
+#include "utils/dsa.h"
+#endif
+
+#if PG_VERSION_NUM >= 130000
+#include "postmaster/interrupt.h"
+#include "storage/latch.h"
+#endif
 
 #include "funcapi.h"
 
+/*
+ * Static probes (see trimmed_aggregates_probes.d), generated only when the
+ * server was configured with --enable-dtrace, and no-ops otherwise.
+ */
+#ifdef ENABLE_DTRACE
+#include "trimmed_aggregates_probes.h"
+#else
+#define TRACE_TRIMMED_APPEND(INT1, INT2) do {} while (0)
+#define TRACE_TRIMMED_SORT_START(INT1, INT2) do {} while (0)
+#define TRACE_TRIMMED_SORT_DONE(INT1) do {} while (0)
+#define TRACE_TRIMMED_MERGE_START(INT1, INT2) do {} while (0)
+#define TRACE_TRIMMED_MERGE_DONE(INT1) do {} while (0)
+#define TRACE_TRIMMED_COMBINE_START(INT1, INT2) do {} while (0)
+#define TRACE_TRIMMED_COMBINE_DONE(INT1) do {} while (0)
+#define TRACE_TRIMMED_SERIALIZE(INT1, INT2) do {} while (0)
+#define TRACE_TRIMMED_DESERIALIZE(INT1, INT2) do {} while (0)
+#define TRACE_TRIMMED_FINAL(INT1, INT2, INT3) do {} while (0)
+#endif
+
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
 #endif
 
-
 #define GET_AGG_CONTEXT(fname, fcinfo, aggcontext)  \
 	if (! AggCheckCallContext(fcinfo, &aggcontext)) {   \
 		elog(ERROR, "%s called in non-aggregate context", fname);  \
@@ -45,53 +122,146 @@ PG_MODULE_MAGIC;
 		elog(ERROR, "%s called in non-aggregate context", fname);  \
 	}
 
-
 /* how many elements to start with */
 #define MIN_ELEMENTS	32
 
-/* FIXME The final functions copy a lot of code - refactor to share. */
+/*
+ * The numeric final functions evaluate the statistics in trimmed_multi_numeric
+ * (the single-cut ones as a single configuration). The fixed-width types
+ * (including the weighted variants) are generated from trimmed_template.h.
+ */
 
-/* Structures used to keep the data - the 'elements' array is extended
- * on the fly if needed. */
+/* statistics computed by the combined aggregate (in this order) */
+#define STAT_AVG			0
+#define STAT_VAR_POP		1
+#define STAT_VAR_SAMP		2
+#define STAT_VAR			3
+#define STAT_STDDEV_POP		4
+#define STAT_STDDEV_SAMP	5
+#define STAT_STDDEV			6
 
-typedef struct state_double
-{
-	int		maxelements;	/* size of elements array */
-	int		nelements;		/* number of used items */
+#define NUM_STATS			7
 
-	double	cut_lower;		/* fraction to cut at the lower end */
-	double	cut_upper;		/* fraction to cut at the upper end */
+/* order statistics of the kept part (only when requested explicitly) */
+#define STAT_MIN			7
+#define STAT_MAX			8
+#define STAT_MEDIAN			9
 
-	bool	sorted;			/* are the elements sorted */
+/* pseudo-statistic, meaning "all of the above" (except order statistics) */
+#define STAT_ALL			(-1)
 
-	double *elements;		/* array of values */
-} state_double;
+#define STAT_IS_ORDER(stat)	((stat) >= STAT_MIN)
 
-typedef struct state_int32
+/* names of the statistics (as used by the regular aggregates) */
+static const char *stat_names[] = {
+	"avg", "var_pop", "var_samp", "var", "stddev_pop", "stddev_samp", "stddev",
+	"min", "max", "median"
+};
+
+/*
+ * Optional parameters of the aggregate, shared by all the state types. We
+ * keep them in a single flat chunk of memory, so that it's trivial to copy
+ * and serialize them.
+ *
+ * The cuts are stored as (lower, upper) pairs, one for each configuration,
+ * followed by the requested quantiles and then the list of requested
+ * statistics (STAT_* values).
+ */
+typedef struct trimmed_params
 {
-	int		maxelements;	/* size of elements array */
-	int		nelements;		/* number of used items */
+	int		len;			/* total size of the chunk (in bytes) */
+	int		ncuts;			/* number of cut configurations */
+	int		nquantiles;		/* number of requested quantiles */
+	int		nstats;			/* number of requested statistics */
 
-	double	cut_lower;		/* fraction to cut at the lower end */
-	double	cut_upper;		/* fraction to cut at the upper end */
+	double	confidence;		/* confidence level of the interval (or 0) */
+	int		nresamples;		/* bootstrap resamples (0 means analytic) */
 
-	bool	sorted;			/* are the elements sorted */
+	double	cuts[FLEXIBLE_ARRAY_MEMBER];	/* lower/upper cut pairs */
+} trimmed_params;
 
-	int32  *elements;		/* array of values */
-} state_int32;
+#define PARAMS_SIZE(ncuts, nquantiles, nstats)	\
+	(offsetof(trimmed_params, cuts) + \
+	 (2 * (ncuts) + (nquantiles)) * sizeof(double) + \
+	 (nstats) * sizeof(int))
 
-typedef struct state_int64
+#define PARAMS_CUT_LOWER(params, i)	((params)->cuts[2 * (i)])
+#define PARAMS_CUT_UPPER(params, i)	((params)->cuts[2 * (i) + 1])
+#define PARAMS_QUANTILES(params)	(&(params)->cuts[2 * (params)->ncuts])
+#define PARAMS_STATS(params)	\
+	((int *) &(params)->cuts[2 * (params)->ncuts + (params)->nquantiles])
+
+/*
+ * Sorted runs of values, collected by the combine functions. Instead of
+ * merging the states right away (which means copying all the data over and
+ * over with many partial states), we only remember the runs and merge all
+ * of them at once when the sorted data are actually needed.
+ */
+typedef struct run_numeric
 {
-	int		maxelements;	/* size of elements array */
-	int		nelements;		/* number of used items */
+	char   *data;			/* sorted values */
+	int		usedlen;		/* size of the data */
+	int		nelements;		/* number of values */
+} run_numeric;
 
-	double	cut_lower;		/* fraction to cut at the lower end */
-	double	cut_upper;		/* fraction to cut at the upper end */
+/*
+ * Memory accounted to a state (for the memory budget). The accounted amount
+ * is released by a reset callback of the memory context with the state.
+ */
+typedef struct trimmed_memory
+{
+	Size	accounted;		/* bytes accounted to the state */
+	MemoryContextCallback callback;	/* releases the accounted memory */
+} trimmed_memory;
 
-	bool	sorted;			/* are the elements sorted */
+static void memory_init(trimmed_memory *memory, MemoryContext context);
+static bool memory_fits(trimmed_memory *memory, Size size);
+static bool memory_grow(trimmed_memory *memory, Size size);
+static void memory_release(trimmed_memory *memory);
+
+/*
+ * States of the fixed-width types, and the functions working with them, are
+ * generated from trimmed_template.h. Here we only declare them, the functions
+ * are defined at the end of the file.
+ */
+#define TT_TYPE double
+#define TT_SUFFIX double
+#define TT_GETARG PG_GETARG_FLOAT8
+#define TT_EXTENDED
+#define TT_WEIGHTED
+#define TT_DECLARE
+#include "trimmed_template.h"
+
+#define TT_TYPE int32
+#define TT_SUFFIX int32
+#define TT_GETARG PG_GETARG_INT32
+#define TT_EXTENDED
+#define TT_WEIGHTED
+#define TT_DECLARE
+#include "trimmed_template.h"
+
+#define TT_TYPE int64
+#define TT_SUFFIX int64
+#define TT_GETARG PG_GETARG_INT64
+#define TT_EXTENDED
+#define TT_WEIGHTED
+#define TT_DECLARE
+#include "trimmed_template.h"
+
+#define TT_TYPE int16
+#define TT_SUFFIX int16
+#define TT_GETARG PG_GETARG_INT16
+#define TT_DECLARE
+#include "trimmed_template.h"
+
+#define TT_TYPE float4
+#define TT_SUFFIX float4
+#define TT_GETARG PG_GETARG_FLOAT4
+#define TT_DECLARE
+#include "trimmed_template.h"
 
-	int64  *elements;		/* array of values */
-} state_int64;
+/* Structures used to keep the data - the 'elements' array is extended
+ * on the fly if needed. */
 
 typedef struct state_numeric
 {
@@ -105,1710 +275,2193 @@ typedef struct state_numeric
 	int		maxlen;			/* total size of the buffer */
 	int		usedlen;		/* used part of the buffer */
 
+	int		sample_shift;	/* values are sampled with rate 1/2^shift */
+
 	char    *data;			/* contents of the numeric values */
+
+	trimmed_params *params;	/* optional parameters (or NULL) */
+
+	int		nruns;			/* number of runs to merge (or 0) */
+	int		maxruns;		/* size of the runs array */
+	run_numeric *runs;			/* sorted runs, collected by combine */
+
+	trimmed_memory memory;	/* memory accounted to the state */
 } state_numeric;
 
+/*
+ * Rows trimmed by one column (the key), with statistics computed from the
+ * other columns (payloads). The keys and each of the payload columns are
+ * stored in separate arrays, in the same order.
+ */
+typedef struct state_keyed
+{
+	int		maxelements;	/* size of the arrays */
+	int		nelements;		/* number of used items */
+	int		npayloads;		/* number of payload columns */
+
+	bool	array;			/* payloads passed as an array */
+
+	double	cut_lower;		/* fraction to cut at the lower end */
+	double	cut_upper;		/* fraction to cut at the upper end */
+
+	bool	sorted;			/* are the rows sorted by the key */
+
+	int		sample_shift;	/* rows are sampled with rate 1/2^shift */
+
+	double *keys;			/* keys (used for trimming) */
+	double **payloads;		/* payload columns */
+
+	trimmed_memory memory;	/* memory accounted to the state */
+} state_keyed;
+
+/* space needed for a single row of the keyed state */
+#define KEYED_WIDTH(state)	((1 + (state)->npayloads) * sizeof(double))
+
+/* key and position of a row (used to sort the rows by the key) */
+typedef struct keyed_row
+{
+	double	key;
+	int		row;
+} keyed_row;
+
 /* comparators, used for qsort */
 
-static int  double_comparator(const void *a, const void *b);
-static int  int32_comparator(const void *a, const void *b);
-static int  int64_comparator(const void *a, const void *b);
 static int  numeric_comparator(const void *a, const void *b);
 
-static void sort_state_double(state_double *state);
-static void sort_state_int32(state_int32 *state);
-static void sort_state_int64(state_int64 *state);
 static void sort_state_numeric(state_numeric *state);
 
+/* merging sorted arrays (in combine functions) */
+
+static void merge_numeric(char *a, int alen, char *b, int blen, char *out);
+
+/* merging sorted runs (collected by combine functions) */
+static void merge_runs_numeric(state_numeric *state);
+
+static void heap_sift_numeric(char **pos, int *heap, int nheap);
+
+static int  run_numeric_comparator(const void *a, const void *b);
+static char *numeric_last(char *data, int len);
+
 static Datum
 double_to_array(FunctionCallInfo fcinfo, double * d, int len);
 
 static Datum
 numeric_to_array(FunctionCallInfo fcinfo, Numeric * d, int len);
 
+static Datum
+fixed_to_array(void *elements, int nelements, int width, Oid typid);
+
 /* ACCUMULATE DATA */
 
-PG_FUNCTION_INFO_V1(trimmed_append_double);
-PG_FUNCTION_INFO_V1(trimmed_append_int32);
-PG_FUNCTION_INFO_V1(trimmed_append_int64);
+PG_FUNCTION_INFO_V1(trimmed_append_interval);
 PG_FUNCTION_INFO_V1(trimmed_append_numeric);
 
-Datum trimmed_append_double(PG_FUNCTION_ARGS);
-Datum trimmed_append_int32(PG_FUNCTION_ARGS);
-Datum trimmed_append_int64(PG_FUNCTION_ARGS);
+Datum trimmed_append_interval(PG_FUNCTION_ARGS);
 Datum trimmed_append_numeric(PG_FUNCTION_ARGS);
 
+PG_FUNCTION_INFO_V1(trimmed_append_array_numeric);
+
+Datum trimmed_append_array_numeric(PG_FUNCTION_ARGS);
+
 /* SERIALIZE STATE */
 
-PG_FUNCTION_INFO_V1(trimmed_serial_double);
-PG_FUNCTION_INFO_V1(trimmed_serial_int32);
-PG_FUNCTION_INFO_V1(trimmed_serial_int64);
 PG_FUNCTION_INFO_V1(trimmed_serial_numeric);
 
-Datum trimmed_serial_double(PG_FUNCTION_ARGS);
-Datum trimmed_serial_int32(PG_FUNCTION_ARGS);
-Datum trimmed_serial_int64(PG_FUNCTION_ARGS);
 Datum trimmed_serial_numeric(PG_FUNCTION_ARGS);
 
 /* DESERIALIZE STATE */
 
-PG_FUNCTION_INFO_V1(trimmed_deserial_double);
-PG_FUNCTION_INFO_V1(trimmed_deserial_int32);
-PG_FUNCTION_INFO_V1(trimmed_deserial_int64);
 PG_FUNCTION_INFO_V1(trimmed_deserial_numeric);
 
-Datum trimmed_deserial_double(PG_FUNCTION_ARGS);
-Datum trimmed_deserial_int32(PG_FUNCTION_ARGS);
-Datum trimmed_deserial_int64(PG_FUNCTION_ARGS);
 Datum trimmed_deserial_numeric(PG_FUNCTION_ARGS);
 
 /* COMBINE STATE */
 
-PG_FUNCTION_INFO_V1(trimmed_combine_double);
-PG_FUNCTION_INFO_V1(trimmed_combine_int32);
-PG_FUNCTION_INFO_V1(trimmed_combine_int64);
 PG_FUNCTION_INFO_V1(trimmed_combine_numeric);
 
-Datum trimmed_combine_double(PG_FUNCTION_ARGS);
-Datum trimmed_combine_int32(PG_FUNCTION_ARGS);
-Datum trimmed_combine_int64(PG_FUNCTION_ARGS);
 Datum trimmed_combine_numeric(PG_FUNCTION_ARGS);
 
 /* AVERAGE */
 
-PG_FUNCTION_INFO_V1(trimmed_avg_double);
-PG_FUNCTION_INFO_V1(trimmed_avg_int32);
-PG_FUNCTION_INFO_V1(trimmed_avg_int64);
+PG_FUNCTION_INFO_V1(trimmed_avg_timestamp);
+PG_FUNCTION_INFO_V1(trimmed_avg_interval);
 PG_FUNCTION_INFO_V1(trimmed_avg_numeric);
 
-Datum trimmed_avg_double(PG_FUNCTION_ARGS);
-Datum trimmed_avg_int32(PG_FUNCTION_ARGS);
-Datum trimmed_avg_int64(PG_FUNCTION_ARGS);
+Datum trimmed_avg_timestamp(PG_FUNCTION_ARGS);
+Datum trimmed_avg_interval(PG_FUNCTION_ARGS);
 Datum trimmed_avg_numeric(PG_FUNCTION_ARGS);
 
 /* VARIANCE */
 
 /* exact */
-PG_FUNCTION_INFO_V1(trimmed_var_double);
-PG_FUNCTION_INFO_V1(trimmed_var_int32);
-PG_FUNCTION_INFO_V1(trimmed_var_int64);
 PG_FUNCTION_INFO_V1(trimmed_var_numeric);
 
-Datum trimmed_var_double(PG_FUNCTION_ARGS);
-Datum trimmed_var_int32(PG_FUNCTION_ARGS);
-Datum trimmed_var_int64(PG_FUNCTION_ARGS);
 Datum trimmed_var_numeric(PG_FUNCTION_ARGS);
 
 /* population estimate */
-PG_FUNCTION_INFO_V1(trimmed_var_pop_double);
-PG_FUNCTION_INFO_V1(trimmed_var_pop_int32);
-PG_FUNCTION_INFO_V1(trimmed_var_pop_int64);
 PG_FUNCTION_INFO_V1(trimmed_var_pop_numeric);
 
-Datum trimmed_var_pop_double(PG_FUNCTION_ARGS);
-Datum trimmed_var_pop_int32(PG_FUNCTION_ARGS);
-Datum trimmed_var_pop_int64(PG_FUNCTION_ARGS);
 Datum trimmed_var_pop_numeric(PG_FUNCTION_ARGS);
 
 /* sample estimate */
-PG_FUNCTION_INFO_V1(trimmed_var_samp_double);
-PG_FUNCTION_INFO_V1(trimmed_var_samp_int32);
-PG_FUNCTION_INFO_V1(trimmed_var_samp_int64);
 PG_FUNCTION_INFO_V1(trimmed_var_samp_numeric);
 
-Datum trimmed_var_samp_double(PG_FUNCTION_ARGS);
-Datum trimmed_var_samp_int32(PG_FUNCTION_ARGS);
-Datum trimmed_var_samp_int64(PG_FUNCTION_ARGS);
 Datum trimmed_var_samp_numeric(PG_FUNCTION_ARGS);
 
 /* STANDARD DEVIATION */
 
 /* exact */
-PG_FUNCTION_INFO_V1(trimmed_stddev_double);
-PG_FUNCTION_INFO_V1(trimmed_stddev_int32);
-PG_FUNCTION_INFO_V1(trimmed_stddev_int64);
 PG_FUNCTION_INFO_V1(trimmed_stddev_numeric);
 
-Datum trimmed_stddev_double(PG_FUNCTION_ARGS);
-Datum trimmed_stddev_int32(PG_FUNCTION_ARGS);
-Datum trimmed_stddev_int64(PG_FUNCTION_ARGS);
 Datum trimmed_stddev_numeric(PG_FUNCTION_ARGS);
 
 /* population estimate */
-PG_FUNCTION_INFO_V1(trimmed_stddev_pop_double);
-PG_FUNCTION_INFO_V1(trimmed_stddev_pop_int32);
-PG_FUNCTION_INFO_V1(trimmed_stddev_pop_int64);
 PG_FUNCTION_INFO_V1(trimmed_stddev_pop_numeric);
 
-Datum trimmed_stddev_pop_double(PG_FUNCTION_ARGS);
-Datum trimmed_stddev_pop_int32(PG_FUNCTION_ARGS);
-Datum trimmed_stddev_pop_int64(PG_FUNCTION_ARGS);
 Datum trimmed_stddev_pop_numeric(PG_FUNCTION_ARGS);
 
 /* sample estimate */
-PG_FUNCTION_INFO_V1(trimmed_stddev_samp_double);
-PG_FUNCTION_INFO_V1(trimmed_stddev_samp_int32);
-PG_FUNCTION_INFO_V1(trimmed_stddev_samp_int64);
 PG_FUNCTION_INFO_V1(trimmed_stddev_samp_numeric);
 
-Datum trimmed_stddev_samp_double(PG_FUNCTION_ARGS);
-Datum trimmed_stddev_samp_int32(PG_FUNCTION_ARGS);
-Datum trimmed_stddev_samp_int64(PG_FUNCTION_ARGS);
 Datum trimmed_stddev_samp_numeric(PG_FUNCTION_ARGS);
 
 /* AVERAGE */
 
-PG_FUNCTION_INFO_V1(trimmed_double_array);
-PG_FUNCTION_INFO_V1(trimmed_int32_array);
-PG_FUNCTION_INFO_V1(trimmed_int64_array);
 PG_FUNCTION_INFO_V1(trimmed_numeric_array);
 
-Datum trimmed_double_array(PG_FUNCTION_ARGS);
-Datum trimmed_int32_array(PG_FUNCTION_ARGS);
-Datum trimmed_int64_array(PG_FUNCTION_ARGS);
 Datum trimmed_numeric_array(PG_FUNCTION_ARGS);
 
-/* numeric helper */
-static Numeric create_numeric(int value);
-static Numeric add_numeric(Numeric a, Numeric b);
-static Numeric sub_numeric(Numeric a, Numeric b);
-static Numeric div_numeric(Numeric a, Numeric b);
-static Numeric mul_numeric(Numeric a, Numeric b);
-static Numeric pow_numeric(Numeric a, int b);
-static Numeric sqrt_numeric(Numeric a);
+/* MULTIPLE CUT CONFIGURATIONS */
 
+PG_FUNCTION_INFO_V1(trimmed_avg_numeric_multi);
 
-Datum
-trimmed_append_double(PG_FUNCTION_ARGS)
-{
-	state_double *state;
-	MemoryContext aggcontext;
+PG_FUNCTION_INFO_V1(trimmed_var_numeric_multi);
 
-	GET_AGG_CONTEXT("trimmed_append_double", fcinfo, aggcontext);
+PG_FUNCTION_INFO_V1(trimmed_var_pop_numeric_multi);
 
-	/*
-	 * If both arguments are NULL, we can return NULL directly (instead of
-	 * just allocating empty aggregate state even if we don't need it).
-	 */
-	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
-		PG_RETURN_NULL();
+PG_FUNCTION_INFO_V1(trimmed_var_samp_numeric_multi);
 
-	if (PG_ARGISNULL(0))
-	{
-		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
+PG_FUNCTION_INFO_V1(trimmed_stddev_numeric_multi);
 
-		state = (state_double*)palloc(sizeof(state_double));
-		state->elements = (double*)palloc(MIN_ELEMENTS * sizeof(double));
+PG_FUNCTION_INFO_V1(trimmed_stddev_pop_numeric_multi);
 
-		MemoryContextSwitchTo(oldcontext);
+PG_FUNCTION_INFO_V1(trimmed_stddev_samp_numeric_multi);
 
-		state->maxelements = MIN_ELEMENTS;
-		state->nelements = 0;
-		state->sorted = false;
+PG_FUNCTION_INFO_V1(trimmed_numeric_array_multi);
 
-		/* how much to cut */
-		if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
-			elog(ERROR, "both upper and lower cut must not be NULL");
+Datum trimmed_avg_numeric_multi(PG_FUNCTION_ARGS);
 
-		state->cut_lower = PG_GETARG_FLOAT8(2);
-		state->cut_upper = PG_GETARG_FLOAT8(3);
+Datum trimmed_var_numeric_multi(PG_FUNCTION_ARGS);
 
-		if (state->cut_lower < 0.0 || state->cut_lower >= 1.0)
-			elog(ERROR, "lower cut needs to be between 0 and 1 (inclusive)");
+Datum trimmed_var_pop_numeric_multi(PG_FUNCTION_ARGS);
 
-		if (state->cut_upper < 0.0 || state->cut_upper >= 1.0)
-			elog(ERROR, "upper cut needs to be between 0 and 1 (inclusive)");
+Datum trimmed_var_samp_numeric_multi(PG_FUNCTION_ARGS);
 
-		if (state->cut_lower + state->cut_upper >= 1.0)
-			elog(ERROR, "lower and upper cut sum to >= 1.0");
-	}
-	else
-		state = (state_double*)PG_GETARG_POINTER(0);
+Datum trimmed_stddev_numeric_multi(PG_FUNCTION_ARGS);
 
-	if (! PG_ARGISNULL(1))
-	{
-		double element = PG_GETARG_FLOAT8(1);
+Datum trimmed_stddev_pop_numeric_multi(PG_FUNCTION_ARGS);
 
-		if (state->nelements >= state->maxelements)
-		{
-			state->maxelements *= 2;
-			state->elements = (double*)repalloc(state->elements,
-											   sizeof(double) * state->maxelements);
-		}
+Datum trimmed_stddev_samp_numeric_multi(PG_FUNCTION_ARGS);
 
-		state->elements[state->nelements++] = element;
-	}
+Datum trimmed_numeric_array_multi(PG_FUNCTION_ARGS);
 
-	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
+static Datum trimmed_multi_numeric(state_numeric *state, int stat);
+static Datum trimmed_stat_numeric(FunctionCallInfo fcinfo, state_numeric *state,
+								  int stat);
 
-	PG_RETURN_POINTER(state);
-}
+/* parameters */
+static void parse_params(FunctionCallInfo fcinfo, MemoryContext aggcontext,
+						 double *cut_lower, double *cut_upper,
+						 trimmed_params **params);
+static void check_cuts(double cut_lower, double cut_upper);
+static int	parse_stat(const char *name);
 
-Datum
-trimmed_append_int32(PG_FUNCTION_ARGS)
-{
-	state_int32 *state;
-	MemoryContext aggcontext;
+/* serialized format */
+static void serialize_header(StringInfo buf, double cut_lower, double cut_upper,
+							 int sample_shift, int nelements);
+static void deserialize_header(StringInfo buf, bytea *state,
+							   double *cut_lower, double *cut_upper,
+							   int *sample_shift, int *nelements, int width);
+static void serialize_params(StringInfo buf, trimmed_params *params);
+static trimmed_params *deserialize_params(StringInfo buf);
 
-	GET_AGG_CONTEXT("trimmed_append_int32", fcinfo, aggcontext);
+/* multiple cut configurations */
+static int	multi_configs(trimmed_params *params);
+static int *multi_stats(trimmed_params *params, int *stat, int *nstats,
+						bool *need_x2, bool *need_dev2);
+static void multi_bounds(int nelements, double cut_lower, double cut_upper,
+						 trimmed_params *params, int *bounds, int *order);
+static void sort_indexes(int *indexes, int nindexes, int *order);
+static double multi_stat(int stat, int64 cnt, double sum_x, double sum_x2,
+						 double sum_dev2);
+static Numeric multi_stat_numeric(int stat, int cnt, Numeric sum_x,
+								  Numeric numerator, Numeric sum_dev2);
+static Datum multi_to_array(Datum *values, bool *nulls, trimmed_params *params,
+							int nconfigs, int nstats, Oid typid);
 
-	/*
-	 * If both arguments are NULL, we can return NULL directly (instead of
-	 * just allocating empty aggregate state even if we don't need it).
-	 */
-	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
-		PG_RETURN_NULL();
+/* QUANTILES */
 
-	if (PG_ARGISNULL(0))
-	{
-		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
+PG_FUNCTION_INFO_V1(trimmed_quantiles_numeric);
 
-		state = (state_int32*)palloc(sizeof(state_int32));
-		state->elements = (int32*)palloc(MIN_ELEMENTS * sizeof(int32));
+Datum trimmed_quantiles_numeric(PG_FUNCTION_ARGS);
 
-		MemoryContextSwitchTo(oldcontext);
+static double stat_quantile(int stat);
+static void quantiles_numeric(char *ptr, int cnt, double *quantiles,
+							  int nquantiles, Datum *result);
+static Numeric interpolate_numeric(Numeric lo, Numeric hi, double frac);
 
-		state->maxelements = MIN_ELEMENTS;
-		state->nelements = 0;
-		state->sorted = false;
+/* TRIMMING BY A KEY */
 
-		/* how much to cut */
-		if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
-			elog(ERROR, "both upper and lower cut must not be NULL");
+/* pseudo-statistic, the sum of the kept payloads (only for keyed aggregates) */
+#define KEYED_SUM			(-2)
 
-		state->cut_lower = PG_GETARG_FLOAT8(2);
-		state->cut_upper = PG_GETARG_FLOAT8(3);
+PG_FUNCTION_INFO_V1(trimmed_append_keyed);
+PG_FUNCTION_INFO_V1(trimmed_append_keyed_array);
+PG_FUNCTION_INFO_V1(trimmed_serial_keyed);
+PG_FUNCTION_INFO_V1(trimmed_deserial_keyed);
+PG_FUNCTION_INFO_V1(trimmed_combine_keyed);
 
-		if (state->cut_lower < 0.0 || state->cut_lower >= 1.0)
-			elog(ERROR, "lower cut needs to be between 0 and 1 (inclusive)");
+PG_FUNCTION_INFO_V1(trimmed_keyed_sum);
+PG_FUNCTION_INFO_V1(trimmed_keyed_avg);
+PG_FUNCTION_INFO_V1(trimmed_keyed_var);
+PG_FUNCTION_INFO_V1(trimmed_keyed_var_pop);
+PG_FUNCTION_INFO_V1(trimmed_keyed_var_samp);
+PG_FUNCTION_INFO_V1(trimmed_keyed_stddev);
+PG_FUNCTION_INFO_V1(trimmed_keyed_stddev_pop);
+PG_FUNCTION_INFO_V1(trimmed_keyed_stddev_samp);
+PG_FUNCTION_INFO_V1(trimmed_keyed_array);
 
-		if (state->cut_upper < 0.0 || state->cut_upper >= 1.0)
-			elog(ERROR, "upper cut needs to be between 0 and 1 (inclusive)");
+Datum trimmed_append_keyed(PG_FUNCTION_ARGS);
+Datum trimmed_append_keyed_array(PG_FUNCTION_ARGS);
+Datum trimmed_serial_keyed(PG_FUNCTION_ARGS);
+Datum trimmed_deserial_keyed(PG_FUNCTION_ARGS);
+Datum trimmed_combine_keyed(PG_FUNCTION_ARGS);
 
-		if (state->cut_lower + state->cut_upper >= 1.0)
-			elog(ERROR, "lower and upper cut sum to >= 1.0");
-	}
-	else
-		state = (state_int32*)PG_GETARG_POINTER(0);
+Datum trimmed_keyed_sum(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_avg(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_var(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_var_pop(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_var_samp(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_stddev(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_stddev_pop(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_stddev_samp(PG_FUNCTION_ARGS);
+Datum trimmed_keyed_array(PG_FUNCTION_ARGS);
 
-	if (! PG_ARGISNULL(1))
-	{
-		int32 element = PG_GETARG_INT32(1);
+static Datum trimmed_keyed(FunctionCallInfo fcinfo, int stat);
+static void sort_state_keyed(state_keyed *state);
 
-		if (state->nelements >= state->maxelements)
-		{
-			state->maxelements *= 2;
-			state->elements = (int32*)repalloc(state->elements,
-											  sizeof(int32) * state->maxelements);
-		}
+/* WINSORIZED STATISTICS (the fixed-width types are in trimmed_template.h) */
 
-		state->elements[state->nelements++] = element;
-	}
+PG_FUNCTION_INFO_V1(winsorized_avg_numeric);
+PG_FUNCTION_INFO_V1(winsorized_var_numeric);
+PG_FUNCTION_INFO_V1(winsorized_var_pop_numeric);
+PG_FUNCTION_INFO_V1(winsorized_var_samp_numeric);
+PG_FUNCTION_INFO_V1(winsorized_stddev_numeric);
+PG_FUNCTION_INFO_V1(winsorized_stddev_pop_numeric);
+PG_FUNCTION_INFO_V1(winsorized_stddev_samp_numeric);
+PG_FUNCTION_INFO_V1(winsorized_numeric_array);
 
-	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
+Datum winsorized_avg_numeric(PG_FUNCTION_ARGS);
+Datum winsorized_var_numeric(PG_FUNCTION_ARGS);
+Datum winsorized_var_pop_numeric(PG_FUNCTION_ARGS);
+Datum winsorized_var_samp_numeric(PG_FUNCTION_ARGS);
+Datum winsorized_stddev_numeric(PG_FUNCTION_ARGS);
+Datum winsorized_stddev_pop_numeric(PG_FUNCTION_ARGS);
+Datum winsorized_stddev_samp_numeric(PG_FUNCTION_ARGS);
+Datum winsorized_numeric_array(PG_FUNCTION_ARGS);
 
-	PG_RETURN_POINTER(state);
-}
+static Datum winsorized_numeric(FunctionCallInfo fcinfo, int stat);
 
-Datum
-trimmed_append_int64(PG_FUNCTION_ARGS)
-{
-	state_int64 *state;
-	MemoryContext aggcontext;
+/* KEPT VALUES (the fixed-width types are in trimmed_template.h) */
 
-	GET_AGG_CONTEXT("trimmed_append_int64", fcinfo, aggcontext);
+PG_FUNCTION_INFO_V1(trimmed_values_numeric);
 
-	/*
-	 * If both arguments are NULL, we can return NULL directly (instead of
-	 * just allocating empty aggregate state even if we don't need it).
-	 */
-	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
-		PG_RETURN_NULL();
+Datum trimmed_values_numeric(PG_FUNCTION_ARGS);
 
-	if (PG_ARGISNULL(0))
-	{
-		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
+/* CONFIDENCE INTERVALS (the fixed-width types are in trimmed_template.h) */
 
-		state = (state_int64*)palloc(sizeof(state_int64));
-		state->elements = (int64*)palloc(MIN_ELEMENTS * sizeof(int64));
+/* the resamples use a fixed seed, so the intervals are reproducible */
+#define BOOTSTRAP_SEED		UINT64CONST(0x5DEECE66D)
 
-		MemoryContextSwitchTo(oldcontext);
+static double normal_quantile(double p);
+static double incomplete_beta(double a, double b, double x);
+static double student_t_quantile(double p, double df);
+static Datum bootstrap_interval(FunctionCallInfo fcinfo, double *means,
+								int nresamples, double confidence);
 
-		state->maxelements = MIN_ELEMENTS;
-		state->nelements = 0;
-		state->sorted = false;
+/* state serialization and combining (shared with the trimmed_state types) */
+static bytea *serialize_numeric(state_numeric *state);
 
-		/* how much to cut */
-		if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
-			elog(ERROR, "both upper and lower cut must not be NULL");
+static state_numeric *deserialize_numeric(bytea *state, MemoryContext context);
 
-		state->cut_lower = PG_GETARG_FLOAT8(2);
-		state->cut_upper = PG_GETARG_FLOAT8(3);
+static state_numeric *combine_numeric(state_numeric *state1, state_numeric *state2,
+							MemoryContext agg_context);
 
-		if (state->cut_lower < 0.0 || state->cut_lower >= 1.0)
-			elog(ERROR, "lower cut needs to be between 0 and 1 (inclusive)");
+/* PERSISTENT STATE (trimmed_state types) */
 
-		if (state->cut_upper < 0.0 || state->cut_upper >= 1.0)
-			elog(ERROR, "upper cut needs to be between 0 and 1 (inclusive)");
+PG_FUNCTION_INFO_V1(trimmed_state_numeric_in);
+PG_FUNCTION_INFO_V1(trimmed_state_numeric_out);
+PG_FUNCTION_INFO_V1(trimmed_state_numeric_recv);
+PG_FUNCTION_INFO_V1(trimmed_state_numeric_send);
 
-		if (state->cut_lower + state->cut_upper >= 1.0)
-			elog(ERROR, "lower and upper cut sum to >= 1.0");
-	}
-	else
-		state = (state_int64*)PG_GETARG_POINTER(0);
+PG_FUNCTION_INFO_V1(trimmed_state_final_numeric);
 
-	if (! PG_ARGISNULL(1))
-	{
-		int64 element = PG_GETARG_INT64(1);
+PG_FUNCTION_INFO_V1(trimmed_merge_numeric);
 
-		if (state->nelements >= state->maxelements)
-		{
-			state->maxelements *= 2;
-			state->elements = (int64*)repalloc(state->elements,
-											  sizeof(int64) * state->maxelements);
-		}
+PG_FUNCTION_INFO_V1(trimmed_state_avg_numeric);
 
-		state->elements[state->nelements++] = element;
-	}
+PG_FUNCTION_INFO_V1(trimmed_state_var_numeric);
 
-	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
+PG_FUNCTION_INFO_V1(trimmed_state_var_pop_numeric);
 
-	PG_RETURN_POINTER(state);
-}
+PG_FUNCTION_INFO_V1(trimmed_state_var_samp_numeric);
 
-Datum
-trimmed_append_numeric(PG_FUNCTION_ARGS)
-{
-	state_numeric *state;
-	MemoryContext aggcontext;
+PG_FUNCTION_INFO_V1(trimmed_state_stddev_numeric);
 
-	GET_AGG_CONTEXT("trimmed_append_numeric", fcinfo, aggcontext);
+PG_FUNCTION_INFO_V1(trimmed_state_stddev_pop_numeric);
 
-	/*
-	 * If both arguments are NULL, we can return NULL directly (instead of
-	 * just allocating empty aggregate state even if we don't need it).
-	 */
-	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
-		PG_RETURN_NULL();
+PG_FUNCTION_INFO_V1(trimmed_state_stddev_samp_numeric);
 
-	if (PG_ARGISNULL(0))
-	{
-		state = (state_numeric*)MemoryContextAlloc(aggcontext,
-												   sizeof(state_numeric));
+PG_FUNCTION_INFO_V1(trimmed_state_numeric_array);
 
-		state->nelements = 0;
-		state->data = NULL;
-		state->usedlen = 0;
-		state->maxlen = 32;	/* TODO make this a constant */
-		state->sorted = false;
+Datum trimmed_state_numeric_in(PG_FUNCTION_ARGS);
+Datum trimmed_state_numeric_out(PG_FUNCTION_ARGS);
+Datum trimmed_state_numeric_recv(PG_FUNCTION_ARGS);
+Datum trimmed_state_numeric_send(PG_FUNCTION_ARGS);
 
-		/* how much to cut */
-		if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
-			elog(ERROR, "both upper and lower cut must not be NULL");
+Datum trimmed_state_final_numeric(PG_FUNCTION_ARGS);
 
-		state->cut_lower = PG_GETARG_FLOAT8(2);
-		state->cut_upper = PG_GETARG_FLOAT8(3);
+Datum trimmed_merge_numeric(PG_FUNCTION_ARGS);
 
-		if (state->cut_lower < 0.0 || state->cut_lower >= 1.0)
-			elog(ERROR, "lower cut needs to be between 0 and 1 (inclusive)");
+Datum trimmed_state_avg_numeric(PG_FUNCTION_ARGS);
 
-		if (state->cut_upper < 0.0 || state->cut_upper >= 1.0)
-			elog(ERROR, "upper cut needs to be between 0 and 1 (inclusive)");
+Datum trimmed_state_var_numeric(PG_FUNCTION_ARGS);
 
-		if (state->cut_lower + state->cut_upper >= 1.0)
-			elog(ERROR, "lower and upper cut sum to >= 1.0");
-	}
-	else
-		state = (state_numeric*)PG_GETARG_POINTER(0);
+Datum trimmed_state_var_pop_numeric(PG_FUNCTION_ARGS);
 
-	if (! PG_ARGISNULL(1))
-	{
-		Numeric element = PG_GETARG_NUMERIC(1);
+Datum trimmed_state_var_samp_numeric(PG_FUNCTION_ARGS);
 
-		int len = VARSIZE(element);
+Datum trimmed_state_stddev_numeric(PG_FUNCTION_ARGS);
 
-		/* if there's not enough space in the data buffer, repalloc it */
-		if (state->usedlen + len > state->maxlen)
-		{
-			while (len + state->usedlen > state->maxlen)
-				state->maxlen *= 2;
+Datum trimmed_state_stddev_pop_numeric(PG_FUNCTION_ARGS);
 
-			if (state->data != NULL)
-				state->data = repalloc(state->data, state->maxlen);
-		}
+Datum trimmed_state_stddev_samp_numeric(PG_FUNCTION_ARGS);
 
-		/* if first entry, we need to allocate the buffer */
-		if (! state->data)
-			state->data = MemoryContextAlloc(aggcontext, state->maxlen);
+Datum trimmed_state_numeric_array(PG_FUNCTION_ARGS);
 
-		/* copy the contents of the Numeric in place */
-		memcpy(state->data + state->usedlen, element, len);
+static Datum trimmed_state_numeric(FunctionCallInfo fcinfo, int stat);
+static state_numeric *build_state_numeric(Datum *values, int nvalues,
+										 double cut_lower, double cut_upper,
+										 int sample_shift);
+static char *parse_state_cuts(char *str, double *cut_lower, double *cut_upper,
+							  int *sample_shift);
+static char *sample_rate_str(int sample_shift);
+static Datum first_element(Datum array, Oid typid, bool *isnull);
 
-		state->usedlen += len;
-		state->nelements += 1;
-	}
+/* RUNTIME COUNTERS */
 
-	Assert(state->usedlen <= state->maxlen);
-	Assert((!state->usedlen && !state->data) || (state->usedlen && state->data));
+PG_FUNCTION_INFO_V1(trimmed_counters);
+PG_FUNCTION_INFO_V1(trimmed_counters_reset);
+PG_FUNCTION_INFO_V1(trimmed_counters_reset_shared);
 
-	PG_RETURN_POINTER(state);
-}
+Datum trimmed_counters(PG_FUNCTION_ARGS);
+Datum trimmed_counters_reset(PG_FUNCTION_ARGS);
+Datum trimmed_counters_reset_shared(PG_FUNCTION_ARGS);
 
-Datum
-trimmed_serial_double(PG_FUNCTION_ARGS)
-{
-	state_double   *state = (state_double *)PG_GETARG_POINTER(0);
-	Size			hlen = offsetof(state_double, elements);	/* header */
-	Size			len = state->nelements * sizeof(double);		/* elements */
-	bytea		   *out = (bytea *)palloc(VARHDRSZ + len + hlen);
-	char		   *ptr;
+static void counters_flush(void);
 
-	CHECK_AGG_CONTEXT("trimmed_serial_double", fcinfo);
+/* PROGRESS */
 
-	/* we want to serialize the data in sorted format */
-	sort_state_double(state);
+PG_FUNCTION_INFO_V1(trimmed_progress);
 
-	SET_VARSIZE(out, VARHDRSZ + len + hlen);
-	ptr = VARDATA(out);
+Datum trimmed_progress(PG_FUNCTION_ARGS);
 
-	memcpy(ptr, state, offsetof(state_double, elements));
-	ptr += offsetof(state_double, elements);
+/* BENCHMARK */
 
-	memcpy(ptr, state->elements, len);
+PG_FUNCTION_INFO_V1(trimmed_benchmark);
 
-	PG_RETURN_BYTEA_P(out);
-}
+Datum trimmed_benchmark(PG_FUNCTION_ARGS);
 
-Datum
-trimmed_serial_int32(PG_FUNCTION_ARGS)
-{
-	state_int32	   *state = (state_int32 *)PG_GETARG_POINTER(0);
-	Size			hlen = offsetof(state_int32, elements);		/* header */
-	Size			len = state->nelements * sizeof(int32);		/* elements */
-	bytea		   *out = (bytea *)palloc(VARHDRSZ + len + hlen);
-	char		   *ptr;
+/* SHARED CACHE */
 
-	CHECK_AGG_CONTEXT("trimmed_serial_int32", fcinfo);
+void _PG_init(void);
 
-	/* we want to serialize the data in sorted format */
-	sort_state_int32(state);
+PG_FUNCTION_INFO_V1(trimmed_cache_invalidate);
+PG_FUNCTION_INFO_V1(trimmed_cache_reset);
 
-	SET_VARSIZE(out, VARHDRSZ + len + hlen);
-	ptr = VARDATA(out);
+PG_FUNCTION_INFO_V1(trimmed_cached_state_double);
+PG_FUNCTION_INFO_V1(trimmed_cached_state_int32);
+PG_FUNCTION_INFO_V1(trimmed_cached_state_int64);
+PG_FUNCTION_INFO_V1(trimmed_cached_state_numeric);
 
-	memcpy(ptr, state, offsetof(state_int32, elements));
-	ptr += offsetof(state_int32, elements);
+Datum trimmed_cache_invalidate(PG_FUNCTION_ARGS);
+Datum trimmed_cache_reset(PG_FUNCTION_ARGS);
 
-	memcpy(ptr, state->elements, len);
+Datum trimmed_cached_state_double(PG_FUNCTION_ARGS);
+Datum trimmed_cached_state_int32(PG_FUNCTION_ARGS);
+Datum trimmed_cached_state_int64(PG_FUNCTION_ARGS);
+Datum trimmed_cached_state_numeric(PG_FUNCTION_ARGS);
 
-	PG_RETURN_BYTEA_P(out);
-}
+static Datum trimmed_cached_state(FunctionCallInfo fcinfo, const char *typname);
+static void cache_xact_callback(XactEvent event, void *arg);
 
-Datum
-trimmed_serial_int64(PG_FUNCTION_ARGS)
-{
-	state_int64	   *state = (state_int64 *)PG_GETARG_POINTER(0);
-	Size			hlen = offsetof(state_int64, elements);		/* header */
-	Size			len = state->nelements * sizeof(int64);		/* elements */
-	bytea		   *out = (bytea *)palloc(VARHDRSZ + len + hlen);
-	char		   *ptr;
+/* BACKGROUND WORKER */
 
-	CHECK_AGG_CONTEXT("trimmed_serial_int64", fcinfo);
+PG_FUNCTION_INFO_V1(trimmed_worker_start);
 
-	/* we want to serialize the data in sorted format */
-	sort_state_int64(state);
+Datum trimmed_worker_start(PG_FUNCTION_ARGS);
 
-	SET_VARSIZE(out, VARHDRSZ + len + hlen);
-	ptr = VARDATA(out);
+PGDLLEXPORT void trimmed_worker_main(Datum main_arg);
 
-	memcpy(ptr, state, offsetof(state_int64, elements));
-	ptr += offsetof(state_int64, elements);
+#if PG_VERSION_NUM >= 130000
+static void worker_init(BackgroundWorker *worker, Oid dbid);
+static void worker_refresh(void);
+static bool worker_lock(void);
+static int	worker_pid(void);
+#endif
 
-	memcpy(ptr, state->elements, len);
+#if PG_VERSION_NUM >= 150000
+static void cache_shmem_request(void);
+static void cache_shmem_startup(void);
+static void cache_relcache_callback(Datum arg, Oid relid);
+#endif
 
-	PG_RETURN_BYTEA_P(out);
-}
+/* numeric helper */
+static Numeric create_numeric(int value);
+static Numeric float_to_numeric(double value);
+static Numeric add_numeric(Numeric a, Numeric b);
+static Numeric sub_numeric(Numeric a, Numeric b);
+static Numeric div_numeric(Numeric a, Numeric b);
+static Numeric mul_numeric(Numeric a, Numeric b);
+static Numeric sqrt_numeric(Numeric a);
+static Numeric round_numeric(Numeric a, int scale);
+static int	scale_numeric(Numeric a);
 
-Datum
-trimmed_serial_numeric(PG_FUNCTION_ARGS)
+/*
+ * RUNTIME COUNTERS
+ *
+ * To see where the time goes (accumulating the values, sorting, merging the
+ * runs collected by the combine functions, serialization) and how large the
+ * states get, each backend counts the work done by the aggregates. The
+ * counters are returned by trimmed_counters(), and may be reset by
+ * trimmed_counters_reset().
+ *
+ * When the library is loaded through shared_preload_libraries (on
+ * PostgreSQL 15 or newer), the counters are also added to counters in
+ * shared memory at the end of each transaction (including the transactions
+ * of parallel workers), so the work of all backends may be seen at once.
+ */
+
+typedef struct trimmed_timing
 {
-	state_numeric *state = (state_numeric *)PG_GETARG_POINTER(0);
-	Size	hlen = offsetof(state_numeric, data);		/* header */
-	Size	len = state->usedlen;						/* elements */
-	bytea  *out;
-	char   *ptr;
+	int64		count;			/* number of operations */
+	instr_time	time;			/* total duration */
+} trimmed_timing;
 
-	CHECK_AGG_CONTEXT("trimmed_serial_numeric", fcinfo);
+typedef struct trimmed_counters_data
+{
+	int64		appended;		/* values passed to the aggregates */
+	int64		allocated;		/* bytes allocated for the values */
+	int64		peak_state;		/* size of the largest state (bytes) */
+	trimmed_timing sorts;		/* sorting unsorted values */
+	trimmed_timing merges;		/* merging runs collected by combine */
+	int64		combines;		/* states combined */
+	int64		serialized;		/* bytes of serialized states */
+	int64		deserialized;	/* bytes of deserialized states */
+} trimmed_counters_data;
+
+/* columns returned by trimmed_counters() */
+#define COUNTERS_COLUMNS	11
+
+/* counters of this backend, and the part already added to shared memory */
+static trimmed_counters_data counters;
+static trimmed_counters_data counters_flushed;
+
+#if PG_VERSION_NUM >= 150000
+
+/* counters of all backends (the times are in microseconds) */
+typedef struct counters_shared
+{
+	pg_atomic_uint64 appended;
+	pg_atomic_uint64 allocated;
+	pg_atomic_uint64 peak_state;
+	pg_atomic_uint64 sorts;
+	pg_atomic_uint64 sort_time;
+	pg_atomic_uint64 merges;
+	pg_atomic_uint64 merge_time;
+	pg_atomic_uint64 combines;
+	pg_atomic_uint64 serialized;
+	pg_atomic_uint64 deserialized;
+} counters_shared;
+
+static counters_shared *shared_counters = NULL;
 
-	out = (bytea *)palloc(VARHDRSZ + len + hlen);
-	SET_VARSIZE(out, VARHDRSZ + len + hlen);
-	ptr = (char*) VARDATA(out);
+#endif
 
-	/* we want to serialize the data in sorted format */
-	sort_state_numeric(state);
+/* add the duration of an operation started at 'start' */
+static inline void
+counters_timing(trimmed_timing *timing, instr_time start)
+{
+	instr_time	duration;
 
-	/* now copy as a single chunk */
-	memcpy(ptr, state, offsetof(state_numeric, data));
-	ptr += offsetof(state_numeric, data);
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	INSTR_TIME_ADD(timing->time, duration);
 
-	memcpy(ptr, state->data, state->usedlen);
-	ptr += state->usedlen;
+	timing->count++;
+}
 
-	/* we better get exactly the expected amount of data */
-	Assert((char*)VARDATA(out) + len + hlen == ptr);
+#if PG_VERSION_NUM >= 150000
 
-	PG_RETURN_BYTEA_P(out);
+static void
+counters_shmem_init(counters_shared *shared)
+{
+	pg_atomic_init_u64(&shared->appended, 0);
+	pg_atomic_init_u64(&shared->allocated, 0);
+	pg_atomic_init_u64(&shared->peak_state, 0);
+	pg_atomic_init_u64(&shared->sorts, 0);
+	pg_atomic_init_u64(&shared->sort_time, 0);
+	pg_atomic_init_u64(&shared->merges, 0);
+	pg_atomic_init_u64(&shared->merge_time, 0);
+	pg_atomic_init_u64(&shared->combines, 0);
+	pg_atomic_init_u64(&shared->serialized, 0);
+	pg_atomic_init_u64(&shared->deserialized, 0);
 }
 
-Datum
-trimmed_deserial_double(PG_FUNCTION_ARGS)
+/* microseconds added to the timing since the last flush */
+static uint64
+counters_flush_time(instr_time time, instr_time flushed)
 {
-	state_double *out = (state_double *)palloc(sizeof(state_double));
-	bytea  *state = (bytea *)PG_GETARG_POINTER(0);
-	Size	len PG_USED_FOR_ASSERTS_ONLY = VARSIZE_ANY_EXHDR(state);
-	char   *ptr = VARDATA(state);
-
-	CHECK_AGG_CONTEXT("trimmed_deserial_double", fcinfo);
+	INSTR_TIME_SUBTRACT(time, flushed);
 
-	Assert(len > 0);
-	Assert((len - offsetof(state_double, elements)) % sizeof(double) == 0);
+	return (uint64) INSTR_TIME_GET_MICROSEC(time);
+}
 
-	/* copy the header */
-	memcpy(out, ptr, offsetof(state_double, elements));
-	ptr += offsetof(state_double, elements);
+#endif
 
-	Assert((out->nelements > 0) && (out->maxelements >= out->nelements));
-	Assert(len == offsetof(state_double, elements) + out->nelements * sizeof(double));
-	Assert(out->sorted);
+/*
+ * Add the counters incremented since the last flush to the shared counters
+ * (called at the end of a transaction).
+ */
+static void
+counters_flush(void)
+{
+#if PG_VERSION_NUM >= 150000
+	uint64		peak;
 
-	/* we only allocate the necessary space */
-	out->elements = (double *)palloc(out->nelements * sizeof(double));
-	out->maxelements = out->nelements;
+	if (shared_counters == NULL)
+		return;
 
-	memcpy((void *)out->elements, ptr, out->nelements * sizeof(double));
+	/* nothing new since the last flush (the structs have no padding) */
+	if (memcmp(&counters, &counters_flushed, sizeof(trimmed_counters_data)) == 0)
+		return;
 
-	PG_RETURN_POINTER(out);
+	pg_atomic_fetch_add_u64(&shared_counters->appended,
+							counters.appended - counters_flushed.appended);
+	pg_atomic_fetch_add_u64(&shared_counters->allocated,
+							counters.allocated - counters_flushed.allocated);
+	pg_atomic_fetch_add_u64(&shared_counters->sorts,
+							counters.sorts.count - counters_flushed.sorts.count);
+	pg_atomic_fetch_add_u64(&shared_counters->sort_time,
+							counters_flush_time(counters.sorts.time,
+												counters_flushed.sorts.time));
+	pg_atomic_fetch_add_u64(&shared_counters->merges,
+							counters.merges.count - counters_flushed.merges.count);
+	pg_atomic_fetch_add_u64(&shared_counters->merge_time,
+							counters_flush_time(counters.merges.time,
+												counters_flushed.merges.time));
+	pg_atomic_fetch_add_u64(&shared_counters->combines,
+							counters.combines - counters_flushed.combines);
+	pg_atomic_fetch_add_u64(&shared_counters->serialized,
+							counters.serialized - counters_flushed.serialized);
+	pg_atomic_fetch_add_u64(&shared_counters->deserialized,
+							counters.deserialized - counters_flushed.deserialized);
+
+	/* the peak is a maximum, not a sum */
+	peak = pg_atomic_read_u64(&shared_counters->peak_state);
+	while ((peak < (uint64) counters.peak_state) &&
+		   !pg_atomic_compare_exchange_u64(&shared_counters->peak_state, &peak,
+										   (uint64) counters.peak_state))
+		;
+
+	counters_flushed = counters;
+#endif
 }
 
+/*
+ * Return the counters of the current backend, and the shared counters (if
+ * available) as a second row.
+ */
 Datum
-trimmed_deserial_int32(PG_FUNCTION_ARGS)
+trimmed_counters(PG_FUNCTION_ARGS)
 {
-	state_int32 *out = (state_int32 *)palloc(sizeof(state_int32));
-	bytea  *state = (bytea *)PG_GETARG_POINTER(0);
-	Size	len PG_USED_FOR_ASSERTS_ONLY = VARSIZE_ANY_EXHDR(state);
-	char   *ptr = VARDATA(state);
-
-	CHECK_AGG_CONTEXT("trimmed_deserial_int32", fcinfo);
-
-	Assert(len > 0);
-	Assert((len - offsetof(state_int32, elements)) % sizeof(int32) == 0);
-
-	/* copy the header */
-	memcpy(out, ptr, offsetof(state_int32, elements));
-	ptr += offsetof(state_int32, elements);
-
-	Assert((out->nelements > 0) && (out->maxelements >= out->nelements));
-	Assert(len == offsetof(state_int32, elements) + out->nelements * sizeof(int32));
-	Assert(out->sorted);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	Datum		values[COUNTERS_COLUMNS];
+	bool		nulls[COUNTERS_COLUMNS];
 
-	/* we only allocate the necessary space */
-	out->elements = (int32 *)palloc(out->nelements * sizeof(int32));
-	out->maxelements = out->nelements;
+	if ((rsinfo == NULL) || !IsA(rsinfo, ReturnSetInfo) ||
+		!(rsinfo->allowedModes & SFRM_Materialize))
+		elog(ERROR, "set-valued function called in context that cannot accept a set");
 
-	memcpy((void *)out->elements, ptr, out->nelements * sizeof(int32));
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
 
-	PG_RETURN_POINTER(out);
-}
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
 
-Datum
-trimmed_deserial_int64(PG_FUNCTION_ARGS)
-{
-	state_int64 *out = (state_int64 *)palloc(sizeof(state_int64));
-	bytea  *state = (bytea *) PG_GETARG_POINTER(0);
-	Size	len PG_USED_FOR_ASSERTS_ONLY = VARSIZE_ANY_EXHDR(state);
-	char   *ptr = VARDATA(state);
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
 
-	CHECK_AGG_CONTEXT("trimmed_deserial_int64", fcinfo);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
 
-	Assert(len > 0);
-	Assert((len - offsetof(state_int64, elements)) % sizeof(int32) == 0);
+	MemoryContextSwitchTo(oldcontext);
 
-	/* copy the header */
-	memcpy(out, ptr, offsetof(state_int64, elements));
-	ptr += offsetof(state_int64, elements);
+	memset(nulls, 0, sizeof(nulls));
 
-	Assert((out->nelements > 0) && (out->maxelements >= out->nelements));
-	Assert(len == offsetof(state_int64, elements) + out->nelements * sizeof(int64));
-	Assert(out->sorted);
+	values[0] = CStringGetTextDatum("backend");
+	values[1] = Int64GetDatum(counters.appended);
+	values[2] = Int64GetDatum(counters.allocated);
+	values[3] = Int64GetDatum(counters.peak_state);
+	values[4] = Int64GetDatum(counters.sorts.count);
+	values[5] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(counters.sorts.time));
+	values[6] = Int64GetDatum(counters.merges.count);
+	values[7] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(counters.merges.time));
+	values[8] = Int64GetDatum(counters.combines);
+	values[9] = Int64GetDatum(counters.serialized);
+	values[10] = Int64GetDatum(counters.deserialized);
 
-	/* we only allocate the necessary space */
-	out->elements = (int64 *)palloc(out->nelements * sizeof(int64));
-	out->maxelements = out->nelements;
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 
-	memcpy((void *)out->elements, ptr, out->nelements * sizeof(int64));
+#if PG_VERSION_NUM >= 150000
+	if (shared_counters != NULL)
+	{
+		values[0] = CStringGetTextDatum("shared");
+		values[1] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->appended));
+		values[2] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->allocated));
+		values[3] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->peak_state));
+		values[4] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->sorts));
+		values[5] = Float8GetDatum(pg_atomic_read_u64(&shared_counters->sort_time) / 1000.0);
+		values[6] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->merges));
+		values[7] = Float8GetDatum(pg_atomic_read_u64(&shared_counters->merge_time) / 1000.0);
+		values[8] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->combines));
+		values[9] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->serialized));
+		values[10] = Int64GetDatum(pg_atomic_read_u64(&shared_counters->deserialized));
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+#endif
 
-	PG_RETURN_POINTER(out);
+	return (Datum) 0;
 }
 
+/*
+ * Reset the counters of the current backend (the work done so far is still
+ * added to the shared counters).
+ */
 Datum
-trimmed_deserial_numeric(PG_FUNCTION_ARGS)
+trimmed_counters_reset(PG_FUNCTION_ARGS)
 {
-	state_numeric *out = (state_numeric *)palloc(sizeof(state_numeric));
-	bytea  *state = (bytea *)PG_GETARG_POINTER(0);
-	Size	len = VARSIZE_ANY_EXHDR(state);
-	char   *ptr = VARDATA(state);
-
-	CHECK_AGG_CONTEXT("trimmed_deserial_numeric", fcinfo);
-
-	Assert(len > 0);
-
-	/* first read the struct header, stored at the beginning */
-	memcpy(out, ptr, offsetof(state_numeric, data));
-	ptr += offsetof(state_numeric, data);
-
-	/* we don't serialize empty groups (we keep the state NULL) */
-	Assert((out->nelements > 0) && (out->usedlen > 0));
-	Assert(out->usedlen <= out->maxlen);
-	Assert(out->usedlen == (len - offsetof(state_numeric, data)));
-	Assert(out->sorted);
+	counters_flush();
 
-	/* fist copy the Numeric values into the buffer */
-	out->data = palloc(len - offsetof(state_numeric, data));
-	memcpy(out->data, ptr, len - offsetof(state_numeric, data));
+	memset(&counters, 0, sizeof(trimmed_counters_data));
+	memset(&counters_flushed, 0, sizeof(trimmed_counters_data));
 
-	PG_RETURN_POINTER(out);
+	PG_RETURN_VOID();
 }
 
+/*
+ * Reset the shared counters (the counters of the backends are not reset).
+ */
 Datum
-trimmed_combine_double(PG_FUNCTION_ARGS)
+trimmed_counters_reset_shared(PG_FUNCTION_ARGS)
 {
-	int i, j, k;
-	double *tmp;
-	state_double *state1;
-	state_double *state2;
-	MemoryContext agg_context;
-	MemoryContext old_context;
-
-	GET_AGG_CONTEXT("trimmed_combine_double", fcinfo, agg_context);
-
-	state1 = PG_ARGISNULL(0) ? NULL : (state_double *) PG_GETARG_POINTER(0);
-	state2 = PG_ARGISNULL(1) ? NULL : (state_double *) PG_GETARG_POINTER(1);
-
-	if (state2 == NULL)
-		PG_RETURN_POINTER(state1);
-
-	if (state1 == NULL)
+#if PG_VERSION_NUM >= 150000
+	if (shared_counters != NULL)
 	{
-		old_context = MemoryContextSwitchTo(agg_context);
+		/* don't add the work done before the reset later */
+		counters_flush();
+
+		pg_atomic_write_u64(&shared_counters->appended, 0);
+		pg_atomic_write_u64(&shared_counters->allocated, 0);
+		pg_atomic_write_u64(&shared_counters->peak_state, 0);
+		pg_atomic_write_u64(&shared_counters->sorts, 0);
+		pg_atomic_write_u64(&shared_counters->sort_time, 0);
+		pg_atomic_write_u64(&shared_counters->merges, 0);
+		pg_atomic_write_u64(&shared_counters->merge_time, 0);
+		pg_atomic_write_u64(&shared_counters->combines, 0);
+		pg_atomic_write_u64(&shared_counters->serialized, 0);
+		pg_atomic_write_u64(&shared_counters->deserialized, 0);
+	}
+#endif
 
-		state1 = (state_double *)palloc(sizeof(state_double));
-		state1->maxelements = state2->maxelements;
-		state1->nelements = state2->nelements;
+	PG_RETURN_VOID();
+}
 
-		state1->cut_lower = state2->cut_lower;
-		state1->cut_upper = state2->cut_upper;
-		state1->sorted = state2->sorted;
+/*
+ * PROGRESS
+ *
+ * Sorting or merging hundreds of millions of values may take minutes, so
+ * the long-running kernels are split into chunks, checking for interrupts
+ * (so that the query can be cancelled quickly) and reporting progress after
+ * each chunk.
+ *
+ * Large arrays are partitioned (three-way quicksort-style, checking for interrupts
+ * during each pass) until the parts are small enough to be sorted by a
+ * single pg_qsort call. The merges check for interrupts every few thousand
+ * values.
+ *
+ * When the library is loaded through shared_preload_libraries (on
+ * PostgreSQL 15 or newer), the phase and number of processed values of
+ * sorts/merges of at least SORT_CHUNK values are also published in shared
+ * memory (one slot per backend), and returned by trimmed_progress().
+ */
 
-		state1->elements = (double*)palloc(sizeof(double) * state2->maxelements);
+/* values sorted by a single pg_qsort call (and smallest reported sort) */
+#define SORT_CHUNK			(1024 * 1024)
 
-		memcpy(state1->elements, state2->elements, sizeof(double) * state2->maxelements);
+/* check for interrupts (and report progress) every this many values */
+#define PROGRESS_INTERVAL	(64 * 1024)
 
-		MemoryContextSwitchTo(old_context);
+/* partitioning passes before falling back to pg_qsort for the part */
+#define SORT_MAX_DEPTH		64
 
-		PG_RETURN_POINTER(state1);
-	}
+/* maximum size of a sorted element (weighted_int64 is the largest) */
+#define SORT_MAX_WIDTH		16
 
-	Assert((state1 != NULL) && (state2 != NULL));
+#define PROGRESS_PHASE_SORT		1
+#define PROGRESS_PHASE_MERGE	2
 
-	/* make sure both states are sorted */
-	sort_state_double(state1);
-	sort_state_double(state2);
+static const char *progress_phases[] = {NULL, "sort", "merge"};
 
-	tmp = (double*)MemoryContextAlloc(agg_context,
-					  sizeof(double) * (state1->nelements + state2->nelements));
+/* check for interrupts once the merge gets to this value */
+static int64 progress_next = PG_INT64_MAX;
 
-	/* merge the two arrays */
-	i = j = k = 0;
-	while (true)
-	{
-		Assert(k <= (state1->nelements + state2->nelements));
-		Assert((i <= state1->nelements) && (j <= state2->nelements));
+/* is the current operation reported (it's large enough) */
+static bool progress_active = false;
 
-		if ((i < state1->nelements) && (j < state2->nelements))
-		{
-			if (state1->elements[i] <= state2->elements[j])
-				tmp[k++] = state1->elements[i++];
-			else
-				tmp[k++] = state2->elements[j++];
-		}
-		else if (i < state1->nelements)
-			tmp[k++] = state1->elements[i++];
-		else if (j < state2->nelements)
-			tmp[k++] = state2->elements[j++];
-		else
-			/* no more elements to process */
-			break;
-	}
+#if PG_VERSION_NUM >= 150000
 
-	Assert(k == (state1->nelements + state2->nelements));
-	Assert((i == state1->nelements) && (j == state2->nelements));
+/*
+ * Progress of a backend. Only the backend itself writes to the slot, and the
+ * values are read without locking, so they may be slightly inconsistent.
+ */
+typedef struct progress_slot
+{
+	int			pid;			/* backend sorting/merging (0 if idle) */
+	int			phase;			/* PROGRESS_PHASE_* */
+	int64		done;			/* values processed so far */
+	int64		total;			/* values to process */
+} progress_slot;
 
-	/* free the two arrays */
-	pfree(state1->elements);
-	state1->elements = tmp;
+static progress_slot *progress_slots = NULL;
 
-	/* and finally remember the current number of elements */
-	state1->nelements += state2->nelements;
-	state1->maxelements = state1->nelements;
+#define PROGRESS_SLOT()	(&progress_slots[MyProc->pgprocno])
 
-	PG_RETURN_POINTER(state1);
-}
+#endif
 
-Datum
-trimmed_combine_int32(PG_FUNCTION_ARGS)
+static void
+progress_start(int phase, int64 total)
 {
-	int i, j, k;
-	int32 *tmp;
-	state_int32 *state1;
-	state_int32 *state2;
-	MemoryContext agg_context;
-	MemoryContext old_context;
+	progress_active = (total >= SORT_CHUNK);
+	progress_next = progress_active ? PROGRESS_INTERVAL : PG_INT64_MAX;
 
-	GET_AGG_CONTEXT("trimmed_combine_int32", fcinfo, agg_context);
+#if PG_VERSION_NUM >= 150000
+	if (progress_active && (progress_slots != NULL) && (MyProc != NULL))
+	{
+		volatile progress_slot *slot = PROGRESS_SLOT();
 
-	state1 = PG_ARGISNULL(0) ? NULL : (state_int32 *) PG_GETARG_POINTER(0);
-	state2 = PG_ARGISNULL(1) ? NULL : (state_int32 *) PG_GETARG_POINTER(1);
+		slot->phase = phase;
+		slot->done = 0;
+		slot->total = total;
 
-	if (state2 == NULL)
-		PG_RETURN_POINTER(state1);
+		pg_write_barrier();
 
-	if (state1 == NULL)
-	{
-		old_context = MemoryContextSwitchTo(agg_context);
+		slot->pid = MyProcPid;
+	}
+#endif
+}
 
-		state1 = (state_int32 *)palloc(sizeof(state_int32));
-		state1->maxelements = state2->maxelements;
-		state1->nelements = state2->nelements;
+static void
+progress_update(int64 done)
+{
+#if PG_VERSION_NUM >= 150000
+	if (progress_active && (progress_slots != NULL) && (MyProc != NULL))
+		PROGRESS_SLOT()->done = done;
+#endif
+}
 
-		state1->cut_lower = state2->cut_lower;
-		state1->cut_upper = state2->cut_upper;
-		state1->sorted = state2->sorted;
+/* called at the end of the operation, and on abort */
+static void
+progress_end(void)
+{
+#if PG_VERSION_NUM >= 150000
+	if (progress_active && (progress_slots != NULL) && (MyProc != NULL))
+		PROGRESS_SLOT()->pid = 0;
+#endif
 
-		state1->elements = (int32*)palloc(sizeof(int32) * state2->maxelements);
+	progress_active = false;
+	progress_next = PG_INT64_MAX;
+}
 
-		memcpy(state1->elements, state2->elements, sizeof(int32) * state2->maxelements);
+/*
+ * Called by the merge loops with the number of values merged so far - once
+ * in a while, check for interrupts and report the progress.
+ */
+static inline void
+progress_check(int64 done)
+{
+	if (done < progress_next)
+		return;
 
-		MemoryContextSwitchTo(old_context);
+	progress_next = done + PROGRESS_INTERVAL;
 
-		PG_RETURN_POINTER(state1);
-	}
+	CHECK_FOR_INTERRUPTS();
+	progress_update(done);
+}
 
-	Assert((state1 != NULL) && (state2 != NULL));
+static inline void
+swap_elements(char *a, char *b, Size width)
+{
+	char	tmp[SORT_MAX_WIDTH];
 
-	/* make sure both states are sorted */
-	sort_state_int32(state1);
-	sort_state_int32(state2);
+	/* copies with constant sizes get inlined */
+	switch (width)
+	{
+		case 4:
+			memcpy(tmp, a, 4);
+			memcpy(a, b, 4);
+			memcpy(b, tmp, 4);
+			break;
+		case 8:
+			memcpy(tmp, a, 8);
+			memcpy(a, b, 8);
+			memcpy(b, tmp, 8);
+			break;
+		default:
+			memcpy(tmp, a, width);
+			memcpy(a, b, width);
+			memcpy(b, tmp, width);
+			break;
+	}
+}
 
-	tmp = (int32*)MemoryContextAlloc(agg_context,
-					  sizeof(int32) * (state1->nelements + state2->nelements));
+/*
+ * Partition the elements into three parts - less than, equal to and greater
+ * than the median of the first, middle and last element. The equal part is
+ * [*lt, *gt), and is never empty (it contains the pivot).
+ */
+static void
+sort_partition(char *base, int nelements, Size width,
+			   int (*cmp) (const void *, const void *), int *lt, int *gt)
+{
+	char	pivot[SORT_MAX_WIDTH];
+	char   *a = base,
+		   *b = base + (nelements / 2) * width,
+		   *c = base + (nelements - 1) * width;
+	int		i = 0,
+			l = 0,
+			g = nelements;
+
+	if (cmp(a, b) < 0)
+		memcpy(pivot, (cmp(b, c) < 0) ? b : ((cmp(a, c) < 0) ? c : a), width);
+	else
+		memcpy(pivot, (cmp(b, c) > 0) ? b : ((cmp(a, c) > 0) ? c : a), width);
 
-	/* merge the two arrays */
-	i = j = k = 0;
-	while (true)
+	while (i < g)
 	{
-		Assert(k <= (state1->nelements + state2->nelements));
-		Assert((i <= state1->nelements) && (j <= state2->nelements));
+		int		r = cmp(base + i * width, pivot);
 
-		if ((i < state1->nelements) && (j < state2->nelements))
+		if (r < 0)
 		{
-			if (state1->elements[i] <= state2->elements[j])
-				tmp[k++] = state1->elements[i++];
-			else
-				tmp[k++] = state2->elements[j++];
+			if (l < i)
+				swap_elements(base + l * width, base + i * width, width);
+			l++;
+			i++;
 		}
-		else if (i < state1->nelements)
-			tmp[k++] = state1->elements[i++];
-		else if (j < state2->nelements)
-			tmp[k++] = state2->elements[j++];
+		else if (r > 0)
+			swap_elements(base + i * width, base + (--g) * width, width);
 		else
-			/* no more elements to process */
-			break;
-	}
-
-	Assert(k == (state1->nelements + state2->nelements));
-	Assert((i == state1->nelements) && (j == state2->nelements));
-
-	/* free the two arrays */
-	pfree(state1->elements);
-	state1->elements = tmp;
+			i++;
 
-	/* and finally remember the current number of elements */
-	state1->nelements += state2->nelements;
-	state1->maxelements = state1->nelements;
+		if ((i % PROGRESS_INTERVAL) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
 
-	PG_RETURN_POINTER(state1);
+	*lt = l;
+	*gt = g;
 }
 
-Datum
-trimmed_combine_int64(PG_FUNCTION_ARGS)
+static void
+sort_chunks(char *base, int nelements, Size width,
+			int (*cmp) (const void *, const void *), int64 *done, int depth)
 {
-	int i, j, k;
-	int64 *tmp;
-	state_int64 *state1;
-	state_int64 *state2;
-	MemoryContext agg_context;
-	MemoryContext old_context;
-
-	GET_AGG_CONTEXT("trimmed_combine_int64", fcinfo, agg_context);
-
-	state1 = PG_ARGISNULL(0) ? NULL : (state_int64 *) PG_GETARG_POINTER(0);
-	state2 = PG_ARGISNULL(1) ? NULL : (state_int64 *) PG_GETARG_POINTER(1);
-
-	if (state2 == NULL)
-		PG_RETURN_POINTER(state1);
-
-	if (state1 == NULL)
+	/* recurse into the smaller part, iterate on the larger one */
+	while ((nelements > SORT_CHUNK) && (depth-- > 0))
 	{
-		old_context = MemoryContextSwitchTo(agg_context);
+		int		lt, gt;
 
-		state1 = (state_int64 *)palloc(sizeof(state_int64));
-		state1->maxelements = state2->maxelements;
-		state1->nelements = state2->nelements;
+		sort_partition(base, nelements, width, cmp, &lt, &gt);
 
-		state1->cut_lower = state2->cut_lower;
-		state1->cut_upper = state2->cut_upper;
-		state1->sorted = state2->sorted;
+		/* the values equal to the pivot are in the right place already */
+		*done += (gt - lt);
 
-		state1->elements = (int64*)palloc(sizeof(int64) * state2->maxelements);
+		CHECK_FOR_INTERRUPTS();
+		progress_update(*done);
 
-		memcpy(state1->elements, state2->elements, sizeof(int64) * state2->maxelements);
+		if (lt < nelements - gt)
+		{
+			sort_chunks(base, lt, width, cmp, done, depth);
+			base += gt * width;
+			nelements -= gt;
+		}
+		else
+		{
+			sort_chunks(base + gt * width, nelements - gt, width, cmp, done, depth);
+			nelements = lt;
+		}
+	}
 
-		MemoryContextSwitchTo(old_context);
+	pg_qsort(base, nelements, width, cmp);
 
-		PG_RETURN_POINTER(state1);
-	}
+	*done += nelements;
 
-	Assert((state1 != NULL) && (state2 != NULL));
+	CHECK_FOR_INTERRUPTS();
+	progress_update(*done);
+}
 
-	/* make sure both states are sorted */
-	sort_state_int64(state1);
-	sort_state_int64(state2);
+/*
+ * Sort the elements (just like pg_qsort), in chunks of at most SORT_CHUNK
+ * elements sorted by pg_qsort, so that the sort can be interrupted. Just
+ * like pg_qsort, we first check if the data happen to be sorted already.
+ */
+static void
+sort_chunked(void *base, int nelements, Size width,
+			 int (*cmp) (const void *, const void *))
+{
+	int64	done = 0;
+	int		i;
+	char   *ptr = (char *) base;
 
-	tmp = (int64*)MemoryContextAlloc(agg_context,
-					  sizeof(int64) * (state1->nelements + state2->nelements));
+	Assert(width <= SORT_MAX_WIDTH);
 
-	/* merge the two arrays */
-	i = j = k = 0;
-	while (true)
+	if (nelements <= SORT_CHUNK)
 	{
-		Assert(k <= (state1->nelements + state2->nelements));
-		Assert((i <= state1->nelements) && (j <= state2->nelements));
+		pg_qsort(base, nelements, width, cmp);
+		return;
+	}
 
-		if ((i < state1->nelements) && (j < state2->nelements))
-		{
-			if (state1->elements[i] <= state2->elements[j])
-				tmp[k++] = state1->elements[i++];
-			else
-				tmp[k++] = state2->elements[j++];
-		}
-		else if (i < state1->nelements)
-			tmp[k++] = state1->elements[i++];
-		else if (j < state2->nelements)
-			tmp[k++] = state2->elements[j++];
-		else
-			/* no more elements to process */
+	for (i = 1; i < nelements; i++, ptr += width)
+	{
+		if (cmp(ptr, ptr + width) > 0)
 			break;
+
+		if ((i % PROGRESS_INTERVAL) == 0)
+			CHECK_FOR_INTERRUPTS();
 	}
 
-	Assert(k == (state1->nelements + state2->nelements));
-	Assert((i == state1->nelements) && (j == state2->nelements));
+	if (i == nelements)
+		return;
 
-	/* free the two arrays */
-	pfree(state1->elements);
-	state1->elements = tmp;
+	progress_start(PROGRESS_PHASE_SORT, nelements);
 
-	/* and finally remember the current number of elements */
-	state1->nelements += state2->nelements;
-	state1->maxelements = state1->nelements;
+	sort_chunks((char *) base, nelements, width, cmp, &done, SORT_MAX_DEPTH);
 
-	PG_RETURN_POINTER(state1);
+	progress_end();
 }
 
+/*
+ * Return the progress of sorts/merges in all backends (when preloaded).
+ */
 Datum
-trimmed_combine_numeric(PG_FUNCTION_ARGS)
+trimmed_progress(PG_FUNCTION_ARGS)
 {
-	int				i;
-	state_numeric *state1;
-	state_numeric *state2;
-	MemoryContext agg_context;
-
-	char		   *data, *tmp, *ptr1, *ptr2;
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
 
-	GET_AGG_CONTEXT("trimmed_combine_numeric", fcinfo, agg_context);
-
-	state1 = PG_ARGISNULL(0) ? NULL : (state_numeric *) PG_GETARG_POINTER(0);
-	state2 = PG_ARGISNULL(1) ? NULL : (state_numeric *) PG_GETARG_POINTER(1);
+	if ((rsinfo == NULL) || !IsA(rsinfo, ReturnSetInfo) ||
+		!(rsinfo->allowedModes & SFRM_Materialize))
+		elog(ERROR, "set-valued function called in context that cannot accept a set");
 
-	if (state2 == NULL)
-		PG_RETURN_POINTER(state1);
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
 
-	if (state1 == NULL)
-	{
-		state1 = (state_numeric *)MemoryContextAlloc(agg_context,
-													sizeof(state_numeric));
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
 
-		state1->nelements = state2->nelements;
-		state1->cut_lower = state2->cut_lower;
-		state1->cut_upper = state2->cut_upper;
-		state1->usedlen = state2->usedlen;
-		state1->maxlen = state2->maxlen;
-		state1->sorted = state2->sorted;
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
 
-		/* copy the buffer */
-		state1->data = MemoryContextAlloc(agg_context, state1->usedlen);
-		memcpy(state1->data, state2->data, state1->usedlen);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
 
-		PG_RETURN_POINTER(state1);
-	}
+	MemoryContextSwitchTo(oldcontext);
 
-	Assert((state1 != NULL) && (state2 != NULL));
+#if PG_VERSION_NUM >= 150000
+	if (progress_slots != NULL)
+	{
+		int		i;
 
-	/* make sure both states are sorted */
-	sort_state_numeric(state1);
-	sort_state_numeric(state2);
+		for (i = 0; i < MaxBackends; i++)
+		{
+			volatile progress_slot *slot = &progress_slots[i];
+			Datum	values[4];
+			bool	nulls[4] = {false, false, false, false};
+			int		pid = slot->pid;
+			int		phase;
 
-	/* allocate temporary arrays */
-	data = MemoryContextAlloc(agg_context, state1->usedlen + state2->usedlen);
-	tmp = data;
+			if (pid == 0)
+				continue;
 
-	/* merge the two arrays */
-	ptr1 = state1->data;
-	ptr2 = state2->data;
+			pg_read_barrier();
 
-	for (i = 0; i < state1->nelements + state2->nelements; i++)
-	{
-		Numeric element;
+			phase = slot->phase;
 
-		Assert(ptr1 <= (state1->data + state1->usedlen));
-		Assert(ptr2 <= (state2->data + state2->usedlen));
+			values[0] = Int32GetDatum(pid);
+			values[1] = CStringGetTextDatum(progress_phases[phase]);
+			values[2] = Int64GetDatum(slot->done);
+			values[3] = Int64GetDatum(slot->total);
 
-		if ((ptr1 < (state1->data + state1->usedlen)) &&
-			(ptr2 < (state2->data + state2->usedlen)))
-		{
-			if (numeric_comparator(&ptr1, &ptr2) <= 0)
-			{
-				element = (Numeric)ptr1;
-				ptr1 += VARSIZE(ptr1);
-			}
-			else
-			{
-				element = (Numeric)ptr2;
-				ptr2 += VARSIZE(ptr2);
-			}
-		}
-		else if (ptr1 < (state1->data + state1->usedlen))
-		{
-			element = (Numeric)ptr1;
-			ptr1 += VARSIZE(ptr1);
-		}
-		else if (ptr2 < (state2->data + state2->usedlen))
-		{
-			element = (Numeric)ptr2;
-			ptr2 += VARSIZE(ptr2);
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 		}
-		else
-			elog(ERROR, "unexpected");
-
-		/* actually copy the value */
-		memcpy(tmp, element, VARSIZE(element));
-		tmp += VARSIZE(element);
 	}
+#endif
 
-	Assert(ptr1 == (state1->data + state1->usedlen));
-	Assert(ptr2 == (state2->data + state2->usedlen));
-	Assert((tmp - data) == (state1->usedlen + state2->usedlen));
-
-	/* free the two arrays */
-	pfree(state1->data);
-	state1->data = data;
-
-	/* and finally remember the current number of elements */
-	state1->nelements += state2->nelements;
-	state1->usedlen += state2->usedlen;
-
-	PG_RETURN_POINTER(state1);
+	return (Datum) 0;
 }
 
-Datum
-trimmed_avg_double(PG_FUNCTION_ARGS)
-{
-	int		i, from, to, cnt;
-	double	result = 0;
-
-	state_double *state;
-
-	CHECK_AGG_CONTEXT("trimmed_avg_double", fcinfo);
+/*
+ * PARALLEL FINALIZATION
+ *
+ * A single very large group (hundreds of millions of values) is finalized
+ * by a single backend, so the sort and the summations may take a long time
+ * even on machines with many idle cores. When trimmed_aggregates.finalize_threads
+ * is set, the sort of a large state and the summations of the kept values
+ * run on a few short-lived threads.
+ *
+ * The threads only run simple kernels - pg_qsort, merges and sums - on
+ * memory allocated by the backend before the threads are started. They
+ * don't allocate memory, don't report errors and don't check for interrupts,
+ * and all signals are blocked in them (so the signals are still delivered
+ * to the backend). The backend itself runs one of the tasks, and joins all
+ * the threads before doing anything else.
+ *
+ * The sort splits the values into one chunk per thread, sorts the chunks
+ * with pg_qsort and then merges pairs of sorted runs until there's a single
+ * run. Each merge round is split into slices of equal size (the boundaries
+ * of the slices in the two merged runs are found by a binary search), so
+ * that all the threads are busy even in the last round. Interrupts are
+ * checked between the rounds.
+ *
+ * The sums are computed per slice and then added together, so the results
+ * may differ from the serial ones in the last few digits.
+ */
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+/* maximum value of trimmed_aggregates.finalize_threads */
+#define FINALIZE_MAX_THREADS	64
 
-	state = (state_double*)PG_GETARG_POINTER(0);
+/* minimum number of values processed by each of the threads */
+#define FINALIZE_MIN_VALUES		(256 * 1024)
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+/* values drawn in each round of bootstrap resamples (between interrupts) */
+#define BOOTSTRAP_ROUND_VALUES	(16 * 1024 * 1024)
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+/* number of threads used by the finalization (0 or 1 means serial) */
+static int	finalize_threads = 0;
 
-	if (from >= to)
-		PG_RETURN_NULL();
+/* first value of a slice (of the same size) for each of the tasks */
+#define FINALIZE_SLICE(n, task, ntasks) \
+	((int) (((int64) (n) * (task)) / (ntasks)))
 
-	sort_state_double(state);
+typedef void (*finalize_kernel) (void *arg, int task, int ntasks);
 
-	for (i = from; i < to; i++)
-		result = result + state->elements[i];
+typedef struct finalize_thread
+{
+	finalize_kernel kernel;
+	void	   *arg;
+	int			task;
+	int			ntasks;
+} finalize_thread;
+
+/* the sort of a single state (merging the runs from src to dst) */
+typedef struct finalize_sort
+{
+	char	   *src;
+	char	   *dst;
+	int			nelements;
+	Size		width;
+	int			(*cmp) (const void *, const void *);
+	void		(*sortfn) (void *, int);	/* sorts a chunk (or NULL) */
+	int			runs;			/* chunks in each of the merged runs */
+} finalize_sort;
+
+/* sums of the values (and squares) or of the squared deviations */
+typedef struct finalize_sums
+{
+	void	   *elements;
+	int			from;
+	int			to;
+	double		avg;
+	double		sum_x[FINALIZE_MAX_THREADS];
+	double		sum_x2[FINALIZE_MAX_THREADS];
+} finalize_sums;
+
+/* bootstrap resamples (a range of them, split between the tasks) */
+typedef struct finalize_bootstrap
+{
+	void	   *elements;		/* sorted values */
+	int			nelements;
+	int			from;			/* kept part of each resample */
+	int			to;
+	int			first;			/* resamples of the current round */
+	int			last;
+	int32	   *counts;			/* multiplicities (nelements per task) */
+	double	   *means;			/* trimmed means of the resamples */
+} finalize_bootstrap;
 
-	PG_RETURN_FLOAT8(result/cnt);
+/*
+ * Number of threads to process the values with (less than two means the
+ * caller should process the values on its own).
+ */
+static int
+finalize_nthreads(int nvalues)
+{
+	return Min(finalize_threads, nvalues / FINALIZE_MIN_VALUES);
 }
 
-Datum
-trimmed_double_array(PG_FUNCTION_ARGS)
+static void *
+finalize_thread_main(void *arg)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0;
+	finalize_thread *thread = (finalize_thread *) arg;
 
-	/* average, var_pop, var_samp, variance, stddev_pop, stddev_samp, stddev */
-	double  result[7] = {0, 0, 0, 0, 0, 0, 0};
+	thread->kernel(thread->arg, thread->task, thread->ntasks);
 
-	state_double *state;
+	return NULL;
+}
 
-	CHECK_AGG_CONTEXT("trimmed_double_array", fcinfo);
+/*
+ * Run the tasks of the kernel, each on a separate thread (except for the
+ * first one, which is run by the backend). If a thread can't be started,
+ * the backend runs the task itself.
+ */
+static void
+finalize_run(finalize_kernel kernel, void *arg, int ntasks)
+{
+	finalize_thread threads[FINALIZE_MAX_THREADS];
+	pthread_t	handles[FINALIZE_MAX_THREADS];
+	bool		started[FINALIZE_MAX_THREADS];
+	sigset_t	blocked,
+				saved;
+	int			i;
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	Assert((ntasks > 0) && (ntasks <= FINALIZE_MAX_THREADS));
 
-	state = (state_double*)PG_GETARG_POINTER(0);
+	/* the threads inherit the signal mask */
+	sigfillset(&blocked);
+	pthread_sigmask(SIG_SETMASK, &blocked, &saved);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	for (i = 1; i < ntasks; i++)
+	{
+		threads[i].kernel = kernel;
+		threads[i].arg = arg;
+		threads[i].task = i;
+		threads[i].ntasks = ntasks;
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+		started[i] = (pthread_create(&handles[i], NULL, finalize_thread_main,
+									 &threads[i]) == 0);
+	}
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
 
-	sort_state_double(state);
+	kernel(arg, 0, ntasks);
 
-	/* average */
-	result[0] = 0;
-	result[1] = 1;
-	result[2] = 2;
-
-	for (i = from; i < to; i++)
+	for (i = 1; i < ntasks; i++)
 	{
-		result[0] += state->elements[i];
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
+		if (started[i])
+			pthread_join(handles[i], NULL);
+		else
+			kernel(arg, i, ntasks);
 	}
+}
 
-	result[0] /= cnt;
-	result[1] = (cnt * sum_x2 - sum_x * sum_x) / (cnt * cnt);	   /* var_pop */
-	result[2] = (cnt * sum_x2 - sum_x * sum_x) / (cnt * (cnt - 1)); /* var_samp */
-
-	/* variance */
-	result[3] = 0;
-	for (i = from; i < to; i++)
-		result[3] += (state->elements[i] - result[0]) * (state->elements[i] - result[0]);
+static inline void
+copy_element(char *dst, const char *src, Size width)
+{
+	/* copies with constant sizes get inlined */
+	switch (width)
+	{
+		case 4:
+			memcpy(dst, src, 4);
+			break;
+		case 8:
+			memcpy(dst, src, 8);
+			break;
+		default:
+			memcpy(dst, src, width);
+			break;
+	}
+}
 
-	result[3] /= cnt;
-	result[4] = sqrt(result[1]); /* stddev_pop */
-	result[5] = sqrt(result[2]); /* stddev_samp */
-	result[6] = sqrt(result[3]); /* stddev */
+static void
+finalize_sort_kernel(void *arg, int task, int ntasks)
+{
+	finalize_sort *sort = (finalize_sort *) arg;
+	int			from = FINALIZE_SLICE(sort->nelements, task, ntasks),
+				to = FINALIZE_SLICE(sort->nelements, task + 1, ntasks);
 
-	return double_to_array(fcinfo, result, 7);
+	/* the chunks may be sorted by a sort specialized for the type */
+	if (sort->sortfn != NULL)
+		sort->sortfn(sort->src + from * sort->width, to - from);
+	else
+		pg_qsort(sort->src + from * sort->width, to - from, sort->width, sort->cmp);
 }
 
-Datum
-trimmed_avg_int32(PG_FUNCTION_ARGS)
+/*
+ * Number of values from the first run among the first k merged values (on
+ * ties, the values from the first run go first).
+ */
+static int
+finalize_corank(char *a, int na, char *b, int nb, int k, Size width,
+				int (*cmp) (const void *, const void *))
 {
-	int		i, from, to, cnt;
-	double	result = 0;
-
-	state_int32 *state;
+	int			lo = Max(0, k - nb),
+				hi = Min(k, na);
 
-	CHECK_AGG_CONTEXT("trimmed_avg_int32", fcinfo);
+	while (lo < hi)
+	{
+		int			mid = lo + (hi - lo) / 2;
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+		if (cmp(a + mid * width, b + (k - mid - 1) * width) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
+	return lo;
+}
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+/*
+ * Merge a slice of the pair of runs the task belongs to. The slices are
+ * aligned with the chunks, so each slice is a part of a single pair.
+ */
+static void
+finalize_merge_kernel(void *arg, int task, int ntasks)
+{
+	finalize_sort *sort = (finalize_sort *) arg;
+	Size		width = sort->width;
+	int			pair = (task / (2 * sort->runs)) * (2 * sort->runs);
+	int			start = FINALIZE_SLICE(sort->nelements, pair, ntasks),
+				middle = FINALIZE_SLICE(sort->nelements, Min(pair + sort->runs, ntasks), ntasks),
+				end = FINALIZE_SLICE(sort->nelements, Min(pair + 2 * sort->runs, ntasks), ntasks);
+	int			from = FINALIZE_SLICE(sort->nelements, task, ntasks) - start,
+				to = FINALIZE_SLICE(sort->nelements, task + 1, ntasks) - start;
+	char	   *a = sort->src + start * width,
+			   *b = sort->src + middle * width,
+			   *dst = sort->dst + (start + from) * width;
+	int			na = middle - start,
+				nb = end - middle;
+	int			i = finalize_corank(a, na, b, nb, from, width, sort->cmp),
+				j = from - i,
+				iend = finalize_corank(a, na, b, nb, to, width, sort->cmp),
+				jend = to - iend;
+
+	while ((i < iend) && (j < jend))
+	{
+		if (sort->cmp(a + i * width, b + j * width) <= 0)
+			copy_element(dst, a + (i++) * width, width);
+		else
+			copy_element(dst, b + (j++) * width, width);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+		dst += width;
+	}
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	memcpy(dst, a + i * width, (iend - i) * width);
+	dst += (iend - i) * width;
 
-	sort_state_int32(state);
+	memcpy(dst, b + j * width, (jend - j) * width);
+}
 
-	for (i = from; i < to; i++)
-		result = result + (double)state->elements[i];
+static void
+finalize_copy_kernel(void *arg, int task, int ntasks)
+{
+	finalize_sort *sort = (finalize_sort *) arg;
+	int			from = FINALIZE_SLICE(sort->nelements, task, ntasks),
+				to = FINALIZE_SLICE(sort->nelements, task + 1, ntasks);
 
-	PG_RETURN_FLOAT8(result/cnt);
+	memcpy(sort->dst + from * sort->width, sort->src + from * sort->width,
+		   (to - from) * sort->width);
 }
 
-Datum
-trimmed_int32_array(PG_FUNCTION_ARGS)
+/*
+ * Sort the elements (just like sort_chunked), using multiple threads when
+ * the parallel finalization is enabled and there are enough elements. The
+ * chunks are sorted by the sort function (when not NULL), which must not
+ * check for interrupts, or by pg_qsort with the comparator.
+ */
+static void
+sort_parallel(void *base, int nelements, Size width,
+			  int (*cmp) (const void *, const void *),
+			  void (*sortfn) (void *, int))
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0;
+	finalize_sort sort;
+	int			i,
+				ntasks = finalize_nthreads(nelements);
+	char	   *ptr = (char *) base;
+	char	   *tmp;
 
-	/* average, var_pop, var_samp, variance, stddev_pop, stddev_samp, stddev */
-	double	result[7] = {0, 0, 0, 0, 0, 0, 0};
+	if (ntasks < 2)
+	{
+		sort_chunked(base, nelements, width, cmp);
+		return;
+	}
 
-	state_int32 *state;
+	for (i = 1; i < nelements; i++, ptr += width)
+	{
+		if (cmp(ptr, ptr + width) > 0)
+			break;
 
-	CHECK_AGG_CONTEXT("trimmed_int32_array", fcinfo);
+		if ((i % PROGRESS_INTERVAL) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	if (i == nelements)
+		return;
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
+	tmp = palloc((Size) nelements * width);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	progress_start(PROGRESS_PHASE_SORT, nelements);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	sort.src = (char *) base;
+	sort.dst = tmp;
+	sort.nelements = nelements;
+	sort.width = width;
+	sort.cmp = cmp;
+	sort.sortfn = sortfn;
+	sort.runs = 1;
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	finalize_run(finalize_sort_kernel, &sort, ntasks);
 
-	sort_state_int32(state);
+	/* each round merges pairs of runs (and halves the number of runs) */
+	while (sort.runs < ntasks)
+	{
+		char	   *swap;
 
-	/* average */
-	result[0] = 0;
-	result[1] = 0;
-	result[2] = 0;
+		CHECK_FOR_INTERRUPTS();
+		progress_update((int64) nelements * sort.runs / ntasks);
 
-	for (i = from; i < to; i++)
-	{
-		result[0] += (double)state->elements[i];
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + ((double)state->elements[i])*((double)state->elements[i]);
-	}
+		finalize_run(finalize_merge_kernel, &sort, ntasks);
 
-	result[0] /= cnt;
-	result[1] = (cnt * sum_x2 - sum_x * sum_x) / (cnt * cnt);	   /* var_pop */
-	result[2] = (cnt * sum_x2 - sum_x * sum_x) / (cnt * (cnt - 1)); /* var_samp */
+		swap = sort.src;
+		sort.src = sort.dst;
+		sort.dst = swap;
 
-	/* variance */
-	result[3] = 0;
-	for (i = from; i < to; i++)
-		result[3] += ((double)state->elements[i] - result[0])*((double)state->elements[i] - result[0]);
+		sort.runs *= 2;
+	}
+
+	/* the last round may have merged the values into the temporary buffer */
+	if (sort.src != (char *) base)
+	{
+		sort.dst = (char *) base;
+		finalize_run(finalize_copy_kernel, &sort, ntasks);
+	}
 
-	result[3] /= cnt;
-	result[4] = sqrt(result[1]); /* stddev_pop */
-	result[5] = sqrt(result[2]); /* stddev_samp */
-	result[6] = sqrt(result[3]); /* stddev */
+	pfree(tmp);
 
-	return double_to_array(fcinfo, result, 7);
+	progress_end();
 }
 
-Datum
-trimmed_avg_int64(PG_FUNCTION_ARGS)
+/*
+ * Add the sum of elements (and of their squares, unless sum_x2 is NULL) in
+ * [from, to) to the sums, using multiple threads when enabled.
+ */
+static void
+sum_values(finalize_kernel kernel, void *elements, int from, int to,
+		   double *sum_x, double *sum_x2)
 {
-	int		i, from, to, cnt;
-	double	result = 0;
+	finalize_sums sums;
+	int			i,
+				ntasks = finalize_nthreads(to - from);
 
-	state_int64 *state;
+	Assert(ntasks >= 2);
 
-	CHECK_AGG_CONTEXT("trimmed_avg_int64", fcinfo);
+	sums.elements = elements;
+	sums.from = from;
+	sums.to = to;
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	finalize_run(kernel, &sums, ntasks);
 
-	state = (state_int64*)PG_GETARG_POINTER(0);
+	for (i = 0; i < ntasks; i++)
+	{
+		*sum_x = *sum_x + sums.sum_x[i];
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+		if (sum_x2 != NULL)
+			*sum_x2 = *sum_x2 + sums.sum_x2[i];
+	}
+}
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+static double
+sum_deviations(finalize_kernel kernel, void *elements, int from, int to,
+			   double avg)
+{
+	finalize_sums sums;
+	int			i,
+				ntasks = finalize_nthreads(to - from);
+	double		sum_dev2 = 0;
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	Assert(ntasks >= 2);
 
-	sort_state_int64(state);
+	sums.elements = elements;
+	sums.from = from;
+	sums.to = to;
+	sums.avg = avg;
 
-	for (i = from; i < to; i++)
-		result = result + (double)state->elements[i];
+	finalize_run(kernel, &sums, ntasks);
+
+	for (i = 0; i < ntasks; i++)
+		sum_dev2 = sum_dev2 + sums.sum_x2[i];
 
-	PG_RETURN_FLOAT8(result/cnt);
+	return sum_dev2;
 }
 
-Datum
-trimmed_int64_array(PG_FUNCTION_ARGS)
+/*
+ * Compute trimmed means of bootstrap resamples of the (sorted) values. The
+ * resamples are processed in rounds of roughly BOOTSTRAP_ROUND_VALUES values,
+ * with interrupts checked between the rounds, and each round is split between
+ * the threads (when enabled). Each thread needs its own array of counts, and
+ * the counts are charged to the memory budget - when they don't fit, fewer
+ * threads are used.
+ */
+static void
+bootstrap_means(finalize_kernel kernel, void *elements, int nelements,
+				int from, int to, int nresamples, double *means)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0;
+	finalize_bootstrap boot;
+	trimmed_memory *memory;
+	int			ntasks,
+				round;
+	int64		nvalues = (int64) nelements * nresamples;
+
+	ntasks = finalize_nthreads((int) Min(nvalues, PG_INT32_MAX));
+	ntasks = Max(1, Min(ntasks, nresamples));
+
+	/* released by the context reset, if we fail before the end */
+	memory = (trimmed_memory *) palloc(sizeof(trimmed_memory));
+	memory_init(memory, CurrentMemoryContext);
+
+	while ((ntasks > 1) &&
+		   ! memory_fits(memory, (Size) ntasks * nelements * sizeof(int32)))
+		ntasks--;
+
+	/* the counts can't be sampled, so even a single task has to fit */
+	if (! memory_grow(memory, (Size) ntasks * nelements * sizeof(int32)))
+		elog(ERROR, "memory budget is too small for the bootstrap resamples");
+
+	round = Max(ntasks, BOOTSTRAP_ROUND_VALUES / nelements);
+
+	boot.elements = elements;
+	boot.nelements = nelements;
+	boot.from = from;
+	boot.to = to;
+	boot.means = means;
+	boot.counts = (int32 *) MemoryContextAllocHuge(CurrentMemoryContext,
+												   (Size) ntasks * nelements * sizeof(int32));
+
+	for (boot.first = 0; boot.first < nresamples; boot.first = boot.last)
+	{
+		CHECK_FOR_INTERRUPTS();
 
-	/* average, var_pop, var_samp, variance, stddev_pop, stddev_samp, stddev */
-	double	result[7] = {0, 0, 0, 0, 0, 0, 0};
+		boot.last = Min(nresamples, boot.first + round);
 
-	state_int64 *state;
+		if (ntasks >= 2)
+			finalize_run(kernel, &boot, ntasks);
+		else
+			kernel(&boot, 0, 1);
+	}
 
-	CHECK_AGG_CONTEXT("trimmed_int64_array", fcinfo);
+	pfree(boot.counts);
+	memory_release(memory);
+}
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+/*
+ * MEMORY BUDGET
+ *
+ * The memory used by the states may be limited, both for individual states
+ * and for all the states in the backend. When a state would exceed the
+ * budget, we either fail (the default), or we degrade to a random sample of
+ * the values - whenever the state gets full, each value is kept with
+ * probability 1/2, and the values added later are sampled at the reduced
+ * rate (1/2^sample_shift). The trimmed statistics computed from the sample
+ * are then estimates of the exact values.
+ */
 
-	state = (state_int64*)PG_GETARG_POINTER(0);
+#define MEMORY_POLICY_ERROR		0
+#define MEMORY_POLICY_SAMPLE	1
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+/* random() gives us 31 random bits (the shift mask has to fit) */
+#define MAX_SAMPLE_SHIFT		30
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+/*
+ * Random bits used for sampling. On PG 15+ the sampling uses a private PRNG,
+ * so that it does not consume values from the global sequence (reproducible
+ * after setseed()). It's seeded on first use in each backend, not in _PG_init,
+ * because with shared_preload_libraries all backends would share the seed.
+ * Older releases use random().
+ */
+#if PG_VERSION_NUM >= 150000
+static pg_prng_state sample_prng;
+static int	sample_prng_pid = 0;
 
-	if (from >= to)
-		PG_RETURN_NULL();
+static inline uint32
+sample_random(void)
+{
+	if (unlikely(sample_prng_pid != MyProcPid))
+	{
+		if (!pg_prng_strong_seed(&sample_prng))
+			pg_prng_seed(&sample_prng,
+						 (uint64) MyProcPid ^ (uint64) GetCurrentTimestamp());
+		sample_prng_pid = MyProcPid;
+	}
 
-	sort_state_int64(state);
+	return pg_prng_uint32(&sample_prng);
+}
+#else
+#define sample_random()		((uint32) random())
+#endif
 
-	/* average */
-	result[0] = 0;
-	result[1] = 0;
-	result[2] = 0;
+static int	state_memory = 0;
+static int	backend_memory = 0;
+static int	memory_policy = MEMORY_POLICY_ERROR;
 
-	for (i = from; i < to; i++)
-	{
-		result[0] += (double)state->elements[i];
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + ((double)state->elements[i])*((double)state->elements[i]);
-	}
+/* penalize hashed aggregation exceeding hash_mem (see trimmed_upper_paths) */
+static bool enable_planner_support = true;
 
-	result[0] /= cnt;
-	result[1] = (cnt * sum_x2 - sum_x * sum_x) / (cnt * cnt);	   /* var_pop */
-	result[2] = (cnt * sum_x2 - sum_x * sum_x) / (cnt * (cnt - 1)); /* var_samp */
+static const struct config_enum_entry memory_policies[] = {
+	{"error", MEMORY_POLICY_ERROR, false},
+	{"sample", MEMORY_POLICY_SAMPLE, false},
+	{NULL, 0, false}
+};
 
-	/* variance */
-	result[3] = 0;
-	for (i = from; i < to; i++)
-		result[3] += ((double)state->elements[i] - result[0])*((double)state->elements[i] - result[0]);
+/* memory accounted to all the states in this backend */
+static Size	backend_memory_used = 0;
 
-	result[3] /= cnt;
-	result[4] = sqrt(result[1]); /* stddev_pop */
-	result[5] = sqrt(result[2]); /* stddev_samp */
-	result[6] = sqrt(result[3]); /* stddev */
+static void
+memory_release(trimmed_memory *memory)
+{
+	Assert(backend_memory_used >= memory->accounted);
 
-	return double_to_array(fcinfo, result, 7);
+	backend_memory_used -= memory->accounted;
+	memory->accounted = 0;
 }
 
-Datum
-trimmed_avg_numeric(PG_FUNCTION_ARGS)
+static void
+memory_reset_callback(void *arg)
 {
-	int		i, from, to;
-	Numeric	result, cnt;
-	char   *ptr;
+	memory_release((trimmed_memory *) arg);
+}
 
-	state_numeric *state;
+/*
+ * The accounted memory is released when the memory context (which has to
+ * contain the state itself) gets reset or deleted.
+ */
+static void
+memory_init(trimmed_memory *memory, MemoryContext context)
+{
+	memory->accounted = 0;
+	memory->callback.func = memory_reset_callback;
+	memory->callback.arg = (void *) memory;
 
-	CHECK_AGG_CONTEXT("trimmed_avg_numeric", fcinfo);
+	MemoryContextRegisterResetCallback(context, &memory->callback);
+}
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+/* would accounting 'size' bytes to the state fit into the budget? */
+static bool
+memory_fits(trimmed_memory *memory, Size size)
+{
+	Size	delta;
 
-	state = (state_numeric*)PG_GETARG_POINTER(0);
+	if (size <= memory->accounted)
+		return true;
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
+	delta = size - memory->accounted;
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	if ((state_memory > 0) && (size > (Size) state_memory * 1024))
+		return false;
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	if ((backend_memory > 0) &&
+		(backend_memory_used + delta > (Size) backend_memory * 1024))
+		return false;
 
-	/* create numeric values */
-	cnt	= create_numeric(to-from);
-	result = create_numeric(0);
+	return true;
+}
 
-	sort_state_numeric(state);
+/*
+ * Account 'size' bytes to the state (unless already accounted). Returns
+ * false when that would exceed the budget and the state should be sampled
+ * instead, or fails when sampling is not allowed.
+ */
+static bool
+memory_grow(trimmed_memory *memory, Size size)
+{
+	if (size <= memory->accounted)
+		return true;
 
-	/* we need to walk through the buffer from start */
-	for (i = 0, ptr = state->data; i < to; i++, ptr += VARSIZE(ptr))
+	if (! memory_fits(memory, size))
 	{
-		Assert(ptr <= (state->data + state->usedlen));
+		if (memory_policy == MEMORY_POLICY_ERROR)
+			elog(ERROR, "trimmed aggregate state exceeds the memory budget");
 
-		if (i >= from)
-			result = add_numeric(result, div_numeric((Numeric)ptr, cnt));
+		return false;
 	}
 
-	PG_RETURN_NUMERIC(result);
-}
+	counters.allocated += (size - memory->accounted);
+	counters.peak_state = Max(counters.peak_state, (int64) size);
 
-Datum
-trimmed_numeric_array(PG_FUNCTION_ARGS)
-{
-	int		i, from, to;
+	backend_memory_used += (size - memory->accounted);
+	memory->accounted = size;
 
-	/* average, var_pop, var_samp, variance, stddev_pop, stddev_samp, stddev */
-	Numeric	result[7];
-	Numeric	sum_x, sum_x2;
-	Numeric	cntNumeric, cntNumeric_1;
-	char *ptr, *fromptr;
+	return true;
+}
 
-	state_numeric *state;
+/* maximum number of values to allocate space for upfront */
+#define MAX_INITIAL_ELEMENTS	(1024 * 1024)
 
-	CHECK_AGG_CONTEXT("trimmed_numeric_array", fcinfo);
+/* rough size of a numeric value (for sizing the buffer) */
+#define NUMERIC_VALUE_WIDTH		16
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+/*
+ * Number of values to allocate space for in a new state. In aggregates (but
+ * not window functions) we expect the groups to get about the same number
+ * of values, so we use the planner estimates (input rows / groups) and
+ * allocate the space at once, instead of doubling the array over and over.
+ * Each input row adds 'nitems' values (more than one for array inputs, where
+ * the first array is assumed to have the typical length). The estimate is
+ * capped, and it has to fit into the memory budget.
+ */
+static int
+initial_elements(FunctionCallInfo fcinfo, trimmed_memory *memory, Size width,
+				 int nitems)
+{
+	Agg		   *agg;
+	double		ngroups;
+	double		nvalues;
 
-	state = (state_numeric*)PG_GETARG_POINTER(0);
+	if ((fcinfo->context == NULL) || !IsA(fcinfo->context, AggState))
+		return MIN_ELEMENTS;
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
+	agg = (Agg *) ((AggState *) fcinfo->context)->ss.ps.plan;
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	if (outerPlan(agg) == NULL)
+		return MIN_ELEMENTS;
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	ngroups = (agg->numGroups > 0) ? agg->numGroups : agg->plan.plan_rows;
+	nvalues = outerPlan(agg)->plan_rows / Max(ngroups, 1.0) * Max(nitems, 1);
+	nvalues = Min(nvalues, MAX_INITIAL_ELEMENTS);
 
-	/* create numeric values */
-	cntNumeric = create_numeric(to-from);
-	cntNumeric_1 = create_numeric(to-from-1);
+	if ((nvalues <= MIN_ELEMENTS) || ! memory_fits(memory, (Size) nvalues * width))
+		return MIN_ELEMENTS;
 
-	sort_state_numeric(state);
+	(void) memory_grow(memory, (Size) nvalues * width);
 
-	/* average */
-	result[0] = create_numeric(0);
-	result[1] = create_numeric(0);
-	result[2] = create_numeric(0);
+	return (int) nvalues;
+}
 
-	sum_x   = create_numeric(0);
-	sum_x2  = create_numeric(0);
+/* keep the value with probability 1/2^shift */
+static inline bool
+sample_keep(int shift)
+{
+	/* the shift of a combined state is capped by sample_check, but be safe */
+	shift = Min(shift, MAX_SAMPLE_SHIFT);
 
-	/* compute sumX and sumX2 */
-	for (i = 0, ptr = state->data, fromptr = NULL; i < to; i++, ptr += VARSIZE(ptr))
-	{
-		Assert(ptr <= (state->data + state->usedlen));
+	return (shift == 0) ||
+		((sample_random() & (((uint32) 1 << shift) - 1)) == 0);
+}
 
-		if (i >= from)
-		{
-			/* remember offset to the 'from' value */
-			fromptr = (i == from) ? ptr : fromptr;
+/*
+ * Minimum number of values the sample needs to keep, so that each (non-zero)
+ * cut still removes at least one value. With fewer values, the statistics
+ * would be computed from a handful of values (or none at all).
+ */
+static int
+sample_min_elements(double cut_lower, double cut_upper)
+{
+	double	nvalues = 2;
 
-			sum_x  = add_numeric(sum_x, (Numeric)ptr);
-			sum_x2 = add_numeric(sum_x2,
-								 mul_numeric((Numeric)ptr,
-											 (Numeric)ptr));
-		}
-	}
+	if (cut_lower > 0)
+		nvalues = Max(nvalues, ceil(1.0 / cut_lower));
 
-	/* make sure we got a valid pointer to start from in the second pass */
-	Assert(fromptr != NULL);
+	if (cut_upper > 0)
+		nvalues = Max(nvalues, ceil(1.0 / cut_upper));
 
-	/* compute the average */
-	result[0] = div_numeric(sum_x, cntNumeric);
+	return (int) Min(nvalues, PG_INT32_MAX);
+}
+
+/*
+ * Check that the state may be halved - the sampling rate must not drop below
+ * 1/2^MAX_SAMPLE_SHIFT, and the halved state has to keep enough values for
+ * the cuts. Called before each halving forced by the memory budget.
+ */
+static inline void
+sample_check(int nelements, int shift, double cut_lower, double cut_upper)
+{
+	if ((shift >= MAX_SAMPLE_SHIFT) ||
+		(nelements / 2 < sample_min_elements(cut_lower, cut_upper)))
+		elog(ERROR, "memory budget is too small for a trimmed aggregate state");
+}
 
-	/* var_pop */
-	result[1] = div_numeric(
-					sub_numeric(
-						mul_numeric(cntNumeric, sum_x2),
-						mul_numeric(sum_x, sum_x)
-					),
-					mul_numeric(cntNumeric, cntNumeric));
+static void
+halve_state_numeric(state_numeric *state)
+{
+	int		i, j;
+	char   *ptr, *out;
 
-	/* var_samp */
-	result[2] = div_numeric(
-					sub_numeric(
-						mul_numeric(cntNumeric, sum_x2),
-						mul_numeric(sum_x, sum_x)
-					),
-					mul_numeric(cntNumeric, cntNumeric_1));
+	if (state->nruns > 0)
+		sort_state_numeric(state);
 
-	/* variance */
-	result[3] = create_numeric(0);
-	for (i = from, ptr = fromptr; i < to; i++, ptr += VARSIZE(ptr))
+	ptr = out = state->data;
+	for (i = 0, j = 0; i < state->nelements; i++)
 	{
-		Numeric	 delta;
+		int		len = VARSIZE(ptr);
 
-		Assert(ptr <= (state->data + state->usedlen));
+		if (sample_random() & 1)
+		{
+			if (out != ptr)
+				memmove(out, ptr, len);
 
-		delta = sub_numeric((Numeric)ptr, result[0]);
-		result[3]   = add_numeric(result[3], mul_numeric(delta, delta));
-	}
-	result[3] = div_numeric(result[3], cntNumeric);
+			out += len;
+			j++;
+		}
 
-	result[4] = sqrt_numeric(result[1]); /* stddev_pop */
-	result[5] = sqrt_numeric(result[2]); /* stddev_samp */
-	result[6] = sqrt_numeric(result[3]); /* stddev */
+		ptr += len;
+	}
 
-	return numeric_to_array(fcinfo, result, 7);
+	state->usedlen = out - state->data;
+	state->nelements = j;
+	state->sample_shift++;
 }
 
-Datum
-trimmed_var_double(PG_FUNCTION_ARGS)
+static void
+append_numeric(state_numeric *state, Numeric value, MemoryContext aggcontext)
 {
-	int		i, from, to, cnt;
-	double	result = 0, avg = 0;
+	int		len = VARSIZE(value);
 
-	state_double *state;
+	counters.appended++;
+	TRACE_TRIMMED_APPEND(1, state->nelements);
 
-	CHECK_AGG_CONTEXT("trimmed_var_double", fcinfo);
+	/* if there's not enough space in the data buffer, repalloc it */
+	while (state->usedlen + len > state->maxlen)
+	{
+		if (! memory_grow(&state->memory, 2 * state->maxlen))
+		{
+			sample_check(state->nelements, state->sample_shift,
+						 state->cut_lower, state->cut_upper);
+			halve_state_numeric(state);
+			continue;
+		}
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+		state->maxlen *= 2;
 
-	state = (state_double*)PG_GETARG_POINTER(0);
+		if (state->data != NULL)
+			state->data = repalloc(state->data, state->maxlen);
+	}
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	if (! sample_keep(state->sample_shift))
+		return;
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	/* if first entry, we need to allocate the buffer */
+	if (! state->data)
+		state->data = MemoryContextAlloc(aggcontext, state->maxlen);
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	/* copy the contents of the Numeric in place */
+	memcpy(state->data + state->usedlen, value, len);
 
-	sort_state_double(state);
+	state->usedlen += len;
+	state->nelements += 1;
+}
 
-	for (i = from; i < to; i++)
-		avg = avg + state->elements[i];
-	avg /= cnt;
+/*
+ * Intervals are kept as microseconds, linearized the same way as when
+ * comparing intervals (a month is 30 days, a day is 24 hours).
+ */
+static int64
+interval_to_usecs(Interval *span)
+{
+	double	usecs = (double) span->time
+					+ (double) span->day * USECS_PER_DAY
+					+ (double) span->month * DAYS_PER_MONTH * USECS_PER_DAY;
 
-	for (i = from; i < to; i++)
-		result = result + (state->elements[i] - avg)*(state->elements[i] - avg);
+	if (fabs(usecs) >= (double) PG_INT64_MAX)
+		elog(ERROR, "interval out of range");
 
-	PG_RETURN_FLOAT8(result/cnt);
+	return span->time + (int64) span->day * USECS_PER_DAY
+		+ (int64) span->month * DAYS_PER_MONTH * USECS_PER_DAY;
 }
 
 Datum
-trimmed_var_int32(PG_FUNCTION_ARGS)
+trimmed_append_interval(PG_FUNCTION_ARGS)
 {
+	state_int64 *state;
+	MemoryContext aggcontext;
 
-	int		i, from, to, cnt;
-	double	result = 0, avg = 0;
-
-	state_int32 *state;
+	GET_AGG_CONTEXT("trimmed_append_interval", fcinfo, aggcontext);
 
-	CHECK_AGG_CONTEXT("trimmed_var_int32", fcinfo);
+	/*
+	 * If both arguments are NULL, we can return NULL directly (instead of
+	 * just allocating empty aggregate state even if we don't need it).
+	 */
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
 
 	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
+		state = (state_int64*)palloc(sizeof(state_int64));
+		memory_init(&state->memory, aggcontext);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+		/* allocate space for the expected number of values */
+		state->maxelements = initial_elements(fcinfo, &state->memory,
+											  sizeof(int64), 1);
+		state->elements = (int64*)palloc(state->maxelements * sizeof(int64));
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+		MemoryContextSwitchTo(oldcontext);
 
-	if (from >= to)
-		PG_RETURN_NULL();
+		state->nelements = 0;
+		state->sorted = false;
+		state->nruns = 0;
+		state->maxruns = 0;
+		state->runs = NULL;
+		state->sample_shift = 0;
+
+		/* how much to cut (and other parameters) */
+		parse_params(fcinfo, aggcontext, &state->cut_lower, &state->cut_upper,
+					 &state->params);
+	}
+	else
+		state = (state_int64*)PG_GETARG_POINTER(0);
 
-	sort_state_int32(state);
+	if (! PG_ARGISNULL(1))
+	{
+		int64 element = interval_to_usecs(PG_GETARG_INTERVAL_P(1));
 
-	for (i = from; i < to; i++)
-		avg = avg + (double)state->elements[i];
-	avg /= cnt;
+		append_int64(state, element);
+	}
 
-	for (i = from; i < to; i++)
-		result = result + (state->elements[i] - avg)*(state->elements[i] - avg);
+	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
 
-	PG_RETURN_FLOAT8(result/cnt);
+	PG_RETURN_POINTER(state);
 }
 
 Datum
-trimmed_var_int64(PG_FUNCTION_ARGS)
+trimmed_append_numeric(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	result = 0, avg = 0;
-
-	state_int64 *state;
+	state_numeric *state;
+	MemoryContext aggcontext;
 
-	CHECK_AGG_CONTEXT("trimmed_var_int64", fcinfo);
+	GET_AGG_CONTEXT("trimmed_append_numeric", fcinfo, aggcontext);
 
-	if (PG_ARGISNULL(0))
+	/*
+	 * If both arguments are NULL, we can return NULL directly (instead of
+	 * just allocating empty aggregate state even if we don't need it).
+	 */
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
 		PG_RETURN_NULL();
 
-	state = (state_int64*)PG_GETARG_POINTER(0);
+	if (PG_ARGISNULL(0))
+	{
+		state = (state_numeric*)MemoryContextAlloc(aggcontext,
+												   sizeof(state_numeric));
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+		memory_init(&state->memory, aggcontext);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+		/* space for the expected number of values (allocated lazily) */
+		state->maxlen = initial_elements(fcinfo, &state->memory,
+										 NUMERIC_VALUE_WIDTH, 1);
+		state->maxlen = (state->maxlen > MIN_ELEMENTS) ?
+			state->maxlen * NUMERIC_VALUE_WIDTH : MIN_ELEMENTS;
 
-	if (from >= to)
-		PG_RETURN_NULL();
+		state->nelements = 0;
+		state->data = NULL;
+		state->usedlen = 0;
+		state->sorted = false;
+		state->nruns = 0;
+		state->maxruns = 0;
+		state->runs = NULL;
+		state->sample_shift = 0;
+
+		/* how much to cut (and other parameters) */
+		parse_params(fcinfo, aggcontext, &state->cut_lower, &state->cut_upper,
+					 &state->params);
+	}
+	else
+		state = (state_numeric*)PG_GETARG_POINTER(0);
 
-	sort_state_int64(state);
+	if (! PG_ARGISNULL(1))
+	{
+		Numeric element = PG_GETARG_NUMERIC(1);
 
-	for (i = from; i < to; i++)
-		avg = avg + (double)state->elements[i];
-	avg /= cnt;
+		append_numeric(state, element, aggcontext);
+	}
 
-	for (i = from; i < to; i++)
-		result = result + (state->elements[i] - avg)*(state->elements[i] - avg);
+	Assert(state->usedlen <= state->maxlen);
+	Assert(!state->usedlen || state->data);
 
-	PG_RETURN_FLOAT8(result/cnt);
+	PG_RETURN_POINTER(state);
 }
 
+/*
+ * Unlike the fixed-width types (see trimmed_template.h), for numeric we
+ * can't copy the array data directly, because the values may use short
+ * varlena headers (and the state requires regular ones), but we still
+ * compute the total length first and enlarge the buffer only once.
+ */
 Datum
-trimmed_var_numeric(PG_FUNCTION_ARGS)
+trimmed_append_array_numeric(PG_FUNCTION_ARGS)
 {
-	int		i, from, to;
-	Numeric	result, avg, cnt;
-	char   *ptr, *fromptr;
 	state_numeric *state;
+	MemoryContext aggcontext;
+	ArrayType  *array;
+	Datum	   *values;
+	bool	   *nulls;
+	int			i, nitems, len;
+	int			nelements;
 
-	CHECK_AGG_CONTEXT("trimmed_var_numeric", fcinfo);
+	GET_AGG_CONTEXT("trimmed_append_array_numeric", fcinfo, aggcontext);
 
-	if (PG_ARGISNULL(0))
+	/*
+	 * If both arguments are NULL, we can return NULL directly (instead of
+	 * just allocating empty aggregate state even if we don't need it).
+	 */
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
 		PG_RETURN_NULL();
 
-	state = (state_numeric*)PG_GETARG_POINTER(0);
+	if (! PG_ARGISNULL(1))
+		array = PG_GETARG_ARRAYTYPE_P(1);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
+	if (PG_ARGISNULL(0))
+	{
+		state = (state_numeric*)MemoryContextAlloc(aggcontext,
+												   sizeof(state_numeric));
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+		memory_init(&state->memory, aggcontext);
 
-	if (from >= to)
-		PG_RETURN_NULL();
+		/* space for the expected number of values (allocated lazily) */
+		state->maxlen = initial_elements(fcinfo, &state->memory,
+										 NUMERIC_VALUE_WIDTH,
+										 PG_ARGISNULL(1) ? 1 :
+										 ArrayGetNItems(ARR_NDIM(array),
+														ARR_DIMS(array)));
+		state->maxlen = (state->maxlen > MIN_ELEMENTS) ?
+			state->maxlen * NUMERIC_VALUE_WIDTH : MIN_ELEMENTS;
+
+		state->nelements = 0;
+		state->data = NULL;
+		state->usedlen = 0;
+		state->sorted = false;
+		state->nruns = 0;
+		state->maxruns = 0;
+		state->runs = NULL;
+		state->sample_shift = 0;
+
+		/* how much to cut (and other parameters) */
+		parse_params(fcinfo, aggcontext, &state->cut_lower, &state->cut_upper,
+					 &state->params);
+	}
+	else
+		state = (state_numeric*)PG_GETARG_POINTER(0);
 
-	cnt = create_numeric(to - from);
-	avg = create_numeric(0);
-	result = create_numeric(0);
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(state);
 
-	sort_state_numeric(state);
+	deconstruct_array(array, NUMERICOID, -1, false, 'i',
+					  &values, &nulls, &nitems);
 
-	for (i = 0, ptr = state->data, fromptr = NULL; i < to; i++, ptr += VARSIZE(ptr))
+	/* detoast the values (expanding short headers), and sum the lengths */
+	for (i = 0, len = 0; i < nitems; i++)
 	{
-		Assert(ptr <= (state->data + state->usedlen));
+		if (nulls[i])
+			continue;
 
-		if (i >= from)
+		values[i] = NumericGetDatum(DatumGetNumeric(values[i]));
+		len += VARSIZE(DatumGetPointer(values[i]));
+	}
+
+	if (len == 0)
+		PG_RETURN_POINTER(state);
+
+	/* if there's not enough space in the data buffer, repalloc it */
+	if ((state->sample_shift == 0) && (state->usedlen + len > state->maxlen))
+	{
+		int		maxlen = state->maxlen;
+
+		while (len + state->usedlen > maxlen)
+			maxlen *= 2;
+
+		if (memory_grow(&state->memory, maxlen))
 		{
-			/* remember offset to the 'from' value */
-			fromptr = (i == from) ? ptr : fromptr;
+			state->maxlen = maxlen;
+
+			if (state->data != NULL)
+				state->data = repalloc(state->data, state->maxlen);
+		}
+	}
 
-			avg = add_numeric(avg, div_numeric((Numeric)ptr, cnt));
+	/* over the memory budget (or sampling already), add the values one by one */
+	if ((state->sample_shift > 0) || (state->usedlen + len > state->maxlen))
+	{
+		for (i = 0; i < nitems; i++)
+		{
+			if (! nulls[i])
+				append_numeric(state, DatumGetNumeric(values[i]), aggcontext);
 		}
+
+		PG_RETURN_POINTER(state);
 	}
 
-	/* make sure we got a valid pointer for the second pass */
-	Assert(fromptr != NULL);
+	/* if first entry, we need to allocate the buffer */
+	if (! state->data)
+		state->data = MemoryContextAlloc(aggcontext, state->maxlen);
+
+	nelements = state->nelements;
 
-	for (i = from, ptr = fromptr; i < to; i++, ptr += VARSIZE(ptr))
+	/* copy the contents of the Numeric values in place */
+	for (i = 0; i < nitems; i++)
 	{
-		Assert(ptr <= (state->data + state->usedlen));
+		Pointer	element = DatumGetPointer(values[i]);
+
+		if (nulls[i])
+			continue;
 
-		result = add_numeric(
-					result,
-					div_numeric(
-						pow_numeric(sub_numeric((Numeric)ptr,avg),2),
-						cnt));
+		memcpy(state->data + state->usedlen, element, VARSIZE(element));
+
+		state->usedlen += VARSIZE(element);
+		state->nelements += 1;
 	}
 
-	PG_RETURN_NUMERIC(result);
+	counters.appended += (state->nelements - nelements);
+	TRACE_TRIMMED_APPEND(state->nelements - nelements, nelements);
+
+	Assert(state->usedlen <= state->maxlen);
+	Assert(!state->usedlen || state->data);
+
+	PG_RETURN_POINTER(state);
 }
 
 Datum
-trimmed_var_pop_double(PG_FUNCTION_ARGS)
+trimmed_serial_numeric(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
-
-	state_double *state;
-
-	CHECK_AGG_CONTEXT("trimmed_var_pop_double", fcinfo);
-
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	state_numeric *state = (state_numeric *)PG_GETARG_POINTER(0);
 
-	state = (state_double*)PG_GETARG_POINTER(0);
+	bytea	   *out;
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	CHECK_AGG_CONTEXT("trimmed_serial_numeric", fcinfo);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	out = serialize_numeric(state);
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	/*
+	 * The partial state is done. Don't count it against the budget of the
+	 * states combined later in this backend (e.g. by the parallel leader).
+	 */
+	memory_release(&state->memory);
 
-	sort_state_double(state);
+	PG_RETURN_BYTEA_P(out);
+}
 
-	for (i = from; i < to; i++)
-	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
-	}
+Datum
+trimmed_deserial_numeric(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	GET_AGG_CONTEXT("trimmed_deserial_numeric", fcinfo, aggcontext);
 
-	PG_RETURN_FLOAT8 (numerator / (cnt * cnt));
+	/*
+	 * Allocate the state in the aggregate context, so that the combine
+	 * function can use it directly, without copying the data.
+	 */
+	PG_RETURN_POINTER(deserialize_numeric((bytea *)PG_GETARG_POINTER(0),
+										  aggcontext));
 }
 
 Datum
-trimmed_var_pop_int32(PG_FUNCTION_ARGS)
+trimmed_combine_numeric(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
+	state_numeric *state1;
+	state_numeric *state2;
+	MemoryContext agg_context;
 
-	state_int32 *state;
+	GET_AGG_CONTEXT("trimmed_combine_numeric", fcinfo, agg_context);
 
-	CHECK_AGG_CONTEXT("trimmed_var_pop_int32", fcinfo);
+	state1 = PG_ARGISNULL(0) ? NULL : (state_numeric *) PG_GETARG_POINTER(0);
+	state2 = PG_ARGISNULL(1) ? NULL : (state_numeric *) PG_GETARG_POINTER(1);
 
-	if (PG_ARGISNULL(0))
+	/* nothing to combine (and we must not return a NULL pointer) */
+	if ((state1 == NULL) && (state2 == NULL))
 		PG_RETURN_NULL();
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
-
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	if (state2 == NULL)
+		PG_RETURN_POINTER(state1);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	/*
+	 * The partial state was deserialized in the aggregate context, so we can
+	 * simply adopt it, without copying the data.
+	 */
+	if (state1 == NULL)
+		PG_RETURN_POINTER(state2);
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	PG_RETURN_POINTER(combine_numeric(state1, state2, agg_context));
+}
 
-	sort_state_int32(state);
+/*
+ * Exact average of int64 values, rounded to the nearest integer (half away
+ * from zero). The quotients and remainders (by the number of values) are
+ * summed separately, so the sum can't overflow.
+ */
+static int64
+avg_int64_exact(int64 *elements, int from, int to)
+{
+	int		i;
+	int64	cnt = (to - from),
+			quotient = 0,
+			remainder = 0;
 
 	for (i = from; i < to; i++)
 	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
+		quotient += elements[i] / cnt;
+		remainder += elements[i] % cnt;
+
+		if (remainder >= cnt)
+		{
+			quotient++;
+			remainder -= cnt;
+		}
+		else if (remainder <= -cnt)
+		{
+			quotient--;
+			remainder += cnt;
+		}
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	if (2 * remainder >= cnt)
+		quotient++;
+	else if (2 * remainder <= -cnt)
+		quotient--;
 
-	PG_RETURN_FLOAT8 (numerator / (cnt * cnt));
+	return quotient;
 }
 
+/* timestamp and timestamptz (both stored as int64 microseconds) */
 Datum
-trimmed_var_pop_int64(PG_FUNCTION_ARGS)
+trimmed_avg_timestamp(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double  sum_x = 0, sum_x2 = 0, numerator;
+	int		from, to;
 
 	state_int64 *state;
 
-	CHECK_AGG_CONTEXT("trimmed_var_pop_int64", fcinfo);
+	CHECK_AGG_CONTEXT("trimmed_avg_timestamp", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
@@ -1817,43 +2470,44 @@ trimmed_var_pop_int64(PG_FUNCTION_ARGS)
 
 	from = floor(state->nelements * state->cut_lower);
 	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
 
 	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
 
 	if (from >= to)
 		PG_RETURN_NULL();
 
+	TRACE_TRIMMED_FINAL(state->nelements, from, to);
+
 	sort_state_int64(state);
 
-	for (i = from; i < to; i++)
-	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
-	}
+	/* infinite kept values make the average infinite */
+	if (TIMESTAMP_IS_NOBEGIN(state->elements[from]) &&
+		TIMESTAMP_IS_NOEND(state->elements[to - 1]))
+		elog(ERROR, "average of -infinity and infinity is undefined");
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	if (TIMESTAMP_IS_NOBEGIN(state->elements[from]) ||
+		TIMESTAMP_IS_NOEND(state->elements[to - 1]))
+		PG_RETURN_TIMESTAMP(TIMESTAMP_IS_NOBEGIN(state->elements[from]) ?
+							state->elements[from] : state->elements[to - 1]);
 
-	PG_RETURN_FLOAT8 (numerator / (cnt * cnt));
+	PG_RETURN_TIMESTAMP(avg_int64_exact(state->elements, from, to));
 }
 
 Datum
-trimmed_var_pop_numeric(PG_FUNCTION_ARGS)
+trimmed_avg_interval(PG_FUNCTION_ARGS)
 {
-	int		i, from, to;
-	Numeric	sum_x, sum_x2, cnt;
-	char   *ptr;
-	state_numeric *state;
+	int		from, to;
+	int64	usecs;
+	Interval *result;
 
-	CHECK_AGG_CONTEXT("trimmed_var_pop_numeric", fcinfo);
+	state_int64 *state;
+
+	CHECK_AGG_CONTEXT("trimmed_avg_interval", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	state = (state_numeric*)PG_GETARG_POINTER(0);
+	state = (state_int64*)PG_GETARG_POINTER(0);
 
 	from = floor(state->nelements * state->cut_lower);
 	to   = state->nelements - floor(state->nelements * state->cut_upper);
@@ -1863,346 +2517,385 @@ trimmed_var_pop_numeric(PG_FUNCTION_ARGS)
 	if (from >= to)
 		PG_RETURN_NULL();
 
-	cnt = create_numeric(to - from);
-	sum_x = create_numeric(0);
-	sum_x2 = create_numeric(0);
-
-	sort_state_numeric(state);
+	TRACE_TRIMMED_FINAL(state->nelements, from, to);
 
-	for (i = 0, ptr = state->data; i < to; i++, ptr += VARSIZE(ptr))
-	{
-		Assert(ptr <= (state->data + state->usedlen));
+	sort_state_int64(state);
 
-		if (i >= from)
-		{
-			sum_x = add_numeric(sum_x, (Numeric)ptr);
-			sum_x2 = add_numeric(
-						sum_x2,
-						mul_numeric((Numeric)ptr, (Numeric)ptr));
-		}
-	}
+	usecs = avg_int64_exact(state->elements, from, to);
 
-	sum_x2 = mul_numeric(cnt, sum_x2);
-	sum_x = mul_numeric(sum_x, sum_x);
+	/*
+	 * Days and time, the same as justify_hours(). The state only has the
+	 * linearized intervals, so unlike the built-in avg(interval) we can't
+	 * average the months and days separately (and keep the months).
+	 */
+	result = (Interval *) palloc(sizeof(Interval));
 
-	/* Watch out for roundoff error producing a negative numerator */
-	if (numeric_comparator(&sum_x2, &sum_x) <= 0)
-		PG_RETURN_NUMERIC(create_numeric(0));
+	result->month = 0;
+	result->day = usecs / USECS_PER_DAY;
+	result->time = usecs % USECS_PER_DAY;
 
-	PG_RETURN_NUMERIC (sub_numeric(
-							div_numeric(
-								sum_x2,
-								mul_numeric(cnt, cnt)),
-							div_numeric(
-								sum_x,
-								mul_numeric(cnt, cnt))));
+	PG_RETURN_INTERVAL_P(result);
 }
 
 Datum
-trimmed_var_samp_double(PG_FUNCTION_ARGS)
+trimmed_avg_numeric(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
-
-	state_double *state;
-
-	CHECK_AGG_CONTEXT("trimmed_var_samp_double", fcinfo);
+	CHECK_AGG_CONTEXT("trimmed_avg_numeric", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	state = (state_double*)PG_GETARG_POINTER(0);
-
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_AVG);
+}
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+Datum
+trimmed_numeric_array(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_numeric_array", fcinfo);
 
-	if (from >= to)
+	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	sort_state_double(state);
-
-	for (i = from; i < to; i++)
-	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
-	}
-
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
-
-	PG_RETURN_FLOAT8 (numerator / (cnt * (cnt - 1)));
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_ALL);
 }
 
 Datum
-trimmed_var_samp_int32(PG_FUNCTION_ARGS)
+trimmed_var_numeric(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
-
-	state_int32 *state;
-
-	CHECK_AGG_CONTEXT("trimmed_var_samp_int32", fcinfo);
+	CHECK_AGG_CONTEXT("trimmed_var_numeric", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
-
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_VAR);
+}
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+Datum
+trimmed_var_pop_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_var_pop_numeric", fcinfo);
 
-	if (from >= to)
+	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	sort_state_int32(state);
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_VAR_POP);
+}
 
-	for (i = from; i < to; i++)
-	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
-	}
+Datum
+trimmed_var_samp_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_var_samp_numeric", fcinfo);
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8 (numerator / (cnt * (cnt - 1)));
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_VAR_SAMP);
 }
 
 Datum
-trimmed_var_samp_int64(PG_FUNCTION_ARGS)
+trimmed_stddev_numeric(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
-
-	state_int64 *state;
-
-	CHECK_AGG_CONTEXT("trimmed_var_samp_int64", fcinfo);
+	CHECK_AGG_CONTEXT("trimmed_stddev_numeric", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	state = (state_int64*)PG_GETARG_POINTER(0);
-
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_STDDEV);
+}
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+Datum
+trimmed_stddev_pop_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_stddev_pop_numeric", fcinfo);
 
-	if (from >= to)
+	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	sort_state_int64(state);
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_STDDEV_POP);
+}
 
-	for (i = from; i < to; i++)
-	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
-	}
+Datum
+trimmed_stddev_samp_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_stddev_samp_numeric", fcinfo);
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8 (numerator / (cnt * (cnt - 1)));
+	return trimmed_stat_numeric(fcinfo, (state_numeric *) PG_GETARG_POINTER(0),
+								STAT_STDDEV_SAMP);
 }
 
 Datum
-trimmed_var_samp_numeric(PG_FUNCTION_ARGS)
+trimmed_avg_numeric_multi(PG_FUNCTION_ARGS)
 {
-	int		i, from, to;
-	Numeric	sum_x, sum_x2, cnt;
-	char   *ptr;
-	state_numeric *state;
-
-	CHECK_AGG_CONTEXT("trimmed_var_samp_numeric", fcinfo);
+	CHECK_AGG_CONTEXT("trimmed_avg_numeric_multi", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	state = (state_numeric*)PG_GETARG_POINTER(0);
-
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_AVG);
+}
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+Datum
+trimmed_var_numeric_multi(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_var_numeric_multi", fcinfo);
 
-	if (from >= to)
+	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	cnt  = create_numeric(to - from);
-	sum_x = create_numeric(0);
-	sum_x2 = create_numeric(0);
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_VAR);
+}
 
-	sort_state_numeric(state);
+Datum
+trimmed_var_pop_numeric_multi(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_var_pop_numeric_multi", fcinfo);
 
-	for (i = 0, ptr = state->data; i < to; i++, ptr += VARSIZE(ptr))
-	{
-		Assert(ptr <= (state->data + state->usedlen));
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-		if (i >= from)
-		{
-			sum_x = add_numeric(sum_x, (Numeric)ptr);
-			sum_x2 = add_numeric(
-							sum_x2,
-							mul_numeric((Numeric)ptr, (Numeric)ptr));
-		}
-	}
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_VAR_POP);
+}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	sum_x2 = mul_numeric(cnt, sum_x2);
-	sum_x = mul_numeric(sum_x, sum_x);
+Datum
+trimmed_var_samp_numeric_multi(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_var_samp_numeric_multi", fcinfo);
 
-	if (numeric_comparator(&sum_x2, &sum_x) <= 0)
-		PG_RETURN_NUMERIC(create_numeric(0));
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	PG_RETURN_NUMERIC (sub_numeric(
-							div_numeric(
-								sum_x2,
-								mul_numeric(
-									cnt,
-									sub_numeric(cnt, create_numeric(1)))),
-							div_numeric(
-								sum_x,
-								mul_numeric(
-									cnt,
-									sub_numeric(cnt, create_numeric(1))))));
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_VAR_SAMP);
 }
 
 Datum
-trimmed_stddev_double(PG_FUNCTION_ARGS)
+trimmed_stddev_numeric_multi(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	result = 0, avg = 0;
+	CHECK_AGG_CONTEXT("trimmed_stddev_numeric_multi", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	state_double *state;
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_STDDEV);
+}
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_double", fcinfo);
+Datum
+trimmed_stddev_pop_numeric_multi(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_stddev_pop_numeric_multi", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	state = (state_double*)PG_GETARG_POINTER(0);
-
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_STDDEV_POP);
+}
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+Datum
+trimmed_stddev_samp_numeric_multi(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_stddev_samp_numeric_multi", fcinfo);
 
-	if (from >= to)
+	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	sort_state_double(state);
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_STDDEV_SAMP);
+}
 
-	for (i = from; i < to; i++)
-		avg = avg + state->elements[i];
-	avg /= cnt;
+Datum
+trimmed_numeric_array_multi(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_numeric_array_multi", fcinfo);
 
-	for (i = from; i < to; i++)
-		result = result + (state->elements[i] - avg)*(state->elements[i] - avg);
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8 (sqrt(result/cnt));
+	return trimmed_multi_numeric((state_numeric *) PG_GETARG_POINTER(0), STAT_ALL);
 }
 
-Datum
-trimmed_stddev_int32(PG_FUNCTION_ARGS)
+/*
+ * Evaluate the requested statistics for all the cut configurations, the same
+ * way as for the fixed-width types (see trimmed_template.h), but with the
+ * sums computed in numeric.
+ *
+ * Unlike the fixed-width types, we don't use prefix sums - the difference of
+ * two prefix sums may have a higher scale than the sum of the kept values (if
+ * a value cut off has more digits), and the scale of numeric division depends
+ * on the operands. The result would have a different number of digits than
+ * the same statistic computed by the single-cut aggregates.
+ */
+static Datum
+trimmed_multi_numeric(state_numeric *state, int stat)
 {
-	int		i, from, to, cnt;
-	double	result = 0, avg = 0;
+	int		i, b, c, s, nconfigs, nstats;
+	int	   *bounds, *order, *stats;
+	char   *ptr, **ptrs;
+	Datum  *values;
+	bool   *nulls;
+	bool	need_x2, need_dev2;
 
-	state_int32 *state;
+	nconfigs = multi_configs(state->params);
+	stats = multi_stats(state->params, &stat, &nstats, &need_x2, &need_dev2);
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_int32", fcinfo);
+	bounds = (int *) palloc(2 * nconfigs * sizeof(int));
+	order = (int *) palloc(2 * nconfigs * sizeof(int));
+	ptrs = (char **) palloc(2 * nconfigs * sizeof(char *));
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	values = (Datum *) palloc(nconfigs * nstats * sizeof(Datum));
+	nulls = (bool *) palloc(nconfigs * nstats * sizeof(bool));
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
+	multi_bounds(state->nelements, state->cut_lower, state->cut_upper,
+				 state->params, bounds, order);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	sort_state_numeric(state);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	/*
+	 * Walk the boundaries in ascending order, and remember pointers to the
+	 * values, so that we don't need to walk the buffer for each of them.
+	 */
+	for (b = 0, i = 0, ptr = state->data; b < 2 * nconfigs; b++)
+	{
+		for (; i < bounds[order[b]]; i++, ptr += VARSIZE(ptr))
+			Assert(ptr <= (state->data + state->usedlen));
 
-	if (from >= to)
-		PG_RETURN_NULL();
+		ptrs[order[b]] = ptr;
+	}
 
-	sort_state_int32(state);
+	for (c = 0; c < nconfigs; c++)
+	{
+		int		from = bounds[2 * c],
+				to = bounds[2 * c + 1];
+		Numeric	sum_x,
+				sum_x2,
+				numerator = NULL,
+				sum_dev2 = NULL;
 
-	for (i = from; i < to; i++)
-		avg = avg + (double)state->elements[i];
-	avg /= cnt;
+		Assert((0 <= from) && (to <= state->nelements));
 
-	for (i = from; i < to; i++)
-		result = result + (state->elements[i] - avg)*(state->elements[i] - avg);
+		if (from >= to)
+		{
+			for (s = 0; s < nstats; s++)
+				nulls[c * nstats + s] = true;
+			continue;
+		}
 
-	PG_RETURN_FLOAT8 (sqrt(result/cnt));
-}
+		TRACE_TRIMMED_FINAL(state->nelements, from, to);
 
-Datum
-trimmed_stddev_int64(PG_FUNCTION_ARGS)
-{
-	int		i, from, to, cnt;
-	double	result = 0, avg = 0;
+		/*
+		 * We only compute sum of squares when actually needed, as it's not
+		 * exactly cheap for numeric values.
+		 */
+		sum_x = create_numeric(0);
+		sum_x2 = create_numeric(0);
 
-	state_int64 *state;
+		for (i = from, ptr = ptrs[2 * c]; i < to; i++, ptr += VARSIZE(ptr))
+		{
+			Assert(ptr <= (state->data + state->usedlen));
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_int64", fcinfo);
+			sum_x = add_numeric(sum_x, (Numeric)ptr);
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+			if (need_x2)
+				sum_x2 = add_numeric(sum_x2,
+									 mul_numeric((Numeric)ptr, (Numeric)ptr));
+		}
 
-	state = (state_int64*)PG_GETARG_POINTER(0);
+		/* the numerator shared by var_pop/var_samp (and stddev) */
+		if (need_x2)
+		{
+			Numeric	a = mul_numeric(create_numeric(to - from), sum_x2);
+			Numeric	b = mul_numeric(sum_x, sum_x);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+			/* Watch out for roundoff error producing a negative numerator */
+			if (numeric_comparator(&a, &b) <= 0)
+				numerator = create_numeric(0);
+			else
+				numerator = sub_numeric(a, b);
+		}
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+		/* exact variance needs a second pass through the kept values */
+		if (need_dev2)
+		{
+			Numeric	avg = div_numeric(sum_x, create_numeric(to - from));
 
-	if (from >= to)
-		PG_RETURN_NULL();
+			sum_dev2 = create_numeric(0);
+			for (i = from, ptr = ptrs[2 * c]; i < to; i++, ptr += VARSIZE(ptr))
+			{
+				Numeric	delta = sub_numeric((Numeric)ptr, avg);
 
-	sort_state_int64(state);
+				sum_dev2 = add_numeric(sum_dev2, mul_numeric(delta, delta));
+			}
+		}
 
-	for (i = from; i < to; i++)
-		avg = avg + (double)state->elements[i];
-	avg /= cnt;
+		for (s = 0; s < nstats; s++)
+		{
+			if (STAT_IS_ORDER(stats[s]))
+			{
+				double	q = stat_quantile(stats[s]);
 
-	for (i = from; i < to; i++)
-		result = result + (state->elements[i] - avg)*(state->elements[i] - avg);
+				quantiles_numeric(ptrs[2 * c], (to - from), &q, 1,
+								  &values[c * nstats + s]);
+			}
+			else
+				values[c * nstats + s]
+					= NumericGetDatum(multi_stat_numeric(stats[s], (to - from),
+														 sum_x, numerator,
+														 sum_dev2));
+			nulls[c * nstats + s] = false;
+		}
+	}
+
+	return multi_to_array(values, nulls, state->params, nconfigs, nstats,
+						  NUMERICOID);
+}
+
+/*
+ * The single-cut aggregates (and the persistent states) evaluate a single
+ * cut configuration, so that the results are the same as for the multi-cut
+ * aggregates and the lists of statistics, including the scale.
+ */
+static Datum
+trimmed_stat_numeric(FunctionCallInfo fcinfo, state_numeric *state, int stat)
+{
+	bool	isnull;
+	Datum	result = trimmed_multi_numeric(state, stat);
+
+	if (stat == STAT_ALL)
+		PG_RETURN_DATUM(result);
+
+	result = first_element(result, NUMERICOID, &isnull);
+
+	if (isnull)
+		PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8 (sqrt(result/cnt));
+	PG_RETURN_DATUM(result);
 }
 
 Datum
-trimmed_stddev_numeric(PG_FUNCTION_ARGS)
+trimmed_quantiles_numeric(PG_FUNCTION_ARGS)
 {
 	int		i, from, to;
-	Numeric	result, avg, cnt;
-	char   *ptr, *fromptr;
+	char   *ptr;
+	Datum  *result;
+
 	state_numeric *state;
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_numeric", fcinfo);
+	CHECK_AGG_CONTEXT("trimmed_quantiles_numeric", fcinfo);
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
 	state = (state_numeric*)PG_GETARG_POINTER(0);
 
+	Assert((state->params != NULL) && (state->params->nquantiles > 0));
+
 	from = floor(state->nelements * state->cut_lower);
 	to   = state->nelements - floor(state->nelements * state->cut_upper);
 
@@ -2211,619 +2904,4790 @@ trimmed_stddev_numeric(PG_FUNCTION_ARGS)
 	if (from >= to)
 		PG_RETURN_NULL();
 
-	cnt = create_numeric(to - from);
-	avg = create_numeric(0);
-	result = create_numeric(0);
+	TRACE_TRIMMED_FINAL(state->nelements, from, to);
 
 	sort_state_numeric(state);
 
-	for (i = 0, ptr = state->data, fromptr = NULL; i < to; i++, ptr += VARSIZE(ptr))
-	{
+	/* skip to the first kept value */
+	for (i = 0, ptr = state->data; i < from; i++, ptr += VARSIZE(ptr))
 		Assert(ptr <= (state->data + state->usedlen));
 
-		if (i >= from)
-		{
-			/* remember offset to the 'from' value */
-			fromptr = (i == from) ? ptr : fromptr;
+	result = (Datum *) palloc(state->params->nquantiles * sizeof(Datum));
 
-			avg = add_numeric(avg, div_numeric((Numeric)ptr, cnt));
-		}
-	}
+	quantiles_numeric(ptr, (to - from), PARAMS_QUANTILES(state->params),
+					  state->params->nquantiles, result);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(result, state->params->nquantiles,
+										  NUMERICOID, -1, false, 'i'));
+}
+
+/*
+ * TRIMMING BY A KEY
+ *
+ * The keyed aggregates (avg_by, var_by, ...) trim the rows by one column
+ * (the key), and compute the statistics of other columns (the payloads)
+ * for the rows that were kept. The payloads may be a single value, or an
+ * array of values (for multiple columns at once).
+ *
+ * The keys and the payloads are kept as separate arrays (one per column),
+ * so the kept range of each payload column is contiguous once the rows are
+ * sorted by the key, and may be summed by the same kernels as the regular
+ * aggregates.
+ */
 
-	/* make sure we have a valid start pointer for the second pass */
-	Assert(fromptr != NULL);
+static void
+halve_state_keyed(state_keyed *state)
+{
+	int		i, j, c;
 
-	for (i = from, ptr = fromptr; i < to; i++, ptr += VARSIZE(ptr))
+	for (i = 0, j = 0; i < state->nelements; i++)
 	{
-		Assert(ptr <= (state->data + state->usedlen));
+		if (sample_random() & 1)
+		{
+			state->keys[j] = state->keys[i];
 
-		result = add_numeric(
-					result,
-					div_numeric(
-						pow_numeric(sub_numeric((Numeric)ptr, avg), 2),
-						cnt));
+			for (c = 0; c < state->npayloads; c++)
+				state->payloads[c][j] = state->payloads[c][i];
+
+			j++;
+		}
 	}
 
-	PG_RETURN_NUMERIC (sqrt_numeric(result));
+	state->nelements = j;
+	state->sample_shift++;
 }
 
-Datum
-trimmed_stddev_pop_double(PG_FUNCTION_ARGS)
+static void
+append_keyed(state_keyed *state, double key, double *values)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
+	int		c;
+
+	counters.appended++;
+	TRACE_TRIMMED_APPEND(1, state->nelements);
 
-	state_double *state;
+	while (state->nelements >= state->maxelements)
+	{
+		if (! memory_grow(&state->memory, 2 * state->maxelements * KEYED_WIDTH(state)))
+		{
+			sample_check(state->nelements, state->sample_shift,
+						 state->cut_lower, state->cut_upper);
+			halve_state_keyed(state);
+			continue;
+		}
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_pop_double", fcinfo);
+		state->maxelements *= 2;
+		state->keys = (double *) repalloc(state->keys,
+								sizeof(double) * state->maxelements);
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+		for (c = 0; c < state->npayloads; c++)
+			state->payloads[c] = (double *) repalloc(state->payloads[c],
+								sizeof(double) * state->maxelements);
+	}
 
-	state = (state_double*)PG_GETARG_POINTER(0);
+	if (! sample_keep(state->sample_shift))
+		return;
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	state->keys[state->nelements] = key;
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	for (c = 0; c < state->npayloads; c++)
+		state->payloads[c][state->nelements] = values[c];
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	state->nelements++;
+}
 
-	sort_state_double(state);
+/*
+ * Add a row to the state, which is created by the first row (so that we
+ * know the number of payload columns). Arguments 3 and 4 are the cuts.
+ */
+static Datum
+trimmed_append_keyed_row(FunctionCallInfo fcinfo, MemoryContext aggcontext,
+						 double key, double *values, int nvalues, bool array)
+{
+	state_keyed *state;
+	int			c;
 
-	for (i = from; i < to; i++)
+	if (PG_ARGISNULL(0))
 	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
-	}
+		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+		state = (state_keyed *) palloc(sizeof(state_keyed));
+		memory_init(&state->memory, aggcontext);
 
-	PG_RETURN_FLOAT8 (sqrt(numerator / (cnt * cnt)));
-}
+		state->npayloads = nvalues;
+		state->array = array;
 
-Datum
-trimmed_stddev_pop_int32(PG_FUNCTION_ARGS)
-{
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
+		/* allocate space for the expected number of rows */
+		state->maxelements = initial_elements(fcinfo, &state->memory,
+											  KEYED_WIDTH(state), 1);
 
-	state_int32 *state;
+		state->keys = (double *) palloc(state->maxelements * sizeof(double));
+		state->payloads = (double **) palloc(nvalues * sizeof(double *));
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_pop_int32", fcinfo);
+		for (c = 0; c < nvalues; c++)
+			state->payloads[c] = (double *) palloc(state->maxelements * sizeof(double));
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+		MemoryContextSwitchTo(oldcontext);
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
+		state->nelements = 0;
+		state->sorted = false;
+		state->sample_shift = 0;
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+		/* how much to cut */
+		state->cut_lower = PG_GETARG_FLOAT8(3);
+		state->cut_upper = PG_GETARG_FLOAT8(4);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+		check_cuts(state->cut_lower, state->cut_upper);
+	}
+	else
+		state = (state_keyed *) PG_GETARG_POINTER(0);
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	if (nvalues != state->npayloads)
+		elog(ERROR, "payload arrays must have the same number of elements");
 
-	sort_state_int32(state);
+	append_keyed(state, key, values);
 
-	for (i = from; i < to; i++)
+	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Rows with a NULL key or payload are ignored (and so they don't count
+ * for the cuts, either).
+ */
+Datum
+trimmed_append_keyed(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	double		value;
+
+	GET_AGG_CONTEXT("trimmed_append_keyed", fcinfo, aggcontext);
+
+	if (PG_ARGISNULL(1) || PG_ARGISNULL(2))
 	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	value = PG_GETARG_FLOAT8(1);
 
-	PG_RETURN_FLOAT8 (sqrt(numerator / (cnt * cnt)));
+	return trimmed_append_keyed_row(fcinfo, aggcontext, PG_GETARG_FLOAT8(2),
+									&value, 1, false);
 }
 
 Datum
-trimmed_stddev_pop_int64(PG_FUNCTION_ARGS)
+trimmed_append_keyed_array(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
+	MemoryContext aggcontext;
+	ArrayType  *array;
+	Datum	   *elements;
+	bool	   *nulls;
+	double	   *values;
+	int			i,
+				nvalues;
 
-	state_int64 *state;
+	GET_AGG_CONTEXT("trimmed_append_keyed_array", fcinfo, aggcontext);
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_pop_int64", fcinfo);
+	if (PG_ARGISNULL(1) || PG_ARGISNULL(2))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
 
-	state = (state_int64*)PG_GETARG_POINTER(0);
+	array = PG_GETARG_ARRAYTYPE_P(1);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	Assert(ARR_ELEMTYPE(array) == FLOAT8OID);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	if (ARR_NDIM(array) != 1)
+		elog(ERROR, "payload array must be one-dimensional");
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	deconstruct_array(array, FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL, 'd',
+					  &elements, &nulls, &nvalues);
 
-	sort_state_int64(state);
+	values = (double *) palloc(nvalues * sizeof(double));
 
-	for (i = from; i < to; i++)
+	for (i = 0; i < nvalues; i++)
 	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
+		/* a NULL in any of the payloads means the row is ignored */
+		if (nulls[i])
+		{
+			if (PG_ARGISNULL(0))
+				PG_RETURN_NULL();
+
+			PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+		}
+
+		values[i] = DatumGetFloat8(elements[i]);
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	return trimmed_append_keyed_row(fcinfo, aggcontext, PG_GETARG_FLOAT8(2),
+									values, nvalues, true);
+}
+
+static int
+keyed_comparator(const void *a, const void *b)
+{
+	keyed_row  *ra = (keyed_row *) a;
+	keyed_row  *rb = (keyed_row *) b;
+
+	if (ra->key != rb->key)
+		return (ra->key > rb->key) - (ra->key < rb->key);
 
-	PG_RETURN_FLOAT8 (sqrt(numerator / (cnt * cnt)));
+	/* rows with the same key stay in the order they were added */
+	return (ra->row > rb->row) - (ra->row < rb->row);
 }
 
-Datum
-trimmed_stddev_pop_numeric(PG_FUNCTION_ARGS)
+/*
+ * Sort the rows by the key. We sort (key, row) pairs, and then reorder the
+ * payload columns one by one.
+ */
+static void
+sort_state_keyed(state_keyed *state)
 {
-	int		i, from, to;
-	Numeric	sum_x, sum_x2, cnt;
-	char   *ptr;
-	state_numeric *state;
+	instr_time	start;
+	keyed_row  *rows;
+	double	   *tmp;
+	int			i, c;
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_pop_numeric", fcinfo);
+	if (state->sorted)
+		return;
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	INSTR_TIME_SET_CURRENT(start);
 
-	state = (state_numeric*)PG_GETARG_POINTER(0);
+	TRACE_TRIMMED_SORT_START(state->nelements, state->nelements * KEYED_WIDTH(state));
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
+	rows = (keyed_row *) palloc(state->nelements * sizeof(keyed_row));
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	for (i = 0; i < state->nelements; i++)
+	{
+		rows[i].key = state->keys[i];
+		rows[i].row = i;
+	}
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	sort_parallel(rows, state->nelements, sizeof(keyed_row),
+				  &keyed_comparator, NULL);
 
-	cnt  = create_numeric(to - from);
-	sum_x = create_numeric(0);
-	sum_x2 = create_numeric(0);
+	for (i = 0; i < state->nelements; i++)
+		state->keys[i] = rows[i].key;
 
-	sort_state_numeric(state);
+	tmp = (double *) palloc(state->nelements * sizeof(double));
 
-	for (i = 0, ptr = state->data; i < to; i++, ptr += VARSIZE(ptr))
+	for (c = 0; c < state->npayloads; c++)
 	{
-		Assert(ptr <= (state->data + state->usedlen));
+		double *payload = state->payloads[c];
 
-		if (i >= from)
-		{
-			sum_x = add_numeric(sum_x, (Numeric)ptr);
-			sum_x2 = add_numeric(sum_x2,
-								 mul_numeric((Numeric)ptr, (Numeric)ptr));
-		}
+		for (i = 0; i < state->nelements; i++)
+			tmp[i] = payload[rows[i].row];
+
+		memcpy(payload, tmp, state->nelements * sizeof(double));
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	sum_x2 = mul_numeric(cnt, sum_x2);
-	sum_x = mul_numeric(sum_x, sum_x);
+	pfree(tmp);
+	pfree(rows);
 
-	if (numeric_comparator(&sum_x2, &sum_x) <= 0)
-		PG_RETURN_NUMERIC(create_numeric(0));
+	counters_timing(&counters.sorts, start);
+	TRACE_TRIMMED_SORT_DONE(state->nelements);
 
-	PG_RETURN_NUMERIC (sqrt_numeric(
-							sub_numeric(
-								div_numeric(
-									sum_x2,
-									pow_numeric(cnt, 2)),
-								div_numeric(
-									sum_x,
-									pow_numeric(cnt, 2)))));
+	state->sorted = true;
 }
 
+/*
+ * The rows are serialized unsorted (the combine function simply appends
+ * them to the other state). The header is followed by the keys and then
+ * the payload columns.
+ */
 Datum
-trimmed_stddev_samp_double(PG_FUNCTION_ARGS)
+trimmed_serial_keyed(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
-
-	state_double *state;
-
-	CHECK_AGG_CONTEXT("trimmed_stddev_samp_double", fcinfo);
-
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	state_keyed *state = (state_keyed *) PG_GETARG_POINTER(0);
+	Size		hlen = offsetof(state_keyed, keys);	/* header */
+	Size		len = state->nelements * sizeof(double);	/* one column */
+	bytea	   *out;
+	char	   *ptr;
+	int			c;
 
-	state = (state_double*)PG_GETARG_POINTER(0);
-
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	CHECK_AGG_CONTEXT("trimmed_serial_keyed", fcinfo);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	out = (bytea *) palloc(VARHDRSZ + hlen + (1 + state->npayloads) * len);
+	SET_VARSIZE(out, VARHDRSZ + hlen + (1 + state->npayloads) * len);
+	ptr = VARDATA(out);
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	memcpy(ptr, state, hlen);
+	ptr += hlen;
 
-	sort_state_double(state);
+	memcpy(ptr, state->keys, len);
+	ptr += len;
 
-	for (i = from; i < to; i++)
+	for (c = 0; c < state->npayloads; c++)
 	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
+		memcpy(ptr, state->payloads[c], len);
+		ptr += len;
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	counters.serialized += VARSIZE(out);
+	TRACE_TRIMMED_SERIALIZE(state->nelements, VARSIZE(out));
 
-	PG_RETURN_FLOAT8 (sqrt(numerator / (cnt * (cnt - 1))));
+	/*
+	 * The partial state is done. Don't count it against the budget of the
+	 * states combined later in this backend (e.g. by the parallel leader).
+	 */
+	memory_release(&state->memory);
+
+	PG_RETURN_BYTEA_P(out);
 }
 
 Datum
-trimmed_stddev_samp_int32(PG_FUNCTION_ARGS)
+trimmed_deserial_keyed(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
+	bytea	   *state = (bytea *) PG_GETARG_POINTER(0);
+	Size		len PG_USED_FOR_ASSERTS_ONLY = VARSIZE_ANY_EXHDR(state);
+	char	   *ptr = VARDATA(state);
+	state_keyed *out;
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	int			c;
 
-	state_int32 *state;
+	GET_AGG_CONTEXT("trimmed_deserial_keyed", fcinfo, aggcontext);
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_samp_int32", fcinfo);
+	counters.deserialized += VARSIZE_ANY(state);
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	/* allocate the state in the aggregate context (combine adopts it) */
+	oldcontext = MemoryContextSwitchTo(aggcontext);
 
-	state = (state_int32*)PG_GETARG_POINTER(0);
+	out = (state_keyed *) palloc(sizeof(state_keyed));
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	/* copy the header */
+	memcpy(out, ptr, offsetof(state_keyed, keys));
+	ptr += offsetof(state_keyed, keys);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	Assert((out->nelements >= 0) && (out->npayloads > 0));
+	Assert(len == offsetof(state_keyed, keys) +
+		   (1 + out->npayloads) * out->nelements * sizeof(double));
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	/* we only allocate the necessary space */
+	out->maxelements = out->nelements;
 
-	sort_state_int32(state);
+	out->keys = (double *) palloc(out->nelements * sizeof(double));
+	memcpy(out->keys, ptr, out->nelements * sizeof(double));
+	ptr += out->nelements * sizeof(double);
 
-	for (i = from; i < to; i++)
+	out->payloads = (double **) palloc(out->npayloads * sizeof(double *));
+
+	for (c = 0; c < out->npayloads; c++)
 	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
+		out->payloads[c] = (double *) palloc(out->nelements * sizeof(double));
+		memcpy(out->payloads[c], ptr, out->nelements * sizeof(double));
+		ptr += out->nelements * sizeof(double);
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	memory_init(&out->memory, aggcontext);
 
-	PG_RETURN_FLOAT8 (sqrt(numerator / (cnt * (cnt - 1))));
+	MemoryContextSwitchTo(oldcontext);
+
+	TRACE_TRIMMED_DESERIALIZE(out->nelements, VARSIZE_ANY(state));
+
+	PG_RETURN_POINTER(out);
 }
 
+/*
+ * Combine the states by appending the rows of the second state to the
+ * first one (the rows get sorted only once, in the final function).
+ */
 Datum
-trimmed_stddev_samp_int64(PG_FUNCTION_ARGS)
+trimmed_combine_keyed(PG_FUNCTION_ARGS)
 {
-	int		i, from, to, cnt;
-	double	sum_x = 0, sum_x2 = 0, numerator;
+	state_keyed *state1;
+	state_keyed *state2;
+	MemoryContext agg_context;
+	int			c;
 
-	state_int64 *state;
+	GET_AGG_CONTEXT("trimmed_combine_keyed", fcinfo, agg_context);
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_samp_int64", fcinfo);
+	state1 = PG_ARGISNULL(0) ? NULL : (state_keyed *) PG_GETARG_POINTER(0);
+	state2 = PG_ARGISNULL(1) ? NULL : (state_keyed *) PG_GETARG_POINTER(1);
 
-	if (PG_ARGISNULL(0))
+	/* nothing to combine (and we must not return a NULL pointer) */
+	if ((state1 == NULL) && (state2 == NULL))
 		PG_RETURN_NULL();
 
-	state = (state_int64*)PG_GETARG_POINTER(0);
+	if (state2 == NULL)
+		PG_RETURN_POINTER(state1);
 
-	from = floor(state->nelements * state->cut_lower);
-	to   = state->nelements - floor(state->nelements * state->cut_upper);
-	cnt  = (to - from);
+	/* the partial state was deserialized in the aggregate context */
+	if (state1 == NULL)
+		PG_RETURN_POINTER(state2);
 
-	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+	if (state1->npayloads != state2->npayloads)
+		elog(ERROR, "payload arrays must have the same number of elements");
 
-	if (from >= to)
-		PG_RETURN_NULL();
+	if ((state1->cut_lower != state2->cut_lower) ||
+		(state1->cut_upper != state2->cut_upper))
+		elog(ERROR, "trimmed states with different cuts can't be merged");
 
-	sort_state_int64(state);
+	counters.combines++;
+	TRACE_TRIMMED_COMBINE_START(state1->nelements, state2->nelements);
 
-	for (i = from; i < to; i++)
+	/* both states need to sample the rows at the same rate */
+	while (state1->sample_shift < state2->sample_shift)
+		halve_state_keyed(state1);
+
+	while (state2->sample_shift < state1->sample_shift)
+		halve_state_keyed(state2);
+
+	if (state1->nelements + state2->nelements > state1->maxelements)
+	{
+		state1->maxelements = state1->nelements + state2->nelements;
+		state1->keys = (double *) repalloc(state1->keys,
+								sizeof(double) * state1->maxelements);
+
+		for (c = 0; c < state1->npayloads; c++)
+			state1->payloads[c] = (double *) repalloc(state1->payloads[c],
+								sizeof(double) * state1->maxelements);
+	}
+
+	memcpy(state1->keys + state1->nelements, state2->keys,
+		   state2->nelements * sizeof(double));
+
+	for (c = 0; c < state1->npayloads; c++)
+		memcpy(state1->payloads[c] + state1->nelements, state2->payloads[c],
+			   state2->nelements * sizeof(double));
+
+	state1->nelements += state2->nelements;
+	if (state2->nelements > 0)
+		state1->sorted = false;
+
+	/* the data of the second state are now accounted to the first one */
+	memory_release(&state2->memory);
+
+	/* halving does not shrink the arrays, so account only the kept rows */
+	while (! memory_grow(&state1->memory, state1->nelements * KEYED_WIDTH(state1)))
 	{
-		sum_x = sum_x + state->elements[i];
-		sum_x2 = sum_x2 + state->elements[i]*state->elements[i];
+		sample_check(state1->nelements, state1->sample_shift,
+					 state1->cut_lower, state1->cut_upper);
+		halve_state_keyed(state1);
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	numerator = (cnt * sum_x2 - sum_x * sum_x);
-	if (numerator <= 0)
-		PG_RETURN_FLOAT8(0.0);
+	TRACE_TRIMMED_COMBINE_DONE(state1->nelements);
 
-	PG_RETURN_FLOAT8 (sqrt(numerator / (cnt * (cnt - 1))));
+	PG_RETURN_POINTER(state1);
 }
 
-Datum
-trimmed_stddev_samp_numeric(PG_FUNCTION_ARGS)
+/*
+ * Compute the requested statistic of each payload column (or all of the
+ * statistics of a single payload, for STAT_ALL) from the rows kept after
+ * trimming by the key.
+ */
+static Datum
+trimmed_keyed(FunctionCallInfo fcinfo, int stat)
 {
-	int		i, from, to;
-	Numeric	sum_x, sum_x2, cnt;
-	char   *ptr;
-	state_numeric *state;
+	int			i, c;
+	int			from, to, cnt;
+	double	   *result;
+	bool		need_x2 = (stat != STAT_AVG) && (stat != KEYED_SUM),
+				need_dev2 = (stat == STAT_ALL) || (stat == STAT_VAR) ||
+							(stat == STAT_STDDEV);
 
-	CHECK_AGG_CONTEXT("trimmed_stddev_samp_numeric", fcinfo);
+	state_keyed *state;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	state = (state_numeric*)PG_GETARG_POINTER(0);
+	state = (state_keyed *) PG_GETARG_POINTER(0);
 
 	from = floor(state->nelements * state->cut_lower);
 	to   = state->nelements - floor(state->nelements * state->cut_upper);
+	cnt  = (to - from);
 
 	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
 
 	if (from >= to)
 		PG_RETURN_NULL();
 
-	cnt  = create_numeric(to - from);
-	sum_x = create_numeric(0);
-	sum_x2 = create_numeric(0);
+	TRACE_TRIMMED_FINAL(state->nelements, from, to);
 
-	sort_state_numeric(state);
+	sort_state_keyed(state);
 
-	for (i = 0, ptr = state->data; i < to; i++, ptr += VARSIZE(ptr))
+	result = (double *) palloc(Max(NUM_STATS, state->npayloads) * sizeof(double));
+
+	for (c = 0; c < state->npayloads; c++)
 	{
-		Assert(ptr <= (state->data + state->usedlen));
+		double	sum_x = 0, sum_x2 = 0, sum_dev2 = 0;
 
-		if (i >= from)
+		sum_double(state->payloads[c], from, to, &sum_x, need_x2 ? &sum_x2 : NULL);
+
+		if (need_dev2)
+			sum_dev2 = sum_dev2_double(state->payloads[c], from, to, sum_x / cnt);
+
+		if (stat == STAT_ALL)
 		{
-			sum_x = add_numeric(sum_x, (Numeric)ptr);
-			sum_x2 = add_numeric(sum_x2, pow_numeric((Numeric)ptr, 2));
+			Assert(state->npayloads == 1);
+
+			for (i = 0; i < NUM_STATS; i++)
+				result[i] = multi_stat(i, cnt, sum_x, sum_x2, sum_dev2);
+
+			return double_to_array(fcinfo, result, NUM_STATS);
 		}
+
+		if (stat == KEYED_SUM)
+			result[c] = sum_x;
+		else
+			result[c] = multi_stat(stat, cnt, sum_x, sum_x2, sum_dev2);
 	}
 
-	/* Watch out for roundoff error producing a negative numerator */
-	sum_x2 = mul_numeric(cnt, sum_x2);
-	sum_x = pow_numeric(sum_x, 2);
-
-	if (numeric_comparator(&sum_x2, &sum_x) <= 0)
-		PG_RETURN_NUMERIC(create_numeric(0));
-
-	PG_RETURN_NUMERIC (sqrt_numeric(
-							sub_numeric(
-								div_numeric(
-									sum_x2,
-									mul_numeric(
-										cnt,
-										sub_numeric(cnt, create_numeric(1)))),
-								div_numeric(
-									sum_x,
-									mul_numeric(
-										cnt,
-										sub_numeric(cnt, create_numeric(1)))))));
-}
+	if (! state->array)
+		PG_RETURN_FLOAT8(result[0]);
 
-static int
-double_comparator(const void *a, const void *b)
-{
-	double af = (*(double*)a);
-	double bf = (*(double*)b);
-	return (af > bf) - (af < bf);
+	return double_to_array(fcinfo, result, state->npayloads);
 }
 
-static int
-int32_comparator(const void *a, const void *b)
+Datum
+trimmed_keyed_sum(PG_FUNCTION_ARGS)
 {
-	int32 af = (*(int32*)a);
-	int32 bf = (*(int32*)b);
-	return (af > bf) - (af < bf);
-}
+	CHECK_AGG_CONTEXT("trimmed_keyed_sum", fcinfo);
 
-static int
-int64_comparator(const void *a, const void *b)
-{
-	int64 af = (*(int64*)a);
-	int64 bf = (*(int64*)b);
-	return (af > bf) - (af < bf);
+	return trimmed_keyed(fcinfo, KEYED_SUM);
 }
 
-static int
-numeric_comparator(const void *a, const void *b)
+Datum
+trimmed_keyed_avg(PG_FUNCTION_ARGS)
 {
-	return DatumGetInt32(
-			DirectFunctionCall2(numeric_cmp,
-								NumericGetDatum(* (Numeric *) a),
-								NumericGetDatum(* (Numeric *) b)));
+	CHECK_AGG_CONTEXT("trimmed_keyed_avg", fcinfo);
+
+	return trimmed_keyed(fcinfo, STAT_AVG);
 }
 
-static Numeric
-create_numeric(int value)
+Datum
+trimmed_keyed_var(PG_FUNCTION_ARGS)
 {
-	return DatumGetNumeric(
-			DirectFunctionCall1(int4_numeric,
-								Int32GetDatum(value)));
+	CHECK_AGG_CONTEXT("trimmed_keyed_var", fcinfo);
+
+	return trimmed_keyed(fcinfo, STAT_VAR);
 }
 
-static Numeric
-add_numeric(Numeric a, Numeric b)
+Datum
+trimmed_keyed_var_pop(PG_FUNCTION_ARGS)
 {
-	return DatumGetNumeric(
-			DirectFunctionCall2(numeric_add,
-								NumericGetDatum(a),
-								NumericGetDatum(b)));
+	CHECK_AGG_CONTEXT("trimmed_keyed_var_pop", fcinfo);
+
+	return trimmed_keyed(fcinfo, STAT_VAR_POP);
 }
 
-static Numeric
-div_numeric(Numeric a, Numeric b)
+Datum
+trimmed_keyed_var_samp(PG_FUNCTION_ARGS)
 {
-	return DatumGetNumeric(
-			DirectFunctionCall2(numeric_div,
-								NumericGetDatum(a),
-								NumericGetDatum(b)));
+	CHECK_AGG_CONTEXT("trimmed_keyed_var_samp", fcinfo);
+
+	return trimmed_keyed(fcinfo, STAT_VAR_SAMP);
 }
 
-static Numeric
-mul_numeric(Numeric a, Numeric b)
+Datum
+trimmed_keyed_stddev(PG_FUNCTION_ARGS)
 {
-	return DatumGetNumeric(
-			DirectFunctionCall2(numeric_mul,
-								NumericGetDatum(a),
-								NumericGetDatum(b)));
+	CHECK_AGG_CONTEXT("trimmed_keyed_stddev", fcinfo);
+
+	return trimmed_keyed(fcinfo, STAT_STDDEV);
 }
 
-static Numeric
-sub_numeric(Numeric a, Numeric b)
+Datum
+trimmed_keyed_stddev_pop(PG_FUNCTION_ARGS)
 {
-	return DatumGetNumeric(
-			DirectFunctionCall2(numeric_sub,
-								NumericGetDatum(a),
-								NumericGetDatum(b)));
+	CHECK_AGG_CONTEXT("trimmed_keyed_stddev_pop", fcinfo);
+
+	return trimmed_keyed(fcinfo, STAT_STDDEV_POP);
 }
 
-static Numeric
-pow_numeric(Numeric a, int b)
+Datum
+trimmed_keyed_stddev_samp(PG_FUNCTION_ARGS)
 {
-	return DatumGetNumeric(
-			DirectFunctionCall2(numeric_power,
-								NumericGetDatum(a),
-								NumericGetDatum(create_numeric(b))));
+	CHECK_AGG_CONTEXT("trimmed_keyed_stddev_samp", fcinfo);
+
+	return trimmed_keyed(fcinfo, STAT_STDDEV_SAMP);
 }
 
-static Numeric
-sqrt_numeric(Numeric a)
+Datum
+trimmed_keyed_array(PG_FUNCTION_ARGS)
 {
-	return DatumGetNumeric(
-			DirectFunctionCall1(numeric_sqrt,
-								NumericGetDatum(a)));
-}
+	CHECK_AGG_CONTEXT("trimmed_keyed_array", fcinfo);
 
+	return trimmed_keyed(fcinfo, STAT_ALL);
+}
 
 /*
- * Helper functions used to prepare the resulting array (when there's
- * an array of quantiles).
+ * WINSORIZED STATISTICS
+ *
+ * Winsorizing replaces the values outside the cuts by the lowest/highest
+ * value kept (instead of discarding them), so the statistics are computed
+ * from all the values. That only needs the boundaries of the kept part,
+ * so it's computed from the same sorted state as the trimmed statistics.
+ * The fixed-width types are generated from trimmed_template.h.
  */
-static Datum
-double_to_array(FunctionCallInfo fcinfo, double * d, int len)
+
+Datum
+winsorized_avg_numeric(PG_FUNCTION_ARGS)
 {
-	ArrayBuildState *astate = NULL;
-	int		 i;
+	CHECK_AGG_CONTEXT("winsorized_avg_numeric", fcinfo);
 
-	for (i = 0; i < len; i++) {
+	return winsorized_numeric(fcinfo, STAT_AVG);
+}
 
-		/* stash away this field */
-		astate = accumArrayResult(astate,
-								  Float8GetDatum(d[i]),
-								  false,
-								  FLOAT8OID,
-								  CurrentMemoryContext);
-	}
+Datum
+winsorized_var_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("winsorized_var_numeric", fcinfo);
 
-	return makeArrayResult(astate, CurrentMemoryContext);
+	return winsorized_numeric(fcinfo, STAT_VAR);
 }
 
-static Datum
-numeric_to_array(FunctionCallInfo fcinfo, Numeric * d, int len)
+Datum
+winsorized_var_pop_numeric(PG_FUNCTION_ARGS)
 {
-	ArrayBuildState *astate = NULL;
-	int		 i;
-
-	for (i = 0; i < len; i++) {
+	CHECK_AGG_CONTEXT("winsorized_var_pop_numeric", fcinfo);
 
-		/* stash away this field */
-		astate = accumArrayResult(astate,
-								  NumericGetDatum(d[i]),
-								  false,
-								  NUMERICOID,
-								  CurrentMemoryContext);
+	return winsorized_numeric(fcinfo, STAT_VAR_POP);
+}
 
-	}
+Datum
+winsorized_var_samp_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("winsorized_var_samp_numeric", fcinfo);
 
-	return makeArrayResult(astate, CurrentMemoryContext);
+	return winsorized_numeric(fcinfo, STAT_VAR_SAMP);
 }
 
-static void
-sort_state_double(state_double *state)
+Datum
+winsorized_stddev_numeric(PG_FUNCTION_ARGS)
 {
+	CHECK_AGG_CONTEXT("winsorized_stddev_numeric", fcinfo);
+
+	return winsorized_numeric(fcinfo, STAT_STDDEV);
+}
+
+Datum
+winsorized_stddev_pop_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("winsorized_stddev_pop_numeric", fcinfo);
+
+	return winsorized_numeric(fcinfo, STAT_STDDEV_POP);
+}
+
+Datum
+winsorized_stddev_samp_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("winsorized_stddev_samp_numeric", fcinfo);
+
+	return winsorized_numeric(fcinfo, STAT_STDDEV_SAMP);
+}
+
+Datum
+winsorized_numeric_array(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("winsorized_numeric_array", fcinfo);
+
+	return winsorized_numeric(fcinfo, STAT_ALL);
+}
+
+/*
+ * Compute the requested winsorized statistic (or all of them, for STAT_ALL).
+ * The values below/above the cuts are accounted as copies of the lowest and
+ * highest value kept, so we only walk the kept part of the buffer.
+ */
+static Datum
+winsorized_numeric(FunctionCallInfo fcinfo, int stat)
+{
+	int		i, from, to, cnt;
+	Numeric	sum_x, sum_x2, sum_dev2, numerator;
+	Numeric	low, high, nlow, nhigh;
+	Numeric	result[NUM_STATS];
+	char   *ptr, *fromptr;
+
+	state_numeric *state;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (state_numeric*)PG_GETARG_POINTER(0);
+
+	from = floor(state->nelements * state->cut_lower);
+	to   = state->nelements - floor(state->nelements * state->cut_upper);
+	cnt  = state->nelements;
+
+	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+
+	if (from >= to)
+		PG_RETURN_NULL();
+
+	TRACE_TRIMMED_FINAL(state->nelements, from, to);
+
+	sort_state_numeric(state);
+
+	sum_x  = create_numeric(0);
+	sum_x2 = create_numeric(0);
+
+	/* compute sumX and sumX2 of the kept part */
+	for (i = 0, ptr = state->data, fromptr = NULL, high = NULL; i < to; i++, ptr += VARSIZE(ptr))
+	{
+		Assert(ptr <= (state->data + state->usedlen));
+
+		if (i >= from)
+		{
+			/* remember offset to the 'from' value */
+			fromptr = (i == from) ? ptr : fromptr;
+			high = (Numeric) ptr;
+
+			sum_x  = add_numeric(sum_x, (Numeric)ptr);
+			sum_x2 = add_numeric(sum_x2, mul_numeric((Numeric)ptr, (Numeric)ptr));
+		}
+	}
+
+	/* make sure we got a valid pointer to start from in the second pass */
+	Assert((fromptr != NULL) && (high != NULL));
+
+	low = (Numeric) fromptr;
+
+	/* the values cut at either end count as copies of the boundary values */
+	nlow  = create_numeric(from);
+	nhigh = create_numeric(cnt - to);
+
+	sum_x  = add_numeric(sum_x,
+						 add_numeric(mul_numeric(nlow, low),
+									 mul_numeric(nhigh, high)));
+	sum_x2 = add_numeric(sum_x2,
+						 add_numeric(mul_numeric(nlow, mul_numeric(low, low)),
+									 mul_numeric(nhigh, mul_numeric(high, high))));
+
+	numerator = sub_numeric(mul_numeric(create_numeric(cnt), sum_x2),
+							mul_numeric(sum_x, sum_x));
+
+	/* second pass is needed only for the exact variance */
+	sum_dev2 = create_numeric(0);
+	if ((stat == STAT_ALL) || (stat == STAT_VAR) || (stat == STAT_STDDEV))
+	{
+		Numeric	avg = div_numeric(sum_x, create_numeric(cnt));
+		Numeric	delta;
+
+		for (i = from, ptr = fromptr; i < to; i++, ptr += VARSIZE(ptr))
+		{
+			Assert(ptr <= (state->data + state->usedlen));
+
+			delta = sub_numeric((Numeric)ptr, avg);
+			sum_dev2 = add_numeric(sum_dev2, mul_numeric(delta, delta));
+		}
+
+		delta = sub_numeric(low, avg);
+		sum_dev2 = add_numeric(sum_dev2, mul_numeric(nlow, mul_numeric(delta, delta)));
+
+		delta = sub_numeric(high, avg);
+		sum_dev2 = add_numeric(sum_dev2, mul_numeric(nhigh, mul_numeric(delta, delta)));
+	}
+
+	if (stat != STAT_ALL)
+		PG_RETURN_NUMERIC(multi_stat_numeric(stat, cnt, sum_x, numerator, sum_dev2));
+
+	for (i = 0; i < NUM_STATS; i++)
+		result[i] = multi_stat_numeric(i, cnt, sum_x, numerator, sum_dev2);
+
+	return numeric_to_array(fcinfo, result, NUM_STATS);
+}
+
+/*
+ * KEPT VALUES
+ *
+ * The trimmed_values aggregate returns the kept part of the sorted state
+ * itself (as an array), e.g. to pass it to other functions. The values are
+ * already sorted, so it's just a slice of the state - for the fixed-width
+ * types (generated from trimmed_template.h) the slice is copied into the
+ * array at once, for numeric we only collect pointers into the buffer.
+ */
+
+Datum
+trimmed_values_numeric(PG_FUNCTION_ARGS)
+{
+	int		i, from, to;
+	char   *ptr;
+	Datum  *values;
+
+	state_numeric *state;
+
+	CHECK_AGG_CONTEXT("trimmed_values_numeric", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (state_numeric*)PG_GETARG_POINTER(0);
+
+	from = floor(state->nelements * state->cut_lower);
+	to   = state->nelements - floor(state->nelements * state->cut_upper);
+
+	Assert((0 <= from) && (from <= to) && (to <= state->nelements));
+
+	if (from >= to)
+		PG_RETURN_NULL();
+
+	TRACE_TRIMMED_FINAL(state->nelements, from, to);
+
+	sort_state_numeric(state);
+
+	values = (Datum *) palloc(sizeof(Datum) * (to - from));
+
+	for (i = 0, ptr = state->data; i < to; i++, ptr += VARSIZE(ptr))
+	{
+		Assert(ptr <= (state->data + state->usedlen));
+
+		if (i >= from)
+			values[i - from] = PointerGetDatum(ptr);
+	}
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(values, (to - from), NUMERICOID,
+										  -1, false, 'i'));
+}
+
+/*
+ * CONFIDENCE INTERVALS
+ *
+ * The trimmed_ci aggregate computes a confidence interval of the trimmed
+ * mean from the sorted state, either analytically (Yuen's interval, using
+ * the winsorized variance and the Student t distribution), or by resampling
+ * the sorted values in memory (percentile bootstrap). The resampling draws
+ * the multiplicities of the values directly, so each resample is already
+ * sorted and its trimmed mean only needs a single pass over the counts.
+ * The fixed-width types are generated from trimmed_template.h.
+ */
+
+/*
+ * Next value of the splitmix64 generator - fast, with a 64-bit state, so
+ * each resample may start from a seed derived from its number (and the
+ * results don't depend on how the resamples are split between threads).
+ */
+static inline uint64
+bootstrap_random(uint64 *state)
+{
+	uint64		z = (*state += UINT64CONST(0x9E3779B97F4A7C15));
+
+	z = (z ^ (z >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64CONST(0x94D049BB133111EB);
+
+	return z ^ (z >> 31);
+}
+
+/* random index in [0, n), by multiplying the upper 32 bits */
+static inline int
+bootstrap_index(uint64 *state, int n)
+{
+	return (int) (((bootstrap_random(state) >> 32) * (uint64) n) >> 32);
+}
+
+/*
+ * Quantile of the standard normal distribution (the rational approximation
+ * by Acklam, with relative error below 1.2e-9).
+ */
+static double
+normal_quantile(double p)
+{
+	static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+							   -2.759285104469687e+02, 1.383577518672690e+02,
+							   -3.066479806614716e+01, 2.506628277459239e+00};
+	static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+							   -1.556989798598866e+02, 6.680131188771972e+01,
+							   -1.328068155288572e+01};
+	static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+							   -2.400758277161838e+00, -2.549732539343734e+00,
+							   4.374664141464968e+00, 2.938163982698783e+00};
+	static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+							   2.445134137142996e+00, 3.754408661907416e+00};
+	double		q, r;
+
+	if (p < 0.02425)
+	{
+		q = sqrt(-2 * log(p));
+		return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+			((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+	}
+
+	if (p > 1 - 0.02425)
+		return -normal_quantile(1 - p);
+
+	q = p - 0.5;
+	r = q * q;
+
+	return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+		(((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+/*
+ * Regularized incomplete beta function I_x(a, b), evaluated using the
+ * continued fraction (by the modified Lentz's method).
+ */
+static double
+incomplete_beta(double a, double b, double x)
+{
+	int		i;
+	double	front, f = 1, c = 1, d = 0;
+
+	if (x <= 0)
+		return 0;
+
+	if (x >= 1)
+		return 1;
+
+	/* the continued fraction converges quickly only below the mean */
+	if (x > (a + 1) / (a + b + 2))
+		return 1 - incomplete_beta(b, a, 1 - x);
+
+	front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) +
+				a * log(x) + b * log1p(-x)) / a;
+
+	for (i = 0; i <= 300; i++)
+	{
+		int		m = i / 2;
+		double	num;
+
+		if (i == 0)
+			num = 1;
+		else if (i % 2 == 0)
+			num = (m * (b - m) * x) / ((a + 2 * m - 1) * (a + 2 * m));
+		else
+			num = -((a + m) * (a + b + m) * x) / ((a + 2 * m) * (a + 2 * m + 1));
+
+		d = 1 + num * d;
+		d = 1 / ((fabs(d) < 1e-30) ? 1e-30 : d);
+
+		c = 1 + num / c;
+		c = (fabs(c) < 1e-30) ? 1e-30 : c;
+
+		f *= c * d;
+
+		if (fabs(1 - c * d) < 1e-14)
+			break;
+	}
+
+	return front * (f - 1);
+}
+
+/*
+ * Quantile of the Student t distribution with df degrees of freedom. We
+ * start from the Cornish-Fisher expansion around the normal quantile, and
+ * refine it by Newton's method on the distribution function.
+ */
+static double
+student_t_quantile(double p, double df)
+{
+	int		i;
+	double	z, z2, t, lnorm;
+
+	Assert((p > 0) && (p < 1) && (df >= 1));
+
+	/* closed forms for one and two degrees of freedom */
+	if (df == 1)
+		return tan(M_PI * (p - 0.5));
+
+	if (df == 2)
+		return (2 * p - 1) / sqrt(2 * p * (1 - p));
+
+	z = normal_quantile(p);
+	z2 = z * z;
+
+	t = z + z * (z2 + 1) / (4 * df)
+		+ z * ((5 * z2 + 16) * z2 + 3) / (96 * df * df)
+		+ z * (((3 * z2 + 19) * z2 + 17) * z2 - 15) / (384 * df * df * df)
+		+ z * ((((79 * z2 + 776) * z2 + 1482) * z2 - 1920) * z2 - 945) / (92160 * df * df * df * df);
+
+	lnorm = lgamma((df + 1) / 2) - lgamma(df / 2) - 0.5 * log(df * M_PI);
+
+	for (i = 0; i < 50; i++)
+	{
+		double	tail = 0.5 * incomplete_beta(df / 2, 0.5, df / (df + t * t)),
+				cdf = (t > 0) ? (1 - tail) : tail,
+				pdf = exp(lnorm - (df + 1) / 2 * log1p(t * t / df)),
+				step = (cdf - p) / pdf;
+
+		t -= step;
+
+		if (fabs(step) < 1e-12 * (1 + fabs(t)))
+			break;
+	}
+
+	return t;
+}
+
+/*
+ * Percentile bootstrap interval, i.e. the quantiles of the resampled means
+ * (interpolated the same way as percentile_cont does it).
+ */
+static Datum
+bootstrap_interval(FunctionCallInfo fcinfo, double *means, int nresamples,
+				   double confidence)
+{
+	int		i;
+	double	result[2];
+	double	q[2] = {(1 - confidence) / 2, (1 + confidence) / 2};
+
+	pg_qsort(means, nresamples, sizeof(double), double_comparator);
+
+	for (i = 0; i < 2; i++)
+	{
+		double	pos = q[i] * (nresamples - 1);
+		int		lo = floor(pos),
+				hi = Min(lo + 1, nresamples - 1);
+
+		result[i] = means[lo] + (pos - lo) * (means[hi] - means[lo]);
+	}
+
+	return double_to_array(fcinfo, result, 2);
+}
+
+/*
+ * PERSISTENT STATE
+ *
+ * The trimmed_state types store the (sorted) data collected by an aggregate,
+ * so that it can be stored in a table and merged later (e.g. hourly states
+ * rolled up into daily ones), without rescanning the raw data. The internal
+ * representation is the same as the serialized aggregate state, so the
+ * conversions are cheap.
+ *
+ * The text format is "(lower,upper):{values}", the binary format is the two
+ * cuts followed by the number of values and the values themselves.
+ */
+
+Datum
+trimmed_state_numeric_in(PG_FUNCTION_ARGS)
+{
+	char	   *str = PG_GETARG_CSTRING(0);
+	double		cut_lower,
+				cut_upper;
+	int			sample_shift;
+	char	   *values;
+	ArrayType  *array;
+	Datum	   *elements;
+	bool	   *nulls;
+	int			i, nelements;
+	state_numeric *state;
+
+	values = parse_state_cuts(str, &cut_lower, &cut_upper, &sample_shift);
+
+	array = DatumGetArrayTypeP(OidInputFunctionCall(F_ARRAY_IN, values,
+													NUMERICOID, -1));
+
+	if (ARR_NDIM(array) > 1)
+		elog(ERROR, "values of a trimmed state need to be one-dimensional");
+
+	deconstruct_array(array, NUMERICOID, -1, false, 'i',
+					  &elements, &nulls, &nelements);
+
+	for (i = 0; i < nelements; i++)
+		if (nulls[i])
+			elog(ERROR, "values of a trimmed state must not be NULL");
+
+	state = build_state_numeric(elements, nelements, cut_lower, cut_upper,
+								sample_shift);
+
+	PG_RETURN_BYTEA_P(serialize_numeric(state));
+}
+
+Datum
+trimmed_state_numeric_out(PG_FUNCTION_ARGS)
+{
+	int			i;
+	state_numeric *state = deserialize_numeric(PG_GETARG_BYTEA_P(0),
+											   CurrentMemoryContext);
+	Datum	   *values = (Datum *) palloc((state->nelements + 1) * sizeof(Datum));
+	char	   *ptr = state->data;
+	ArrayType  *array;
+	StringInfoData str;
+
+	for (i = 0; i < state->nelements; i++)
+	{
+		values[i] = NumericGetDatum((Numeric) ptr);
+		ptr += VARSIZE(ptr);
+	}
+
+	array = construct_array(values, state->nelements, NUMERICOID, -1, false, 'i');
+
+	initStringInfo(&str);
+	appendStringInfo(&str, "(%s,%s)%s:%s",
+					 DatumGetCString(DirectFunctionCall1(float8out,
+											Float8GetDatum(state->cut_lower))),
+					 DatumGetCString(DirectFunctionCall1(float8out,
+											Float8GetDatum(state->cut_upper))),
+					 sample_rate_str(state->sample_shift),
+					 OidOutputFunctionCall(F_ARRAY_OUT, PointerGetDatum(array)));
+
+	PG_RETURN_CSTRING(str.data);
+}
+
+Datum
+trimmed_state_numeric_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo	buf = (StringInfo) PG_GETARG_POINTER(0);
+	int			i, nvalues;
+	int			sample_shift;
+	double		cut_lower,
+				cut_upper;
+	Datum	   *values;
+
+	cut_lower = pq_getmsgfloat8(buf);
+	cut_upper = pq_getmsgfloat8(buf);
+
+	check_cuts(cut_lower, cut_upper);
+
+	sample_shift = pq_getmsgint(buf, sizeof(int32));
+
+	if ((sample_shift < 0) || (sample_shift > MAX_SAMPLE_SHIFT))
+		elog(ERROR, "invalid sample rate in a trimmed state");
+
+	nvalues = pq_getmsgint(buf, sizeof(int32));
+
+	/* each value has at least the length */
+	if ((nvalues < 0) || (nvalues > (buf->len - buf->cursor) / sizeof(int32)))
+		elog(ERROR, "invalid number of values in a trimmed state");
+
+	values = (Datum *) palloc((nvalues + 1) * sizeof(Datum));
+
+	/* each value is stored in the numeric binary format, prefixed by length */
+	for (i = 0; i < nvalues; i++)
+	{
+		StringInfoData	item;
+		int				len = pq_getmsgint(buf, sizeof(int32));
+
+		if ((len < 0) || (len > buf->len - buf->cursor))
+			elog(ERROR, "invalid value length in a trimmed state");
+
+		item.data = (char *) pq_getmsgbytes(buf, len);
+		item.len = len;
+		item.maxlen = len;
+		item.cursor = 0;
+
+		values[i] = DirectFunctionCall3(numeric_recv, PointerGetDatum(&item),
+										ObjectIdGetDatum(InvalidOid),
+										Int32GetDatum(-1));
+	}
+
+	PG_RETURN_BYTEA_P(serialize_numeric(build_state_numeric(values, nvalues,
+															cut_lower, cut_upper,
+															sample_shift)));
+}
+
+Datum
+trimmed_state_numeric_send(PG_FUNCTION_ARGS)
+{
+	int			i;
+	state_numeric *state = deserialize_numeric(PG_GETARG_BYTEA_P(0),
+											   CurrentMemoryContext);
+	char	   *ptr = state->data;
+	StringInfoData buf;
+
+	pq_begintypsend(&buf);
+
+	pq_sendfloat8(&buf, state->cut_lower);
+	pq_sendfloat8(&buf, state->cut_upper);
+	pq_sendint32(&buf, state->sample_shift);
+	pq_sendint32(&buf, state->nelements);
+
+	for (i = 0; i < state->nelements; i++)
+	{
+		bytea  *value = DatumGetByteaPP(DirectFunctionCall1(numeric_send,
+													NumericGetDatum((Numeric) ptr)));
+
+		pq_sendint32(&buf, VARSIZE_ANY_EXHDR(value));
+		pq_sendbytes(&buf, VARDATA_ANY(value), VARSIZE_ANY_EXHDR(value));
+
+		ptr += VARSIZE(ptr);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+Datum
+trimmed_state_final_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("trimmed_state_final_numeric", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_BYTEA_P(serialize_numeric((state_numeric *) PG_GETARG_POINTER(0)));
+}
+
+Datum
+trimmed_merge_numeric(PG_FUNCTION_ARGS)
+{
+	state_numeric *state;
+	state_numeric *value;
+	MemoryContext aggcontext;
+
+	GET_AGG_CONTEXT("trimmed_merge_numeric", fcinfo, aggcontext);
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	value = deserialize_numeric(PG_GETARG_BYTEA_P(1), aggcontext);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_POINTER(value);
+
+	state = (state_numeric *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_POINTER(combine_numeric(state, value, aggcontext));
+}
+
+Datum
+trimmed_state_avg_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_AVG);
+}
+
+Datum
+trimmed_state_var_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_VAR);
+}
+
+Datum
+trimmed_state_var_pop_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_VAR_POP);
+}
+
+Datum
+trimmed_state_var_samp_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_VAR_SAMP);
+}
+
+Datum
+trimmed_state_stddev_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_STDDEV);
+}
+
+Datum
+trimmed_state_stddev_pop_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_STDDEV_POP);
+}
+
+Datum
+trimmed_state_stddev_samp_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_STDDEV_SAMP);
+}
+
+Datum
+trimmed_state_numeric_array(PG_FUNCTION_ARGS)
+{
+	return trimmed_state_numeric(fcinfo, STAT_ALL);
+}
+
+static Datum
+trimmed_state_numeric(FunctionCallInfo fcinfo, int stat)
+{
+	state_numeric *state = deserialize_numeric(PG_GETARG_BYTEA_P(0),
+										   CurrentMemoryContext);
+
+	if (PG_NARGS() == 3)
+	{
+		state->cut_lower = PG_GETARG_FLOAT8(1);
+		state->cut_upper = PG_GETARG_FLOAT8(2);
+
+		check_cuts(state->cut_lower, state->cut_upper);
+	}
+
+	return trimmed_stat_numeric(fcinfo, state, stat);
+}
+
+/*
+ * Parse the "(lower,upper):" prefix of a trimmed state, and return pointer
+ * to the remaining part of the string (with the values). Sampled states
+ * include the sample rate too, e.g. "(lower,upper)@1/8:".
+ */
+static char *
+parse_state_cuts(char *str, double *cut_lower, double *cut_upper,
+				 int *sample_shift)
+{
+	char   *ptr = str;
+	char   *end;
+
+	while (isspace((unsigned char) *ptr))
+		ptr++;
+
+	if (*ptr++ != '(')
+		elog(ERROR, "invalid input syntax for trimmed state: \"%s\"", str);
+
+	*cut_lower = strtod(ptr, &end);
+	if ((end == ptr) || (*end != ','))
+		elog(ERROR, "invalid input syntax for trimmed state: \"%s\"", str);
+
+	ptr = end + 1;
+
+	*cut_upper = strtod(ptr, &end);
+	if ((end == ptr) || (*end != ')'))
+		elog(ERROR, "invalid input syntax for trimmed state: \"%s\"", str);
+
+	ptr = end + 1;
+
+	*sample_shift = 0;
+	if (*ptr == '@')
+	{
+		long	rate;
+
+		if (strncmp(ptr, "@1/", 3) != 0)
+			elog(ERROR, "invalid input syntax for trimmed state: \"%s\"", str);
+
+		ptr += 3;
+
+		/* the rate has to be a power of two */
+		rate = strtol(ptr, &end, 10);
+		if ((end == ptr) || (rate < 2) || (rate > (1L << MAX_SAMPLE_SHIFT)) ||
+			((rate & (rate - 1)) != 0))
+			elog(ERROR, "invalid sample rate of trimmed state: \"%s\"", str);
+
+		while ((1L << *sample_shift) < rate)
+			(*sample_shift)++;
+
+		ptr = end;
+	}
+
+	if (*ptr++ != ':')
+		elog(ERROR, "invalid input syntax for trimmed state: \"%s\"", str);
+
+	check_cuts(*cut_lower, *cut_upper);
+
+	return ptr;
+}
+
+/* the sample rate of a state, as printed in the text format */
+static char *
+sample_rate_str(int sample_shift)
+{
+	if (sample_shift == 0)
+		return "";
+
+	return psprintf("@1/%d", 1 << sample_shift);
+}
+
+static state_numeric *
+build_state_numeric(Datum *values, int nvalues, double cut_lower,
+					double cut_upper, int sample_shift)
+{
+	int		i;
+	state_numeric *state = (state_numeric *) palloc(sizeof(state_numeric));
+
+	state->nelements = nvalues;
+	state->cut_lower = cut_lower;
+	state->cut_upper = cut_upper;
+	state->sorted = false;
+	state->usedlen = 0;
+	state->maxlen = 0;
+	state->params = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+	state->runs = NULL;
+	state->sample_shift = sample_shift;
+	memory_init(&state->memory, CurrentMemoryContext);
+
+	/* detoast the values (which also expands short headers) */
+	for (i = 0; i < nvalues; i++)
+	{
+		values[i] = NumericGetDatum(DatumGetNumeric(values[i]));
+		state->maxlen += VARSIZE(DatumGetPointer(values[i]));
+	}
+
+	state->data = NULL;
+	if (state->maxlen > 0)
+		state->data = palloc(state->maxlen);
+
+	for (i = 0; i < nvalues; i++)
+	{
+		int		len = VARSIZE(DatumGetPointer(values[i]));
+
+		memcpy(state->data + state->usedlen, DatumGetPointer(values[i]), len);
+		state->usedlen += len;
+	}
+
+	sort_state_numeric(state);
+
+	return state;
+}
+
+/*
+ * Extract the only element of a single-statistic result.
+ */
+static Datum
+first_element(Datum array, Oid typid, bool *isnull)
+{
+	Datum  *values;
+	bool   *nulls;
+	int		nvalues;
+	int16	typlen;
+	bool	typbyval;
+	char	typalign;
+
+	get_typlenbyvalalign(typid, &typlen, &typbyval, &typalign);
+
+	deconstruct_array(DatumGetArrayTypeP(array), typid, typlen, typbyval,
+					  typalign, &values, &nulls, &nvalues);
+
+	Assert(nvalues == 1);
+
+	*isnull = nulls[0];
+
+	return values[0];
+}
+
+/*
+ * Serialization, deserialization and combining of the states, shared by
+ * the aggregate support functions and the persistent trimmed_state types.
+ */
+static bytea *
+serialize_numeric(state_numeric *state)
+{
+	StringInfoData buf;
+	bytea  *out;
+
+	/* we want to serialize the data in sorted format */
+	sort_state_numeric(state);
+
+	pq_begintypsend(&buf);
+
+	serialize_header(&buf, state->cut_lower, state->cut_upper,
+					 state->sample_shift, state->nelements);
+
+	pq_sendint32(&buf, state->usedlen);
+	pq_sendbytes(&buf, state->data, state->usedlen);
+
+	/* optional parameters go at the end */
+	serialize_params(&buf, state->params);
+
+	out = pq_endtypsend(&buf);
+
+	counters.serialized += VARSIZE(out);
+	TRACE_TRIMMED_SERIALIZE(state->nelements, VARSIZE(out));
+
+	return out;
+}
+
+static state_numeric *
+deserialize_numeric(bytea *state, MemoryContext context)
+{
+	state_numeric *out;
+	StringInfoData buf;
+	int		i;
+	char   *ptr;
+	MemoryContext oldcontext = MemoryContextSwitchTo(context);
+
+	counters.deserialized += VARSIZE_ANY(state);
+
+	out = (state_numeric *)palloc(sizeof(state_numeric));
+
+	/* each value has at least the varlena header */
+	deserialize_header(&buf, state, &out->cut_lower, &out->cut_upper,
+					   &out->sample_shift, &out->nelements, VARHDRSZ);
+
+	out->usedlen = pq_getmsgint(&buf, sizeof(int32));
+
+	if ((out->usedlen < 0) ||
+		((int64) out->usedlen < (int64) out->nelements * VARHDRSZ) ||
+		(out->usedlen > buf.len - buf.cursor))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: invalid length of values %d",
+						out->usedlen)));
+
+	/* copy the Numeric values into the buffer */
+	out->data = NULL;
+	if (out->usedlen > 0)
+	{
+		out->data = palloc(out->usedlen);
+		pq_copymsgbytes(&buf, out->data, out->usedlen);
+	}
+
+	out->maxlen = out->usedlen;
+	out->sorted = true;
+
+	/* the values have to fill the buffer exactly */
+	ptr = out->data;
+	for (i = 0; i < out->nelements; i++)
+	{
+		if ((out->data + out->usedlen - ptr < VARHDRSZ) ||
+			(VARSIZE(ptr) < VARHDRSZ) ||
+			(VARSIZE(ptr) > out->data + out->usedlen - ptr))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_CORRUPTED),
+					 errmsg("invalid trimmed state: invalid numeric value")));
+
+		ptr += VARSIZE(ptr);
+	}
+
+	if (ptr != out->data + out->usedlen)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: invalid length of values %d",
+						out->usedlen)));
+
+	/* whatever remains are the optional parameters */
+	out->params = deserialize_params(&buf);
+
+	out->nruns = 0;
+	out->maxruns = 0;
+	out->runs = NULL;
+
+	memory_init(&out->memory, context);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	TRACE_TRIMMED_DESERIALIZE(out->nelements, VARSIZE_ANY(state));
+
+	return out;
+}
+
+/*
+ * Combine the states, respecting the memory budget. The states have to be
+ * sampled at the same rate, and the result may need to be halved.
+ */
+static state_numeric *
+combine_data_numeric(state_numeric *state1, state_numeric *state2, MemoryContext agg_context)
+{
+	Assert((state1 != NULL) && (state2 != NULL));
+
+	/* stored states may be built with different cuts */
+	if ((state1->cut_lower != state2->cut_lower) ||
+		(state1->cut_upper != state2->cut_upper))
+		elog(ERROR, "trimmed states with different cuts can't be merged");
+
+	/* empty state does not add anything */
+	if (state2->nelements == 0)
+		return state1;
+
+	/* make sure the new run is sorted (and does not have runs of its own) */
+	sort_state_numeric(state2);
+
+	/* adopt the data, if the current state is empty */
+	if ((state1->nelements == 0) && (state1->nruns == 0))
+	{
+		if (state1->data != NULL)
+			pfree(state1->data);
+
+		state1->data = state2->data;
+		state1->nelements = state2->nelements;
+		state1->usedlen = state2->usedlen;
+		state1->maxlen = state2->maxlen;
+		state1->sorted = true;
+
+		return state1;
+	}
+
+	/* the current data become the first run (we keep the runs sorted) */
+	if (state1->nruns == 0)
+	{
+		sort_state_numeric(state1);
+
+		state1->maxruns = 8;
+		state1->runs = (run_numeric *) MemoryContextAlloc(agg_context,
+								state1->maxruns * sizeof(run_numeric));
+
+		state1->runs[0].data = state1->data;
+		state1->runs[0].usedlen = state1->usedlen;
+		state1->runs[0].nelements = state1->nelements;
+		state1->nruns = 1;
+	}
+	else if (state1->nruns >= state1->maxruns)
+	{
+		state1->maxruns *= 2;
+		state1->runs = (run_numeric *) repalloc(state1->runs,
+								state1->maxruns * sizeof(run_numeric));
+	}
+
+	state1->runs[state1->nruns].data = state2->data;
+	state1->runs[state1->nruns].usedlen = state2->usedlen;
+	state1->runs[state1->nruns].nelements = state2->nelements;
+	state1->nruns++;
+
+	/* the number of elements and used space include the pending runs */
+	state1->nelements += state2->nelements;
+	state1->usedlen += state2->usedlen;
+	state1->sorted = false;
+
+	return state1;
+}
+
+/*
+ * Combine the states, respecting the memory budget. The states have to be
+ * sampled at the same rate, and the result may need to be halved.
+ */
+static state_numeric *
+combine_numeric(state_numeric *state1, state_numeric *state2, MemoryContext agg_context)
+{
+	counters.combines++;
+	TRACE_TRIMMED_COMBINE_START(state1->nelements, state2->nelements);
+
+	/* both states need to sample the values at the same rate */
+	while (state1->sample_shift < state2->sample_shift)
+		halve_state_numeric(state1);
+
+	while (state2->sample_shift < state1->sample_shift)
+		halve_state_numeric(state2);
+
+	state1 = combine_data_numeric(state1, state2, agg_context);
+
+	/* the data of the second state are now accounted to the first one */
+	memory_release(&state2->memory);
+
+	while (! memory_grow(&state1->memory, state1->usedlen))
+	{
+		sample_check(state1->nelements, state1->sample_shift,
+					 state1->cut_lower, state1->cut_upper);
+		halve_state_numeric(state1);
+	}
+
+	TRACE_TRIMMED_COMBINE_DONE(state1->nelements);
+
+	return state1;
+}
+
+static void
+merge_runs_numeric(state_numeric *state)
+{
+	int			i, k, nheap;
+	int		   *heap;
+	char	  **pos;
+	run_numeric *runs = state->runs;
+	int			nruns = state->nruns;
+	char	   *result, *ptr;
+	bool		disjoint = true;
+
+	result = (char *) MemoryContextAlloc(GetMemoryChunkContext(state),
+										 state->usedlen);
+
+	progress_start(PROGRESS_PHASE_MERGE, state->nelements);
+
+	pg_qsort(runs, nruns, sizeof(run_numeric), &run_numeric_comparator);
+
+	for (i = 1; i < nruns; i++)
+	{
+		char   *last = numeric_last(runs[i - 1].data, runs[i - 1].usedlen);
+
+		if (numeric_comparator(&last, &runs[i].data) > 0)
+		{
+			disjoint = false;
+			break;
+		}
+	}
+
+	if (disjoint)
+	{
+		for (i = 0, ptr = result; i < nruns; i++)
+		{
+			memcpy(ptr, runs[i].data, runs[i].usedlen);
+			ptr += runs[i].usedlen;
+		}
+	}
+	else if (nruns == 2)
+		merge_numeric(runs[0].data, runs[0].usedlen,
+					  runs[1].data, runs[1].usedlen, result);
+	else
+	{
+		heap = (int *) palloc(nruns * sizeof(int));
+		pos = (char **) palloc(nruns * sizeof(char *));
+
+		for (i = 0; i < nruns; i++)
+		{
+			heap[i] = i;
+			pos[i] = runs[i].data;
+		}
+
+		/* runs are ordered by the first value, so it's a valid heap already */
+		nheap = nruns;
+
+		for (k = 0, ptr = result; k < state->nelements; k++)
+		{
+			int		r = heap[0];
+
+			progress_check(k);
+
+			memcpy(ptr, pos[r], VARSIZE(pos[r]));
+			ptr += VARSIZE(pos[r]);
+			pos[r] += VARSIZE(pos[r]);
+
+			/* remove exhausted runs from the heap */
+			if (pos[r] == runs[r].data + runs[r].usedlen)
+				heap[0] = heap[--nheap];
+
+			heap_sift_numeric(pos, heap, nheap);
+		}
+
+		Assert(nheap == 0);
+		Assert(ptr == result + state->usedlen);
+
+		pfree(heap);
+		pfree(pos);
+	}
+
+	for (i = 0; i < nruns; i++)
+		pfree(runs[i].data);
+
+	pfree(runs);
+
+	state->data = result;
+	state->maxlen = state->usedlen;
+	state->runs = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+
+	progress_end();
+}
+
+static void
+heap_sift_numeric(char **pos, int *heap, int nheap)
+{
+	int		i = 0;
+
+	while (true)
+	{
+		int		child = 2 * i + 1;
+		int		tmp;
+
+		if (child >= nheap)
+			break;
+
+		/* pick the smaller child */
+		if ((child + 1 < nheap) &&
+			(numeric_comparator(&pos[heap[child + 1]], &pos[heap[child]]) < 0))
+			child++;
+
+		if (numeric_comparator(&pos[heap[i]], &pos[heap[child]]) <= 0)
+			break;
+
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+
+		i = child;
+	}
+}
+
+/*
+ * For numeric we can't gallop, as the values are variable-length, but we
+ * still concatenate the buffers when the ranges don't overlap (finding the
+ * last value requires walking the buffer, but that's much cheaper than
+ * comparing the values), and copy the remaining part at once.
+ */
+static void
+merge_numeric(char *a, int alen, char *b, int blen, char *out)
+{
+	char   *enda = a + alen,
+		   *endb = b + blen;
+	int64	k = 0;
+
+	if ((alen > 0) && (blen > 0))
+	{
+		char   *lasta = numeric_last(a, alen);
+		char   *lastb = numeric_last(b, blen);
+
+		if (numeric_comparator(&lasta, &b) <= 0)
+		{
+			memcpy(out, a, alen);
+			memcpy(out + alen, b, blen);
+			return;
+		}
+
+		if (numeric_comparator(&lastb, &a) < 0)
+		{
+			memcpy(out, b, blen);
+			memcpy(out + blen, a, alen);
+			return;
+		}
+	}
+
+	while ((a < enda) && (b < endb))
+	{
+		Numeric element;
+
+		progress_check(k++);
+
+		if (numeric_comparator(&a, &b) <= 0)
+		{
+			element = (Numeric)a;
+			a += VARSIZE(a);
+		}
+		else
+		{
+			element = (Numeric)b;
+			b += VARSIZE(b);
+		}
+
+		/* actually copy the value */
+		memcpy(out, element, VARSIZE(element));
+		out += VARSIZE(element);
+	}
+
+	Assert((a <= enda) && (b <= endb));
+
+	/* copy the remaining part (at most one of those is non-empty) */
+	memcpy(out, a, enda - a);
+	out += (enda - a);
+
+	memcpy(out, b, endb - b);
+}
+
+static char *
+numeric_last(char *data, int len)
+{
+	char   *ptr = data;
+
+	Assert(len > 0);
+
+	while (ptr + VARSIZE(ptr) < data + len)
+		ptr += VARSIZE(ptr);
+
+	return ptr;
+}
+
+static int
+numeric_comparator(const void *a, const void *b)
+{
+	return DatumGetInt32(
+			DirectFunctionCall2(numeric_cmp,
+								NumericGetDatum(* (Numeric *) a),
+								NumericGetDatum(* (Numeric *) b)));
+}
+
+static int
+run_numeric_comparator(const void *a, const void *b)
+{
+	return numeric_comparator(&((run_numeric*)a)->data,
+							  &((run_numeric*)b)->data);
+}
+
+static Numeric
+create_numeric(int value)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall1(int4_numeric,
+								Int32GetDatum(value)));
+}
+
+static Numeric
+float_to_numeric(double value)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall1(float8_numeric,
+								Float8GetDatum(value)));
+}
+
+static Numeric
+add_numeric(Numeric a, Numeric b)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall2(numeric_add,
+								NumericGetDatum(a),
+								NumericGetDatum(b)));
+}
+
+static Numeric
+div_numeric(Numeric a, Numeric b)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall2(numeric_div,
+								NumericGetDatum(a),
+								NumericGetDatum(b)));
+}
+
+static Numeric
+mul_numeric(Numeric a, Numeric b)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall2(numeric_mul,
+								NumericGetDatum(a),
+								NumericGetDatum(b)));
+}
+
+static Numeric
+sub_numeric(Numeric a, Numeric b)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall2(numeric_sub,
+								NumericGetDatum(a),
+								NumericGetDatum(b)));
+}
+
+static Numeric
+sqrt_numeric(Numeric a)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall1(numeric_sqrt,
+								NumericGetDatum(a)));
+}
+
+static Numeric
+round_numeric(Numeric a, int scale)
+{
+	return DatumGetNumeric(
+			DirectFunctionCall2(numeric_round,
+								NumericGetDatum(a),
+								Int32GetDatum(scale)));
+}
+
+/* scale of a value, special values (NaN, infinities) have no scale */
+static int
+scale_numeric(Numeric a)
+{
+	if (numeric_is_nan(a))
+		return 0;
+
+#if PG_VERSION_NUM >= 140000
+	if (numeric_is_inf(a))
+		return 0;
+#endif
+
+	return DatumGetInt32(
+			DirectFunctionCall1(numeric_scale,
+								NumericGetDatum(a)));
+}
+
+/*
+ * Quantiles of the kept part of the (sorted) data, interpolated the same way
+ * as percentile_cont does it. The cut boundaries (min/max of the kept part)
+ * and median are simply special quantiles.
+ */
+static double
+stat_quantile(int stat)
+{
+	switch (stat)
+	{
+		case STAT_MIN:
+			return 0.0;
+
+		case STAT_MAX:
+			return 1.0;
+
+		case STAT_MEDIAN:
+			return 0.5;
+	}
+
+	elog(ERROR, "unknown order statistic %d", stat);
+	return 0;	/* keep compiler quiet */
+}
+
+/*
+ * For numeric we need to walk the buffer to find the values, so we compute
+ * the positions for all the quantiles at once, and then do a single pass.
+ * The pointer points at the first kept value, cnt is the number of values.
+ */
+static void
+quantiles_numeric(char *ptr, int cnt, double *quantiles, int nquantiles,
+				  Datum *result)
+{
+	int		i, j;
+	int	   *positions = (int *) palloc(2 * nquantiles * sizeof(int));
+	int	   *order = (int *) palloc(2 * nquantiles * sizeof(int));
+	Numeric *values = (Numeric *) palloc(2 * nquantiles * sizeof(Numeric));
+
+	for (i = 0; i < nquantiles; i++)
+	{
+		double	pos = quantiles[i] * (cnt - 1);
+
+		positions[2 * i] = (int) floor(pos);
+		positions[2 * i + 1] = (int) ceil(pos);
+	}
+
+	sort_indexes(positions, 2 * nquantiles, order);
+
+	for (i = 0, j = 0; i < 2 * nquantiles; i++)
+	{
+		for (; j < positions[order[i]]; j++)
+			ptr += VARSIZE(ptr);
+
+		values[order[i]] = (Numeric) ptr;
+	}
+
+	for (i = 0; i < nquantiles; i++)
+	{
+		double	pos = quantiles[i] * (cnt - 1);
+		double	frac = pos - floor(pos);
+
+		result[i] = NumericGetDatum(interpolate_numeric(values[2 * i],
+														values[2 * i + 1],
+														frac));
+	}
+}
+
+/*
+ * Interpolate between two neighboring values. The result has the scale of
+ * the values (the larger one), extended only by the digits the interpolation
+ * actually needs, so exact hits and interpolated quantiles of the same data
+ * are printed the same way (e.g. 300 and 300.75, not 300.0 and 300.75).
+ */
+static Numeric
+interpolate_numeric(Numeric lo, Numeric hi, double frac)
+{
+	int		scale = Max(scale_numeric(lo), scale_numeric(hi));
+	Numeric	result;
+
+	if ((frac == 0) || (numeric_comparator(&lo, &hi) == 0))
+		return round_numeric(lo, scale);
+
+	result = add_numeric(lo, mul_numeric(sub_numeric(hi, lo),
+										 float_to_numeric(frac)));
+
+	/* strip the trailing zeros the multiplication added */
+	while (scale_numeric(result) > scale)
+	{
+		Numeric	rounded = round_numeric(result, scale_numeric(result) - 1);
+
+		if (numeric_comparator(&rounded, &result) != 0)
+			break;
+
+		result = rounded;
+	}
+
+	return result;
+}
+
+/*
+ * Helper functions used to prepare the resulting array (when there's
+ * an array of quantiles).
+ */
+static Datum
+double_to_array(FunctionCallInfo fcinfo, double * d, int len)
+{
+	ArrayBuildState *astate = NULL;
+	int		 i;
+
+	for (i = 0; i < len; i++) {
+
+		/* stash away this field */
+		astate = accumArrayResult(astate,
+								  Float8GetDatum(d[i]),
+								  false,
+								  FLOAT8OID,
+								  CurrentMemoryContext);
+	}
+
+	return makeArrayResult(astate, CurrentMemoryContext);
+}
+
+static Datum
+numeric_to_array(FunctionCallInfo fcinfo, Numeric * d, int len)
+{
+	ArrayBuildState *astate = NULL;
+	int		 i;
+
+	for (i = 0; i < len; i++) {
+
+		/* stash away this field */
+		astate = accumArrayResult(astate,
+								  NumericGetDatum(d[i]),
+								  false,
+								  NUMERICOID,
+								  CurrentMemoryContext);
+
+	}
+
+	return makeArrayResult(astate, CurrentMemoryContext);
+}
+
+/*
+ * Build a one-dimensional array (without NULLs) from a C array of fixed-width
+ * values. The values of all the fixed-width types are aligned to their width,
+ * so the array data has exactly the same layout as the C array, and we can
+ * copy it at once (instead of accumulating the values one by one).
+ */
+static Datum
+fixed_to_array(void *elements, int nelements, int width, Oid typid)
+{
+	ArrayType  *result;
+	Size		nbytes = (Size) nelements * width;
+	Size		len = ARR_OVERHEAD_NONULLS(1) + nbytes;
+
+	if (!AllocSizeIsValid(len))
+		elog(ERROR, "too many values for an array (%d values)", nelements);
+
+	result = (ArrayType *) palloc(len);
+
+	SET_VARSIZE(result, len);
+	result->ndim = 1;
+	result->dataoffset = 0;		/* no NULLs */
+	result->elemtype = typid;
+
+	ARR_DIMS(result)[0] = nelements;
+	ARR_LBOUND(result)[0] = 1;
+
+	memcpy(ARR_DATA_PTR(result), elements, nbytes);
+
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
+/*
+ * Parse the parameters of the transition function. The cuts (arguments 2 and
+ * 3) are either a single pair of fractions, or a pair of arrays with multiple
+ * cut configurations (evaluated from a single sorted state). The optional
+ * argument 4 is a list of statistics to compute by the combined aggregate,
+ * a list of quantiles, or a confidence level (optionally followed by the
+ * number of bootstrap resamples in argument 5).
+ *
+ * The arrays are kept in the optional parameters, which are only allocated
+ * when needed.
+ */
+static void
+parse_params(FunctionCallInfo fcinfo, MemoryContext aggcontext,
+			 double *cut_lower, double *cut_upper, trimmed_params **params)
+{
+	int			i;
+	int			ncuts = 0,
+				nquantiles = 0,
+				nstats = 0,
+				nresamples = 0;
+	double		confidence = 0;
+	Datum	   *lower = NULL,
+			   *upper = NULL,
+			   *quantiles = NULL,
+			   *stats = NULL;
+	bool	   *lower_nulls, *upper_nulls, *quantiles_nulls, *stats_nulls;
+
+	if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
+		elog(ERROR, "both upper and lower cut must not be NULL");
+
+	*params = NULL;
+
+	if (get_fn_expr_argtype(fcinfo->flinfo, 2) == FLOAT8ARRAYOID)
+	{
+		int		nupper;
+
+		ArrayType  *lower_array = PG_GETARG_ARRAYTYPE_P(2);
+		ArrayType  *upper_array = PG_GETARG_ARRAYTYPE_P(3);
+
+		if (ARR_NDIM(lower_array) > 1 || ARR_NDIM(upper_array) > 1)
+			elog(ERROR, "arrays of cuts need to be one-dimensional");
+
+		deconstruct_array(lower_array, FLOAT8OID, sizeof(float8),
+						  FLOAT8PASSBYVAL, 'd', &lower, &lower_nulls, &ncuts);
+
+		deconstruct_array(upper_array, FLOAT8OID, sizeof(float8),
+						  FLOAT8PASSBYVAL, 'd', &upper, &upper_nulls, &nupper);
+
+		if (ncuts == 0)
+			elog(ERROR, "arrays of cuts must not be empty");
+
+		if (ncuts != nupper)
+			elog(ERROR, "arrays of lower and upper cuts need to have the same length");
+
+		/* the single-cut fields are not used in this case */
+		*cut_lower = 0;
+		*cut_upper = 0;
+	}
+	else
+	{
+		*cut_lower = PG_GETARG_FLOAT8(2);
+		*cut_upper = PG_GETARG_FLOAT8(3);
+
+		check_cuts(*cut_lower, *cut_upper);
+	}
+
+	/* confidence level (and number of resamples) of the interval */
+	if ((PG_NARGS() > 4) &&
+		(get_fn_expr_argtype(fcinfo->flinfo, 4) == FLOAT8OID))
+	{
+		if (PG_ARGISNULL(4))
+			elog(ERROR, "confidence level must not be NULL");
+
+		confidence = PG_GETARG_FLOAT8(4);
+
+		if (confidence <= 0.0 || confidence >= 1.0)
+			elog(ERROR, "confidence level needs to be between 0 and 1 (exclusive)");
+
+		if (PG_NARGS() > 5)
+		{
+			if (PG_ARGISNULL(5))
+				elog(ERROR, "number of resamples must not be NULL");
+
+			nresamples = PG_GETARG_INT32(5);
+
+			if (nresamples <= 0)
+				elog(ERROR, "number of resamples needs to be positive");
+		}
+	}
+	/* list of quantiles (of the kept part) */
+	else if ((PG_NARGS() > 4) &&
+		(get_fn_expr_argtype(fcinfo->flinfo, 4) == FLOAT8ARRAYOID))
+	{
+		ArrayType  *quantiles_array;
+
+		if (PG_ARGISNULL(4))
+			elog(ERROR, "list of quantiles must not be NULL");
+
+		quantiles_array = PG_GETARG_ARRAYTYPE_P(4);
+
+		if (ARR_NDIM(quantiles_array) > 1)
+			elog(ERROR, "list of quantiles needs to be one-dimensional");
+
+		deconstruct_array(quantiles_array, FLOAT8OID, sizeof(float8),
+						  FLOAT8PASSBYVAL, 'd', &quantiles, &quantiles_nulls,
+						  &nquantiles);
+
+		if (nquantiles == 0)
+			elog(ERROR, "list of quantiles must not be empty");
+	}
+	/* list of statistics requested from the combined aggregate */
+	else if (PG_NARGS() > 4)
+	{
+		ArrayType  *stats_array;
+
+		if (PG_ARGISNULL(4))
+			elog(ERROR, "list of statistics must not be NULL");
+
+		stats_array = PG_GETARG_ARRAYTYPE_P(4);
+
+		if (ARR_NDIM(stats_array) > 1)
+			elog(ERROR, "list of statistics needs to be one-dimensional");
+
+		deconstruct_array(stats_array, TEXTOID, -1, false, 'i',
+						  &stats, &stats_nulls, &nstats);
+
+		if (nstats == 0)
+			elog(ERROR, "list of statistics must not be empty");
+	}
+
+	/* regular aggregate with a single cut, no parameters needed */
+	if ((ncuts == 0) && (nquantiles == 0) && (nstats == 0) && (confidence == 0))
+		return;
+
+	*params = (trimmed_params *) MemoryContextAlloc(aggcontext,
+													PARAMS_SIZE(ncuts, nquantiles, nstats));
+
+	(*params)->len = PARAMS_SIZE(ncuts, nquantiles, nstats);
+	(*params)->ncuts = ncuts;
+	(*params)->nquantiles = nquantiles;
+	(*params)->nstats = nstats;
+	(*params)->confidence = confidence;
+	(*params)->nresamples = nresamples;
+
+	for (i = 0; i < ncuts; i++)
+	{
+		if (lower_nulls[i] || upper_nulls[i])
+			elog(ERROR, "both upper and lower cut must not be NULL");
+
+		PARAMS_CUT_LOWER(*params, i) = DatumGetFloat8(lower[i]);
+		PARAMS_CUT_UPPER(*params, i) = DatumGetFloat8(upper[i]);
+
+		check_cuts(PARAMS_CUT_LOWER(*params, i), PARAMS_CUT_UPPER(*params, i));
+	}
+
+	for (i = 0; i < nquantiles; i++)
+	{
+		if (quantiles_nulls[i])
+			elog(ERROR, "list of quantiles must not contain NULL values");
+
+		PARAMS_QUANTILES(*params)[i] = DatumGetFloat8(quantiles[i]);
+
+		if (PARAMS_QUANTILES(*params)[i] < 0.0 || PARAMS_QUANTILES(*params)[i] > 1.0)
+			elog(ERROR, "quantiles need to be between 0 and 1 (inclusive)");
+	}
+
+	for (i = 0; i < nstats; i++)
+	{
+		if (stats_nulls[i])
+			elog(ERROR, "list of statistics must not contain NULL values");
+
+		PARAMS_STATS(*params)[i] = parse_stat(TextDatumGetCString(stats[i]));
+	}
+}
+
+/*
+ * Translate name of a statistic (as used by the regular aggregates).
+ */
+static int
+parse_stat(const char *name)
+{
+	int		i;
+
+	for (i = 0; i < lengthof(stat_names); i++)
+		if (pg_strcasecmp(name, stat_names[i]) == 0)
+			return i;
+
+	elog(ERROR, "unknown statistic \"%s\"", name);
+	return -1;	/* keep compiler quiet */
+}
+
+static void
+check_cuts(double cut_lower, double cut_upper)
+{
+	if (cut_lower < 0.0 || cut_lower >= 1.0)
+		elog(ERROR, "lower cut needs to be between 0 and 1 (inclusive)");
+
+	if (cut_upper < 0.0 || cut_upper >= 1.0)
+		elog(ERROR, "upper cut needs to be between 0 and 1 (inclusive)");
+
+	if (cut_lower + cut_upper >= 1.0)
+		elog(ERROR, "lower and upper cut sum to >= 1.0");
+}
+
+/*
+ * SERIALIZED FORMAT
+ *
+ * The serialized states are passed between parallel workers, but they are
+ * also the internal representation of the trimmed_state types, i.e. stored
+ * on disk. So the format does not depend on the layout of the in-memory
+ * structs, and starts with a version:
+ *
+ *	version			uint8 (STATE_FORMAT_VERSION)
+ *	cut_lower		float8
+ *	cut_upper		float8
+ *	sample_shift	int32
+ *	nelements		int32
+ *	values			sorted values (see below)
+ *	parameters		optional, until the end of the state (see below)
+ *
+ * The fixed-width values are stored as an array in the native format (the
+ * same as the other on-disk data), the numeric values as the total length
+ * (int32) followed by the varlena values. The header and parameters are
+ * written by pq_send* (in network byte order).
+ */
+#define STATE_FORMAT_VERSION	1
+
+#define STATE_HEADER_SIZE		(1 + 2 * sizeof(float8) + 2 * sizeof(int32))
+
+static void
+serialize_header(StringInfo buf, double cut_lower, double cut_upper,
+				 int sample_shift, int nelements)
+{
+	pq_sendbyte(buf, STATE_FORMAT_VERSION);
+	pq_sendfloat8(buf, cut_lower);
+	pq_sendfloat8(buf, cut_upper);
+	pq_sendint32(buf, sample_shift);
+	pq_sendint32(buf, nelements);
+}
+
+/*
+ * Read and validate the header of a serialized state. The 'width' is the
+ * minimum size of a value, used to check the number of values against the
+ * size of the state.
+ */
+static void
+deserialize_header(StringInfo buf, bytea *state, double *cut_lower,
+				   double *cut_upper, int *sample_shift, int *nelements,
+				   int width)
+{
+	int		version;
+
+	buf->data = VARDATA_ANY(state);
+	buf->len = VARSIZE_ANY_EXHDR(state);
+	buf->maxlen = buf->len;
+	buf->cursor = 0;
+
+	if (buf->len < STATE_HEADER_SIZE)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: %d bytes is too short", buf->len)));
+
+	version = pq_getmsgbyte(buf);
+
+	if (version != STATE_FORMAT_VERSION)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: unsupported format version %d",
+						version)));
+
+	*cut_lower = pq_getmsgfloat8(buf);
+	*cut_upper = pq_getmsgfloat8(buf);
+	*sample_shift = pq_getmsgint(buf, sizeof(int32));
+	*nelements = pq_getmsgint(buf, sizeof(int32));
+
+	if (!(*cut_lower >= 0 && *cut_upper >= 0 && *cut_lower + *cut_upper < 1.0))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: invalid cuts")));
+
+	if ((*sample_shift < 0) || (*sample_shift > MAX_SAMPLE_SHIFT))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: invalid sample rate")));
+
+	if ((*nelements < 0) || (*nelements > (buf->len - buf->cursor) / width))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: invalid number of values %d",
+						*nelements)));
+}
+
+/*
+ * The optional parameters: the counts, the confidence level and resamples,
+ * followed by the cuts and quantiles (float8) and statistics (int32).
+ */
+static void
+serialize_params(StringInfo buf, trimmed_params *params)
+{
+	int		i;
+	int	   *stats;
+
+	if (params == NULL)
+		return;
+
+	stats = PARAMS_STATS(params);
+
+	pq_sendint32(buf, params->ncuts);
+	pq_sendint32(buf, params->nquantiles);
+	pq_sendint32(buf, params->nstats);
+	pq_sendfloat8(buf, params->confidence);
+	pq_sendint32(buf, params->nresamples);
+
+	for (i = 0; i < 2 * params->ncuts + params->nquantiles; i++)
+		pq_sendfloat8(buf, params->cuts[i]);
+
+	for (i = 0; i < params->nstats; i++)
+		pq_sendint32(buf, stats[i]);
+}
+
+/* read the parameters (or NULL, when the state ends before them) */
+static trimmed_params *
+deserialize_params(StringInfo buf)
+{
+	int		i;
+	int		ncuts, nquantiles, nstats;
+	int	   *stats;
+	trimmed_params *params;
+
+	if (buf->cursor == buf->len)
+		return NULL;
+
+	if (buf->len - buf->cursor < 4 * sizeof(int32) + sizeof(float8))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: invalid parameters")));
+
+	ncuts = pq_getmsgint(buf, sizeof(int32));
+	nquantiles = pq_getmsgint(buf, sizeof(int32));
+	nstats = pq_getmsgint(buf, sizeof(int32));
+
+	/* each value takes at least four bytes */
+	if ((ncuts < 0) || (nquantiles < 0) || (nstats < 0) ||
+		((int64) 2 * ncuts + nquantiles + nstats > (buf->len - buf->cursor) / sizeof(int32)))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: invalid parameters")));
+
+	params = (trimmed_params *) palloc(PARAMS_SIZE(ncuts, nquantiles, nstats));
+	params->len = PARAMS_SIZE(ncuts, nquantiles, nstats);
+	params->ncuts = ncuts;
+	params->nquantiles = nquantiles;
+	params->nstats = nstats;
+	params->confidence = pq_getmsgfloat8(buf);
+	params->nresamples = pq_getmsgint(buf, sizeof(int32));
+
+	for (i = 0; i < 2 * ncuts + nquantiles; i++)
+		params->cuts[i] = pq_getmsgfloat8(buf);
+
+	stats = PARAMS_STATS(params);
+	for (i = 0; i < nstats; i++)
+		stats[i] = pq_getmsgint(buf, sizeof(int32));
+
+	if (buf->cursor != buf->len)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid trimmed state: unexpected data after parameters")));
+
+	return params;
+}
+
+/*
+ * Number of cut configurations evaluated by the multi-cut aggregates. When
+ * there are no cut arrays, we evaluate just the regular single cut.
+ */
+static int
+multi_configs(trimmed_params *params)
+{
+	if ((params == NULL) || (params->ncuts == 0))
+		return 1;
+
+	return params->ncuts;
+}
+
+/*
+ * Determine which statistics to compute - either a single one (for the
+ * regular aggregates), the list requested by the user, or all of them. We
+ * also determine which of the (more expensive) sums are actually needed.
+ */
+static int *
+multi_stats(trimmed_params *params, int *stat, int *nstats,
+			bool *need_x2, bool *need_dev2)
+{
+	int		i;
+	int	   *stats;
+
+	if (*stat != STAT_ALL)
+	{
+		stats = stat;
+		*nstats = 1;
+	}
+	else if ((params != NULL) && (params->nstats > 0))
+	{
+		stats = PARAMS_STATS(params);
+		*nstats = params->nstats;
+	}
+	else
+	{
+		stats = (int *) palloc(NUM_STATS * sizeof(int));
+		*nstats = NUM_STATS;
+
+		for (i = 0; i < NUM_STATS; i++)
+			stats[i] = i;
+	}
+
+	*need_x2 = false;
+	*need_dev2 = false;
+
+	for (i = 0; i < *nstats; i++)
+	{
+		if ((stats[i] == STAT_VAR) || (stats[i] == STAT_STDDEV))
+			*need_dev2 = true;
+		else if ((stats[i] != STAT_AVG) && !STAT_IS_ORDER(stats[i]))
+			*need_x2 = true;
+	}
+
+	return stats;
+}
+
+/*
+ * Compute boundaries (from/to indexes) for all the cut configurations, and
+ * also the order of the boundaries (so that we can walk them in a single
+ * pass through the sorted data).
+ */
+static void
+multi_bounds(int nelements, double cut_lower, double cut_upper,
+			 trimmed_params *params, int *bounds, int *order)
+{
+	int		i;
+	int		nconfigs = multi_configs(params);
+
+	for (i = 0; i < nconfigs; i++)
+	{
+		if ((params != NULL) && (params->ncuts > 0))
+		{
+			cut_lower = PARAMS_CUT_LOWER(params, i);
+			cut_upper = PARAMS_CUT_UPPER(params, i);
+		}
+
+		bounds[2 * i] = floor(nelements * cut_lower);
+		bounds[2 * i + 1] = nelements - floor(nelements * cut_upper);
+	}
+
+	sort_indexes(bounds, 2 * nconfigs, order);
+}
+
+/*
+ * Determine order of the indexes (boundaries, positions of quantiles, ...)
+ * so that we can walk them in a single pass. We use a simple insertion
+ * sort, as there's only a couple of them.
+ */
+static void
+sort_indexes(int *indexes, int nindexes, int *order)
+{
+	int		i, j;
+
+	for (i = 0; i < nindexes; i++)
+	{
+		for (j = i; (j > 0) && (indexes[order[j - 1]] > indexes[i]); j--)
+			order[j] = order[j - 1];
+
+		order[j] = i;
+	}
+}
+
+/*
+ * Compute a single statistic from the sums (of values, squares and squared
+ * deviations from the average), the same way the regular aggregates do.
+ */
+static double
+multi_stat(int stat, int64 cnt, double sum_x, double sum_x2, double sum_dev2)
+{
+	double	numerator = ((double) cnt * sum_x2 - sum_x * sum_x);
+
+	/* Watch out for roundoff error producing a negative numerator */
+	if ((numerator <= 0) && (stat != STAT_AVG) &&
+		(stat != STAT_VAR) && (stat != STAT_STDDEV))
+		return 0;
+
+	switch (stat)
+	{
+		case STAT_AVG:
+			return sum_x / cnt;
+
+		case STAT_VAR_POP:
+			return numerator / ((double) cnt * cnt);
+
+		case STAT_VAR_SAMP:
+			return numerator / ((double) cnt * (cnt - 1));
+
+		case STAT_VAR:
+			return sum_dev2 / cnt;
+
+		case STAT_STDDEV_POP:
+			return sqrt(numerator / ((double) cnt * cnt));
+
+		case STAT_STDDEV_SAMP:
+			return sqrt(numerator / ((double) cnt * (cnt - 1)));
+
+		case STAT_STDDEV:
+			return sqrt(sum_dev2 / cnt);
+	}
+
+	elog(ERROR, "unknown statistic %d", stat);
+	return 0;	/* keep compiler quiet */
+}
+
+/*
+ * The numeric variant gets the (non-negative) numerator shared by var_pop
+ * and var_samp directly, so that it's computed only once per configuration.
+ */
+static Numeric
+multi_stat_numeric(int stat, int cnt, Numeric sum_x, Numeric numerator,
+				   Numeric sum_dev2)
+{
+	Numeric	cntNumeric = create_numeric(cnt);
+
+	switch (stat)
+	{
+		case STAT_AVG:
+			return div_numeric(sum_x, cntNumeric);
+
+		case STAT_VAR_POP:
+			return div_numeric(numerator, mul_numeric(cntNumeric, cntNumeric));
+
+		case STAT_VAR_SAMP:
+			if (cnt == 1)
+				return create_numeric(0);
+
+			return div_numeric(numerator,
+							   mul_numeric(cntNumeric, create_numeric(cnt - 1)));
+
+		case STAT_VAR:
+			return div_numeric(sum_dev2, cntNumeric);
+
+		case STAT_STDDEV_POP:
+			return sqrt_numeric(div_numeric(numerator,
+											mul_numeric(cntNumeric, cntNumeric)));
+
+		case STAT_STDDEV_SAMP:
+			if (cnt == 1)
+				return create_numeric(0);
+
+			return sqrt_numeric(div_numeric(numerator,
+											mul_numeric(cntNumeric,
+														create_numeric(cnt - 1))));
+
+		case STAT_STDDEV:
+			return sqrt_numeric(div_numeric(sum_dev2, cntNumeric));
+	}
+
+	elog(ERROR, "unknown statistic %d", stat);
+	return NULL;	/* keep compiler quiet */
+}
+
+/*
+ * Build the result of the multi-cut aggregates - one value per configuration
+ * (or a 2-D array, with one row of statistics per configuration). With just
+ * a single cut configuration, we return a plain list of statistics.
+ */
+static Datum
+multi_to_array(Datum *values, bool *nulls, trimmed_params *params,
+			   int nconfigs, int nstats, Oid typid)
+{
+	int		ndims;
+	int		dims[2];
+	int		lbs[2] = {1, 1};
+	int16	typlen;
+	bool	typbyval;
+	char	typalign;
+
+	if ((params == NULL) || (params->ncuts == 0))
+	{
+		ndims = 1;
+		dims[0] = nstats;
+	}
+	else if (nstats == 1)
+	{
+		ndims = 1;
+		dims[0] = nconfigs;
+	}
+	else
+	{
+		ndims = 2;
+		dims[0] = nconfigs;
+		dims[1] = nstats;
+	}
+
+	get_typlenbyvalalign(typid, &typlen, &typbyval, &typalign);
+
+	PG_RETURN_ARRAYTYPE_P(construct_md_array(values, nulls, ndims, dims, lbs,
+											 typid, typlen, typbyval, typalign));
+}
+
+static void
+sort_state_numeric(state_numeric *state)
+{
+	int		i;
+	char   *data;
+	char   *ptr;
+	Numeric *items;
+	instr_time	start;
+
 	if (state->sorted)
 		return;
 
-	pg_qsort(state->elements, state->nelements, sizeof(double), &double_comparator);
-	state->sorted = true;
+	INSTR_TIME_SET_CURRENT(start);
+
+	/* merge the sorted runs collected by combine */
+	if (state->nruns > 0)
+	{
+		TRACE_TRIMMED_MERGE_START(state->nruns, state->nelements);
+		merge_runs_numeric(state);
+		state->sorted = true;
+		counters_timing(&counters.merges, start);
+		TRACE_TRIMMED_MERGE_DONE(state->nelements);
+		return;
+	}
+
+	TRACE_TRIMMED_SORT_START(state->nelements, state->usedlen);
+
+	/*
+	 * we'll sort a local copy of the data, and then copy it back (we want
+	 * to put the result into the proper memory context)
+	 */
+	items = (Numeric*)palloc(sizeof(Numeric) * state->nelements);
+	data = palloc(state->usedlen);
+	memcpy(data, state->data, state->usedlen);
+
+	/* parse the data into array of Numeric items, for sorting */
+	i = 0;
+	ptr = data;
+	while (ptr < data + state->usedlen)
+	{
+		items[i++] = (Numeric)ptr;
+		ptr += VARSIZE(ptr);
+
+		Assert(i <= state->nelements);
+		Assert(ptr <= (data + state->usedlen));
+	}
+
+	Assert(i == state->nelements);
+	Assert(ptr == (data + state->usedlen));
+
+	sort_chunked(items, state->nelements, sizeof(Numeric), &numeric_comparator);
+
+	/* copy the values from the local array back into the state */
+	ptr = state->data;
+	for (i = 0; i < state->nelements; i++)
+	{
+		memcpy(ptr, items[i], VARSIZE(items[i]));
+		ptr += VARSIZE(items[i]);
+
+		Assert(ptr <= state->data + state->usedlen);
+	}
+
+	Assert(ptr == state->data + state->usedlen);
+
+	pfree(items);
+	pfree(data);
+
+	state->sorted = true;
+
+	counters_timing(&counters.sorts, start);
+	TRACE_TRIMMED_SORT_DONE(state->nelements);
+}
+
+/*
+ * PLANNER SUPPORT
+ *
+ * The aggregates use "internal" transition states without SSPACE, so the
+ * planner assumes each group needs a fixed amount of memory. But the states
+ * keep all the values, so the hash table needs as much memory as the whole
+ * input, no matter how many groups there are. When the aggregated values
+ * are not expected to fit into hash_mem, we penalize the hashed paths (if
+ * there's an alternative), so that we don't build a hash table far larger
+ * than allowed.
+ *
+ * The hook is installed when the library gets loaded, so the first query
+ * in a session is planned without it (unless the library is preloaded).
+ */
+
+static create_upper_paths_hook_type prev_create_upper_paths_hook = NULL;
+
+/*
+ * Is the aggregate a member of this extension? Identified by the dependency
+ * on the extension (not by names, which anyone can pick for their own
+ * functions). The extension OID is looked up by the caller, once per query.
+ */
+static bool
+is_trimmed_aggregate(Oid aggfnoid, Oid extoid)
+{
+	return OidIsValid(extoid) &&
+		(getExtensionOfObject(ProcedureRelationId, aggfnoid) == extoid);
+}
+
+/*
+ * Average width of an aggregate argument. For columns of base relations we
+ * use the widths the planner got from the statistics (so e.g. for arrays it
+ * reflects the average number of elements), otherwise a generic estimate
+ * for the data type.
+ */
+static int32
+argument_width(PlannerInfo *root, Node *arg)
+{
+	if (IsA(arg, Var) && (((Var *) arg)->varlevelsup == 0))
+	{
+		Var		   *var = (Var *) arg;
+		RelOptInfo *rel = NULL;
+
+		if (var->varno < root->simple_rel_array_size)
+			rel = root->simple_rel_array[var->varno];
+
+		if ((rel != NULL) && (rel->attr_widths != NULL) &&
+			(var->varattno >= rel->min_attr) &&
+			(var->varattno <= rel->max_attr) &&
+			(rel->attr_widths[var->varattno - rel->min_attr] > 0))
+			return rel->attr_widths[var->varattno - rel->min_attr];
+	}
+
+	return get_typavgwidth(exprType(arg), exprTypmod(arg));
+}
+
+/*
+ * Estimate the memory needed by the trimmed aggregates in the query, i.e.
+ * the size of the aggregated values for all the input rows. The states
+ * keep all the arguments that vary between the rows (the values, and also
+ * the weights, or the keys and payloads), not just the first one. The other
+ * arguments (cuts and other parameters) are not stored per row.
+ */
+static double
+estimate_state_memory(PlannerInfo *root, double input_rows)
+{
+	List	   *exprs;
+	ListCell   *lc;
+	double		width = 0;
+	Oid			extoid = InvalidOid;
+	bool		extoid_valid = false;
+
+	exprs = pull_var_clause((Node *) root->parse->targetList,
+							PVC_INCLUDE_AGGREGATES | PVC_RECURSE_WINDOWFUNCS |
+							PVC_RECURSE_PLACEHOLDERS);
+	exprs = list_concat(exprs,
+						pull_var_clause(root->parse->havingQual,
+										PVC_INCLUDE_AGGREGATES |
+										PVC_RECURSE_WINDOWFUNCS |
+										PVC_RECURSE_PLACEHOLDERS));
+
+	foreach(lc, exprs)
+	{
+		Aggref	   *aggref = (Aggref *) lfirst(lc);
+		ListCell   *lc2;
+		Node	   *arg;
+
+		if (!IsA(aggref, Aggref) || (aggref->aggtranstype != INTERNALOID))
+			continue;
+
+		if (aggref->args == NIL)
+			continue;
+
+		if (!extoid_valid)
+		{
+			extoid = get_extension_oid("trimmed_aggregates", true);
+			extoid_valid = true;
+		}
+
+		if (!is_trimmed_aggregate(aggref->aggfnoid, extoid))
+			continue;
+
+		foreach(lc2, aggref->args)
+		{
+			arg = (Node *) ((TargetEntry *) lfirst(lc2))->expr;
+
+			if ((lc2 != list_head(aggref->args)) && !contain_var_clause(arg))
+				continue;
+
+			width += argument_width(root, arg);
+		}
+	}
+
+	return input_rows * width;
+}
+
+static double
+hash_memory_limit(void)
+{
+#if PG_VERSION_NUM >= 150000
+	return (double) get_hash_memory_limit();
+#elif PG_VERSION_NUM >= 130000
+	return (double) get_hash_mem() * 1024.0;
+#else
+	return (double) work_mem * 1024.0;
+#endif
+}
+
+static bool
+is_hashed_path(Path *path)
+{
+	return IsA(path, AggPath) && (((AggPath *) path)->aggstrategy == AGG_HASHED);
+}
+
+/*
+ * Penalize the hashed paths, unless all the paths are hashed (then there's
+ * no point, as there's no alternative).
+ */
+static void
+penalize_hashed_paths(List *paths)
+{
+	ListCell   *lc;
+	bool		found = false;
+
+	foreach(lc, paths)
+	{
+		if (!is_hashed_path((Path *) lfirst(lc)))
+		{
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+		return;
+
+	foreach(lc, paths)
+	{
+		Path	   *path = (Path *) lfirst(lc);
+
+		if (!is_hashed_path(path))
+			continue;
+
+		path->startup_cost += disable_cost;
+		path->total_cost += disable_cost;
+	}
+}
+
+#if PG_VERSION_NUM >= 110000
+static void
+trimmed_upper_paths(PlannerInfo *root, UpperRelationKind stage,
+					RelOptInfo *input_rel, RelOptInfo *output_rel,
+					void *extra)
+#else
+static void
+trimmed_upper_paths(PlannerInfo *root, UpperRelationKind stage,
+					RelOptInfo *input_rel, RelOptInfo *output_rel)
+#endif
+{
+	if (prev_create_upper_paths_hook)
+#if PG_VERSION_NUM >= 110000
+		prev_create_upper_paths_hook(root, stage, input_rel, output_rel, extra);
+#else
+		prev_create_upper_paths_hook(root, stage, input_rel, output_rel);
+#endif
+
+#if PG_VERSION_NUM >= 110000
+	if ((stage != UPPERREL_GROUP_AGG) && (stage != UPPERREL_PARTIAL_GROUP_AGG))
+		return;
+#else
+	if (stage != UPPERREL_GROUP_AGG)
+		return;
+#endif
+
+	if (!root->parse->hasAggs || !enable_planner_support)
+		return;
+
+	if (estimate_state_memory(root, input_rel->rows) <= hash_memory_limit())
+		return;
+
+	penalize_hashed_paths(output_rel->pathlist);
+	penalize_hashed_paths(output_rel->partial_pathlist);
+}
+
+/*
+ * BENCHMARK
+ *
+ * Microbenchmark of the core kernels - sorting the values, merging sorted
+ * runs collected by combine and the final summation - on generated data,
+ * without the executor overhead. Used to validate performance changes,
+ * see bench/kernels.sql (make bench). The data are generated by a simple
+ * xorshift generator with a fixed seed, so that the results are repeatable.
+ */
+
+/* number of sorted runs (partial states) for the merge kernel */
+#define BENCH_RUNS			8
+
+#define BENCH_SORT			0
+#define BENCH_MERGE			1
+#define BENCH_FINAL			2
+
+#define BENCH_UNIFORM		0
+#define BENCH_SKEWED		1
+#define BENCH_PRESORTED		2
+#define BENCH_DUPLICATES	3
+
+static const char *bench_kernels[] = {"sort", "merge", "final", NULL};
+static const char *bench_distributions[] = {
+	"uniform", "skewed", "presorted", "duplicates", NULL
+};
+static const char *bench_types[] = {"double", "int32", "int64", "numeric", NULL};
+
+static int
+bench_lookup(const char **names, const char *what, char *name)
+{
+	int		i;
+
+	for (i = 0; names[i] != NULL; i++)
+		if (strcmp(names[i], name) == 0)
+			return i;
+
+	elog(ERROR, "unknown benchmark %s \"%s\"", what, name);
+
+	return -1;					/* keep compiler quiet */
+}
+
+/* uniform random value in [0,1), using a xorshift generator */
+static double
+bench_random(uint64 *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+
+	return (double) (*seed >> 11) / (double) (UINT64CONST(1) << 53);
+}
+
+/* generate the values (converted to the benchmarked type later) */
+static double *
+bench_values(int distribution, int nvalues)
+{
+	int		i;
+	uint64	seed = UINT64CONST(0x9E3779B97F4A7C15);
+	double *values = (double *) palloc(nvalues * sizeof(double));
+
+	for (i = 0; i < nvalues; i++)
+	{
+		double	u = bench_random(&seed);
+
+		switch (distribution)
+		{
+			case BENCH_UNIFORM:
+				values[i] = floor(u * 1000000);
+				break;
+			case BENCH_SKEWED:
+				/* most values close to zero, a long tail */
+				values[i] = floor(pow(u, 8) * 1000000);
+				break;
+			case BENCH_PRESORTED:
+				values[i] = i;
+				break;
+			case BENCH_DUPLICATES:
+				values[i] = floor(u * 16);
+				break;
+		}
+	}
+
+	return values;
+}
+
+/* seconds elapsed since 'start' */
+static double
+bench_elapsed(instr_time start)
+{
+	instr_time	duration;
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	return INSTR_TIME_GET_DOUBLE(duration);
+}
+
+static state_double *
+bench_state_double(double *values, int nvalues)
+{
+	int		i;
+	state_double *state = (state_double *) palloc(sizeof(state_double));
+
+	state->maxelements = nvalues;
+	state->nelements = nvalues;
+	state->elements = (double *) palloc(nvalues * sizeof(double));
+	state->cut_lower = 0.1;
+	state->cut_upper = 0.1;
+	state->sorted = false;
+	state->params = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+	state->runs = NULL;
+	state->sample_shift = 0;
+	memory_init(&state->memory, CurrentMemoryContext);
+
+	for (i = 0; i < nvalues; i++)
+		state->elements[i] = (double) values[i];
+
+	return state;
+}
+
+/* best time (in seconds) of the kernel, out of 'loops' runs */
+static double
+bench_double(int kernel, double *values, int nvalues, int loops)
+{
+	int			i, l;
+	double		best = -1;
+	MemoryContext context = AllocSetContextCreate(CurrentMemoryContext,
+												  "trimmed benchmark",
+												  ALLOCSET_DEFAULT_SIZES);
+
+	for (l = 0; l < loops; l++)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(context);
+		state_double  *states[BENCH_RUNS];
+		instr_time	start;
+		double		elapsed = 0;
+
+		switch (kernel)
+		{
+			case BENCH_SORT:
+				states[0] = bench_state_double(values, nvalues);
+
+				INSTR_TIME_SET_CURRENT(start);
+				sort_state_double(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_MERGE:
+				/* contiguous chunks, sorted (like partial states) */
+				for (i = 0; i < BENCH_RUNS; i++)
+				{
+					int		from = (int) ((int64) nvalues * i / BENCH_RUNS);
+					int		to = (int) ((int64) nvalues * (i + 1) / BENCH_RUNS);
+
+					states[i] = bench_state_double(values + from, to - from);
+					sort_state_double(states[i]);
+				}
+
+				INSTR_TIME_SET_CURRENT(start);
+				for (i = 1; i < BENCH_RUNS; i++)
+					states[0] = combine_double(states[0], states[i], context);
+				sort_state_double(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_FINAL:
+				states[0] = bench_state_double(values, nvalues);
+				sort_state_double(states[0]);
+
+				INSTR_TIME_SET_CURRENT(start);
+				(void) trimmed_multi_double(states[0], STAT_ALL);
+				elapsed = bench_elapsed(start);
+				break;
+		}
+
+		best = (best < 0) ? elapsed : Min(best, elapsed);
+
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextReset(context);
+	}
+
+	MemoryContextDelete(context);
+
+	return best;
+}
+
+static state_int32 *
+bench_state_int32(double *values, int nvalues)
+{
+	int		i;
+	state_int32 *state = (state_int32 *) palloc(sizeof(state_int32));
+
+	state->maxelements = nvalues;
+	state->nelements = nvalues;
+	state->elements = (int32 *) palloc(nvalues * sizeof(int32));
+	state->cut_lower = 0.1;
+	state->cut_upper = 0.1;
+	state->sorted = false;
+	state->params = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+	state->runs = NULL;
+	state->sample_shift = 0;
+	memory_init(&state->memory, CurrentMemoryContext);
+
+	for (i = 0; i < nvalues; i++)
+		state->elements[i] = (int32) values[i];
+
+	return state;
+}
+
+/* best time (in seconds) of the kernel, out of 'loops' runs */
+static double
+bench_int32(int kernel, double *values, int nvalues, int loops)
+{
+	int			i, l;
+	double		best = -1;
+	MemoryContext context = AllocSetContextCreate(CurrentMemoryContext,
+												  "trimmed benchmark",
+												  ALLOCSET_DEFAULT_SIZES);
+
+	for (l = 0; l < loops; l++)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(context);
+		state_int32  *states[BENCH_RUNS];
+		instr_time	start;
+		double		elapsed = 0;
+
+		switch (kernel)
+		{
+			case BENCH_SORT:
+				states[0] = bench_state_int32(values, nvalues);
+
+				INSTR_TIME_SET_CURRENT(start);
+				sort_state_int32(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_MERGE:
+				/* contiguous chunks, sorted (like partial states) */
+				for (i = 0; i < BENCH_RUNS; i++)
+				{
+					int		from = (int) ((int64) nvalues * i / BENCH_RUNS);
+					int		to = (int) ((int64) nvalues * (i + 1) / BENCH_RUNS);
+
+					states[i] = bench_state_int32(values + from, to - from);
+					sort_state_int32(states[i]);
+				}
+
+				INSTR_TIME_SET_CURRENT(start);
+				for (i = 1; i < BENCH_RUNS; i++)
+					states[0] = combine_int32(states[0], states[i], context);
+				sort_state_int32(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_FINAL:
+				states[0] = bench_state_int32(values, nvalues);
+				sort_state_int32(states[0]);
+
+				INSTR_TIME_SET_CURRENT(start);
+				(void) trimmed_multi_int32(states[0], STAT_ALL);
+				elapsed = bench_elapsed(start);
+				break;
+		}
+
+		best = (best < 0) ? elapsed : Min(best, elapsed);
+
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextReset(context);
+	}
+
+	MemoryContextDelete(context);
+
+	return best;
+}
+
+static state_int64 *
+bench_state_int64(double *values, int nvalues)
+{
+	int		i;
+	state_int64 *state = (state_int64 *) palloc(sizeof(state_int64));
+
+	state->maxelements = nvalues;
+	state->nelements = nvalues;
+	state->elements = (int64 *) palloc(nvalues * sizeof(int64));
+	state->cut_lower = 0.1;
+	state->cut_upper = 0.1;
+	state->sorted = false;
+	state->params = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+	state->runs = NULL;
+	state->sample_shift = 0;
+	memory_init(&state->memory, CurrentMemoryContext);
+
+	for (i = 0; i < nvalues; i++)
+		state->elements[i] = (int64) values[i];
+
+	return state;
+}
+
+/* best time (in seconds) of the kernel, out of 'loops' runs */
+static double
+bench_int64(int kernel, double *values, int nvalues, int loops)
+{
+	int			i, l;
+	double		best = -1;
+	MemoryContext context = AllocSetContextCreate(CurrentMemoryContext,
+												  "trimmed benchmark",
+												  ALLOCSET_DEFAULT_SIZES);
+
+	for (l = 0; l < loops; l++)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(context);
+		state_int64  *states[BENCH_RUNS];
+		instr_time	start;
+		double		elapsed = 0;
+
+		switch (kernel)
+		{
+			case BENCH_SORT:
+				states[0] = bench_state_int64(values, nvalues);
+
+				INSTR_TIME_SET_CURRENT(start);
+				sort_state_int64(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_MERGE:
+				/* contiguous chunks, sorted (like partial states) */
+				for (i = 0; i < BENCH_RUNS; i++)
+				{
+					int		from = (int) ((int64) nvalues * i / BENCH_RUNS);
+					int		to = (int) ((int64) nvalues * (i + 1) / BENCH_RUNS);
+
+					states[i] = bench_state_int64(values + from, to - from);
+					sort_state_int64(states[i]);
+				}
+
+				INSTR_TIME_SET_CURRENT(start);
+				for (i = 1; i < BENCH_RUNS; i++)
+					states[0] = combine_int64(states[0], states[i], context);
+				sort_state_int64(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_FINAL:
+				states[0] = bench_state_int64(values, nvalues);
+				sort_state_int64(states[0]);
+
+				INSTR_TIME_SET_CURRENT(start);
+				(void) trimmed_multi_int64(states[0], STAT_ALL);
+				elapsed = bench_elapsed(start);
+				break;
+		}
+
+		best = (best < 0) ? elapsed : Min(best, elapsed);
+
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextReset(context);
+	}
+
+	MemoryContextDelete(context);
+
+	return best;
+}
+
+static state_numeric *
+bench_state_numeric(Numeric *values, int nvalues)
+{
+	int		i;
+	char   *ptr;
+	state_numeric *state = (state_numeric *) palloc(sizeof(state_numeric));
+
+	state->nelements = nvalues;
+	state->cut_lower = 0.1;
+	state->cut_upper = 0.1;
+	state->sorted = false;
+	state->params = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+	state->runs = NULL;
+	state->sample_shift = 0;
+	memory_init(&state->memory, CurrentMemoryContext);
+
+	state->usedlen = 0;
+	for (i = 0; i < nvalues; i++)
+		state->usedlen += VARSIZE(values[i]);
+
+	state->maxlen = Max(state->usedlen, 1);
+	state->data = ptr = (char *) palloc(state->maxlen);
+
+	for (i = 0; i < nvalues; i++)
+	{
+		memcpy(ptr, values[i], VARSIZE(values[i]));
+		ptr += VARSIZE(values[i]);
+	}
+
+	return state;
+}
+
+static double
+bench_numeric(int kernel, double *values, int nvalues, int loops)
+{
+	int			i, l;
+	double		best = -1;
+	Numeric	   *numerics = (Numeric *) palloc(nvalues * sizeof(Numeric));
+	MemoryContext context = AllocSetContextCreate(CurrentMemoryContext,
+												  "trimmed benchmark",
+												  ALLOCSET_DEFAULT_SIZES);
+
+	/* values with two decimal digits, e.g. amounts of money */
+	for (i = 0; i < nvalues; i++)
+		numerics[i] = DatumGetNumeric(DirectFunctionCall1(float8_numeric,
+										Float8GetDatum(values[i] / 100)));
+
+	for (l = 0; l < loops; l++)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(context);
+		state_numeric *states[BENCH_RUNS];
+		instr_time	start;
+		double		elapsed = 0;
+
+		switch (kernel)
+		{
+			case BENCH_SORT:
+				states[0] = bench_state_numeric(numerics, nvalues);
+
+				INSTR_TIME_SET_CURRENT(start);
+				sort_state_numeric(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_MERGE:
+				/* contiguous chunks, sorted (like partial states) */
+				for (i = 0; i < BENCH_RUNS; i++)
+				{
+					int		from = (int) ((int64) nvalues * i / BENCH_RUNS);
+					int		to = (int) ((int64) nvalues * (i + 1) / BENCH_RUNS);
+
+					states[i] = bench_state_numeric(numerics + from, to - from);
+					sort_state_numeric(states[i]);
+				}
+
+				INSTR_TIME_SET_CURRENT(start);
+				for (i = 1; i < BENCH_RUNS; i++)
+					states[0] = combine_numeric(states[0], states[i], context);
+				sort_state_numeric(states[0]);
+				elapsed = bench_elapsed(start);
+				break;
+
+			case BENCH_FINAL:
+				states[0] = bench_state_numeric(numerics, nvalues);
+				sort_state_numeric(states[0]);
+
+				INSTR_TIME_SET_CURRENT(start);
+				(void) trimmed_multi_numeric(states[0], STAT_ALL);
+				elapsed = bench_elapsed(start);
+				break;
+		}
+
+		best = (best < 0) ? elapsed : Min(best, elapsed);
+
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextReset(context);
+	}
+
+	MemoryContextDelete(context);
+
+	return best;
+}
+
+/*
+ * Run the kernel on 'nvalues' generated values, and return the best time
+ * per value (in nanoseconds) out of 'loops' runs.
+ */
+Datum
+trimmed_benchmark(PG_FUNCTION_ARGS)
+{
+	int			kernel = bench_lookup(bench_kernels, "kernel",
+									  text_to_cstring(PG_GETARG_TEXT_PP(0)));
+	int			type = bench_lookup(bench_types, "type",
+									text_to_cstring(PG_GETARG_TEXT_PP(1)));
+	int			distribution = bench_lookup(bench_distributions, "distribution",
+											text_to_cstring(PG_GETARG_TEXT_PP(2)));
+	int			nvalues = PG_GETARG_INT32(3);
+	int			loops = PG_GETARG_INT32(4);
+	double	   *values;
+	double		elapsed = 0;
+
+	if ((nvalues < BENCH_RUNS) || (loops < 1))
+		elog(ERROR, "benchmark needs at least %d values and one loop", BENCH_RUNS);
+
+	values = bench_values(distribution, nvalues);
+
+	switch (type)
+	{
+		case 0:
+			elapsed = bench_double(kernel, values, nvalues, loops);
+			break;
+		case 1:
+			elapsed = bench_int32(kernel, values, nvalues, loops);
+			break;
+		case 2:
+			elapsed = bench_int64(kernel, values, nvalues, loops);
+			break;
+		case 3:
+			elapsed = bench_numeric(kernel, values, nvalues, loops);
+			break;
+	}
+
+	PG_RETURN_FLOAT8(elapsed * 1e9 / nvalues);
+}
+
+/*
+ * SHARED CACHE
+ *
+ * Dashboards often evaluate the same trimmed aggregate over the same slice
+ * of a table over and over. The trimmed_cached_state_* functions compute the
+ * sorted state for (relation, column, filter, cuts), and keep it in a shared
+ * memory cache (a DSA area, sized by trimmed_aggregates.cache_size), so that
+ * repeated calls only need to copy the state and finalize it.
+ *
+ * The cache requires loading the library through shared_preload_libraries.
+ * Without it (or with cache_size = 0) the states are simply computed on each
+ * call.
+ *
+ * Invalidation is based on per-relation epochs (hashed into a fixed number of
+ * buckets, so unrelated relations may invalidate each other, which is fine).
+ * The epoch is bumped by the trimmed_cache_invalidate() statement trigger
+ * (and again when the writing transaction commits), and on relcache
+ * invalidations (e.g. DDL on the relation). A cached state is used only when
+ * its epoch matches the current one. The epoch is read before the snapshot
+ * for computing the state is taken, so a concurrent commit can only make the
+ * entry look stale, never the other way around.
+ *
+ * The cache is used only in READ COMMITTED transactions (with transaction
+ * snapshots the cached state might not match the snapshot), not for relations
+ * modified by the current transaction, and not for relations with row level
+ * security. The caller always needs SELECT privilege on the column. Only
+ * plain tables (without inheritance children) with the invalidation trigger
+ * on all kinds of writes are cached, otherwise the states might go stale.
+ *
+ * The filter is a condition on the relation. It's validated on the analyzed
+ * query (so it can't turn the query into something else), volatile filters
+ * are rejected, and states with filters that might evaluate differently over
+ * time (stable functions like now(), subqueries) are not cached. The cache
+ * key contains the user and search_path, and the filter is identified by the
+ * analyzed expression (with resolved functions and operators), not the text.
+ */
+
+#if PG_VERSION_NUM >= 150000
+
+/* number of epoch buckets */
+#define CACHE_EPOCHS		1024
+
+#define CACHE_EPOCH_BUCKET(dbid, relid)	\
+	((((uint32) (dbid)) * 31 + ((uint32) (relid))) % CACHE_EPOCHS)
+
+typedef struct cache_shared
+{
+	LWLock	   *lock;			/* protects the handles, serializes eviction */
+	int			tranche;		/* tranche for the DSA area and hash table */
+	dsa_handle	area;			/* DSA area with the cached states */
+	dshash_table_handle table;	/* hash table of cache entries */
+	pg_atomic_uint64 used;		/* bytes used by the cached states */
+	pg_atomic_uint64 clock;		/* access counter (for LRU eviction) */
+	pg_atomic_uint64 epochs[CACHE_EPOCHS];	/* invalidation epochs */
+} cache_shared;
+
+typedef struct cache_key
+{
+	Oid			dbid;			/* database */
+	Oid			relid;			/* relation */
+	Oid			typid;			/* type of the state */
+	AttrNumber	attnum;			/* column */
+	Oid			userid;			/* user computing the state */
+	double		cut_lower;		/* cuts stored in the state */
+	double		cut_upper;
+	uint32		filter_hash;	/* hash of the filter (with search_path) */
+} cache_key;
+
+typedef struct cache_entry
+{
+	cache_key	key;			/* hash key (must be first) */
+	dsa_pointer	data;			/* filter (NUL-terminated) and the state */
+	Size		len;			/* size of the data chunk */
+	Size		filter_len;		/* length of the filter (including NUL) */
+	uint64		epoch;			/* epoch of the relation when computed */
+	uint64		lastused;		/* value of the clock at the last access */
+} cache_entry;
+
+/* candidate for eviction, copied from the hash table */
+typedef struct cache_victim
+{
+	cache_key	key;
+	uint64		lastused;		/* clock of the last access (0 if stale) */
+} cache_victim;
+
+static cache_shared *cache = NULL;
+static dsa_area *cache_area = NULL;
+static dshash_table *cache_table = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static const dshash_parameters cache_params = {
+	.key_size = sizeof(cache_key),
+	.entry_size = sizeof(cache_entry),
+	.compare_function = dshash_memcmp,
+	.hash_function = dshash_memhash,
+#if PG_VERSION_NUM >= 170000
+	.copy_function = dshash_memcpy,
+#endif
+	/* tranche_id is set when creating/attaching */
+};
+
+#endif
+
+/* size of the shared cache (in kB), 0 disables it */
+static int	cache_size = 0;
+
+/* relations modified (through the trigger) by the current transaction */
+static List *cache_written = NIL;
+
+/* background worker refreshing the registered statistics */
+static int	worker_interval = 60;
+static int	worker_memory = 65536;
+static char *worker_database = NULL;
+static char *worker_role = NULL;
+
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("trimmed_aggregates.cache_size",
+							"Size of the shared cache of sorted states.",
+							"Zero disables the cache. The cache requires "
+							"loading the library in shared_preload_libraries.",
+							&cache_size,
+							0, 0, MAX_KILOBYTES,
+							PGC_SIGHUP,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("trimmed_aggregates.state_memory",
+							"Memory budget of a single aggregate state.",
+							"Zero means no limit.",
+							&state_memory,
+							0, 0, MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("trimmed_aggregates.backend_memory",
+							"Memory budget of all aggregate states in a backend.",
+							"Zero means no limit.",
+							&backend_memory,
+							0, 0, MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomEnumVariable("trimmed_aggregates.memory_policy",
+							 "What to do when a state exceeds the memory budget.",
+							 "Either fail with an error, or sample the values.",
+							 &memory_policy,
+							 MEMORY_POLICY_ERROR,
+							 memory_policies,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("trimmed_aggregates.finalize_threads",
+							"Number of threads sorting and summing large states.",
+							"Zero or one means the values are processed by the backend.",
+							&finalize_threads,
+							0, 0, FINALIZE_MAX_THREADS,
+							PGC_USERSET,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("trimmed_aggregates.planner_support",
+							 "Avoid hashed aggregation when the values exceed hash_mem.",
+							 NULL,
+							 &enable_planner_support,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("trimmed_aggregates.worker_interval",
+							"Time between refreshes of the registered statistics.",
+							NULL,
+							&worker_interval,
+							60, 1, INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("trimmed_aggregates.worker_memory",
+							"Memory budget for a batch of new rows processed by the worker.",
+							NULL,
+							&worker_memory,
+							65536, 1024, MAX_KILOBYTES,
+							PGC_SIGHUP,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	/* postmaster variables can be defined only while preloading */
+	if (process_shared_preload_libraries_in_progress)
+	{
+		DefineCustomStringVariable("trimmed_aggregates.worker_database",
+								   "Database to start the worker in (when preloaded).",
+								   NULL,
+								   &worker_database,
+								   NULL,
+								   PGC_POSTMASTER,
+								   0,
+								   NULL, NULL, NULL);
+
+		DefineCustomStringVariable("trimmed_aggregates.worker_role",
+								   "Role the worker started when preloaded runs as.",
+								   "Has to be set to a role that is not a superuser.",
+								   &worker_role,
+								   NULL,
+								   PGC_POSTMASTER,
+								   0,
+								   NULL, NULL, NULL);
+	}
+
+	RegisterXactCallback(cache_xact_callback, NULL);
+
+	prev_create_upper_paths_hook = create_upper_paths_hook;
+	create_upper_paths_hook = trimmed_upper_paths;
+
+#if PG_VERSION_NUM >= 150000
+	MarkGUCPrefixReserved("trimmed_aggregates");
+#endif
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 130000
+	/* start the worker automatically, if requested */
+	if ((worker_database != NULL) && (worker_database[0] != '\0'))
+	{
+		BackgroundWorker worker;
+
+		if ((worker_role == NULL) || (worker_role[0] == '\0'))
+			ereport(WARNING,
+					(errmsg("trimmed aggregates worker not started"),
+					 errdetail("trimmed_aggregates.worker_role is not set.")));
+		else
+		{
+			worker_init(&worker, InvalidOid);
+			RegisterBackgroundWorker(&worker);
+		}
+	}
+#endif
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = cache_shmem_request;
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = cache_shmem_startup;
+
+	CacheRegisterRelcacheCallback(cache_relcache_callback, (Datum) 0);
+#endif
+}
+
+#if PG_VERSION_NUM >= 150000
+
+static void
+cache_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(cache_shared)));
+	RequestAddinShmemSpace(MAXALIGN(sizeof(counters_shared)));
+	RequestAddinShmemSpace(MAXALIGN(mul_size(MaxBackends, sizeof(progress_slot))));
+	RequestNamedLWLockTranche("trimmed_aggregates", 1);
+}
+
+static void
+cache_shmem_startup(void)
+{
+	bool	found;
+	int		i;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	cache = ShmemInitStruct("trimmed_aggregates", sizeof(cache_shared), &found);
+
+	if (!found)
+	{
+		cache->lock = &(GetNamedLWLockTranche("trimmed_aggregates"))->lock;
+		cache->tranche = LWLockNewTrancheId();
+		cache->area = DSA_HANDLE_INVALID;
+		cache->table = DSHASH_HANDLE_INVALID;
+
+		pg_atomic_init_u64(&cache->used, 0);
+		pg_atomic_init_u64(&cache->clock, 0);
+
+		for (i = 0; i < CACHE_EPOCHS; i++)
+			pg_atomic_init_u64(&cache->epochs[i], 0);
+	}
+
+	shared_counters = ShmemInitStruct("trimmed_aggregates counters",
+									  sizeof(counters_shared), &found);
+
+	if (!found)
+		counters_shmem_init(shared_counters);
+
+	progress_slots = ShmemInitStruct("trimmed_aggregates progress",
+									 mul_size(MaxBackends, sizeof(progress_slot)),
+									 &found);
+
+	if (!found)
+		memset(progress_slots, 0, mul_size(MaxBackends, sizeof(progress_slot)));
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Attach to the DSA area and the hash table (creating them on first use).
+ * Returns false if the cache is not available.
+ */
+static bool
+cache_attach(void)
+{
+	MemoryContext	oldcontext;
+	dshash_parameters params = cache_params;
+
+	if ((cache == NULL) || (cache_size == 0))
+		return false;
+
+	if (cache_table != NULL)
+		return true;
+
+	LWLockRegisterTranche(cache->tranche, "trimmed_aggregates_cache");
+	params.tranche_id = cache->tranche;
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+
+	LWLockAcquire(cache->lock, LW_EXCLUSIVE);
+
+	if (cache->area == DSA_HANDLE_INVALID)
+	{
+		cache_area = dsa_create(cache->tranche);
+		dsa_pin(cache_area);
+		dsa_pin_mapping(cache_area);
+
+		cache_table = dshash_create(cache_area, &params, NULL);
+
+		cache->area = dsa_get_handle(cache_area);
+		cache->table = dshash_get_hash_table_handle(cache_table);
+	}
+	else
+	{
+		cache_area = dsa_attach(cache->area);
+		dsa_pin_mapping(cache_area);
+
+		cache_table = dshash_attach(cache_area, &params, cache->table, NULL);
+	}
+
+	LWLockRelease(cache->lock);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return true;
+}
+
+static uint64
+cache_epoch(Oid relid)
+{
+	return pg_atomic_read_u64(&cache->epochs[CACHE_EPOCH_BUCKET(MyDatabaseId, relid)]);
+}
+
+static void
+cache_bump_epoch(Oid dbid, Oid relid)
+{
+	pg_atomic_fetch_add_u64(&cache->epochs[CACHE_EPOCH_BUCKET(dbid, relid)], 1);
+}
+
+/*
+ * Remove the entry (the caller holds an exclusive lock on it).
+ */
+static void
+cache_remove_entry(cache_entry *entry)
+{
+	dsa_free(cache_area, entry->data);
+	pg_atomic_sub_fetch_u64(&cache->used, entry->len);
+
+	dshash_delete_entry(cache_table, entry);
+}
+
+/*
+ * Look for a valid cached state, and return a copy of it (or NULL).
+ */
+static bytea *
+cache_lookup(cache_key *key, char *filter)
+{
+	cache_entry *entry;
+	bytea	   *result = NULL;
+	Size		filter_len = strlen(filter) + 1;
+
+	entry = dshash_find(cache_table, key, true);
+
+	if (entry == NULL)
+		return NULL;
+
+	/* drop stale entries right away */
+	if (entry->epoch != cache_epoch(key->relid))
+	{
+		cache_remove_entry(entry);
+		return NULL;
+	}
+
+	/* the filter hash might be a collision */
+	if ((entry->filter_len == filter_len) &&
+		(memcmp(dsa_get_address(cache_area, entry->data), filter, filter_len) == 0))
+	{
+		result = (bytea *) palloc(entry->len - filter_len);
+		memcpy(result, (char *) dsa_get_address(cache_area, entry->data) + filter_len,
+			   entry->len - filter_len);
+
+		entry->lastused = pg_atomic_fetch_add_u64(&cache->clock, 1);
+	}
+
+	dshash_release_lock(cache_table, entry);
+
+	return result;
+}
+
+static int
+cache_victim_comparator(const void *a, const void *b)
+{
+	uint64	la = ((const cache_victim *) a)->lastused;
+	uint64	lb = ((const cache_victim *) b)->lastused;
+
+	if (la < lb)
+		return -1;
+	else if (la > lb)
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Evict the least recently used entries until there's enough space for an
+ * entry of the requested size. The caller holds the cache lock.
+ *
+ * We collect all the entries in a single pass through the hash table, sort
+ * them by the last access and then remove the oldest ones, instead of
+ * looking for the oldest entry again for each victim (which would be
+ * quadratic in the number of entries). Stale entries (of relations modified
+ * since the state was computed) are evicted first.
+ */
+static void
+cache_evict(Size len)
+{
+	Size	limit = (Size) cache_size * 1024;
+	int		i,
+			nvictims = 0,
+			maxvictims = 64;
+	dshash_seq_status status;
+	cache_entry *entry;
+	cache_victim *victims;
+
+	if (pg_atomic_read_u64(&cache->used) + len <= limit)
+		return;
+
+	victims = (cache_victim *) palloc(maxvictims * sizeof(cache_victim));
+
+	dshash_seq_init(&status, cache_table, false);
+	while ((entry = dshash_seq_next(&status)) != NULL)
+	{
+		int		bucket = CACHE_EPOCH_BUCKET(entry->key.dbid, entry->key.relid);
+		bool	stale = (entry->epoch != pg_atomic_read_u64(&cache->epochs[bucket]));
+
+		if (nvictims == maxvictims)
+		{
+			maxvictims *= 2;
+			victims = (cache_victim *) repalloc(victims,
+												maxvictims * sizeof(cache_victim));
+		}
+
+		victims[nvictims].key = entry->key;
+		victims[nvictims].lastused = stale ? 0 : entry->lastused;
+		nvictims++;
+	}
+	dshash_seq_term(&status);
+
+	pg_qsort(victims, nvictims, sizeof(cache_victim), &cache_victim_comparator);
+
+	for (i = 0; i < nvictims; i++)
+	{
+		if (pg_atomic_read_u64(&cache->used) + len <= limit)
+			break;
+
+		/* might have been removed/replaced since, but we don't care */
+		if ((entry = dshash_find(cache_table, &victims[i].key, true)) != NULL)
+			cache_remove_entry(entry);
+	}
+
+	pfree(victims);
+}
+
+/*
+ * Store the state in the cache (unless it's too large, or the epoch changed
+ * since we started computing it).
+ */
+static void
+cache_store(cache_key *key, char *filter, bytea *state, uint64 epoch)
+{
+	cache_entry *entry;
+	bool		found;
+	dsa_pointer	data;
+	Size		filter_len = strlen(filter) + 1;
+	Size		len = filter_len + VARSIZE(state);
+	char	   *ptr;
+
+	if (len > (Size) cache_size * 1024)
+		return;
+
+	LWLockAcquire(cache->lock, LW_EXCLUSIVE);
+
+	cache_evict(len);
+
+	data = dsa_allocate_extended(cache_area, len, DSA_ALLOC_NO_OOM);
+
+	if (!DsaPointerIsValid(data))
+	{
+		LWLockRelease(cache->lock);
+		return;
+	}
+
+	ptr = dsa_get_address(cache_area, data);
+	memcpy(ptr, filter, filter_len);
+	memcpy(ptr + filter_len, state, VARSIZE(state));
+
+	entry = dshash_find_or_insert(cache_table, key, &found);
+
+	/* a concurrent backend might have cached the state too */
+	if (found)
+	{
+		dsa_free(cache_area, entry->data);
+		pg_atomic_sub_fetch_u64(&cache->used, entry->len);
+	}
+
+	entry->data = data;
+	entry->len = len;
+	entry->filter_len = filter_len;
+	entry->epoch = epoch;
+	entry->lastused = pg_atomic_fetch_add_u64(&cache->clock, 1);
+
+	pg_atomic_add_fetch_u64(&cache->used, len);
+
+	dshash_release_lock(cache_table, entry);
+
+	LWLockRelease(cache->lock);
+}
+
+/*
+ * Invalidate states of relations affected by DDL. Resets of the whole relcache
+ * are ignored - those happen e.g. whenever a parallel worker starts, and the
+ * backend executing the DDL always invalidates the relation explicitly.
+ */
+static void
+cache_relcache_callback(Datum arg, Oid relid)
+{
+	if ((cache == NULL) || !OidIsValid(relid))
+		return;
+
+	cache_bump_epoch(MyDatabaseId, relid);
+}
+
+#endif
+
+/*
+ * At commit, bump the epochs of relations modified by the transaction again,
+ * to invalidate states cached by other backends before the changes became
+ * visible.
+ */
+static void
+cache_xact_callback(XactEvent event, void *arg)
+{
+#if PG_VERSION_NUM >= 150000
+	ListCell   *lc;
+
+	if ((event == XACT_EVENT_COMMIT) || (event == XACT_EVENT_PARALLEL_COMMIT) ||
+		(event == XACT_EVENT_PREPARE))
+	{
+		if (cache != NULL)
+			foreach(lc, cache_written)
+				cache_bump_epoch(MyDatabaseId, lfirst_oid(lc));
+	}
+#endif
+
+	/* the list lives in the transaction context */
+	if ((event == XACT_EVENT_COMMIT) || (event == XACT_EVENT_PARALLEL_COMMIT) ||
+		(event == XACT_EVENT_PREPARE) || (event == XACT_EVENT_ABORT) ||
+		(event == XACT_EVENT_PARALLEL_ABORT))
+	{
+		cache_written = NIL;
+
+		/* publish the runtime counters */
+		counters_flush();
+
+		/* a sort/merge interrupted by an error is not running anymore */
+		progress_end();
+	}
 }
 
-static void
-sort_state_int32(state_int32 *state)
+/*
+ * Statement trigger invalidating cached states of the relation.
+ */
+Datum
+trimmed_cache_invalidate(PG_FUNCTION_ARGS)
 {
-	if (state->sorted)
-		return;
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	Oid			relid;
 
-	pg_qsort(state->elements, state->nelements, sizeof(int32), &int32_comparator);
-	state->sorted = true;
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "trimmed_cache_invalidate: not called by trigger manager");
+
+	relid = RelationGetRelid(trigdata->tg_relation);
+
+	if (!list_member_oid(cache_written, relid))
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(TopTransactionContext);
+
+		cache_written = lappend_oid(cache_written, relid);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+#if PG_VERSION_NUM >= 150000
+	if (cache != NULL)
+		cache_bump_epoch(MyDatabaseId, relid);
+#endif
+
+	return PointerGetDatum(NULL);
 }
 
-static void
-sort_state_int64(state_int64 *state)
+/*
+ * Discard all cached states (in all databases).
+ */
+Datum
+trimmed_cache_reset(PG_FUNCTION_ARGS)
 {
-	if (state->sorted)
-		return;
+#if PG_VERSION_NUM >= 150000
+	dshash_seq_status status;
+	cache_entry *entry;
 
-	pg_qsort(state->elements, state->nelements, sizeof(int64), &int64_comparator);
-	state->sorted = true;
+	if (!cache_attach())
+		PG_RETURN_VOID();
+
+	LWLockAcquire(cache->lock, LW_EXCLUSIVE);
+
+	dshash_seq_init(&status, cache_table, true);
+	while ((entry = dshash_seq_next(&status)) != NULL)
+	{
+		dsa_free(cache_area, entry->data);
+		pg_atomic_sub_fetch_u64(&cache->used, entry->len);
+		dshash_delete_current(&status);
+	}
+	dshash_seq_term(&status);
+
+	LWLockRelease(cache->lock);
+#endif
+
+	PG_RETURN_VOID();
+}
+
+Datum
+trimmed_cached_state_double(PG_FUNCTION_ARGS)
+{
+	return trimmed_cached_state(fcinfo, "double precision");
+}
+
+Datum
+trimmed_cached_state_int32(PG_FUNCTION_ARGS)
+{
+	return trimmed_cached_state(fcinfo, "int");
+}
+
+Datum
+trimmed_cached_state_int64(PG_FUNCTION_ARGS)
+{
+	return trimmed_cached_state(fcinfo, "bigint");
+}
+
+Datum
+trimmed_cached_state_numeric(PG_FUNCTION_ARGS)
+{
+	return trimmed_cached_state(fcinfo, "numeric");
+}
+
+/*
+ * Check the analyzed query computing the cached state, and return the filter
+ * (the WHERE condition). The filter is pasted into the query, so make sure it
+ * did not turn the query into something else (set operations, ordering, ...).
+ */
+static Node *
+cached_state_filter(SPIPlanPtr plan)
+{
+	List	   *sources = SPI_plan_get_plan_sources(plan);
+	CachedPlanSource *source;
+	Query	   *query;
+
+	if (list_length(sources) != 1)
+		elog(ERROR, "filter has to be a condition on the relation");
+
+	source = (CachedPlanSource *) linitial(sources);
+
+	if (list_length(source->query_list) != 1)
+		elog(ERROR, "filter has to be a condition on the relation");
+
+	query = (Query *) linitial(source->query_list);
+
+	if ((query->commandType != CMD_SELECT) ||
+		(query->utilityStmt != NULL) ||
+		(query->setOperations != NULL) ||
+		(query->cteList != NIL) ||
+		(query->groupClause != NIL) ||
+		(query->groupingSets != NIL) ||
+		(query->havingQual != NULL) ||
+		(query->hasWindowFuncs) ||
+		(query->distinctClause != NIL) ||
+		(query->sortClause != NIL) ||
+		(query->limitOffset != NULL) ||
+		(query->limitCount != NULL) ||
+		(query->rowMarks != NIL) ||
+		(list_length(query->targetList) != 1) ||
+		(list_length(query->jointree->fromlist) != 1))
+		elog(ERROR, "filter has to be a condition on the relation");
+
+	if (contain_volatile_functions(query->jointree->quals))
+		elog(ERROR, "filter must not contain volatile functions");
+
+	return query->jointree->quals;
+}
+
+#if PG_VERSION_NUM >= 150000
+
+/*
+ * Can the states computed from the relation be cached? That requires the
+ * relation to be a plain table without inheritance children (writes to the
+ * children would not fire the trigger), with enabled trimmed_cache_invalidate
+ * statement triggers on INSERT, UPDATE, DELETE and TRUNCATE.
+ */
+static bool
+cache_relation_invalidated(Oid relid, Oid nspid)
+{
+	Relation	rel;
+	Oid			funcid;
+	int16		events = 0;
+	int			i;
+
+	funcid = LookupFuncName(list_make2(makeString(get_namespace_name(nspid)),
+									   makeString("trimmed_cache_invalidate")),
+							0, NULL, true);
+
+	if (!OidIsValid(funcid))
+		return false;
+
+	rel = table_open(relid, AccessShareLock);
+
+	if ((rel->rd_rel->relkind == RELKIND_RELATION) &&
+		(!rel->rd_rel->relhassubclass) &&
+		(rel->trigdesc != NULL))
+	{
+		for (i = 0; i < rel->trigdesc->numtriggers; i++)
+		{
+			Trigger    *trigger = &rel->trigdesc->triggers[i];
+
+			if ((trigger->tgfoid != funcid) ||
+				(trigger->tgenabled == TRIGGER_DISABLED) ||
+				TRIGGER_FOR_ROW(trigger->tgtype))
+				continue;
+
+			events |= trigger->tgtype;
+		}
+	}
+
+	table_close(rel, AccessShareLock);
+
+	return TRIGGER_FOR_INSERT(events) && TRIGGER_FOR_UPDATE(events) &&
+		TRIGGER_FOR_DELETE(events) && TRIGGER_FOR_TRUNCATE(events);
+}
+
+#endif
+
+/*
+ * Return the state for the given column of a relation (optionally with a
+ * filter), either from the shared cache or computed by the trimmed_state
+ * aggregate (and then stored in the cache).
+ */
+static Datum
+trimmed_cached_state(FunctionCallInfo fcinfo, const char *typname)
+{
+	Oid			relid;
+	Oid			nspid;
+	char	   *column;
+	char	   *filter;
+	double		cut_lower,
+				cut_upper;
+	AttrNumber	attnum;
+	bool		use_cache = false;
+	StringInfoData query;
+	Oid			argtypes[2] = {FLOAT8OID, FLOAT8OID};
+	Datum		args[2];
+	Datum		result;
+	bool		isnull;
+	SPIPlanPtr	plan;
+	Node	   *quals;
+	MemoryContext oldcontext;
+#if PG_VERSION_NUM >= 150000
+	cache_key	key;
+	char	   *identity = NULL;
+	uint64		epoch = 0;
+#endif
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		elog(ERROR, "relation and column must not be NULL");
+
+	if (PG_ARGISNULL(3) || PG_ARGISNULL(4))
+		elog(ERROR, "both upper and lower cut must not be NULL");
+
+	relid = PG_GETARG_OID(0);
+	column = NameStr(*PG_GETARG_NAME(1));
+	filter = PG_ARGISNULL(2) ? "" : text_to_cstring(PG_GETARG_TEXT_PP(2));
+	cut_lower = PG_GETARG_FLOAT8(3);
+	cut_upper = PG_GETARG_FLOAT8(4);
+
+	check_cuts(cut_lower, cut_upper);
+
+	attnum = get_attnum(relid, column);
+	if (attnum == InvalidAttrNumber)
+		elog(ERROR, "column \"%s\" of relation \"%s\" does not exist",
+			 column, get_rel_name(relid));
+
+	nspid = get_func_namespace(fcinfo->flinfo->fn_oid);
+
+	initStringInfo(&query);
+	appendStringInfo(&query, "SELECT %s.trimmed_state(%s::%s, $1, $2) FROM %s",
+					 quote_identifier(get_namespace_name(nspid)),
+					 quote_identifier(column), typname,
+					 quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)),
+												get_rel_name(relid)));
+
+	if (filter[0] != '\0')
+		appendStringInfo(&query, " WHERE %s", filter);
+
+	args[0] = Float8GetDatum(cut_lower);
+	args[1] = Float8GetDatum(cut_upper);
+
+	oldcontext = CurrentMemoryContext;
+
+	SPI_connect();
+
+	if ((plan = SPI_prepare(query.data, 2, argtypes)) == NULL)
+		elog(ERROR, "failed to prepare the trimmed state query: %s",
+			 SPI_result_code_string(SPI_result));
+
+	quals = cached_state_filter(plan);
+
+#if PG_VERSION_NUM >= 150000
+	use_cache = cache_attach() &&
+		!IsolationUsesXactSnapshot() &&
+		!list_member_oid(cache_written, relid) &&
+		!contain_mutable_functions(quals) &&
+		!checkExprHasSubLink(quals) &&
+		(check_enable_rls(relid, InvalidOid, true) == RLS_NONE) &&
+		((pg_class_aclcheck(relid, GetUserId(), ACL_SELECT) == ACLCHECK_OK) ||
+		 (pg_attribute_aclcheck(relid, attnum, GetUserId(), ACL_SELECT) == ACLCHECK_OK)) &&
+		cache_relation_invalidated(relid, nspid);
+
+	if (use_cache)
+	{
+		bytea  *state;
+
+		/* the state has to outlive the SPI context */
+		MemoryContext spicontext = MemoryContextSwitchTo(oldcontext);
+
+		/* the search_path is quoted, so it can't be confused with the filter */
+		identity = psprintf("%s %s", quote_literal_cstr(namespace_search_path),
+							nodeToString(quals));
+
+		memset(&key, 0, sizeof(cache_key));
+		key.dbid = MyDatabaseId;
+		key.relid = relid;
+		key.typid = get_fn_expr_rettype(fcinfo->flinfo);
+		key.attnum = attnum;
+		key.userid = GetUserId();
+		key.cut_lower = cut_lower;
+		key.cut_upper = cut_upper;
+		key.filter_hash = hash_bytes((unsigned char *) identity, strlen(identity));
+
+		state = cache_lookup(&key, identity);
+
+		MemoryContextSwitchTo(spicontext);
+
+		if (state != NULL)
+		{
+			SPI_finish();
+			PG_RETURN_BYTEA_P(state);
+		}
+
+		/* read the epoch before the snapshot for the query gets taken */
+		epoch = cache_epoch(relid);
+	}
+#endif
+
+	if (SPI_execute_plan(plan, args, NULL, false, 1) != SPI_OK_SELECT)
+		elog(ERROR, "failed to compute the trimmed state");
+
+	result = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+
+	/* copy the state out of the SPI context */
+	if (!isnull)
+	{
+		MemoryContext spicontext = MemoryContextSwitchTo(oldcontext);
+
+		result = PointerGetDatum(PG_DETOAST_DATUM_COPY(result));
+
+		MemoryContextSwitchTo(spicontext);
+	}
+
+	SPI_finish();
+
+	if (isnull)
+		PG_RETURN_NULL();
+
+#if PG_VERSION_NUM >= 150000
+	/* don't cache states computed while the relation was being modified */
+	if (use_cache && (cache_epoch(relid) == epoch))
+		cache_store(&key, identity, (bytea *) DatumGetPointer(result), epoch);
+#endif
+
+	PG_RETURN_DATUM(result);
 }
 
+/*
+ * BACKGROUND WORKER
+ *
+ * The worker periodically calls trimmed_refresh(), which processes rows added
+ * to the registered relations since the last refresh, and merges them into
+ * the states stored in trimmed_results (so the sorting happens outside the
+ * interactive queries). The batches of new rows are sized according to the
+ * memory budget (trimmed_aggregates.worker_memory).
+ *
+ * The worker is either started in the current database by trimmed_worker_start,
+ * or automatically when the library is preloaded and worker_database is set.
+ */
+
+/* rough estimate of memory needed for one value (including the sort) */
+#define WORKER_BYTES_PER_ROW	16
+
+/*
+ * Advisory lock held by the worker running in a database, so that there's
+ * only one worker per database (otherwise they'd refresh the same
+ * registrations concurrently), and its PID may be found in pg_locks.
+ */
+#define WORKER_LOCK_KEY1		0x74726D61	/* "trma" */
+#define WORKER_LOCK_KEY2		1
+
+#if PG_VERSION_NUM >= 130000
+
 static void
-sort_state_numeric(state_numeric *state)
+worker_init(BackgroundWorker *worker, Oid dbid)
 {
-	int		i;
-	char   *data;
-	char   *ptr;
-	Numeric *items;
+	memset(worker, 0, sizeof(BackgroundWorker));
+
+	worker->bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker->bgw_start_time = BgWorkerStart_RecoveryFinished;
+	/* only restart the worker started automatically */
+	worker->bgw_restart_time = OidIsValid(dbid) ? BGW_NEVER_RESTART : 60;
+	worker->bgw_main_arg = ObjectIdGetDatum(dbid);
+
+	snprintf(worker->bgw_library_name, BGW_MAXLEN, "trimmed_aggregates");
+	snprintf(worker->bgw_function_name, BGW_MAXLEN, "trimmed_worker_main");
+	snprintf(worker->bgw_name, BGW_MAXLEN, "trimmed aggregates worker");
+	snprintf(worker->bgw_type, BGW_MAXLEN, "trimmed aggregates worker");
+}
 
-	if (state->sorted)
-		return;
+/*
+ * Run a single refresh in a separate transaction. Databases without the
+ * extension are simply skipped.
+ */
+static void
+worker_refresh(void)
+{
+	StringInfoData query;
+	char	   *schema = NULL;
+	int64		batch_rows = ((int64) worker_memory * 1024) / WORKER_BYTES_PER_ROW;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+	pgstat_report_activity(STATE_RUNNING, "trimmed_refresh");
+
+	if ((SPI_execute("SELECT n.nspname FROM pg_extension e JOIN pg_namespace n"
+					 " ON (n.oid = e.extnamespace)"
+					 " WHERE e.extname = 'trimmed_aggregates'",
+					 true, 1) == SPI_OK_SELECT) && (SPI_processed > 0))
+		schema = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+
+	if (schema != NULL)
+	{
+		initStringInfo(&query);
+		appendStringInfo(&query, "SELECT %s.trimmed_refresh(" INT64_FORMAT ")",
+						 quote_identifier(schema), batch_rows);
+
+		if (SPI_execute(query.data, false, 0) != SPI_OK_SELECT)
+			elog(ERROR, "trimmed_refresh failed");
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	pgstat_report_stat(true);
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/*
+ * Take the worker lock for the current database (for the whole session),
+ * returns false when another worker already holds it.
+ */
+static bool
+worker_lock(void)
+{
+	LOCKTAG		tag;
+	bool		locked;
+
+	SET_LOCKTAG_ADVISORY(tag, MyDatabaseId, WORKER_LOCK_KEY1,
+						 WORKER_LOCK_KEY2, 2);
+
+	StartTransactionCommand();
+	locked = (LockAcquire(&tag, ExclusiveLock, true, true) != LOCKACQUIRE_NOT_AVAIL);
+	CommitTransactionCommand();
+
+	return locked;
+}
+
+/* PID of the worker running in the current database (or 0) */
+static int
+worker_pid(void)
+{
+	int			pid = 0;
+	bool		isnull;
+	char	   *query;
+
+	query = psprintf("SELECT pid FROM pg_catalog.pg_locks"
+					 " WHERE locktype = 'advisory' AND granted"
+					 " AND database = %u AND classid = %u"
+					 " AND objid = %u AND objsubid = 2",
+					 MyDatabaseId, WORKER_LOCK_KEY1, WORKER_LOCK_KEY2);
+
+	SPI_connect();
+
+	if ((SPI_execute(query, true, 1) == SPI_OK_SELECT) && (SPI_processed > 0))
+	{
+		Datum	value = SPI_getbinval(SPI_tuptable->vals[0],
+									  SPI_tuptable->tupdesc, 1, &isnull);
+
+		if (!isnull)
+			pid = DatumGetInt32(value);
+	}
+
+	SPI_finish();
+
+	return pid;
+}
+
+#endif
+
+void
+trimmed_worker_main(Datum main_arg)
+{
+#if PG_VERSION_NUM >= 130000
+	Oid		dbid = DatumGetObjectId(main_arg);
+
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
 
 	/*
-	 * we'll sort a local copy of the data, and then copy it back (we want
-	 * to put the result into the proper memory context)
+	 * Dynamic workers run as the user who started them, the preloaded one as
+	 * the configured role. The refresh builds and runs statements using the
+	 * names from the registry, so it must not run as a superuser unless
+	 * someone explicitly asked for that by calling trimmed_worker_start().
 	 */
-	items = (Numeric*)palloc(sizeof(Numeric) * state->nelements);
-	data = palloc(state->usedlen);
-	memcpy(data, state->data, state->usedlen);
-
-	/* parse the data into array of Numeric items, for pg_qsort */
-	i = 0;
-	ptr = data;
-	while (ptr < data + state->usedlen)
+	if (OidIsValid(dbid))
 	{
-		items[i++] = (Numeric)ptr;
-		ptr += VARSIZE(ptr);
+		Oid		userid;
 
-		Assert(i <= state->nelements);
-		Assert(ptr <= (data + state->usedlen));
+		memcpy(&userid, MyBgworkerEntry->bgw_extra, sizeof(Oid));
+		BackgroundWorkerInitializeConnectionByOid(dbid, userid, 0);
 	}
+	else
+	{
+		BackgroundWorkerInitializeConnection(worker_database, worker_role, 0);
 
-	Assert(i == state->nelements);
-	Assert(ptr == (data + state->usedlen));
+		if (superuser())
+		{
+			ereport(LOG,
+					(errmsg("trimmed aggregates worker not started"),
+					 errdetail("Role \"%s\" is a superuser.", worker_role)));
 
-	pg_qsort(items, state->nelements, sizeof(Numeric), &numeric_comparator);
+			/* exit code 0 unregisters the worker, so it's not restarted */
+			proc_exit(0);
+		}
+	}
 
-	/* copy the values from the local array back into the state */
-	ptr = state->data;
-	for (i = 0; i < state->nelements; i++)
+	/*
+	 * Only one worker per database. The dynamic worker exits for good, the
+	 * preloaded one is restarted later (in case the other one exits).
+	 */
+	if (!worker_lock())
 	{
-		memcpy(ptr, items[i], VARSIZE(items[i]));
-		ptr += VARSIZE(items[i]);
+		ereport(LOG,
+				(errmsg("trimmed aggregates worker is already running in this database")));
+		proc_exit(OidIsValid(dbid) ? 0 : 1);
+	}
 
-		Assert(ptr <= state->data + state->usedlen);
+	while (true)
+	{
+		MemoryContext	oldcontext = CurrentMemoryContext;
+
+		/* failed refresh (e.g. a dropped column) should not kill the worker */
+		PG_TRY();
+		{
+			worker_refresh();
+		}
+		PG_CATCH();
+		{
+			MemoryContextSwitchTo(oldcontext);
+			EmitErrorReport();
+			FlushErrorState();
+			AbortCurrentTransaction();
+			pgstat_report_activity(STATE_IDLE, NULL);
+		}
+		PG_END_TRY();
+
+		(void) WaitLatch(MyLatch,
+						 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 worker_interval * 1000L,
+						 PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
 	}
+#endif
+}
 
-	Assert(ptr == state->data + state->usedlen);
+/*
+ * Start the worker in the current database (running as the current user),
+ * and return its PID. When a worker is already running in the database,
+ * just return the PID of that worker.
+ */
+Datum
+trimmed_worker_start(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 130000
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+	pid_t		pid;
+	int			running;
+	Oid			userid = GetUserId();
 
-	pfree(items);
-	pfree(data);
+	if ((running = worker_pid()) != 0)
+		PG_RETURN_INT32(running);
 
-	state->sorted = true;
+	worker_init(&worker, MyDatabaseId);
+
+	worker.bgw_notify_pid = MyProcPid;
+	memcpy(worker.bgw_extra, &userid, sizeof(Oid));
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+		elog(ERROR, "could not register the background worker (increase max_worker_processes)");
+
+	if (WaitForBackgroundWorkerStartup(handle, &pid) != BGWH_STARTED)
+		elog(ERROR, "could not start the background worker");
+
+	/*
+	 * Wait for the worker to take the lock. If another worker was started
+	 * concurrently, ours exits and we return the PID of the other one.
+	 */
+	while ((running = worker_pid()) == 0)
+	{
+		if (GetBackgroundWorkerPid(handle, &pid) == BGWH_STOPPED)
+		{
+			if ((running = worker_pid()) != 0)
+				break;
+
+			elog(ERROR, "background worker exited during startup");
+		}
+
+		(void) WaitLatch(MyLatch,
+						 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 10L, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	PG_RETURN_INT32(running);
+#else
+	elog(ERROR, "the background worker requires PostgreSQL 13 or newer");
+#endif
 }
+
+/*
+ * FIXED-WIDTH TYPES
+ *
+ * The states of double precision, integer, bigint, smallint and real values
+ * (and the aggregate support functions for them) are generated from the same
+ * template, with the comparisons inlined in the sorts and merges. Smallint
+ * and real only have the basic aggregates, so they don't define TT_EXTENDED.
+ */
+
+#define TT_TYPE double
+#define TT_SUFFIX double
+#define TT_GETARG PG_GETARG_FLOAT8
+#define TT_EXTENDED
+#define TT_WEIGHTED
+#define TT_TYPEOID FLOAT8OID
+#define TT_SENDVALUE pq_sendfloat8
+#define TT_RECVVALUE(buf) pq_getmsgfloat8(buf)
+#define TT_DEFINE
+#include "trimmed_template.h"
+
+#define TT_TYPE int32
+#define TT_SUFFIX int32
+#define TT_GETARG PG_GETARG_INT32
+#define TT_EXTENDED
+#define TT_WEIGHTED
+#define TT_TYPEOID INT4OID
+#define TT_SENDVALUE pq_sendint32
+#define TT_RECVVALUE(buf) pq_getmsgint(buf, sizeof(int32))
+#define TT_DEFINE
+#include "trimmed_template.h"
+
+#define TT_TYPE int64
+#define TT_SUFFIX int64
+#define TT_GETARG PG_GETARG_INT64
+#define TT_EXTENDED
+#define TT_WEIGHTED
+#define TT_TYPEOID INT8OID
+#define TT_SENDVALUE pq_sendint64
+#define TT_RECVVALUE(buf) pq_getmsgint64(buf)
+#define TT_DEFINE
+#include "trimmed_template.h"
+
+#define TT_TYPE int16
+#define TT_SUFFIX int16
+#define TT_GETARG PG_GETARG_INT16
+#define TT_TYPEOID INT2OID
+#define TT_DEFINE
+#include "trimmed_template.h"
+
+#define TT_TYPE float4
+#define TT_SUFFIX float4
+#define TT_GETARG PG_GETARG_FLOAT4
+#define TT_TYPEOID FLOAT4OID
+#define TT_DEFINE
+#include "trimmed_template.h"
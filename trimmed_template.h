@@ -0,0 +1,2882 @@
+/*
+ * trimmed_template.h - Trimmed aggregates for a fixed-width type
+ * Copyright (C) Tomas Vondra, 2011-2016
+ *
+ *
+ * The states of all the fixed-width types (double precision, integer,
+ * bigint, smallint and real) work exactly the same - the values are kept
+ * in an array, sorted, trimmed and then summed. Instead of copying the code
+ * for each type, it's generated from this template, which is included once
+ * for each type (similarly to lib/sort_template.h), with the following
+ * parameters defined:
+ *
+ *	- TT_TYPE - type of the values (e.g. int32)
+ *	- TT_SUFFIX - suffix of the generated names (e.g. int32)
+ *	- TT_GETARG - macro fetching an argument of the type (e.g. PG_GETARG_INT32)
+ *	- TT_TYPEOID - OID of the SQL type (e.g. INT4OID, only needed with TT_DEFINE)
+ *	- TT_SENDVALUE - sends a value in the binary format of the persistent
+ *	  state (e.g. pq_sendint32, only needed with TT_DEFINE and TT_EXTENDED)
+ *	- TT_RECVVALUE - receives a value sent by TT_SENDVALUE (only needed with
+ *	  TT_DEFINE and TT_EXTENDED)
+ *	- TT_EXTENDED - if defined, the array input, multi-cut, quantile and
+ *	  persistent-state (trimmed_state) functions are generated too (only the
+ *	  types with SQL functions for them define it)
+ *	- TT_WEIGHTED - if defined, the weighted variant (elements with a value
+ *	  and a weight, for pre-aggregated data) is generated too
+ *	- TT_DECLARE - if defined, the structs and functions are declared
+ *	- TT_DEFINE - if defined, the functions are defined
+ *
+ * The generated names are the same as in the hand-written code, i.e. the
+ * state of int32 values is state_int32, the sort is sort_state_int32, the
+ * transition function is trimmed_append_int32 and so on (and the weighted
+ * state is state_weighted_int32, with weighted_int32 elements).
+ *
+ * The sorts (and merges) work with the values directly, so the comparisons
+ * get inlined instead of calling a comparator through a pointer. The weighted
+ * elements are sorted by sort_parallel, with a comparator.
+ */
+
+#define TT_MAKE_NAME_(a, b, c)	a##b##c
+#define TT_MAKE_NAME(a, b, c)	TT_MAKE_NAME_(a, b, c)
+#define TT_NAME(prefix, suffix)	TT_MAKE_NAME(prefix, TT_SUFFIX, suffix)
+
+/* PG_FUNCTION_INFO_V1 does not expand the name (it pastes it) */
+#define TT_FUNCTION_INFO(name)	PG_FUNCTION_INFO_V1(name)
+
+#define TT_STATE	TT_NAME(state_,)
+#define TT_RUN		TT_NAME(run_,)
+#define TT_WVALUE	TT_NAME(weighted_,)
+#define TT_WSTATE	TT_NAME(state_weighted_,)
+
+#ifdef TT_DECLARE
+
+/*
+ * Sorted runs of values, collected by the combine functions (see run_numeric
+ * for details).
+ */
+typedef struct TT_RUN
+{
+	TT_TYPE	   *elements;		/* sorted values */
+	int			nelements;		/* number of values */
+} TT_RUN;
+
+/* Structure used to keep the data - the 'elements' array is extended
+ * on the fly if needed. */
+typedef struct TT_STATE
+{
+	int		maxelements;	/* size of elements array */
+	int		nelements;		/* number of used items */
+
+	double	cut_lower;		/* fraction to cut at the lower end */
+	double	cut_upper;		/* fraction to cut at the upper end */
+
+	bool	sorted;			/* are the elements sorted */
+
+	int		sample_shift;	/* values are sampled with rate 1/2^shift */
+
+	TT_TYPE    *elements;		/* array of values */
+
+	trimmed_params *params;	/* optional parameters (or NULL) */
+
+	int		nruns;			/* number of runs to merge (or 0) */
+	int		maxruns;		/* size of the runs array */
+	TT_RUN *runs;			/* sorted runs, collected by combine */
+
+	trimmed_memory memory;	/* memory accounted to the state */
+} TT_STATE;
+
+/* comparators, used for qsort */
+static int	TT_NAME(,_comparator)(const void *a, const void *b);
+static int	TT_NAME(run_,_comparator)(const void *a, const void *b);
+
+/* sorting the values, merging sorted arrays and runs */
+static void TT_NAME(sort_elements_,)(void *base, int nelements);
+static void TT_NAME(sort_chunked_,)(TT_TYPE *elements, int nelements);
+static void TT_NAME(sort_state_,)(TT_STATE *state);
+static void TT_NAME(merge_,)(TT_TYPE *a, int na, TT_TYPE *b, int nb, TT_TYPE *out);
+static void TT_NAME(merge_runs_,)(TT_STATE *state);
+static void TT_NAME(heap_sift_,)(TT_RUN *runs, int *pos, int *heap, int nheap);
+static int	TT_NAME(gallop_,)(TT_TYPE *elements, int from, int to, TT_TYPE key, bool strict);
+
+/* kept part of the (sorted) state, and sums of the kept values */
+static bool TT_NAME(kept_range_,)(TT_STATE *state, int *from, int *to);
+static void TT_NAME(sum_,)(TT_TYPE *elements, int from, int to, double *sum_x, double *sum_x2);
+static double TT_NAME(sum_dev2_,)(TT_TYPE *elements, int from, int to, double avg);
+
+/* accumulating the values */
+static void TT_NAME(halve_state_,)(TT_STATE *state);
+static void TT_NAME(append_,)(TT_STATE *state, TT_TYPE value);
+
+/* state serialization and combining (shared with the trimmed_state types) */
+static bytea *TT_NAME(serialize_,)(TT_STATE *state);
+static TT_STATE *TT_NAME(deserialize_,)(bytea *state, MemoryContext context);
+static TT_STATE *TT_NAME(combine_,)(TT_STATE *state1, TT_STATE *state2,
+							MemoryContext agg_context);
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_append_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_serial_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_deserial_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_combine_,));
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_avg_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_var_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_var_pop_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_var_samp_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_stddev_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_stddev_pop_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_stddev_samp_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_,_array));
+
+Datum TT_NAME(trimmed_append_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_serial_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_deserial_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_combine_,)(PG_FUNCTION_ARGS);
+
+Datum TT_NAME(trimmed_avg_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_var_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_var_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_var_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_stddev_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_stddev_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_stddev_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_,_array)(PG_FUNCTION_ARGS);
+
+/* winsorized statistics (computed from the same sorted state) */
+static Datum TT_NAME(winsorized_,)(FunctionCallInfo fcinfo, int stat);
+
+TT_FUNCTION_INFO(TT_NAME(winsorized_avg_,));
+TT_FUNCTION_INFO(TT_NAME(winsorized_var_,));
+TT_FUNCTION_INFO(TT_NAME(winsorized_var_pop_,));
+TT_FUNCTION_INFO(TT_NAME(winsorized_var_samp_,));
+TT_FUNCTION_INFO(TT_NAME(winsorized_stddev_,));
+TT_FUNCTION_INFO(TT_NAME(winsorized_stddev_pop_,));
+TT_FUNCTION_INFO(TT_NAME(winsorized_stddev_samp_,));
+TT_FUNCTION_INFO(TT_NAME(winsorized_,_array));
+
+Datum TT_NAME(winsorized_avg_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(winsorized_var_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(winsorized_var_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(winsorized_var_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(winsorized_stddev_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(winsorized_stddev_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(winsorized_stddev_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(winsorized_,_array)(PG_FUNCTION_ARGS);
+
+/* kept part of the sorted values (as an array) */
+TT_FUNCTION_INFO(TT_NAME(trimmed_values_,));
+
+Datum TT_NAME(trimmed_values_,)(PG_FUNCTION_ARGS);
+
+/* confidence interval of the trimmed mean */
+TT_FUNCTION_INFO(TT_NAME(trimmed_ci_,));
+
+Datum TT_NAME(trimmed_ci_,)(PG_FUNCTION_ARGS);
+
+#ifdef TT_EXTENDED
+
+/* accumulating all values of an array at once */
+static void TT_NAME(append_values_,)(TT_STATE *state, ArrayType *array, int nitems);
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_append_array_,));
+
+Datum TT_NAME(trimmed_append_array_,)(PG_FUNCTION_ARGS);
+
+/* multiple cut configurations */
+static Datum TT_NAME(trimmed_multi_,)(TT_STATE *state, int stat);
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_avg_,_multi));
+TT_FUNCTION_INFO(TT_NAME(trimmed_var_,_multi));
+TT_FUNCTION_INFO(TT_NAME(trimmed_var_pop_,_multi));
+TT_FUNCTION_INFO(TT_NAME(trimmed_var_samp_,_multi));
+TT_FUNCTION_INFO(TT_NAME(trimmed_stddev_,_multi));
+TT_FUNCTION_INFO(TT_NAME(trimmed_stddev_pop_,_multi));
+TT_FUNCTION_INFO(TT_NAME(trimmed_stddev_samp_,_multi));
+TT_FUNCTION_INFO(TT_NAME(trimmed_,_array_multi));
+
+Datum TT_NAME(trimmed_avg_,_multi)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_var_,_multi)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_var_pop_,_multi)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_var_samp_,_multi)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_stddev_,_multi)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_stddev_pop_,_multi)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_stddev_samp_,_multi)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_,_array_multi)(PG_FUNCTION_ARGS);
+
+/* quantiles */
+static double TT_NAME(quantile_,)(TT_TYPE *elements, int from, int to, double q);
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_quantiles_,));
+
+Datum TT_NAME(trimmed_quantiles_,)(PG_FUNCTION_ARGS);
+
+/* persistent state (trimmed_state types) */
+static TT_STATE *TT_NAME(build_state_,)(TT_TYPE *values, int nvalues,
+										double cut_lower, double cut_upper,
+										int sample_shift);
+static Datum TT_NAME(trimmed_state_,)(FunctionCallInfo fcinfo, int stat);
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_,_in));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_,_out));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_,_recv));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_,_send));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_final_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_merge_,));
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_avg_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_var_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_var_pop_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_var_samp_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_stddev_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_stddev_pop_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_stddev_samp_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_state_,_array));
+
+Datum TT_NAME(trimmed_state_,_in)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_,_out)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_,_recv)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_,_send)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_final_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_merge_,)(PG_FUNCTION_ARGS);
+
+Datum TT_NAME(trimmed_state_avg_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_var_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_var_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_var_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_stddev_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_stddev_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_stddev_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_state_,_array)(PG_FUNCTION_ARGS);
+
+#endif							/* TT_EXTENDED */
+
+#ifdef TT_WEIGHTED
+
+/*
+ * Weighted variant, used for pre-aggregated (value, count) data. Each
+ * element represents 'weight' copies of the value, and the cuts are
+ * applied to the cumulative weight (i.e. the results are the same as if
+ * the values were expanded into 'weight' rows).
+ */
+typedef struct TT_WVALUE
+{
+	TT_TYPE	value;
+	int64	weight;
+} TT_WVALUE;
+
+typedef struct TT_WSTATE
+{
+	int		maxelements;	/* size of elements array */
+	int		nelements;		/* number of used items */
+
+	int64	total;			/* sum of weights */
+
+	double	cut_lower;		/* fraction to cut at the lower end */
+	double	cut_upper;		/* fraction to cut at the upper end */
+
+	bool	sorted;			/* are the elements sorted */
+
+	int		sample_shift;	/* values are sampled with rate 1/2^shift */
+
+	TT_WVALUE *elements;	/* array of (value, weight) pairs */
+
+	trimmed_memory memory;	/* memory accounted to the state */
+} TT_WSTATE;
+
+static int	TT_NAME(weighted_,_comparator)(const void *a, const void *b);
+static int	TT_NAME(gallop_weighted_,)(TT_WVALUE *elements, int from, int to, TT_TYPE key, bool strict);
+static void TT_NAME(merge_weighted_,)(TT_WVALUE *a, int na, TT_WVALUE *b, int nb, TT_WVALUE *out);
+static void TT_NAME(sort_state_weighted_,)(TT_WSTATE *state);
+static void TT_NAME(halve_state_weighted_,)(TT_WSTATE *state);
+static void TT_NAME(append_weighted_,)(TT_WSTATE *state, TT_TYPE value, int64 weight);
+static Datum TT_NAME(trimmed_weighted_,)(FunctionCallInfo fcinfo, int stat);
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_append_weighted_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_serial_weighted_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_deserial_weighted_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_combine_weighted_,));
+
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_avg_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_var_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_var_pop_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_var_samp_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_stddev_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_stddev_pop_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_stddev_samp_,));
+TT_FUNCTION_INFO(TT_NAME(trimmed_weighted_,_array));
+
+Datum TT_NAME(trimmed_append_weighted_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_serial_weighted_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_deserial_weighted_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_combine_weighted_,)(PG_FUNCTION_ARGS);
+
+Datum TT_NAME(trimmed_weighted_avg_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_weighted_var_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_weighted_var_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_weighted_var_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_weighted_stddev_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_weighted_stddev_pop_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_weighted_stddev_samp_,)(PG_FUNCTION_ARGS);
+Datum TT_NAME(trimmed_weighted_,_array)(PG_FUNCTION_ARGS);
+
+#endif							/* TT_WEIGHTED */
+
+#endif							/* TT_DECLARE */
+
+#ifdef TT_DEFINE
+
+static int
+TT_NAME(,_comparator)(const void *a, const void *b)
+{
+	TT_TYPE af = (*(TT_TYPE*)a);
+	TT_TYPE bf = (*(TT_TYPE*)b);
+	return (af > bf) - (af < bf);
+}
+
+static int
+TT_NAME(run_,_comparator)(const void *a, const void *b)
+{
+	TT_TYPE af = ((TT_RUN*)a)->elements[0];
+	TT_TYPE bf = ((TT_RUN*)b)->elements[0];
+	return (af > bf) - (af < bf);
+}
+
+/*
+ * Find the first element in [from, to) greater than the key (or greater or
+ * equal, when not strict), assuming elements[from] is not. We first find the
+ * range using exponential steps, and then do a binary search in it.
+ */
+static int
+TT_NAME(gallop_,)(TT_TYPE *elements, int from, int to, TT_TYPE key, bool strict)
+{
+	int		lo = from,
+			hi = from + 1,
+			step = 1;
+
+	/* invariant: elements[lo] is "below" the key, hi is the candidate */
+	while ((hi < to) &&
+		   (strict ? (elements[hi] <= key) : (elements[hi] < key)))
+	{
+		lo = hi;
+		step *= 2;
+		hi = (to - lo > step) ? (lo + step) : to;
+	}
+
+	/* now the first element above the key is in (lo, hi] */
+	while (hi - lo > 1)
+	{
+		int		mid = lo + (hi - lo) / 2;
+
+		if (strict ? (elements[mid] <= key) : (elements[mid] < key))
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return hi;
+}
+
+/*
+ * Merge two sorted arrays into the output array. When the value ranges do
+ * not overlap (common e.g. with partitioning by the aggregated value), the
+ * arrays are simply concatenated. Otherwise we gallop through runs of values
+ * from the same input (using exponential search), and copy each run at once.
+ * For equal values, elements from the first array go first.
+ */
+static void
+TT_NAME(merge_,)(TT_TYPE *a, int na, TT_TYPE *b, int nb, TT_TYPE *out)
+{
+	int		i = 0,
+			j = 0,
+			n;
+
+	/* disjoint ranges (or empty arrays) - just concatenate */
+	if ((na == 0) || (nb == 0) || (a[na - 1] <= b[0]))
+	{
+		memcpy(out, a, na * sizeof(TT_TYPE));
+		memcpy(out + na, b, nb * sizeof(TT_TYPE));
+		return;
+	}
+
+	if (b[nb - 1] < a[0])
+	{
+		memcpy(out, b, nb * sizeof(TT_TYPE));
+		memcpy(out + nb, a, na * sizeof(TT_TYPE));
+		return;
+	}
+
+	while ((i < na) && (j < nb))
+	{
+		progress_check(i + j);
+
+		if (a[i] <= b[j])
+		{
+			/* all values from 'a' not greater than b[j] */
+			n = TT_NAME(gallop_,)(a, i, na, b[j], true);
+			memcpy(out, a + i, (n - i) * sizeof(TT_TYPE));
+			out += (n - i);
+			i = n;
+		}
+		else
+		{
+			/* all values from 'b' less than a[i] */
+			n = TT_NAME(gallop_,)(b, j, nb, a[i], false);
+			memcpy(out, b + j, (n - j) * sizeof(TT_TYPE));
+			out += (n - j);
+			j = n;
+		}
+	}
+
+	/* copy the remaining part (at most one of those is non-empty) */
+	memcpy(out, a + i, (na - i) * sizeof(TT_TYPE));
+	out += (na - i);
+
+	memcpy(out, b + j, (nb - j) * sizeof(TT_TYPE));
+}
+
+/*
+ * Restore the heap property, after replacing the top of the heap (runs with
+ * the smallest next value are at the top).
+ */
+static void
+TT_NAME(heap_sift_,)(TT_RUN *runs, int *pos, int *heap, int nheap)
+{
+	int		i = 0;
+
+	while (true)
+	{
+		int		child = 2 * i + 1;
+		int		tmp;
+
+		if (child >= nheap)
+			break;
+
+		/* pick the smaller child */
+		if ((child + 1 < nheap) &&
+			(runs[heap[child + 1]].elements[pos[heap[child + 1]]] <
+			 runs[heap[child]].elements[pos[heap[child]]]))
+			child++;
+
+		if (runs[heap[i]].elements[pos[heap[i]]] <=
+			runs[heap[child]].elements[pos[heap[child]]])
+			break;
+
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+
+		i = child;
+	}
+}
+
+/*
+ * Merge all the sorted runs collected by combine into a single array. When
+ * the runs don't overlap (e.g. with partitioning by the aggregated value),
+ * we simply concatenate them (ordered by the first value). With two runs we
+ * do a regular merge, otherwise we do a k-way merge using a binary heap.
+ */
+static void
+TT_NAME(merge_runs_,)(TT_STATE *state)
+{
+	int			i, k, nheap;
+	int		   *heap, *pos;
+	TT_RUN  *runs = state->runs;
+	int			nruns = state->nruns;
+	TT_TYPE	   *result;
+	bool		disjoint = true;
+
+	result = (TT_TYPE *) MemoryContextAlloc(GetMemoryChunkContext(state),
+										  state->nelements * sizeof(TT_TYPE));
+
+	progress_start(PROGRESS_PHASE_MERGE, state->nelements);
+
+	pg_qsort(runs, nruns, sizeof(TT_RUN), &TT_NAME(run_,_comparator));
+
+	for (i = 1; i < nruns; i++)
+	{
+		if (runs[i - 1].elements[runs[i - 1].nelements - 1] > runs[i].elements[0])
+		{
+			disjoint = false;
+			break;
+		}
+	}
+
+	if (disjoint)
+	{
+		for (i = 0, k = 0; i < nruns; i++)
+		{
+			memcpy(result + k, runs[i].elements, runs[i].nelements * sizeof(TT_TYPE));
+			k += runs[i].nelements;
+		}
+	}
+	else if (nruns == 2)
+		TT_NAME(merge_,)(runs[0].elements, runs[0].nelements,
+					runs[1].elements, runs[1].nelements, result);
+	else
+	{
+		heap = (int *) palloc(nruns * sizeof(int));
+		pos = (int *) palloc0(nruns * sizeof(int));
+
+		for (i = 0; i < nruns; i++)
+			heap[i] = i;
+
+		/* runs are ordered by the first value, so it's a valid heap already */
+		nheap = nruns;
+
+		for (k = 0; k < state->nelements; k++)
+		{
+			int		r = heap[0];
+
+			progress_check(k);
+
+			result[k] = runs[r].elements[pos[r]++];
+
+			/* remove exhausted runs from the heap */
+			if (pos[r] == runs[r].nelements)
+				heap[0] = heap[--nheap];
+
+			TT_NAME(heap_sift_,)(runs, pos, heap, nheap);
+		}
+
+		Assert(nheap == 0);
+
+		pfree(heap);
+		pfree(pos);
+	}
+
+	for (i = 0; i < nruns; i++)
+		pfree(runs[i].elements);
+
+	pfree(runs);
+
+	state->elements = result;
+	state->maxelements = state->nelements;
+	state->runs = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+
+	progress_end();
+}
+
+/*
+ * Sort of a chunk of values, generated by lib/sort_template.h with the
+ * comparison inlined (on older releases we simply use pg_qsort). It does
+ * not check for interrupts, so that it can run on the finalize threads.
+ */
+#if PG_VERSION_NUM >= 140000
+#define ST_SORT TT_NAME(qsort_,)
+#define ST_ELEMENT_TYPE TT_TYPE
+#define ST_COMPARE(a, b) ((*(a) > *(b)) - (*(a) < *(b)))
+#define ST_SCOPE static
+#define ST_DEFINE
+#include "lib/sort_template.h"
+#endif
+
+static void
+TT_NAME(sort_elements_,)(void *base, int nelements)
+{
+#if PG_VERSION_NUM >= 140000
+	TT_NAME(qsort_,)((TT_TYPE *) base, nelements);
+#else
+	pg_qsort(base, nelements, sizeof(TT_TYPE), &TT_NAME(,_comparator));
+#endif
+}
+
+/*
+ * Partition the values into three parts (see sort_partition), comparing
+ * the values directly.
+ */
+static void
+TT_NAME(sort_partition_,)(TT_TYPE *elements, int nelements, int *lt, int *gt)
+{
+	TT_TYPE		a = elements[0],
+				b = elements[nelements / 2],
+				c = elements[nelements - 1],
+				pivot;
+	int			i = 0,
+				l = 0,
+				g = nelements;
+
+	if (a < b)
+		pivot = (b < c) ? b : ((a < c) ? c : a);
+	else
+		pivot = (b > c) ? b : ((a > c) ? c : a);
+
+	while (i < g)
+	{
+		TT_TYPE		x = elements[i];
+
+		if (x < pivot)
+		{
+			elements[i++] = elements[l];
+			elements[l++] = x;
+		}
+		else if (x > pivot)
+		{
+			elements[i] = elements[--g];
+			elements[g] = x;
+		}
+		else
+			i++;
+
+		if ((i % PROGRESS_INTERVAL) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+
+	*lt = l;
+	*gt = g;
+}
+
+static void
+TT_NAME(sort_chunks_,)(TT_TYPE *elements, int nelements, int64 *done, int depth)
+{
+	/* recurse into the smaller part, iterate on the larger one */
+	while ((nelements > SORT_CHUNK) && (depth-- > 0))
+	{
+		int		lt, gt;
+
+		TT_NAME(sort_partition_,)(elements, nelements, &lt, &gt);
+
+		/* the values equal to the pivot are in the right place already */
+		*done += (gt - lt);
+
+		CHECK_FOR_INTERRUPTS();
+		progress_update(*done);
+
+		if (lt < nelements - gt)
+		{
+			TT_NAME(sort_chunks_,)(elements, lt, done, depth);
+			elements += gt;
+			nelements -= gt;
+		}
+		else
+		{
+			TT_NAME(sort_chunks_,)(elements + gt, nelements - gt, done, depth);
+			nelements = lt;
+		}
+	}
+
+	TT_NAME(sort_elements_,)(elements, nelements);
+
+	*done += nelements;
+
+	CHECK_FOR_INTERRUPTS();
+	progress_update(*done);
+}
+
+/*
+ * Sort the values in chunks, so that the sort can be interrupted (just like
+ * sort_chunked, but with the comparisons inlined).
+ */
+static void
+TT_NAME(sort_chunked_,)(TT_TYPE *elements, int nelements)
+{
+	int64	done = 0;
+	int		i;
+
+	if (nelements <= SORT_CHUNK)
+	{
+		TT_NAME(sort_elements_,)(elements, nelements);
+		return;
+	}
+
+	for (i = 1; i < nelements; i++)
+	{
+		if (elements[i - 1] > elements[i])
+			break;
+
+		if ((i % PROGRESS_INTERVAL) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+
+	if (i == nelements)
+		return;
+
+	progress_start(PROGRESS_PHASE_SORT, nelements);
+
+	TT_NAME(sort_chunks_,)(elements, nelements, &done, SORT_MAX_DEPTH);
+
+	progress_end();
+}
+
+static void
+TT_NAME(sort_state_,)(TT_STATE *state)
+{
+	instr_time	start;
+
+	if (state->sorted)
+		return;
+
+	INSTR_TIME_SET_CURRENT(start);
+
+	/* merge the sorted runs collected by combine, or sort the data */
+	if (state->nruns > 0)
+	{
+		TRACE_TRIMMED_MERGE_START(state->nruns, state->nelements);
+		TT_NAME(merge_runs_,)(state);
+		counters_timing(&counters.merges, start);
+		TRACE_TRIMMED_MERGE_DONE(state->nelements);
+	}
+	else
+	{
+		TRACE_TRIMMED_SORT_START(state->nelements, state->nelements * sizeof(TT_TYPE));
+		if (finalize_nthreads(state->nelements) >= 2)
+			sort_parallel(state->elements, state->nelements, sizeof(TT_TYPE),
+						  &TT_NAME(,_comparator), &TT_NAME(sort_elements_,));
+		else
+			TT_NAME(sort_chunked_,)(state->elements, state->nelements);
+		counters_timing(&counters.sorts, start);
+		TRACE_TRIMMED_SORT_DONE(state->nelements);
+	}
+
+	state->sorted = true;
+}
+
+static void
+TT_NAME(finalize_sums_,_kernel)(void *arg, int task, int ntasks)
+{
+	finalize_sums *sums = (finalize_sums *) arg;
+	TT_TYPE	   *elements = (TT_TYPE *) sums->elements;
+	int			i,
+				from = sums->from + FINALIZE_SLICE(sums->to - sums->from, task, ntasks),
+				to = sums->from + FINALIZE_SLICE(sums->to - sums->from, task + 1, ntasks);
+	double		sum_x = 0,
+				sum_x2 = 0;
+
+	for (i = from; i < to; i++)
+	{
+		sum_x = sum_x + (double) elements[i];
+		sum_x2 = sum_x2 + ((double) elements[i]) * ((double) elements[i]);
+	}
+
+	sums->sum_x[task] = sum_x;
+	sums->sum_x2[task] = sum_x2;
+}
+
+static void
+TT_NAME(finalize_dev2_,_kernel)(void *arg, int task, int ntasks)
+{
+	finalize_sums *sums = (finalize_sums *) arg;
+	TT_TYPE	   *elements = (TT_TYPE *) sums->elements;
+	int			i,
+				from = sums->from + FINALIZE_SLICE(sums->to - sums->from, task, ntasks),
+				to = sums->from + FINALIZE_SLICE(sums->to - sums->from, task + 1, ntasks);
+	double		sum_dev2 = 0;
+
+	for (i = from; i < to; i++)
+		sum_dev2 = sum_dev2 + (elements[i] - sums->avg) * (elements[i] - sums->avg);
+
+	sums->sum_x2[task] = sum_dev2;
+}
+
+static void
+TT_NAME(sum_,)(TT_TYPE *elements, int from, int to, double *sum_x, double *sum_x2)
+{
+	int			i;
+	double		x = *sum_x,
+				x2 = (sum_x2 != NULL) ? *sum_x2 : 0;
+
+	if (finalize_nthreads(to - from) >= 2)
+	{
+		sum_values(TT_NAME(finalize_sums_,_kernel), elements, from, to, sum_x, sum_x2);
+		return;
+	}
+
+	if (sum_x2 == NULL)
+	{
+		for (i = from; i < to; i++)
+			x = x + (double) elements[i];
+
+		*sum_x = x;
+		return;
+	}
+
+	for (i = from; i < to; i++)
+	{
+		x = x + (double) elements[i];
+		x2 = x2 + ((double) elements[i]) * ((double) elements[i]);
+	}
+
+	*sum_x = x;
+	*sum_x2 = x2;
+}
+
+/* sum of squared deviations from the average */
+static double
+TT_NAME(sum_dev2_,)(TT_TYPE *elements, int from, int to, double avg)
+{
+	int			i;
+	double		sum_dev2 = 0;
+
+	if (finalize_nthreads(to - from) >= 2)
+		return sum_deviations(TT_NAME(finalize_dev2_,_kernel), elements, from, to, avg);
+
+	for (i = from; i < to; i++)
+		sum_dev2 = sum_dev2 + (elements[i] - avg) * (elements[i] - avg);
+
+	return sum_dev2;
+}
+
+/*
+ * Keep each value with probability 1/2. The order of the values is
+ * preserved, so sorted data remain sorted (but runs are merged first).
+ */
+static void
+TT_NAME(halve_state_,)(TT_STATE *state)
+{
+	int		i, j;
+
+	if (state->nruns > 0)
+		TT_NAME(sort_state_,)(state);
+
+	for (i = 0, j = 0; i < state->nelements; i++)
+		if (sample_random() & 1)
+			state->elements[j++] = state->elements[i];
+
+	state->nelements = j;
+	state->sample_shift++;
+}
+
+/*
+ * Add a value to the state. When the state is full and enlarging it would
+ * exceed the memory budget, it's halved (and the value sampled) instead.
+ */
+static void
+TT_NAME(append_,)(TT_STATE *state, TT_TYPE value)
+{
+	counters.appended++;
+	TRACE_TRIMMED_APPEND(1, state->nelements);
+
+	while (state->nelements >= state->maxelements)
+	{
+		if (! memory_grow(&state->memory, 2 * state->maxelements * sizeof(TT_TYPE)))
+		{
+			sample_check(state->nelements, state->sample_shift,
+						 state->cut_lower, state->cut_upper);
+			TT_NAME(halve_state_,)(state);
+			continue;
+		}
+
+		state->maxelements *= 2;
+		state->elements = (TT_TYPE*)repalloc(state->elements,
+								sizeof(TT_TYPE) * state->maxelements);
+	}
+
+	if (sample_keep(state->sample_shift))
+		state->elements[state->nelements++] = value;
+}
+
+Datum
+TT_NAME(trimmed_append_,)(PG_FUNCTION_ARGS)
+{
+	TT_STATE *state;
+	MemoryContext aggcontext;
+
+	GET_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_append_,)), fcinfo, aggcontext);
+
+	/*
+	 * If both arguments are NULL, we can return NULL directly (instead of
+	 * just allocating empty aggregate state even if we don't need it).
+	 */
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = (TT_STATE*)palloc(sizeof(TT_STATE));
+		memory_init(&state->memory, aggcontext);
+
+		/* allocate space for the expected number of values */
+		state->maxelements = initial_elements(fcinfo, &state->memory,
+											  sizeof(TT_TYPE), 1);
+		state->elements = (TT_TYPE*)palloc(state->maxelements * sizeof(TT_TYPE));
+
+		MemoryContextSwitchTo(oldcontext);
+
+		state->nelements = 0;
+		state->sorted = false;
+		state->nruns = 0;
+		state->maxruns = 0;
+		state->runs = NULL;
+		state->sample_shift = 0;
+
+		/* how much to cut (and other parameters) */
+		parse_params(fcinfo, aggcontext, &state->cut_lower, &state->cut_upper,
+					 &state->params);
+	}
+	else
+		state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! PG_ARGISNULL(1))
+	{
+		TT_TYPE element = TT_GETARG(1);
+
+		TT_NAME(append_,)(state, element);
+	}
+
+	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
+
+	PG_RETURN_POINTER(state);
+}
+
+#ifdef TT_EXTENDED
+
+/*
+ * Append the (non-NULL) values of an array one by one, used when the values
+ * need to be sampled.
+ */
+static void
+TT_NAME(append_values_,)(TT_STATE *state, ArrayType *array, int nitems)
+{
+	int		i;
+	bits8  *bitmap = ARR_NULLBITMAP(array);
+	TT_TYPE *values = (TT_TYPE *) ARR_DATA_PTR(array);
+
+	for (i = 0; i < nitems; i++)
+	{
+		if ((bitmap != NULL) && !(bitmap[i / 8] & (1 << (i % 8))))
+			continue;
+
+		TT_NAME(append_,)(state, *values++);
+	}
+}
+
+/*
+ * Append all values from an array at once. The elements array is enlarged
+ * only once, and when there are no NULLs the values are copied directly
+ * from the array data. Otherwise we walk the NULL bitmap one byte at a time,
+ * which allows copying chunks of 8 non-NULL values at once.
+ */
+Datum
+TT_NAME(trimmed_append_array_,)(PG_FUNCTION_ARGS)
+{
+	TT_STATE *state;
+	MemoryContext aggcontext;
+	ArrayType  *array;
+	int			nitems;
+	int			nelements;
+
+	GET_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_append_array_,)), fcinfo, aggcontext);
+
+	/*
+	 * If both arguments are NULL, we can return NULL directly (instead of
+	 * just allocating empty aggregate state even if we don't need it).
+	 */
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	if (! PG_ARGISNULL(1))
+	{
+		array = PG_GETARG_ARRAYTYPE_P(1);
+		nitems = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = (TT_STATE*)palloc(sizeof(TT_STATE));
+		memory_init(&state->memory, aggcontext);
+
+		/* allocate space for the expected number of values (arrays) */
+		state->maxelements = initial_elements(fcinfo, &state->memory,
+											  sizeof(TT_TYPE),
+											  PG_ARGISNULL(1) ? 1 : nitems);
+		state->elements = (TT_TYPE*)palloc(state->maxelements * sizeof(TT_TYPE));
+
+		MemoryContextSwitchTo(oldcontext);
+
+		state->nelements = 0;
+		state->sorted = false;
+		state->nruns = 0;
+		state->maxruns = 0;
+		state->runs = NULL;
+		state->sample_shift = 0;
+
+		/* how much to cut (and other parameters) */
+		parse_params(fcinfo, aggcontext, &state->cut_lower, &state->cut_upper,
+					 &state->params);
+	}
+	else
+		state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(state);
+
+	Assert(ARR_ELEMTYPE(array) == TT_TYPEOID);
+
+	/* make sure there's enough space for all the values */
+	if ((state->sample_shift == 0) &&
+		(state->nelements + nitems > state->maxelements))
+	{
+		int		maxelements = state->maxelements;
+
+		while (state->nelements + nitems > maxelements)
+			maxelements *= 2;
+
+		if (memory_grow(&state->memory, maxelements * sizeof(TT_TYPE)))
+		{
+			state->maxelements = maxelements;
+			state->elements = (TT_TYPE*)repalloc(state->elements,
+								sizeof(TT_TYPE) * state->maxelements);
+		}
+	}
+
+	/* over the memory budget (or sampling already), add the values one by one */
+	if ((state->sample_shift > 0) ||
+		(state->nelements + nitems > state->maxelements))
+	{
+		TT_NAME(append_values_,)(state, array, nitems);
+		PG_RETURN_POINTER(state);
+	}
+
+	nelements = state->nelements;
+
+	if (! ARR_HASNULL(array))
+	{
+		memcpy(state->elements + state->nelements, ARR_DATA_PTR(array),
+			   nitems * sizeof(TT_TYPE));
+		state->nelements += nitems;
+	}
+	else
+	{
+		int		i, j;
+		bits8  *bitmap = ARR_NULLBITMAP(array);
+		TT_TYPE *values = (TT_TYPE *) ARR_DATA_PTR(array);
+
+		/* the non-NULL values are stored one after another (no gaps) */
+		for (i = 0; i < nitems; i += 8)
+		{
+			bits8	bits = bitmap[i / 8];
+			int		n = Min(8, nitems - i);
+
+			if ((bits == 0xFF) && (n == 8))
+			{
+				memcpy(state->elements + state->nelements, values,
+					   8 * sizeof(TT_TYPE));
+				state->nelements += 8;
+				values += 8;
+				continue;
+			}
+
+			for (j = 0; j < n; j++)
+				if (bits & (1 << j))
+					state->elements[state->nelements++] = *values++;
+		}
+	}
+
+	counters.appended += (state->nelements - nelements);
+	TRACE_TRIMMED_APPEND(state->nelements - nelements, nelements);
+
+	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
+
+	PG_RETURN_POINTER(state);
+}
+
+#endif							/* TT_EXTENDED */
+
+/*
+ * Serialization, deserialization and combining of the states, shared by
+ * the aggregate support functions and the persistent trimmed_state types.
+ */
+static bytea *
+TT_NAME(serialize_,)(TT_STATE *state)
+{
+	StringInfoData buf;
+	bytea	   *out;
+
+	/* we want to serialize the data in sorted format */
+	TT_NAME(sort_state_,)(state);
+
+	pq_begintypsend(&buf);
+
+	serialize_header(&buf, state->cut_lower, state->cut_upper,
+					 state->sample_shift, state->nelements);
+
+	pq_sendbytes(&buf, (char *) state->elements,
+				 state->nelements * sizeof(TT_TYPE));
+
+	/* optional parameters go at the end */
+	serialize_params(&buf, state->params);
+
+	out = pq_endtypsend(&buf);
+
+	counters.serialized += VARSIZE(out);
+	TRACE_TRIMMED_SERIALIZE(state->nelements, VARSIZE(out));
+
+	return out;
+}
+
+static TT_STATE *
+TT_NAME(deserialize_,)(bytea *state, MemoryContext context)
+{
+	TT_STATE *out;
+	StringInfoData buf;
+	MemoryContext oldcontext = MemoryContextSwitchTo(context);
+
+	counters.deserialized += VARSIZE_ANY(state);
+
+	out = (TT_STATE *)palloc(sizeof(TT_STATE));
+
+	deserialize_header(&buf, state, &out->cut_lower, &out->cut_upper,
+					   &out->sample_shift, &out->nelements, sizeof(TT_TYPE));
+
+	/* we only allocate the necessary space */
+	out->elements = (TT_TYPE *)palloc(out->nelements * sizeof(TT_TYPE));
+	out->maxelements = out->nelements;
+	out->sorted = true;
+
+	pq_copymsgbytes(&buf, (char *) out->elements,
+					out->nelements * sizeof(TT_TYPE));
+
+	/* whatever remains are the optional parameters */
+	out->params = deserialize_params(&buf);
+
+	out->nruns = 0;
+	out->maxruns = 0;
+	out->runs = NULL;
+
+	memory_init(&out->memory, context);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	TRACE_TRIMMED_DESERIALIZE(out->nelements, VARSIZE_ANY(state));
+
+	return out;
+}
+
+Datum
+TT_NAME(trimmed_serial_,)(PG_FUNCTION_ARGS)
+{
+	TT_STATE *state = (TT_STATE *)PG_GETARG_POINTER(0);
+
+	bytea	   *out;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_serial_,)), fcinfo);
+
+	out = TT_NAME(serialize_,)(state);
+
+	/*
+	 * The partial state is done. Don't count it against the budget of the
+	 * states combined later in this backend (e.g. by the parallel leader).
+	 */
+	memory_release(&state->memory);
+
+	PG_RETURN_BYTEA_P(out);
+}
+
+Datum
+TT_NAME(trimmed_deserial_,)(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+
+	GET_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_deserial_,)), fcinfo, aggcontext);
+
+	/*
+	 * Allocate the state in the aggregate context, so that the combine
+	 * function can use it directly, without copying the data.
+	 */
+	PG_RETURN_POINTER(TT_NAME(deserialize_,)((bytea *)PG_GETARG_POINTER(0),
+										aggcontext));
+}
+
+static TT_STATE *
+TT_NAME(combine_data_,)(TT_STATE *state1, TT_STATE *state2, MemoryContext agg_context)
+{
+	Assert((state1 != NULL) && (state2 != NULL));
+
+	/* stored states may be built with different cuts */
+	if ((state1->cut_lower != state2->cut_lower) ||
+		(state1->cut_upper != state2->cut_upper))
+		elog(ERROR, "trimmed states with different cuts can't be merged");
+
+	/* empty state does not add anything */
+	if (state2->nelements == 0)
+		return state1;
+
+	/* make sure the new run is sorted (and does not have runs of its own) */
+	TT_NAME(sort_state_,)(state2);
+
+	/* adopt the data, if the current state is empty */
+	if ((state1->nelements == 0) && (state1->nruns == 0))
+	{
+		pfree(state1->elements);
+		state1->elements = state2->elements;
+		state1->nelements = state2->nelements;
+		state1->maxelements = state2->maxelements;
+		state1->sorted = true;
+
+		return state1;
+	}
+
+	/* the current data become the first run (we keep the runs sorted) */
+	if (state1->nruns == 0)
+	{
+		TT_NAME(sort_state_,)(state1);
+
+		state1->maxruns = 8;
+		state1->runs = (TT_RUN *) MemoryContextAlloc(agg_context,
+								state1->maxruns * sizeof(TT_RUN));
+
+		state1->runs[0].elements = state1->elements;
+		state1->runs[0].nelements = state1->nelements;
+		state1->nruns = 1;
+	}
+	else if (state1->nruns >= state1->maxruns)
+	{
+		state1->maxruns *= 2;
+		state1->runs = (TT_RUN *) repalloc(state1->runs,
+								state1->maxruns * sizeof(TT_RUN));
+	}
+
+	state1->runs[state1->nruns].elements = state2->elements;
+	state1->runs[state1->nruns].nelements = state2->nelements;
+	state1->nruns++;
+
+	/* the number of elements includes the pending runs */
+	state1->nelements += state2->nelements;
+	state1->sorted = false;
+
+	return state1;
+}
+
+/*
+ * Combine the states, respecting the memory budget. The states have to be
+ * sampled at the same rate, and the result may need to be halved.
+ */
+static TT_STATE *
+TT_NAME(combine_,)(TT_STATE *state1, TT_STATE *state2, MemoryContext agg_context)
+{
+	counters.combines++;
+	TRACE_TRIMMED_COMBINE_START(state1->nelements, state2->nelements);
+
+	/* both states need to sample the values at the same rate */
+	while (state1->sample_shift < state2->sample_shift)
+		TT_NAME(halve_state_,)(state1);
+
+	while (state2->sample_shift < state1->sample_shift)
+		TT_NAME(halve_state_,)(state2);
+
+	state1 = TT_NAME(combine_data_,)(state1, state2, agg_context);
+
+	/* the data of the second state are now accounted to the first one */
+	memory_release(&state2->memory);
+
+	while (! memory_grow(&state1->memory, state1->nelements * sizeof(TT_TYPE)))
+	{
+		sample_check(state1->nelements, state1->sample_shift,
+					 state1->cut_lower, state1->cut_upper);
+		TT_NAME(halve_state_,)(state1);
+	}
+
+	TRACE_TRIMMED_COMBINE_DONE(state1->nelements);
+
+	return state1;
+}
+
+Datum
+TT_NAME(trimmed_combine_,)(PG_FUNCTION_ARGS)
+{
+	TT_STATE *state1;
+	TT_STATE *state2;
+	MemoryContext agg_context;
+
+	GET_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_combine_,)), fcinfo, agg_context);
+
+	state1 = PG_ARGISNULL(0) ? NULL : (TT_STATE *) PG_GETARG_POINTER(0);
+	state2 = PG_ARGISNULL(1) ? NULL : (TT_STATE *) PG_GETARG_POINTER(1);
+
+	/* nothing to combine (and we must not return a NULL pointer) */
+	if ((state1 == NULL) && (state2 == NULL))
+		PG_RETURN_NULL();
+
+	if (state2 == NULL)
+		PG_RETURN_POINTER(state1);
+
+	/*
+	 * The partial state was deserialized in the aggregate context, so we can
+	 * simply adopt it, without copying the data.
+	 */
+	if (state1 == NULL)
+		PG_RETURN_POINTER(state2);
+
+	PG_RETURN_POINTER(TT_NAME(combine_,)(state1, state2, agg_context));
+}
+
+/*
+ * Find the part of the state kept by the cuts, [from, to), and sort the state
+ * (unless nothing is kept). Returns false when the cuts remove all values.
+ */
+static bool
+TT_NAME(kept_range_,)(TT_STATE *state, int *from, int *to)
+{
+	*from = floor(state->nelements * state->cut_lower);
+	*to   = state->nelements - floor(state->nelements * state->cut_upper);
+
+	Assert((0 <= *from) && (*from <= *to) && (*to <= state->nelements));
+
+	if (*from >= *to)
+		return false;
+
+	TRACE_TRIMMED_FINAL(state->nelements, *from, *to);
+
+	TT_NAME(sort_state_,)(state);
+
+	return true;
+}
+
+Datum
+TT_NAME(trimmed_avg_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	result = 0;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_avg_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	TT_NAME(sum_,)(state->elements, from, to, &result, NULL);
+
+	PG_RETURN_FLOAT8(result/cnt);
+}
+
+Datum
+TT_NAME(trimmed_,_array)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	sum_x = 0, sum_x2 = 0;
+
+	/* average, var_pop, var_samp, variance, stddev_pop, stddev_samp, stddev */
+	double	result[7] = {0, 0, 0, 0, 0, 0, 0};
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_,_array)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	/* average */
+	result[0] = 0;
+	result[1] = 0;
+	result[2] = 0;
+
+	TT_NAME(sum_,)(state->elements, from, to, &sum_x, &sum_x2);
+	result[0] = sum_x;
+
+	result[0] /= cnt;
+	result[1] = (cnt * sum_x2 - sum_x * sum_x) / ((double) cnt * cnt);	   /* var_pop */
+	result[2] = (cnt * sum_x2 - sum_x * sum_x) / ((double) cnt * (cnt - 1)); /* var_samp */
+
+	/* variance */
+	result[3] = TT_NAME(sum_dev2_,)(state->elements, from, to, result[0]);
+
+	result[3] /= cnt;
+	result[4] = sqrt(result[1]); /* stddev_pop */
+	result[5] = sqrt(result[2]); /* stddev_samp */
+	result[6] = sqrt(result[3]); /* stddev */
+
+	return double_to_array(fcinfo, result, 7);
+}
+
+Datum
+TT_NAME(trimmed_var_,)(PG_FUNCTION_ARGS)
+{
+
+	int		from, to, cnt;
+	double	result = 0, avg = 0;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_var_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	TT_NAME(sum_,)(state->elements, from, to, &avg, NULL);
+	avg /= cnt;
+
+	result = TT_NAME(sum_dev2_,)(state->elements, from, to, avg);
+
+	PG_RETURN_FLOAT8(result/cnt);
+}
+
+Datum
+TT_NAME(trimmed_var_pop_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	sum_x = 0, sum_x2 = 0, numerator;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_var_pop_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	TT_NAME(sum_,)(state->elements, from, to, &sum_x, &sum_x2);
+
+	/* Watch out for roundoff error producing a negative numerator */
+	numerator = (cnt * sum_x2 - sum_x * sum_x);
+	if (numerator <= 0)
+		PG_RETURN_FLOAT8(0.0);
+
+	PG_RETURN_FLOAT8 (numerator / ((double) cnt * cnt));
+}
+
+Datum
+TT_NAME(trimmed_var_samp_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	sum_x = 0, sum_x2 = 0, numerator;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_var_samp_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	TT_NAME(sum_,)(state->elements, from, to, &sum_x, &sum_x2);
+
+	/* Watch out for roundoff error producing a negative numerator */
+	numerator = (cnt * sum_x2 - sum_x * sum_x);
+	if (numerator <= 0)
+		PG_RETURN_FLOAT8(0.0);
+
+	PG_RETURN_FLOAT8 (numerator / ((double) cnt * (cnt - 1)));
+}
+
+Datum
+TT_NAME(trimmed_stddev_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	result = 0, avg = 0;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_stddev_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	TT_NAME(sum_,)(state->elements, from, to, &avg, NULL);
+	avg /= cnt;
+
+	result = TT_NAME(sum_dev2_,)(state->elements, from, to, avg);
+
+	PG_RETURN_FLOAT8 (sqrt(result/cnt));
+}
+
+Datum
+TT_NAME(trimmed_stddev_pop_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	sum_x = 0, sum_x2 = 0, numerator;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_stddev_pop_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	TT_NAME(sum_,)(state->elements, from, to, &sum_x, &sum_x2);
+
+	/* Watch out for roundoff error producing a negative numerator */
+	numerator = (cnt * sum_x2 - sum_x * sum_x);
+	if (numerator <= 0)
+		PG_RETURN_FLOAT8(0.0);
+
+	PG_RETURN_FLOAT8 (sqrt(numerator / ((double) cnt * cnt)));
+}
+
+Datum
+TT_NAME(trimmed_stddev_samp_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	sum_x = 0, sum_x2 = 0, numerator;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_stddev_samp_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	TT_NAME(sum_,)(state->elements, from, to, &sum_x, &sum_x2);
+
+	/* Watch out for roundoff error producing a negative numerator */
+	numerator = (cnt * sum_x2 - sum_x * sum_x);
+	if (numerator <= 0)
+		PG_RETURN_FLOAT8(0.0);
+
+	PG_RETURN_FLOAT8 (sqrt(numerator / ((double) cnt * (cnt - 1))));
+}
+
+Datum
+TT_NAME(winsorized_avg_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_avg_,)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_AVG);
+}
+
+Datum
+TT_NAME(winsorized_var_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_var_,)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_VAR);
+}
+
+Datum
+TT_NAME(winsorized_var_pop_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_var_pop_,)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_VAR_POP);
+}
+
+Datum
+TT_NAME(winsorized_var_samp_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_var_samp_,)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_VAR_SAMP);
+}
+
+Datum
+TT_NAME(winsorized_stddev_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_stddev_,)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_STDDEV);
+}
+
+Datum
+TT_NAME(winsorized_stddev_pop_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_stddev_pop_,)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_STDDEV_POP);
+}
+
+Datum
+TT_NAME(winsorized_stddev_samp_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_stddev_samp_,)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_STDDEV_SAMP);
+}
+
+Datum
+TT_NAME(winsorized_,_array)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(winsorized_,_array)), fcinfo);
+
+	return TT_NAME(winsorized_,)(fcinfo, STAT_ALL);
+}
+
+/*
+ * Compute the requested winsorized statistic (or all of them, for STAT_ALL).
+ * Instead of discarding the values outside the cuts, they are replaced by the
+ * lowest/highest value kept, so the sums of the kept part only need to be
+ * adjusted by (from * lowest) and ((nelements - to) * highest).
+ */
+static Datum
+TT_NAME(winsorized_,)(FunctionCallInfo fcinfo, int stat)
+{
+	int		i, from, to, cnt;
+	double	low, high;
+	double	sum_x = 0, sum_x2 = 0, sum_dev2 = 0;
+	double	result[NUM_STATS];
+
+	TT_STATE *state;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = state->nelements;
+
+	low  = (double) state->elements[from];
+	high = (double) state->elements[to - 1];
+
+	TT_NAME(sum_,)(state->elements, from, to, &sum_x, &sum_x2);
+
+	sum_x  += from * low + (cnt - to) * high;
+	sum_x2 += from * low * low + (cnt - to) * high * high;
+
+	/* second pass is needed only for the exact variance */
+	if ((stat == STAT_ALL) || (stat == STAT_VAR) || (stat == STAT_STDDEV))
+	{
+		double	avg = sum_x / cnt;
+
+		sum_dev2 = TT_NAME(sum_dev2_,)(state->elements, from, to, avg)
+			+ from * (low - avg) * (low - avg)
+			+ (cnt - to) * (high - avg) * (high - avg);
+	}
+
+	if (stat != STAT_ALL)
+		PG_RETURN_FLOAT8(multi_stat(stat, cnt, sum_x, sum_x2, sum_dev2));
+
+	for (i = 0; i < NUM_STATS; i++)
+		result[i] = multi_stat(i, cnt, sum_x, sum_x2, sum_dev2);
+
+	return double_to_array(fcinfo, result, NUM_STATS);
+}
+
+Datum
+TT_NAME(trimmed_values_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_values_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	/* the kept part is contiguous, so copy it into the array at once */
+	return fixed_to_array(&state->elements[from], (to - from),
+						  sizeof(TT_TYPE), TT_TYPEOID);
+}
+
+/*
+ * Trimmed means of a range of bootstrap resamples. The multiplicities of the
+ * values are drawn into the counts, so the resample is implicitly sorted and
+ * the kept part is found by a single pass over the counts.
+ */
+static void
+TT_NAME(bootstrap_,_kernel)(void *arg, int task, int ntasks)
+{
+	finalize_bootstrap *boot = (finalize_bootstrap *) arg;
+	TT_TYPE	   *elements = (TT_TYPE *) boot->elements;
+	int32	   *counts = boot->counts + (Size) task * boot->nelements;
+	int			i, r,
+				n = boot->nelements,
+				first = boot->first + FINALIZE_SLICE(boot->last - boot->first, task, ntasks),
+				last = boot->first + FINALIZE_SLICE(boot->last - boot->first, task + 1, ntasks);
+
+	for (r = first; r < last; r++)
+	{
+		uint64	seed = BOOTSTRAP_SEED + r;
+		int		pos;
+		double	sum = 0;
+
+		/* decorrelate the seeds of consecutive resamples */
+		seed = bootstrap_random(&seed);
+
+		memset(counts, 0, n * sizeof(int32));
+
+		for (i = 0; i < n; i++)
+			counts[bootstrap_index(&seed, n)]++;
+
+		for (i = 0, pos = 0; pos < boot->to; i++)
+		{
+			int		w = Min(pos + counts[i], boot->to) - Max(pos, boot->from);
+
+			pos += counts[i];
+
+			if (w > 0)
+				sum += w * (double) elements[i];
+		}
+
+		boot->means[r] = sum / (boot->to - boot->from);
+	}
+}
+
+/*
+ * Confidence interval of the trimmed mean - either Yuen's interval (using
+ * the winsorized variance and the t distribution with h-1 degrees of
+ * freedom, where h is the number of kept values), or a percentile bootstrap
+ * interval when the number of resamples was specified.
+ */
+Datum
+TT_NAME(trimmed_ci_,)(PG_FUNCTION_ARGS)
+{
+	int		from, to, cnt;
+	double	sum_x = 0, avg, low, high, wavg, sum_dev2, se, t;
+	double	result[2];
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_ci_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	Assert((state->params != NULL) && (state->params->confidence > 0));
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	cnt = (to - from);
+
+	if (state->params->nresamples > 0)
+	{
+		double *means = (double *) palloc(state->params->nresamples * sizeof(double));
+
+		bootstrap_means(TT_NAME(bootstrap_,_kernel), state->elements,
+						state->nelements, from, to,
+						state->params->nresamples, means);
+
+		return bootstrap_interval(fcinfo, means, state->params->nresamples,
+								  state->params->confidence);
+	}
+
+	/* the t distribution needs at least one degree of freedom */
+	if (cnt < 2)
+		PG_RETURN_NULL();
+
+	TT_NAME(sum_,)(state->elements, from, to, &sum_x, NULL);
+	avg = sum_x / cnt;
+
+	/* winsorized variance (the cut values replaced by the boundary ones) */
+	low  = (double) state->elements[from];
+	high = (double) state->elements[to - 1];
+	wavg = (sum_x + from * low + (state->nelements - to) * high) / state->nelements;
+
+	sum_dev2 = TT_NAME(sum_dev2_,)(state->elements, from, to, wavg)
+		+ from * (low - wavg) * (low - wavg)
+		+ (state->nelements - to) * (high - wavg) * (high - wavg);
+
+	se = sqrt(sum_dev2 / ((double) cnt * (cnt - 1)));
+	t = student_t_quantile((1 + state->params->confidence) / 2, cnt - 1);
+
+	result[0] = avg - t * se;
+	result[1] = avg + t * se;
+
+	return double_to_array(fcinfo, result, 2);
+}
+
+#ifdef TT_EXTENDED
+
+/*
+ * The statistics for multiple cut configurations, computed from a single
+ * sorted state (see trimmed_multi_ for details).
+ */
+Datum
+TT_NAME(trimmed_avg_,_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_avg_,_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_AVG);
+}
+
+Datum
+TT_NAME(trimmed_var_,_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_var_,_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_VAR);
+}
+
+Datum
+TT_NAME(trimmed_var_pop_,_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_var_pop_,_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_VAR_POP);
+}
+
+Datum
+TT_NAME(trimmed_var_samp_,_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_var_samp_,_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_VAR_SAMP);
+}
+
+Datum
+TT_NAME(trimmed_stddev_,_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_stddev_,_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_STDDEV);
+}
+
+Datum
+TT_NAME(trimmed_stddev_pop_,_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_stddev_pop_,_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_STDDEV_POP);
+}
+
+Datum
+TT_NAME(trimmed_stddev_samp_,_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_stddev_samp_,_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_STDDEV_SAMP);
+}
+
+Datum
+TT_NAME(trimmed_,_array_multi)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_,_array_multi)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	return TT_NAME(trimmed_multi_,)((TT_STATE *) PG_GETARG_POINTER(0), STAT_ALL);
+}
+
+/*
+ * Evaluate the requested statistics for all the cut configurations, using
+ * a single sorted state. The sums for all the configurations are computed
+ * from prefix sums, remembered at the cut boundaries during a single pass
+ * through the data. Only the exact variance needs a second pass (over the
+ * kept part), so we only do that when actually requested.
+ */
+static Datum
+TT_NAME(trimmed_multi_,)(TT_STATE *state, int stat)
+{
+	int		i, b, c, s, nconfigs, nstats;
+	int	   *bounds, *order, *stats;
+	double	sum_x = 0, sum_x2 = 0;
+	double *prefix_x, *prefix_x2;
+	Datum  *values;
+	bool   *nulls;
+	bool	need_x2, need_dev2;
+
+	nconfigs = multi_configs(state->params);
+	stats = multi_stats(state->params, &stat, &nstats, &need_x2, &need_dev2);
+
+	bounds = (int *) palloc(2 * nconfigs * sizeof(int));
+	order = (int *) palloc(2 * nconfigs * sizeof(int));
+	prefix_x = (double *) palloc(2 * nconfigs * sizeof(double));
+	prefix_x2 = (double *) palloc(2 * nconfigs * sizeof(double));
+
+	values = (Datum *) palloc(nconfigs * nstats * sizeof(Datum));
+	nulls = (bool *) palloc(nconfigs * nstats * sizeof(bool));
+
+	multi_bounds(state->nelements, state->cut_lower, state->cut_upper,
+				 state->params, bounds, order);
+
+	TT_NAME(sort_state_,)(state);
+
+	/* walk the boundaries in ascending order, remember the prefix sums */
+	for (b = 0, i = 0; b < 2 * nconfigs; b++)
+	{
+		TT_NAME(sum_,)(state->elements, i, bounds[order[b]], &sum_x, &sum_x2);
+		i = bounds[order[b]];
+
+		prefix_x[order[b]] = sum_x;
+		prefix_x2[order[b]] = sum_x2;
+	}
+
+	for (c = 0; c < nconfigs; c++)
+	{
+		int		from = bounds[2 * c],
+				to = bounds[2 * c + 1],
+				cnt = (to - from);
+		double	sum_dev2 = 0;
+
+		Assert((0 <= from) && (to <= state->nelements));
+
+		if (from >= to)
+		{
+			for (s = 0; s < nstats; s++)
+				nulls[c * nstats + s] = true;
+			continue;
+		}
+
+		TRACE_TRIMMED_FINAL(state->nelements, from, to);
+
+		/* exact variance needs a second pass through the kept values */
+		if (need_dev2)
+		{
+			double	avg = (prefix_x[2 * c + 1] - prefix_x[2 * c]) / cnt;
+
+			sum_dev2 = TT_NAME(sum_dev2_,)(state->elements, from, to, avg);
+		}
+
+		for (s = 0; s < nstats; s++)
+		{
+			if (STAT_IS_ORDER(stats[s]))
+				values[c * nstats + s]
+					= Float8GetDatum(TT_NAME(quantile_,)(state->elements, from, to,
+												 stat_quantile(stats[s])));
+			else
+				values[c * nstats + s]
+					= Float8GetDatum(multi_stat(stats[s], cnt,
+												prefix_x[2 * c + 1] - prefix_x[2 * c],
+												prefix_x2[2 * c + 1] - prefix_x2[2 * c],
+												sum_dev2));
+			nulls[c * nstats + s] = false;
+		}
+	}
+
+	return multi_to_array(values, nulls, state->params, nconfigs, nstats,
+						  FLOAT8OID);
+}
+
+Datum
+TT_NAME(trimmed_quantiles_,)(PG_FUNCTION_ARGS)
+{
+	int		i, from, to;
+	double *result;
+
+	TT_STATE *state;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_quantiles_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_STATE*)PG_GETARG_POINTER(0);
+
+	Assert((state->params != NULL) && (state->params->nquantiles > 0));
+
+	if (! TT_NAME(kept_range_,)(state, &from, &to))
+		PG_RETURN_NULL();
+
+	result = (double *) palloc(state->params->nquantiles * sizeof(double));
+
+	for (i = 0; i < state->params->nquantiles; i++)
+		result[i] = TT_NAME(quantile_,)(state->elements, from, to,
+								  PARAMS_QUANTILES(state->params)[i]);
+
+	return double_to_array(fcinfo, result, state->params->nquantiles);
+}
+
+/*
+ * Quantile of the kept part of the sorted values (see stat_quantile).
+ */
+static double
+TT_NAME(quantile_,)(TT_TYPE *elements, int from, int to, double q)
+{
+	double	pos = q * (to - from - 1);
+	int		lo = from + (int) floor(pos),
+			hi = from + (int) ceil(pos);
+
+	Assert((from <= lo) && (lo <= hi) && (hi < to));
+
+	return (double) elements[lo] + (pos - floor(pos)) * ((double) elements[hi] - (double) elements[lo]);
+}
+
+/*
+ * Input and output functions of the trimmed_state types (see PERSISTENT
+ * STATE in trimmed_aggregates.c for the formats).
+ */
+Datum
+TT_NAME(trimmed_state_,_in)(PG_FUNCTION_ARGS)
+{
+	char	   *str = PG_GETARG_CSTRING(0);
+	double		cut_lower,
+				cut_upper;
+	int			sample_shift;
+	char	   *values;
+	ArrayType  *array;
+	TT_STATE   *state;
+
+	values = parse_state_cuts(str, &cut_lower, &cut_upper, &sample_shift);
+
+	array = DatumGetArrayTypeP(OidInputFunctionCall(F_ARRAY_IN, values,
+													TT_TYPEOID, -1));
+
+	if (ARR_NDIM(array) > 1)
+		elog(ERROR, "values of a trimmed state need to be one-dimensional");
+
+	if (array_contains_nulls(array))
+		elog(ERROR, "values of a trimmed state must not be NULL");
+
+	state = TT_NAME(build_state_,)((TT_TYPE *) ARR_DATA_PTR(array),
+							  ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array)),
+							  cut_lower, cut_upper, sample_shift);
+
+	PG_RETURN_BYTEA_P(TT_NAME(serialize_,)(state));
+}
+
+Datum
+TT_NAME(trimmed_state_,_out)(PG_FUNCTION_ARGS)
+{
+	TT_STATE   *state = TT_NAME(deserialize_,)(PG_GETARG_BYTEA_P(0),
+											  CurrentMemoryContext);
+	Datum		array;
+	StringInfoData str;
+
+	array = fixed_to_array(state->elements, state->nelements,
+						   sizeof(TT_TYPE), TT_TYPEOID);
+
+	initStringInfo(&str);
+	appendStringInfo(&str, "(%s,%s)%s:%s",
+					 DatumGetCString(DirectFunctionCall1(float8out,
+											Float8GetDatum(state->cut_lower))),
+					 DatumGetCString(DirectFunctionCall1(float8out,
+											Float8GetDatum(state->cut_upper))),
+					 sample_rate_str(state->sample_shift),
+					 OidOutputFunctionCall(F_ARRAY_OUT, array));
+
+	PG_RETURN_CSTRING(str.data);
+}
+
+Datum
+TT_NAME(trimmed_state_,_recv)(PG_FUNCTION_ARGS)
+{
+	StringInfo	buf = (StringInfo) PG_GETARG_POINTER(0);
+	int			i, nvalues;
+	int			sample_shift;
+	double		cut_lower,
+				cut_upper;
+	TT_TYPE    *values;
+
+	cut_lower = pq_getmsgfloat8(buf);
+	cut_upper = pq_getmsgfloat8(buf);
+
+	check_cuts(cut_lower, cut_upper);
+
+	sample_shift = pq_getmsgint(buf, sizeof(int32));
+
+	if ((sample_shift < 0) || (sample_shift > MAX_SAMPLE_SHIFT))
+		elog(ERROR, "invalid sample rate in a trimmed state");
+
+	nvalues = pq_getmsgint(buf, sizeof(int32));
+
+	if ((nvalues < 0) || (nvalues > (buf->len - buf->cursor) / sizeof(TT_TYPE)))
+		elog(ERROR, "invalid number of values in a trimmed state");
+
+	values = (TT_TYPE *) palloc((nvalues + 1) * sizeof(TT_TYPE));
+
+	for (i = 0; i < nvalues; i++)
+		values[i] = TT_RECVVALUE(buf);
+
+	PG_RETURN_BYTEA_P(TT_NAME(serialize_,)(TT_NAME(build_state_,)(values, nvalues,
+														  cut_lower, cut_upper,
+														  sample_shift)));
+}
+
+Datum
+TT_NAME(trimmed_state_,_send)(PG_FUNCTION_ARGS)
+{
+	int			i;
+	TT_STATE   *state = TT_NAME(deserialize_,)(PG_GETARG_BYTEA_P(0),
+											  CurrentMemoryContext);
+	StringInfoData buf;
+
+	pq_begintypsend(&buf);
+
+	pq_sendfloat8(&buf, state->cut_lower);
+	pq_sendfloat8(&buf, state->cut_upper);
+	pq_sendint32(&buf, state->sample_shift);
+	pq_sendint32(&buf, state->nelements);
+
+	for (i = 0; i < state->nelements; i++)
+		TT_SENDVALUE(&buf, state->elements[i]);
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/*
+ * Final function of the trimmed_state and trimmed_merge aggregates, simply
+ * returns the state in the sorted (serialized) format.
+ */
+Datum
+TT_NAME(trimmed_state_final_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_state_final_,)), fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_BYTEA_P(TT_NAME(serialize_,)((TT_STATE *) PG_GETARG_POINTER(0)));
+}
+
+/*
+ * Merge a stored state into the aggregate state. The stored states are
+ * already sorted, so this is handled just like combining partial states,
+ * i.e. the data are merged only once in the final function.
+ */
+Datum
+TT_NAME(trimmed_merge_,)(PG_FUNCTION_ARGS)
+{
+	TT_STATE   *state;
+	TT_STATE   *value;
+	MemoryContext aggcontext;
+
+	GET_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_merge_,)), fcinfo, aggcontext);
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	value = TT_NAME(deserialize_,)(PG_GETARG_BYTEA_P(1), aggcontext);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_POINTER(value);
+
+	state = (TT_STATE *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_POINTER(TT_NAME(combine_,)(state, value, aggcontext));
+}
+
+Datum
+TT_NAME(trimmed_state_avg_,)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_AVG);
+}
+
+Datum
+TT_NAME(trimmed_state_var_,)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_VAR);
+}
+
+Datum
+TT_NAME(trimmed_state_var_pop_,)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_VAR_POP);
+}
+
+Datum
+TT_NAME(trimmed_state_var_samp_,)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_VAR_SAMP);
+}
+
+Datum
+TT_NAME(trimmed_state_stddev_,)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_STDDEV);
+}
+
+Datum
+TT_NAME(trimmed_state_stddev_pop_,)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_STDDEV_POP);
+}
+
+Datum
+TT_NAME(trimmed_state_stddev_samp_,)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_STDDEV_SAMP);
+}
+
+Datum
+TT_NAME(trimmed_state_,_array)(PG_FUNCTION_ARGS)
+{
+	return TT_NAME(trimmed_state_,)(fcinfo, STAT_ALL);
+}
+
+/*
+ * Compute the statistic from a stored state. The cuts stored in the state
+ * may be overridden by passing different cuts as additional arguments.
+ */
+static Datum
+TT_NAME(trimmed_state_,)(FunctionCallInfo fcinfo, int stat)
+{
+	bool	isnull;
+	Datum	result;
+	TT_STATE   *state = TT_NAME(deserialize_,)(PG_GETARG_BYTEA_P(0),
+											  CurrentMemoryContext);
+
+	if (PG_NARGS() == 3)
+	{
+		state->cut_lower = PG_GETARG_FLOAT8(1);
+		state->cut_upper = PG_GETARG_FLOAT8(2);
+
+		check_cuts(state->cut_lower, state->cut_upper);
+	}
+
+	result = TT_NAME(trimmed_multi_,)(state, stat);
+
+	if (stat == STAT_ALL)
+		PG_RETURN_DATUM(result);
+
+	result = first_element(result, FLOAT8OID, &isnull);
+
+	if (isnull)
+		PG_RETURN_NULL();
+
+	PG_RETURN_DATUM(result);
+}
+
+static TT_STATE *
+TT_NAME(build_state_,)(TT_TYPE *values, int nvalues, double cut_lower,
+					   double cut_upper, int sample_shift)
+{
+	TT_STATE   *state = (TT_STATE *) palloc(sizeof(TT_STATE));
+
+	state->maxelements = Max(nvalues, 1);
+	state->nelements = nvalues;
+	state->elements = (TT_TYPE *) palloc(state->maxelements * sizeof(TT_TYPE));
+	state->cut_lower = cut_lower;
+	state->cut_upper = cut_upper;
+	state->sorted = false;
+	state->params = NULL;
+	state->nruns = 0;
+	state->maxruns = 0;
+	state->runs = NULL;
+	state->sample_shift = sample_shift;
+	memory_init(&state->memory, CurrentMemoryContext);
+
+	memcpy(state->elements, values, nvalues * sizeof(TT_TYPE));
+
+	TT_NAME(sort_state_,)(state);
+
+	return state;
+}
+
+#endif							/* TT_EXTENDED */
+
+#ifdef TT_WEIGHTED
+
+/*
+ * Weighted elements. The functions work the same as for the plain values,
+ * except that the comparisons look at the value of the (value, weight) pair
+ * and the cuts are applied to the total weight.
+ */
+
+static int
+TT_NAME(weighted_,_comparator)(const void *a, const void *b)
+{
+	TT_TYPE af = ((TT_WVALUE*)a)->value;
+	TT_TYPE bf = ((TT_WVALUE*)b)->value;
+	return (af > bf) - (af < bf);
+}
+
+static int
+TT_NAME(gallop_weighted_,)(TT_WVALUE *elements, int from, int to, TT_TYPE key, bool strict)
+{
+	int		lo = from,
+			hi = from + 1,
+			step = 1;
+
+	/* invariant: elements[lo] is "below" the key, hi is the candidate */
+	while ((hi < to) &&
+		   (strict ? (elements[hi].value <= key) : (elements[hi].value < key)))
+	{
+		lo = hi;
+		step *= 2;
+		hi = (to - lo > step) ? (lo + step) : to;
+	}
+
+	/* now the first element above the key is in (lo, hi] */
+	while (hi - lo > 1)
+	{
+		int		mid = lo + (hi - lo) / 2;
+
+		if (strict ? (elements[mid].value <= key) : (elements[mid].value < key))
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return hi;
+}
+
+static void
+TT_NAME(merge_weighted_,)(TT_WVALUE *a, int na, TT_WVALUE *b, int nb, TT_WVALUE *out)
+{
+	int		i = 0,
+			j = 0,
+			n;
+
+	/* disjoint ranges (or empty arrays) - just concatenate */
+	if ((na == 0) || (nb == 0) || (a[na - 1].value <= b[0].value))
+	{
+		memcpy(out, a, na * sizeof(TT_WVALUE));
+		memcpy(out + na, b, nb * sizeof(TT_WVALUE));
+		return;
+	}
+
+	if (b[nb - 1].value < a[0].value)
+	{
+		memcpy(out, b, nb * sizeof(TT_WVALUE));
+		memcpy(out + nb, a, na * sizeof(TT_WVALUE));
+		return;
+	}
+
+	while ((i < na) && (j < nb))
+	{
+		progress_check(i + j);
+
+		if (a[i].value <= b[j].value)
+		{
+			/* all values from 'a' not greater than b[j] */
+			n = TT_NAME(gallop_weighted_,)(a, i, na, b[j].value, true);
+			memcpy(out, a + i, (n - i) * sizeof(TT_WVALUE));
+			out += (n - i);
+			i = n;
+		}
+		else
+		{
+			/* all values from 'b' less than a[i] */
+			n = TT_NAME(gallop_weighted_,)(b, j, nb, a[i].value, false);
+			memcpy(out, b + j, (n - j) * sizeof(TT_WVALUE));
+			out += (n - j);
+			j = n;
+		}
+	}
+
+	/* copy the remaining part (at most one of those is non-empty) */
+	memcpy(out, a + i, (na - i) * sizeof(TT_WVALUE));
+	out += (na - i);
+
+	memcpy(out, b + j, (nb - j) * sizeof(TT_WVALUE));
+}
+
+static void
+TT_NAME(sort_state_weighted_,)(TT_WSTATE *state)
+{
+	instr_time	start;
+
+	if (state->sorted)
+		return;
+
+	INSTR_TIME_SET_CURRENT(start);
+	TRACE_TRIMMED_SORT_START(state->nelements,
+							 state->nelements * sizeof(TT_WVALUE));
+
+	sort_parallel(state->elements, state->nelements, sizeof(TT_WVALUE),
+				  &TT_NAME(weighted_,_comparator), NULL);
+	state->sorted = true;
+
+	counters_timing(&counters.sorts, start);
+	TRACE_TRIMMED_SORT_DONE(state->nelements);
+}
+
+static void
+TT_NAME(halve_state_weighted_,)(TT_WSTATE *state)
+{
+	int		i, j;
+
+	state->total = 0;
+	for (i = 0, j = 0; i < state->nelements; i++)
+	{
+		if (sample_random() & 1)
+		{
+			state->elements[j++] = state->elements[i];
+			state->total += state->elements[i].weight;
+		}
+	}
+
+	state->nelements = j;
+	state->sample_shift++;
+}
+
+static void
+TT_NAME(append_weighted_,)(TT_WSTATE *state, TT_TYPE value, int64 weight)
+{
+	counters.appended++;
+	TRACE_TRIMMED_APPEND(1, state->nelements);
+
+	while (state->nelements >= state->maxelements)
+	{
+		if (! memory_grow(&state->memory, 2 * state->maxelements * sizeof(TT_WVALUE)))
+		{
+			sample_check(state->nelements, state->sample_shift,
+						 state->cut_lower, state->cut_upper);
+			TT_NAME(halve_state_weighted_,)(state);
+			continue;
+		}
+
+		state->maxelements *= 2;
+		state->elements = (TT_WVALUE*)repalloc(state->elements,
+								sizeof(TT_WVALUE) * state->maxelements);
+	}
+
+	if (! sample_keep(state->sample_shift))
+		return;
+
+	state->elements[state->nelements].value = value;
+	state->elements[state->nelements].weight = weight;
+	state->nelements++;
+
+	state->total += weight;
+	state->sorted = false;
+}
+
+Datum
+TT_NAME(trimmed_append_weighted_,)(PG_FUNCTION_ARGS)
+{
+	TT_WSTATE *state;
+	MemoryContext aggcontext;
+
+	GET_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_append_weighted_,)), fcinfo, aggcontext);
+
+	/*
+	 * If both arguments are NULL, we can return NULL directly (instead of
+	 * just allocating empty aggregate state even if we don't need it).
+	 */
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = (TT_WSTATE*)palloc(sizeof(TT_WSTATE));
+		memory_init(&state->memory, aggcontext);
+
+		/* allocate space for the expected number of values */
+		state->maxelements = initial_elements(fcinfo, &state->memory,
+											  sizeof(TT_WVALUE), 1);
+		state->elements = (TT_WVALUE*)palloc(state->maxelements * sizeof(TT_WVALUE));
+
+		MemoryContextSwitchTo(oldcontext);
+
+		state->nelements = 0;
+		state->total = 0;
+		state->sorted = false;
+		state->sample_shift = 0;
+
+		/* how much to cut */
+		state->cut_lower = PG_GETARG_FLOAT8(3);
+		state->cut_upper = PG_GETARG_FLOAT8(4);
+
+		check_cuts(state->cut_lower, state->cut_upper);
+	}
+	else
+		state = (TT_WSTATE*)PG_GETARG_POINTER(0);
+
+	/* rows with NULL value or weight are ignored, just like zero weights */
+	if (! PG_ARGISNULL(1) && ! PG_ARGISNULL(2))
+	{
+		TT_TYPE	element = TT_GETARG(1);
+		int64	weight = PG_GETARG_INT64(2);
+
+		if (weight < 0)
+			elog(ERROR, "weight must not be negative");
+
+		if (weight == 0)
+			PG_RETURN_POINTER(state);
+
+		TT_NAME(append_weighted_,)(state, element, weight);
+	}
+
+	Assert((state->nelements >= 0) && (state->nelements <= state->maxelements));
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+TT_NAME(trimmed_serial_weighted_,)(PG_FUNCTION_ARGS)
+{
+	TT_WSTATE *state = (TT_WSTATE *)PG_GETARG_POINTER(0);
+	Size			hlen = offsetof(TT_WSTATE, elements);	/* header */
+	Size			len = state->nelements * sizeof(TT_WVALUE);	/* elements */
+	bytea		   *out = (bytea *)palloc(VARHDRSZ + len + hlen);
+	char		   *ptr;
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_serial_weighted_,)), fcinfo);
+
+	/* we want to serialize the data in sorted format */
+	TT_NAME(sort_state_weighted_,)(state);
+
+	SET_VARSIZE(out, VARHDRSZ + len + hlen);
+	ptr = VARDATA(out);
+
+	memcpy(ptr, state, hlen);
+	ptr += hlen;
+
+	memcpy(ptr, state->elements, len);
+
+	counters.serialized += VARSIZE(out);
+	TRACE_TRIMMED_SERIALIZE(state->nelements, VARSIZE(out));
+
+	/*
+	 * The partial state is done. Don't count it against the budget of the
+	 * states combined later in this backend (e.g. by the parallel leader).
+	 */
+	memory_release(&state->memory);
+
+	PG_RETURN_BYTEA_P(out);
+}
+
+Datum
+TT_NAME(trimmed_deserial_weighted_,)(PG_FUNCTION_ARGS)
+{
+	TT_WSTATE *out = (TT_WSTATE *)palloc(sizeof(TT_WSTATE));
+	bytea  *state = (bytea *)PG_GETARG_POINTER(0);
+	Size	len PG_USED_FOR_ASSERTS_ONLY = VARSIZE_ANY_EXHDR(state);
+	char   *ptr = VARDATA(state);
+
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_deserial_weighted_,)), fcinfo);
+
+	counters.deserialized += VARSIZE_ANY(state);
+
+	Assert(len > 0);
+	Assert((len - offsetof(TT_WSTATE, elements)) % sizeof(TT_WVALUE) == 0);
+
+	/* copy the header */
+	memcpy(out, ptr, offsetof(TT_WSTATE, elements));
+	ptr += offsetof(TT_WSTATE, elements);
+
+	Assert((out->nelements > 0) && (out->maxelements >= out->nelements));
+	Assert(len == offsetof(TT_WSTATE, elements) + out->nelements * sizeof(TT_WVALUE));
+	Assert(out->sorted);
+
+	/* we only allocate the necessary space */
+	out->elements = (TT_WVALUE *)palloc(out->nelements * sizeof(TT_WVALUE));
+	out->maxelements = out->nelements;
+
+	memcpy((void *)out->elements, ptr, out->nelements * sizeof(TT_WVALUE));
+
+	memory_init(&out->memory, CurrentMemoryContext);
+
+	TRACE_TRIMMED_DESERIALIZE(out->nelements, VARSIZE_ANY(state));
+
+	PG_RETURN_POINTER(out);
+}
+
+Datum
+TT_NAME(trimmed_combine_weighted_,)(PG_FUNCTION_ARGS)
+{
+	TT_WVALUE *tmp;
+	TT_WSTATE *state1;
+	TT_WSTATE *state2;
+	MemoryContext agg_context;
+	MemoryContext old_context;
+
+	GET_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_combine_weighted_,)), fcinfo, agg_context);
+
+	state1 = PG_ARGISNULL(0) ? NULL : (TT_WSTATE *) PG_GETARG_POINTER(0);
+	state2 = PG_ARGISNULL(1) ? NULL : (TT_WSTATE *) PG_GETARG_POINTER(1);
+
+	/* nothing to combine (and we must not return a NULL pointer) */
+	if ((state1 == NULL) && (state2 == NULL))
+		PG_RETURN_NULL();
+
+	if (state2 == NULL)
+		PG_RETURN_POINTER(state1);
+
+	counters.combines++;
+	TRACE_TRIMMED_COMBINE_START((state1 != NULL) ? state1->nelements : 0,
+								state2->nelements);
+
+	if (state1 == NULL)
+	{
+		old_context = MemoryContextSwitchTo(agg_context);
+
+		state1 = (TT_WSTATE *)palloc(sizeof(TT_WSTATE));
+		state1->maxelements = state2->maxelements;
+		state1->nelements = state2->nelements;
+		state1->total = state2->total;
+
+		state1->cut_lower = state2->cut_lower;
+		state1->cut_upper = state2->cut_upper;
+		state1->sorted = state2->sorted;
+		state1->sample_shift = state2->sample_shift;
+		memory_init(&state1->memory, agg_context);
+
+		state1->elements = (TT_WVALUE*)palloc(sizeof(TT_WVALUE) * state2->maxelements);
+
+		memcpy(state1->elements, state2->elements, sizeof(TT_WVALUE) * state2->maxelements);
+
+		MemoryContextSwitchTo(old_context);
+
+		TRACE_TRIMMED_COMBINE_DONE(state1->nelements);
+
+		PG_RETURN_POINTER(state1);
+	}
+
+	Assert((state1 != NULL) && (state2 != NULL));
+
+	/* both states need to sample the values at the same rate */
+	while (state1->sample_shift < state2->sample_shift)
+		TT_NAME(halve_state_weighted_,)(state1);
+
+	while (state2->sample_shift < state1->sample_shift)
+		TT_NAME(halve_state_weighted_,)(state2);
+
+	/* make sure both states are sorted */
+	TT_NAME(sort_state_weighted_,)(state1);
+	TT_NAME(sort_state_weighted_,)(state2);
+
+	tmp = (TT_WVALUE*)MemoryContextAlloc(agg_context,
+					  sizeof(TT_WVALUE) * (state1->nelements + state2->nelements));
+
+	/* merge the two arrays */
+	progress_start(PROGRESS_PHASE_MERGE, state1->nelements + state2->nelements);
+
+	TT_NAME(merge_weighted_,)(state1->elements, state1->nelements,
+			 state2->elements, state2->nelements, tmp);
+
+	progress_end();
+
+	/* free the two arrays */
+	pfree(state1->elements);
+	state1->elements = tmp;
+
+	/* and finally remember the current number of elements */
+	state1->nelements += state2->nelements;
+	state1->maxelements = state1->nelements;
+	state1->total += state2->total;
+
+	/* the combined state may exceed the memory budget */
+	memory_release(&state2->memory);
+
+	while (! memory_grow(&state1->memory, state1->nelements * sizeof(TT_WVALUE)))
+	{
+		sample_check(state1->nelements, state1->sample_shift,
+					 state1->cut_lower, state1->cut_upper);
+		TT_NAME(halve_state_weighted_,)(state1);
+	}
+
+	TRACE_TRIMMED_COMBINE_DONE(state1->nelements);
+
+	PG_RETURN_POINTER(state1);
+}
+
+Datum
+TT_NAME(trimmed_weighted_avg_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_avg_,)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_AVG);
+}
+
+Datum
+TT_NAME(trimmed_weighted_var_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_var_,)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_VAR);
+}
+
+Datum
+TT_NAME(trimmed_weighted_var_pop_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_var_pop_,)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_VAR_POP);
+}
+
+Datum
+TT_NAME(trimmed_weighted_var_samp_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_var_samp_,)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_VAR_SAMP);
+}
+
+Datum
+TT_NAME(trimmed_weighted_stddev_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_stddev_,)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_STDDEV);
+}
+
+Datum
+TT_NAME(trimmed_weighted_stddev_pop_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_stddev_pop_,)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_STDDEV_POP);
+}
+
+Datum
+TT_NAME(trimmed_weighted_stddev_samp_,)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_stddev_samp_,)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_STDDEV_SAMP);
+}
+
+Datum
+TT_NAME(trimmed_weighted_,_array)(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT(CppAsString2(TT_NAME(trimmed_weighted_,_array)), fcinfo);
+
+	return TT_NAME(trimmed_weighted_,)(fcinfo, STAT_ALL);
+}
+
+/*
+ * Compute the requested statistic (or all of them, for STAT_ALL) from the
+ * weighted elements. The cuts are applied to the cumulative weight, so the
+ * elements at the boundaries may be kept only partially.
+ */
+static Datum
+TT_NAME(trimmed_weighted_,)(FunctionCallInfo fcinfo, int stat)
+{
+	int		i;
+	int64	from, to, cnt, pos;
+	double	sum_x = 0, sum_x2 = 0, sum_dev2 = 0;
+	double	result[NUM_STATS];
+
+	TT_WSTATE *state;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TT_WSTATE*)PG_GETARG_POINTER(0);
+
+	from = floor(state->total * state->cut_lower);
+	to   = state->total - floor(state->total * state->cut_upper);
+	cnt  = (to - from);
+
+	Assert((0 <= from) && (from <= to) && (to <= state->total));
+
+	if (from >= to)
+		PG_RETURN_NULL();
+
+	TRACE_TRIMMED_FINAL(state->nelements, from, to);
+
+	TT_NAME(sort_state_weighted_,)(state);
+
+	for (i = 0, pos = 0; (i < state->nelements) && (pos < to); i++)
+	{
+		TT_TYPE	value = state->elements[i].value;
+		int64	w = Min(pos + state->elements[i].weight, to) - Max(pos, from);
+
+		pos += state->elements[i].weight;
+
+		if (w <= 0)
+			continue;
+
+		sum_x += w * value;
+		sum_x2 += w * value * value;
+	}
+
+	/* second pass is needed only for the exact variance */
+	if ((stat == STAT_ALL) || (stat == STAT_VAR) || (stat == STAT_STDDEV))
+	{
+		double	avg = sum_x / cnt;
+
+		for (i = 0, pos = 0; (i < state->nelements) && (pos < to); i++)
+		{
+			TT_TYPE	value = state->elements[i].value;
+			int64	w = Min(pos + state->elements[i].weight, to) - Max(pos, from);
+
+			pos += state->elements[i].weight;
+
+			if (w <= 0)
+				continue;
+
+			sum_dev2 += w * (value - avg) * (value - avg);
+		}
+	}
+
+	if (stat != STAT_ALL)
+		PG_RETURN_FLOAT8(multi_stat(stat, cnt, sum_x, sum_x2, sum_dev2));
+
+	for (i = 0; i < NUM_STATS; i++)
+		result[i] = multi_stat(i, cnt, sum_x, sum_x2, sum_dev2);
+
+	return double_to_array(fcinfo, result, NUM_STATS);
+}
+
+#endif							/* TT_WEIGHTED */
+
+#endif							/* TT_DEFINE */
+
+#undef TT_MAKE_NAME_
+#undef TT_MAKE_NAME
+#undef TT_NAME
+#undef TT_FUNCTION_INFO
+#undef TT_STATE
+#undef TT_RUN
+#undef TT_WVALUE
+#undef TT_WSTATE
+#undef TT_TYPE
+#undef TT_SUFFIX
+#undef TT_GETARG
+#undef TT_TYPEOID
+#undef TT_SENDVALUE
+#undef TT_RECVVALUE
+#undef TT_EXTENDED
+#undef TT_WEIGHTED
+#undef TT_DECLARE
+#undef TT_DEFINE